@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdio.h>
 #include <memory.h>
+#include <time.h>
 
 #include <gst/gst.h>
 
@@ -43,6 +44,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "interface/mmal/util/mmal_default_components.h"
 #include "RaspiCamControl.h"
 #include "RaspiCapture.h"
+#include "RaspiRing.h"
 
 #if 0
 /// Structure to cross reference exposure strings against the MMAL parameter equivalent
@@ -534,19 +536,27 @@ void raspicamcontrol_dump_parameters(const RASPICAM_CAMERA_PARAMETERS * params)
 	//const char *image_effect = raspicli_unmap_xref(params->imageEffect, imagefx_map, imagefx_map_size);
 	//const char *metering_mode = raspicli_unmap_xref(params->exposureMeterMode, metering_mode_map, metering_mode_map_size);
 
-	fprintf(stderr, "Sharpness %d, Contrast %d, Brightness %d\n", params->sharpness,
+	RASPI_DEBUG("Sharpness %d, Contrast %d, Brightness %d", params->sharpness,
 		params->contrast, params->brightness);
-	fprintf(stderr, "Saturation %d, ISO %d, Video Stabilisation %s, Exposure compensation %d\n",
+	RASPI_DEBUG("Saturation %d, ISO %d, Video Stabilisation %s, Exposure compensation %d",
 		params->saturation, params->ISO, params->videoStabilisation ? "Yes" : "No",
 		params->exposureCompensation);
 	//fprintf(stderr, "Exposure Mode '%s', AWB Mode '%s', Image Effect '%s'\n", exp_mode, awb_mode, image_effect);
-	fprintf(stderr, "Exposure Mode '%d', AWB Mode '%d', Image Effect '%d'\n",
+	RASPI_DEBUG("Exposure Mode '%d', AWB Mode '%d', Image Effect '%d'",
 		params->exposureMode, params->awbMode, params->imageEffect);
+	RASPI_DEBUG("Shutter speed %d us, Analog gain %.2f, Digital gain %.2f, AWB gains %.2f/%.2f",
+		params->shutter_speed, params->analog_gain, params->digital_gain,
+		params->awb_gains_r, params->awb_gains_b);
 	//fprintf(stderr, "Metering Mode '%s', Colour Effect Enabled %s with U = %d, V = %d\n", metering_mode, params->colourEffects.enable ? "Yes":"No", params->colourEffects.u, params->colourEffects.v);
-	fprintf(stderr, "Rotation %d, hflip %s, vflip %s\n", params->rotation,
+	RASPI_DEBUG("Rotation %d, hflip %s, vflip %s", params->rotation,
 		params->hflip ? "Yes" : "No", params->vflip ? "Yes" : "No");
-	fprintf(stderr, "ROI x %lf, y %f, w %f h %f\n", params->roi.x, params->roi.y, params->roi.w,
+	RASPI_DEBUG("ROI x %lf, y %f, w %f h %f", params->roi.x, params->roi.y, params->roi.w,
 		params->roi.h);
+	RASPI_DEBUG("Flicker avoidance %d, Video denoise %s, Stills denoise %s, DRC %d",
+		params->flickerAvoidMode, params->videoDenoise ? "Yes" : "No",
+		params->stillsDenoise ? "Yes" : "No", params->drcLevel);
+	RASPI_DEBUG("Annotation flags 0x%x, text '%s', size %d", params->enable_annotate,
+		params->annotate_string, params->annotate_text_size);
 }
 
 /**
@@ -632,8 +642,11 @@ void raspicamcontrol_set_defaults(RASPICAM_CAMERA_PARAMETERS * params)
 	params->videoStabilisation = 0;
 	params->exposureCompensation = 0;
 	params->exposureMode = MMAL_PARAM_EXPOSUREMODE_AUTO;
+	params->shutter_speed = 0;	// 0 = auto
+	params->analog_gain = params->digital_gain = 0;	// 0 = auto
 	params->exposureMeterMode = MMAL_PARAM_EXPOSUREMETERINGMODE_AVERAGE;
 	params->awbMode = MMAL_PARAM_AWBMODE_AUTO;
+	params->awb_gains_r = params->awb_gains_b = 0;
 	params->imageEffect = MMAL_PARAM_IMAGEFX_NONE;
 	params->colourEffects.enable = 0;
 	params->colourEffects.u = 128;
@@ -642,6 +655,648 @@ void raspicamcontrol_set_defaults(RASPICAM_CAMERA_PARAMETERS * params)
 	params->hflip = params->vflip = 0;
 	params->roi.x = params->roi.y = 0.0;
 	params->roi.w = params->roi.h = 1.0;
+	params->flickerAvoidMode = MMAL_PARAM_FLICKERAVOID_OFF;
+	params->videoDenoise = params->stillsDenoise = 1;
+	params->drcLevel = MMAL_PARAMETER_DRC_STRENGTH_OFF;
+	params->enable_annotate = 0;
+	params->annotate_string[0] = '\0';
+	params->annotate_text_size = 0;
+}
+
+static int apply_saturation(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_saturation(camera, params->saturation);
+}
+
+static int apply_sharpness(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_sharpness(camera, params->sharpness);
+}
+
+static int apply_contrast(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_contrast(camera, params->contrast);
+}
+
+static int apply_brightness(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_brightness(camera, params->brightness);
+}
+
+static int apply_ISO(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_ISO(camera, params->ISO);
+}
+
+static int apply_video_stabilisation(MMAL_COMPONENT_T * camera,
+				     const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_video_stabilisation(camera, params->videoStabilisation);
+}
+
+static int apply_exposure_compensation(MMAL_COMPONENT_T * camera,
+				       const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_exposure_compensation(camera, params->exposureCompensation);
+}
+
+static int apply_exposure_mode(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_exposure_mode(camera, params->exposureMode);
+}
+
+static int apply_shutter_speed(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_shutter_speed(camera, params->shutter_speed);
+}
+
+static int set_gain(MMAL_COMPONENT_T * camera, uint32_t id, float gain)
+{
+	MMAL_RATIONAL_T rational = { (int32_t) (gain * 65536), 65536 };
+
+	if (!camera)
+		return 1;
+
+	return mmal_status_to_int(mmal_port_parameter_set_rational(camera->control, id, rational));
+}
+
+static int apply_analog_gain(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return set_gain(camera, MMAL_PARAMETER_ANALOG_GAIN, params->analog_gain);
+}
+
+static int apply_digital_gain(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return set_gain(camera, MMAL_PARAMETER_DIGITAL_GAIN, params->digital_gain);
+}
+
+static int apply_metering_mode(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_metering_mode(camera, params->exposureMeterMode);
+}
+
+static int apply_awb_mode(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_awb_mode(camera, params->awbMode);
+}
+
+static int apply_awb_gains(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_awb_gains(camera, params->awb_gains_r, params->awb_gains_b);
+}
+
+static int apply_imageFX(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_imageFX(camera, params->imageEffect);
+}
+
+static int apply_colourFX(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_colourFX(camera, &params->colourEffects);
+}
+
+static int apply_rotation(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_rotation(camera, params->rotation);
+}
+
+static int apply_flips(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_flips(camera, params->hflip, params->vflip);
+}
+
+static int apply_ROI(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_ROI(camera, params->roi);
+}
+
+static int apply_flicker_avoid(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_flicker_avoid_mode(camera, params->flickerAvoidMode);
+}
+
+static int apply_video_denoise(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_video_denoise(camera, params->videoDenoise);
+}
+
+static int apply_stills_denoise(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_stills_denoise(camera, params->stillsDenoise);
+}
+
+static int apply_DRC(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_DRC(camera, params->drcLevel);
+}
+
+static int apply_annotate(MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return raspicamcontrol_set_annotate(camera, params->enable_annotate,
+					    params->annotate_string, params->annotate_text_size);
+}
+
+static int read_percent(MMAL_COMPONENT_T * camera, uint32_t id, int *value)
+{
+	MMAL_RATIONAL_T rational = { 0, 1 };
+
+	if (mmal_port_parameter_get_rational(camera->control, id, &rational) != MMAL_SUCCESS
+	    || rational.den == 0)
+		return 1;
+
+	*value = rational.num * 100 / rational.den;
+	return 0;
+}
+
+static int read_saturation(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return read_percent(camera, MMAL_PARAMETER_SATURATION, &params->saturation);
+}
+
+static int read_sharpness(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return read_percent(camera, MMAL_PARAMETER_SHARPNESS, &params->sharpness);
+}
+
+static int read_contrast(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return read_percent(camera, MMAL_PARAMETER_CONTRAST, &params->contrast);
+}
+
+static int read_brightness(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return read_percent(camera, MMAL_PARAMETER_BRIGHTNESS, &params->brightness);
+}
+
+static int read_ISO(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	uint32_t value;
+
+	if (mmal_port_parameter_get_uint32(camera->control, MMAL_PARAMETER_ISO, &value) !=
+	    MMAL_SUCCESS)
+		return 1;
+
+	params->ISO = value;
+	return 0;
+}
+
+static int read_video_stabilisation(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_BOOL_T value;
+
+	if (mmal_port_parameter_get_boolean(camera->control, MMAL_PARAMETER_VIDEO_STABILISATION,
+					    &value) != MMAL_SUCCESS)
+		return 1;
+
+	params->videoStabilisation = value;
+	return 0;
+}
+
+static int read_exposure_compensation(MMAL_COMPONENT_T * camera,
+				      RASPICAM_CAMERA_PARAMETERS * params)
+{
+	int32_t value;
+
+	if (mmal_port_parameter_get_int32(camera->control, MMAL_PARAMETER_EXPOSURE_COMP, &value) !=
+	    MMAL_SUCCESS)
+		return 1;
+
+	params->exposureCompensation = value;
+	return 0;
+}
+
+static int read_exposure_mode(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_EXPOSUREMODE_T exp_mode =
+	    { {MMAL_PARAMETER_EXPOSURE_MODE, sizeof(exp_mode)}, 0 };
+
+	if (mmal_port_parameter_get(camera->control, &exp_mode.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->exposureMode = exp_mode.value;
+	return 0;
+}
+
+static int read_shutter_speed(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	uint32_t value;
+
+	if (mmal_port_parameter_get_uint32(camera->control, MMAL_PARAMETER_SHUTTER_SPEED, &value) !=
+	    MMAL_SUCCESS)
+		return 1;
+
+	params->shutter_speed = value;
+	return 0;
+}
+
+static int read_gain(MMAL_COMPONENT_T * camera, uint32_t id, float *gain)
+{
+	MMAL_RATIONAL_T rational = { 0, 1 };
+
+	if (mmal_port_parameter_get_rational(camera->control, id, &rational) != MMAL_SUCCESS
+	    || rational.den == 0)
+		return 1;
+
+	*gain = (float)rational.num / rational.den;
+	return 0;
+}
+
+static int read_analog_gain(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return read_gain(camera, MMAL_PARAMETER_ANALOG_GAIN, &params->analog_gain);
+}
+
+static int read_digital_gain(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	return read_gain(camera, MMAL_PARAMETER_DIGITAL_GAIN, &params->digital_gain);
+}
+
+static int read_metering_mode(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_EXPOSUREMETERINGMODE_T meter_mode =
+	    { {MMAL_PARAMETER_EXP_METERING_MODE, sizeof(meter_mode)}, 0 };
+
+	if (mmal_port_parameter_get(camera->control, &meter_mode.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->exposureMeterMode = meter_mode.value;
+	return 0;
+}
+
+static int read_awb_mode(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_AWBMODE_T awb_mode = { {MMAL_PARAMETER_AWB_MODE, sizeof(awb_mode)}, 0 };
+
+	if (mmal_port_parameter_get(camera->control, &awb_mode.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->awbMode = awb_mode.value;
+	return 0;
+}
+
+static int read_awb_gains(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_AWB_GAINS_T gains =
+	    { {MMAL_PARAMETER_CUSTOM_AWB_GAINS, sizeof(gains)}, {0, 1}, {0, 1} };
+
+	if (mmal_port_parameter_get(camera->control, &gains.hdr) != MMAL_SUCCESS
+	    || gains.r_gain.den == 0 || gains.b_gain.den == 0)
+		return 1;
+
+	params->awb_gains_r = (float)gains.r_gain.num / gains.r_gain.den;
+	params->awb_gains_b = (float)gains.b_gain.num / gains.b_gain.den;
+	return 0;
+}
+
+static int read_imageFX(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_IMAGEFX_T image_fx = { {MMAL_PARAMETER_IMAGE_EFFECT, sizeof(image_fx)}, 0 };
+
+	if (mmal_port_parameter_get(camera->control, &image_fx.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->imageEffect = image_fx.value;
+	return 0;
+}
+
+static int read_colourFX(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_COLOURFX_T colfx = { {MMAL_PARAMETER_COLOUR_EFFECT, sizeof(colfx)}, 0, 0, 0 };
+
+	if (mmal_port_parameter_get(camera->control, &colfx.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->colourEffects.enable = colfx.enable;
+	params->colourEffects.u = colfx.u;
+	params->colourEffects.v = colfx.v;
+	return 0;
+}
+
+static int read_rotation(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	int32_t value;
+
+	if (mmal_port_parameter_get_int32(camera->output[0], MMAL_PARAMETER_ROTATION, &value) !=
+	    MMAL_SUCCESS)
+		return 1;
+
+	params->rotation = value;
+	return 0;
+}
+
+static int read_flips(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_MIRROR_T mirror = { {MMAL_PARAMETER_MIRROR, sizeof(mirror)}, 0 };
+
+	if (mmal_port_parameter_get(camera->output[0], &mirror.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->hflip = mirror.value == MMAL_PARAM_MIRROR_HORIZONTAL
+	    || mirror.value == MMAL_PARAM_MIRROR_BOTH;
+	params->vflip = mirror.value == MMAL_PARAM_MIRROR_VERTICAL
+	    || mirror.value == MMAL_PARAM_MIRROR_BOTH;
+	return 0;
+}
+
+static int read_ROI(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_INPUT_CROP_T crop = { {MMAL_PARAMETER_INPUT_CROP, sizeof(crop)} };
+
+	if (mmal_port_parameter_get(camera->control, &crop.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->roi.x = crop.rect.x / 65536.0;
+	params->roi.y = crop.rect.y / 65536.0;
+	params->roi.w = crop.rect.width / 65536.0;
+	params->roi.h = crop.rect.height / 65536.0;
+	return 0;
+}
+
+static int read_flicker_avoid(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_FLICKERAVOID_T flicker =
+	    { {MMAL_PARAMETER_FLICKER_AVOID, sizeof(flicker)}, 0 };
+
+	if (mmal_port_parameter_get(camera->control, &flicker.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->flickerAvoidMode = flicker.value;
+	return 0;
+}
+
+static int read_video_denoise(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_BOOL_T value;
+
+	if (mmal_port_parameter_get_boolean(camera->control, MMAL_PARAMETER_VIDEO_DENOISE,
+					    &value) != MMAL_SUCCESS)
+		return 1;
+
+	params->videoDenoise = value;
+	return 0;
+}
+
+static int read_stills_denoise(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_BOOL_T value;
+
+	if (mmal_port_parameter_get_boolean(camera->control, MMAL_PARAMETER_STILLS_DENOISE,
+					    &value) != MMAL_SUCCESS)
+		return 1;
+
+	params->stillsDenoise = value;
+	return 0;
+}
+
+static int read_DRC(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_DRC_T drc = { {MMAL_PARAMETER_DYNAMIC_RANGE_COMPRESSION, sizeof(drc)}, 0 };
+
+	if (mmal_port_parameter_get(camera->control, &drc.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	params->drcLevel = drc.strength;
+	return 0;
+}
+
+/* The flags that can't be read back are kept from what was applied */
+static int read_annotate(MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	MMAL_PARAMETER_CAMERA_ANNOTATE_V3_T annotate =
+	    { {MMAL_PARAMETER_ANNOTATE, sizeof(annotate)} };
+	int flags = params->enable_annotate & ~(ANNOTATE_SHUTTER_SETTINGS | ANNOTATE_CAF_SETTINGS
+						| ANNOTATE_GAIN_SETTINGS | ANNOTATE_LENS_SETTINGS
+						| ANNOTATE_MOTION_SETTINGS | ANNOTATE_FRAME_NUMBER
+						| ANNOTATE_BLACK_BACKGROUND);
+
+	if (mmal_port_parameter_get(camera->control, &annotate.hdr) != MMAL_SUCCESS)
+		return 1;
+
+	if (!annotate.enable) {
+		params->enable_annotate = 0;
+		return 0;
+	}
+
+	flags |= annotate.show_shutter ? ANNOTATE_SHUTTER_SETTINGS : 0;
+	flags |= annotate.show_caf ? ANNOTATE_CAF_SETTINGS : 0;
+	flags |= annotate.show_analog_gain ? ANNOTATE_GAIN_SETTINGS : 0;
+	flags |= annotate.show_lens ? ANNOTATE_LENS_SETTINGS : 0;
+	flags |= annotate.show_motion ? ANNOTATE_MOTION_SETTINGS : 0;
+	flags |= annotate.show_frame_num ? ANNOTATE_FRAME_NUMBER : 0;
+	flags |= annotate.enable_text_background ? ANNOTATE_BLACK_BACKGROUND : 0;
+	params->enable_annotate = flags;
+	g_strlcpy(params->annotate_string, annotate.text, sizeof(params->annotate_string));
+	params->annotate_text_size = annotate.text_size;
+	return 0;
+}
+
+/// Bytes of RASPICAM_CAMERA_PARAMETERS from field first to field last inclusive
+#define PARAM_FIELDS(first, last) \
+	G_STRUCT_OFFSET(RASPICAM_CAMERA_PARAMETERS, first), \
+	G_STRUCT_OFFSET(RASPICAM_CAMERA_PARAMETERS, last) + \
+	sizeof(((RASPICAM_CAMERA_PARAMETERS *) 0)->last) - \
+	G_STRUCT_OFFSET(RASPICAM_CAMERA_PARAMETERS, first)
+
+/// How each RASPICAM_PARAM_* is sent, in the order the camera is told about them
+static const struct {
+	const char *name;
+	uint32_t id;		/// MMAL_PARAMETER_*, reported to the parameter_set probe
+	gsize offset;		/// Fields of RASPICAM_CAMERA_PARAMETERS the setter reads
+	gsize size;
+	int (*apply) (MMAL_COMPONENT_T * camera, const RASPICAM_CAMERA_PARAMETERS * params);
+	int (*read) (MMAL_COMPONENT_T * camera, RASPICAM_CAMERA_PARAMETERS * params);
+} parameter_table[RASPICAM_PARAM_COUNT] = {
+	[RASPICAM_PARAM_SATURATION] = {"saturation", MMAL_PARAMETER_SATURATION,
+		    PARAM_FIELDS(saturation, saturation), apply_saturation,
+		    read_saturation},
+	[RASPICAM_PARAM_SHARPNESS] = {"sharpness", MMAL_PARAMETER_SHARPNESS,
+		    PARAM_FIELDS(sharpness, sharpness), apply_sharpness,
+		    read_sharpness},
+	[RASPICAM_PARAM_CONTRAST] = {"contrast", MMAL_PARAMETER_CONTRAST,
+		    PARAM_FIELDS(contrast, contrast), apply_contrast,
+		    read_contrast},
+	[RASPICAM_PARAM_BRIGHTNESS] = {"brightness", MMAL_PARAMETER_BRIGHTNESS,
+		    PARAM_FIELDS(brightness, brightness), apply_brightness,
+		    read_brightness},
+	[RASPICAM_PARAM_ISO] = {"ISO", MMAL_PARAMETER_ISO,
+		    PARAM_FIELDS(ISO, ISO), apply_ISO,
+		    read_ISO},
+	[RASPICAM_PARAM_VIDEO_STABILISATION] = {"video stabilisation",
+		    MMAL_PARAMETER_VIDEO_STABILISATION,
+		    PARAM_FIELDS(videoStabilisation, videoStabilisation),
+		    apply_video_stabilisation,
+		    read_video_stabilisation},
+	[RASPICAM_PARAM_EXPOSURE_COMPENSATION] = {"exposure compensation",
+		    MMAL_PARAMETER_EXPOSURE_COMP,
+		    PARAM_FIELDS(exposureCompensation, exposureCompensation),
+		    apply_exposure_compensation,
+		    read_exposure_compensation},
+	[RASPICAM_PARAM_EXPOSURE_MODE] = {"exposure mode", MMAL_PARAMETER_EXPOSURE_MODE,
+		    PARAM_FIELDS(exposureMode, exposureMode), apply_exposure_mode,
+		    read_exposure_mode},
+	[RASPICAM_PARAM_SHUTTER_SPEED] = {"shutter speed", MMAL_PARAMETER_SHUTTER_SPEED,
+		    PARAM_FIELDS(shutter_speed, shutter_speed), apply_shutter_speed,
+		    read_shutter_speed},
+	[RASPICAM_PARAM_ANALOG_GAIN] = {"analog gain", MMAL_PARAMETER_ANALOG_GAIN,
+		    PARAM_FIELDS(analog_gain, analog_gain), apply_analog_gain,
+		    read_analog_gain},
+	[RASPICAM_PARAM_DIGITAL_GAIN] = {"digital gain", MMAL_PARAMETER_DIGITAL_GAIN,
+		    PARAM_FIELDS(digital_gain, digital_gain), apply_digital_gain,
+		    read_digital_gain},
+	[RASPICAM_PARAM_METERING_MODE] = {"metering mode", MMAL_PARAMETER_EXP_METERING_MODE,
+		    PARAM_FIELDS(exposureMeterMode, exposureMeterMode), apply_metering_mode,
+		    read_metering_mode},
+	[RASPICAM_PARAM_AWB_MODE] = {"AWB mode", MMAL_PARAMETER_AWB_MODE,
+		    PARAM_FIELDS(awbMode, awbMode), apply_awb_mode,
+		    read_awb_mode},
+	[RASPICAM_PARAM_AWB_GAINS] = {"AWB gains", MMAL_PARAMETER_CUSTOM_AWB_GAINS,
+		    PARAM_FIELDS(awb_gains_r, awb_gains_b), apply_awb_gains,
+		    read_awb_gains},
+	[RASPICAM_PARAM_IMAGE_FX] = {"image effect", MMAL_PARAMETER_IMAGE_EFFECT,
+		    PARAM_FIELDS(imageEffect, imageEffect), apply_imageFX,
+		    read_imageFX},
+	[RASPICAM_PARAM_COLOUR_FX] = {"colour effect", MMAL_PARAMETER_COLOUR_EFFECT,
+		    PARAM_FIELDS(colourEffects, colourEffects), apply_colourFX,
+		    read_colourFX},
+	[RASPICAM_PARAM_ROTATION] = {"rotation", MMAL_PARAMETER_ROTATION,
+		    PARAM_FIELDS(rotation, rotation), apply_rotation,
+		    read_rotation},
+	[RASPICAM_PARAM_FLIPS] = {"flips", MMAL_PARAMETER_MIRROR,
+		    PARAM_FIELDS(hflip, vflip), apply_flips,
+		    read_flips},
+	[RASPICAM_PARAM_ROI] = {"ROI", MMAL_PARAMETER_INPUT_CROP,
+		    PARAM_FIELDS(roi, roi), apply_ROI,
+		    read_ROI},
+	[RASPICAM_PARAM_FLICKER_AVOID] = {"flicker avoidance", MMAL_PARAMETER_FLICKER_AVOID,
+		    PARAM_FIELDS(flickerAvoidMode, flickerAvoidMode), apply_flicker_avoid,
+		    read_flicker_avoid},
+	[RASPICAM_PARAM_VIDEO_DENOISE] = {"video denoise", MMAL_PARAMETER_VIDEO_DENOISE,
+		    PARAM_FIELDS(videoDenoise, videoDenoise), apply_video_denoise,
+		    read_video_denoise},
+	[RASPICAM_PARAM_STILLS_DENOISE] = {"stills denoise", MMAL_PARAMETER_STILLS_DENOISE,
+		    PARAM_FIELDS(stillsDenoise, stillsDenoise), apply_stills_denoise,
+		    read_stills_denoise},
+	[RASPICAM_PARAM_DRC] = {"DRC", MMAL_PARAMETER_DYNAMIC_RANGE_COMPRESSION,
+		    PARAM_FIELDS(drcLevel, drcLevel), apply_DRC,
+		    read_DRC},
+	[RASPICAM_PARAM_ANNOTATE] = {"annotation", MMAL_PARAMETER_ANNOTATE,
+		    PARAM_FIELDS(enable_annotate, annotate_text_size), apply_annotate,
+		    read_annotate},
+};
+
+/**
+ * Forget what the camera was told, so the next apply sends everything
+ * @param cache Pointer to the camera's parameter cache
+ */
+void raspicamcontrol_cache_reset(RASPICAM_PARAMETER_CACHE * cache)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->stale = (1u << RASPICAM_PARAM_COUNT) - 1;
+}
+
+/**
+ * Record that a freshly created camera component holds the values
+ * raspicamcontrol_set_defaults() describes, so the first apply only sends
+ * the settings that differ from them.
+ * @param cache Pointer to the camera's parameter cache
+ */
+void raspicamcontrol_cache_assume_defaults(RASPICAM_PARAMETER_CACHE * cache)
+{
+	raspicamcontrol_cache_reset(cache);
+	raspicamcontrol_set_defaults(&cache->applied);
+	cache->stale = 0;
+}
+
+/**
+ * Mark what was read back from the camera as out of date, e.g. on a
+ * MMAL_EVENT_PARAMETER_CHANGED event. Safe from any thread.
+ * @param cache Pointer to the camera's parameter cache
+ * @param id MMAL_PARAMETER_* that changed, or 0 for all of them
+ */
+void raspicamcontrol_cache_invalidate(RASPICAM_PARAMETER_CACHE * cache, uint32_t id)
+{
+	unsigned int bits = 0;
+	int i;
+
+	for (i = 0; i < RASPICAM_PARAM_COUNT; i++) {
+		if (id == 0 || parameter_table[i].id == id)
+			bits |= 1u << i;
+	}
+	if (!bits)
+		return;
+
+	__atomic_fetch_and(&cache->reported_valid, ~bits, __ATOMIC_ACQ_REL);
+	__atomic_fetch_add(&cache->generation, 1, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * Read back the settings the camera is actually using. Only settings that
+ * changed since they were last read go to the camera, the rest come from
+ * the cache. A setting that can't be read, and the annotation, are
+ * reported as last applied.
+ *
+ * @param camera Pointer to camera component
+ * @param cache Pointer to the camera's parameter cache
+ * @param params Pointer to parameter block to accept settings
+ * @return 0 if successful, the number of settings that could not be read otherwise
+ */
+int raspicamcontrol_read_parameters(MMAL_COMPONENT_T * camera,
+				    RASPICAM_PARAMETER_CACHE * cache,
+				    RASPICAM_CAMERA_PARAMETERS * params)
+{
+	unsigned int generation = __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE);
+	unsigned int valid = __atomic_load_n(&cache->reported_valid, __ATOMIC_ACQUIRE);
+	unsigned int fetched = 0;
+	int result = 0;
+	int i;
+
+	for (i = 0; i < RASPICAM_PARAM_COUNT; i++) {
+		if (valid & (1u << i))
+			continue;
+
+		/* The camera never changes the annotation by itself, and only
+		 * holds it the way it was applied */
+		if (i != RASPICAM_PARAM_ANNOTATE) {
+			if (parameter_table[i].read(camera, &cache->reported) == 0) {
+				fetched |= 1u << i;
+				continue;
+			}
+			result++;
+		}
+
+		/* Fall back on what was applied */
+		memcpy((guint8 *) & cache->reported + parameter_table[i].offset,
+		       (const guint8 *) &cache->applied + parameter_table[i].offset,
+		       parameter_table[i].size);
+	}
+
+	/* Only trust the values if nothing changed while they were read */
+	if (fetched && __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE) == generation)
+		__atomic_fetch_or(&cache->reported_valid, fetched, __ATOMIC_ACQ_REL);
+
+	RASPI_LOG("Read %d camera parameters back", __builtin_popcount(fetched));
+
+	*params = cache->reported;
+	return result;
+}
+
+/**
+ * Ask the camera for MMAL_EVENT_PARAMETER_CHANGED events on its control
+ * port whenever it changes one of the settings it was given. Parameters
+ * the camera never changes by itself may be refused, which is harmless.
+ * @param camera Pointer to camera component
+ */
+void raspicamcontrol_request_change_events(MMAL_COMPONENT_T * camera)
+{
+	MMAL_PARAMETER_CHANGE_EVENT_REQUEST_T request =
+	    { {MMAL_PARAMETER_CHANGE_EVENT_REQUEST, sizeof(request)}, 0, MMAL_TRUE };
+	int i;
+
+	for (i = 0; i < RASPICAM_PARAM_COUNT; i++) {
+		request.change_id = parameter_table[i].id;
+		if (mmal_port_parameter_set(camera->control, &request.hdr) != MMAL_SUCCESS)
+			RASPI_LOG("No change events for camera %s", parameter_table[i].name);
+	}
 }
 
 /**
@@ -653,27 +1308,86 @@ void raspicamcontrol_set_defaults(RASPICAM_CAMERA_PARAMETERS * params)
 int raspicamcontrol_get_all_parameters(MMAL_COMPONENT_T * camera,
 				       RASPICAM_CAMERA_PARAMETERS * params)
 {
+	int result = 0;
+	int i;
+
 	vcos_assert(camera);
 	vcos_assert(params);
 
 	if (!camera || !params)
 		return 1;
 
-/* TODO : Write these get functions
-   params->sharpness = raspicamcontrol_get_sharpness(camera);
-   params->contrast = raspicamcontrol_get_contrast(camera);
-   params->brightness = raspicamcontrol_get_brightness(camera);
-   params->saturation = raspicamcontrol_get_saturation(camera);
-   params->ISO = raspicamcontrol_get_ISO(camera);
-   params->videoStabilisation = raspicamcontrol_get_video_stabilisation(camera);
-   params->exposureCompensation = raspicamcontrol_get_exposure_compensation(camera);
-   params->exposureMode = raspicamcontrol_get_exposure_mode(camera);
-   params->awbMode = raspicamcontrol_get_awb_mode(camera);
-   params->imageEffect = raspicamcontrol_get_image_effect(camera);
-   params->colourEffects = raspicamcontrol_get_colour_effect(camera);
-   params->thumbnailConfig = raspicamcontrol_get_thumbnail_config(camera);
-*/
-	return 0;
+	for (i = 0; i < RASPICAM_PARAM_COUNT; i++)
+		result += parameter_table[i].read(camera, params);
+
+	return result;
+}
+
+/**
+ * Bring the camera in line with params, sending only the settings that
+ * differ from what the cache says it already has. A setting the camera
+ * rejects stays stale and is sent again on the next apply. The time each
+ * set took is kept in the cache.
+ *
+ * @param camera Pointer to camera component
+ * @param cache Pointer to the camera's parameter cache
+ * @param params Pointer to parameter block containing parameters
+ * @return 0 if successful, the number of settings that failed otherwise
+ */
+int raspicamcontrol_apply_parameters(MMAL_COMPONENT_T * camera,
+				     RASPICAM_PARAMETER_CACHE * cache,
+				     const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	int result = 0;
+	int64_t start, now;
+	int i;
+
+	vcos_assert(camera);
+
+	if (!camera)
+		return 1;
+
+	start = now = raspiring_now();
+	cache->sets = 0;
+
+	for (i = 0; i < RASPICAM_PARAM_COUNT; i++) {
+		const guint8 *want = (const guint8 *) params + parameter_table[i].offset;
+		guint8 *have = (guint8 *) & cache->applied + parameter_table[i].offset;
+		int64_t then;
+		int ret;
+
+		if (!(cache->stale & (1u << i)) && memcmp(want, have, parameter_table[i].size) == 0)
+			continue;
+
+		then = raspiring_now();
+		ret = parameter_table[i].apply(camera, params);
+		now = raspiring_now();
+		cache->set_us[i] = now - then;
+		cache->sets++;
+		/* The camera may have adjusted what it was given */
+		__atomic_fetch_and(&cache->reported_valid, ~(1u << i), __ATOMIC_ACQ_REL);
+
+		RASPI_PROBE2(parameter_set, parameter_table[i].id, ret);
+
+		if (ret) {
+			RASPI_WARNING("Unable to set camera %s", parameter_table[i].name);
+			cache->stale |= 1u << i;
+			result++;
+		} else {
+			RASPI_LOG("Set camera %s in %" G_GINT64_FORMAT " us",
+				  parameter_table[i].name, cache->set_us[i]);
+			memcpy(have, want, parameter_table[i].size);
+			cache->stale &= ~(1u << i);
+		}
+	}
+
+	cache->apply_us = now - start;
+
+	RASPI_DEBUG("Sent %u of %d camera parameters in %" G_GINT64_FORMAT " us",
+		    cache->sets, RASPICAM_PARAM_COUNT, cache->apply_us);
+	RASPI_PROBE2(parameter_set, 0, result);
+
+	return result;
 }
 
 /**
@@ -685,26 +1399,10 @@ int raspicamcontrol_get_all_parameters(MMAL_COMPONENT_T * camera,
 int raspicamcontrol_set_all_parameters(MMAL_COMPONENT_T * camera,
 				       const RASPICAM_CAMERA_PARAMETERS * params)
 {
-	int result;
-
-	result = raspicamcontrol_set_saturation(camera, params->saturation);
-	result += raspicamcontrol_set_sharpness(camera, params->sharpness);
-	result += raspicamcontrol_set_contrast(camera, params->contrast);
-	result += raspicamcontrol_set_brightness(camera, params->brightness);
-	result += raspicamcontrol_set_ISO(camera, params->ISO);
-	result += raspicamcontrol_set_video_stabilisation(camera, params->videoStabilisation);
-	result += raspicamcontrol_set_exposure_compensation(camera, params->exposureCompensation);
-	result += raspicamcontrol_set_exposure_mode(camera, params->exposureMode);
-	result += raspicamcontrol_set_metering_mode(camera, params->exposureMeterMode);
-	result += raspicamcontrol_set_awb_mode(camera, params->awbMode);
-	result += raspicamcontrol_set_imageFX(camera, params->imageEffect);
-	result += raspicamcontrol_set_colourFX(camera, &params->colourEffects);
-	//result += raspicamcontrol_set_thumbnail_parameters(camera, &params->thumbnailConfig);  TODO Not working for some reason
-	result += raspicamcontrol_set_rotation(camera, params->rotation);
-	result += raspicamcontrol_set_flips(camera, params->hflip, params->vflip);
-	result += raspicamcontrol_set_ROI(camera, params->roi);
+	RASPICAM_PARAMETER_CACHE cache;
 
-	return result;
+	raspicamcontrol_cache_reset(&cache);
+	return raspicamcontrol_apply_parameters(camera, &cache, params);
 }
 
 /**
@@ -943,6 +1641,63 @@ int raspicamcontrol_set_awb_mode(MMAL_COMPONENT_T * camera, MMAL_PARAM_AWBMODE_T
 	return mmal_status_to_int(mmal_port_parameter_set(camera->control, &param.hdr));
 }
 
+/**
+ * Set the red and blue gains used when the AWB mode is off
+ * @param camera Pointer to camera component
+ * @param r_gain Red gain, 0 to leave both gains as they are
+ * @param b_gain Blue gain, 0 to leave both gains as they are
+ * @return 0 if successful, non-zero if any parameters out of range
+ */
+int raspicamcontrol_set_awb_gains(MMAL_COMPONENT_T * camera, float r_gain, float b_gain)
+{
+	MMAL_PARAMETER_AWB_GAINS_T param =
+	    { {MMAL_PARAMETER_CUSTOM_AWB_GAINS, sizeof(param)}, {0, 65536}, {0, 65536} };
+
+	if (!camera)
+		return 1;
+
+	if (!r_gain || !b_gain)
+		return 0;
+
+	param.r_gain.num = (int32_t) (r_gain * 65536);
+	param.b_gain.num = (int32_t) (b_gain * 65536);
+
+	return mmal_status_to_int(mmal_port_parameter_set(camera->control, &param.hdr));
+}
+
+/**
+ * Set a fixed exposure time
+ * @param camera Pointer to camera component
+ * @param speed Exposure time in microseconds, 0 for auto
+ * @return 0 if successful, non-zero if any parameters out of range
+ */
+int raspicamcontrol_set_shutter_speed(MMAL_COMPONENT_T * camera, int speed)
+{
+	if (!camera)
+		return 1;
+
+	return
+	    mmal_status_to_int(mmal_port_parameter_set_uint32
+			       (camera->control, MMAL_PARAMETER_SHUTTER_SPEED, speed));
+}
+
+/**
+ * Set fixed sensor and ISP gains
+ * @param camera Pointer to camera component
+ * @param analog Sensor gain, 0 for auto
+ * @param digital ISP gain, 0 for auto
+ * @return 0 if successful, non-zero if any parameters out of range
+ */
+int raspicamcontrol_set_gains(MMAL_COMPONENT_T * camera, float analog, float digital)
+{
+	int result = set_gain(camera, MMAL_PARAMETER_ANALOG_GAIN, analog);
+
+	if (result)
+		return result;
+
+	return set_gain(camera, MMAL_PARAMETER_DIGITAL_GAIN, digital);
+}
+
 /**
  * Set the image effect for the images
  * @param camera Pointer to camera component
@@ -1079,6 +1834,281 @@ int raspicamcontrol_set_ROI(MMAL_COMPONENT_T * camera, PARAM_FLOAT_RECT_T rect)
 	return mmal_port_parameter_set(camera->control, &crop.hdr);
 }
 
+/**
+ * Set how exposure avoids mains flicker
+ * @param camera Pointer to camera component
+ * @param mode Value from
+ *   - MMAL_PARAM_FLICKERAVOID_OFF,
+ *   - MMAL_PARAM_FLICKERAVOID_AUTO,
+ *   - MMAL_PARAM_FLICKERAVOID_50HZ,
+ *   - MMAL_PARAM_FLICKERAVOID_60HZ,
+ * @return 0 if successful, non-zero if any parameters out of range
+ */
+int raspicamcontrol_set_flicker_avoid_mode(MMAL_COMPONENT_T * camera,
+					   MMAL_PARAM_FLICKERAVOID_T mode)
+{
+	MMAL_PARAMETER_FLICKERAVOID_T param = { {MMAL_PARAMETER_FLICKER_AVOID, sizeof(param)}
+	, mode
+	};
+
+	if (!camera)
+		return 1;
+
+	return mmal_status_to_int(mmal_port_parameter_set(camera->control, &param.hdr));
+}
+
+/**
+ * Turn the ISP's denoise stage on or off for video and preview frames
+ * @param camera Pointer to camera component
+ * @param denoise Flag 0 off 1 on
+ * @return 0 if successful, non-zero if any parameters out of range
+ */
+int raspicamcontrol_set_video_denoise(MMAL_COMPONENT_T * camera, int denoise)
+{
+	if (!camera)
+		return 1;
+
+	return
+	    mmal_status_to_int(mmal_port_parameter_set_boolean
+			       (camera->control, MMAL_PARAMETER_VIDEO_DENOISE, denoise));
+}
+
+/**
+ * Turn the ISP's denoise stage on or off for stills
+ * @param camera Pointer to camera component
+ * @param denoise Flag 0 off 1 on
+ * @return 0 if successful, non-zero if any parameters out of range
+ */
+int raspicamcontrol_set_stills_denoise(MMAL_COMPONENT_T * camera, int denoise)
+{
+	if (!camera)
+		return 1;
+
+	return
+	    mmal_status_to_int(mmal_port_parameter_set_boolean
+			       (camera->control, MMAL_PARAMETER_STILLS_DENOISE, denoise));
+}
+
+/**
+ * Set the strength of dynamic range compression, which lifts shadows
+ * @param camera Pointer to camera component
+ * @param strength Value from
+ *   - MMAL_PARAMETER_DRC_STRENGTH_OFF,
+ *   - MMAL_PARAMETER_DRC_STRENGTH_LOW,
+ *   - MMAL_PARAMETER_DRC_STRENGTH_MEDIUM,
+ *   - MMAL_PARAMETER_DRC_STRENGTH_HIGH,
+ * @return 0 if successful, non-zero if any parameters out of range
+ */
+int raspicamcontrol_set_DRC(MMAL_COMPONENT_T * camera, MMAL_PARAMETER_DRC_STRENGTH_T strength)
+{
+	MMAL_PARAMETER_DRC_T drc = { {MMAL_PARAMETER_DYNAMIC_RANGE_COMPRESSION, sizeof(drc)}
+	, strength
+	};
+
+	if (!camera)
+		return 1;
+
+	return mmal_status_to_int(mmal_port_parameter_set(camera->control, &drc.hdr));
+}
+
+/**
+ * Set what the camera draws over each frame. The firmware renders it, so
+ * it costs no CPU time per frame; changing it costs one parameter set.
+ * @param camera Pointer to camera component
+ * @param flags ANNOTATE_* flags, 0 to turn annotation off
+ * @param text Text to show, already expanded by
+ *   raspicamcontrol_format_annotation()
+ * @param text_size 6-160, 0 for the default size
+ * @return 0 if successful, non-zero if any parameters out of range
+ */
+int raspicamcontrol_set_annotate(MMAL_COMPONENT_T * camera, int flags, const char *text,
+				 int text_size)
+{
+	MMAL_PARAMETER_CAMERA_ANNOTATE_V3_T annotate =
+	    { {MMAL_PARAMETER_ANNOTATE, sizeof(annotate)} };
+
+	if (!camera)
+		return 1;
+
+	if (text_size != 0 && (text_size < 6 || text_size > 160))
+		return 1;
+
+	annotate.enable = flags != 0;
+	annotate.show_shutter = ! !(flags & ANNOTATE_SHUTTER_SETTINGS);
+	annotate.show_analog_gain = ! !(flags & ANNOTATE_GAIN_SETTINGS);
+	annotate.show_lens = ! !(flags & ANNOTATE_LENS_SETTINGS);
+	annotate.show_caf = ! !(flags & ANNOTATE_CAF_SETTINGS);
+	annotate.show_motion = ! !(flags & ANNOTATE_MOTION_SETTINGS);
+	annotate.show_frame_num = ! !(flags & ANNOTATE_FRAME_NUMBER);
+	annotate.enable_text_background = ! !(flags & ANNOTATE_BLACK_BACKGROUND);
+	annotate.text_size = text_size;
+	if (text)
+		g_strlcpy(annotate.text, text, sizeof(annotate.text));
+
+	return mmal_status_to_int(mmal_port_parameter_set(camera->control, &annotate.hdr));
+}
+
+/**
+ * Build the annotation text: the custom text, then the time and date and
+ * the latency marker, as the flags ask for
+ * @param flags ANNOTATE_* flags
+ * @param text Custom text, used with ANNOTATE_USER_TEXT
+ * @param now Monotonic time in microseconds, for ANNOTATE_LATENCY_MARKER
+ * @param out Receives the text
+ * @param size Size of out
+ */
+void raspicamcontrol_format_annotation(int flags, const char *text, int64_t now, char *out,
+				       size_t size)
+{
+	char part[64];
+	time_t t = time(NULL);
+	struct tm tm;
+
+	out[0] = '\0';
+	localtime_r(&t, &tm);
+
+	if ((flags & ANNOTATE_USER_TEXT) && text)
+		g_strlcat(out, text, size);
+	if ((flags & ANNOTATE_TIME_TEXT) && strftime(part, sizeof(part), "%X", &tm)) {
+		if (out[0])
+			g_strlcat(out, " ", size);
+		g_strlcat(out, part, size);
+	}
+	if ((flags & ANNOTATE_DATE_TEXT) && strftime(part, sizeof(part), "%x", &tm)) {
+		if (out[0])
+			g_strlcat(out, " ", size);
+		g_strlcat(out, part, size);
+	}
+	if (flags & ANNOTATE_LATENCY_MARKER) {
+		g_snprintf(part, sizeof(part), "%s@%" G_GINT64_FORMAT, out[0] ? " " : "", now);
+		g_strlcat(out, part, size);
+	}
+}
+
+/* The individual getters below read one setting straight from the camera,
+ * giving the raspicamcontrol_set_defaults() value if it can't be read */
+static RASPICAM_CAMERA_PARAMETERS read_one(MMAL_COMPONENT_T * camera, RASPICAM_PARAM_ID param)
+{
+	RASPICAM_CAMERA_PARAMETERS params;
+
+	raspicamcontrol_set_defaults(&params);
+	if (camera)
+		parameter_table[param].read(camera, &params);
+
+	return params;
+}
+
+int raspicamcontrol_get_saturation(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_SATURATION).saturation;
+}
+
+int raspicamcontrol_get_sharpness(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_SHARPNESS).sharpness;
+}
+
+int raspicamcontrol_get_contrast(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_CONTRAST).contrast;
+}
+
+int raspicamcontrol_get_brightness(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_BRIGHTNESS).brightness;
+}
+
+int raspicamcontrol_get_ISO(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_ISO).ISO;
+}
+
+MMAL_PARAM_EXPOSUREMETERINGMODE_T raspicamcontrol_get_metering_mode(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_METERING_MODE).exposureMeterMode;
+}
+
+int raspicamcontrol_get_video_stabilisation(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_VIDEO_STABILISATION).videoStabilisation;
+}
+
+int raspicamcontrol_get_exposure_compensation(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_EXPOSURE_COMPENSATION).exposureCompensation;
+}
+
+MMAL_PARAM_EXPOSUREMODE_T raspicamcontrol_get_exposure_mode(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_EXPOSURE_MODE).exposureMode;
+}
+
+MMAL_PARAM_AWBMODE_T raspicamcontrol_get_awb_mode(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_AWB_MODE).awbMode;
+}
+
+int raspicamcontrol_get_shutter_speed(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_SHUTTER_SPEED).shutter_speed;
+}
+
+MMAL_PARAM_IMAGEFX_T raspicamcontrol_get_imageFX(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_IMAGE_FX).imageEffect;
+}
+
+MMAL_PARAM_COLOURFX_T raspicamcontrol_get_colourFX(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_COLOUR_FX).colourEffects;
+}
+
+int raspicamcontrol_get_rotation(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_ROTATION).rotation;
+}
+
+PARAM_FLOAT_RECT_T raspicamcontrol_get_ROI(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_ROI).roi;
+}
+
+MMAL_PARAM_FLICKERAVOID_T raspicamcontrol_get_flicker_avoid_mode(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_FLICKER_AVOID).flickerAvoidMode;
+}
+
+int raspicamcontrol_get_video_denoise(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_VIDEO_DENOISE).videoDenoise;
+}
+
+int raspicamcontrol_get_stills_denoise(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_STILLS_DENOISE).stillsDenoise;
+}
+
+MMAL_PARAMETER_DRC_STRENGTH_T raspicamcontrol_get_DRC(MMAL_COMPONENT_T * camera)
+{
+	return read_one(camera, RASPICAM_PARAM_DRC).drcLevel;
+}
+
+MMAL_PARAM_THUMBNAIL_CONFIG_T raspicamcontrol_get_thumbnail_parameters(MMAL_COMPONENT_T * camera)
+{
+	MMAL_PARAMETER_THUMBNAIL_CONFIG_T param =
+	    { {MMAL_PARAMETER_THUMBNAIL_CONFIGURATION, sizeof(param)}, 0, 0, 0, 0 };
+	MMAL_PARAM_THUMBNAIL_CONFIG_T thumbnail = { 0, 0, 0, 0 };
+
+	if (camera && mmal_port_parameter_get(camera->control, &param.hdr) == MMAL_SUCCESS) {
+		thumbnail.enable = param.enable;
+		thumbnail.width = param.width;
+		thumbnail.height = param.height;
+		thumbnail.quality = param.quality;
+	}
+
+	return thumbnail;
+}
+
 /**
  * Asked GPU how much memory it has allocated
  *
@@ -111,6 +111,21 @@ typedef struct
    double h;
 } PARAM_FLOAT_RECT_T;
 
+/// What raspicamcontrol_set_annotate() shows on each frame
+#define ANNOTATE_USER_TEXT          1
+#define ANNOTATE_APP_TEXT           2
+#define ANNOTATE_DATE_TEXT          4
+#define ANNOTATE_TIME_TEXT          8
+#define ANNOTATE_SHUTTER_SETTINGS   16
+#define ANNOTATE_CAF_SETTINGS       32
+#define ANNOTATE_GAIN_SETTINGS      64
+#define ANNOTATE_LENS_SETTINGS      128
+#define ANNOTATE_MOTION_SETTINGS    256
+#define ANNOTATE_FRAME_NUMBER       512
+#define ANNOTATE_BLACK_BACKGROUND   1024
+/// Not a firmware flag: raspicamcontrol_format_annotation() adds "@" and the monotonic time in us
+#define ANNOTATE_LATENCY_MARKER     2048
+
 /// struct contain camera settings
 typedef struct
 {
@@ -122,8 +137,13 @@ typedef struct
    int videoStabilisation;    /// 0 or 1 (false or true)
    int exposureCompensation;  /// -10 to +10 ?
    MMAL_PARAM_EXPOSUREMODE_T exposureMode;
+   int shutter_speed;         /// Exposure time in microseconds, 0 = auto
+   float analog_gain;         /// Sensor gain, 0 = auto
+   float digital_gain;        /// ISP gain, 0 = auto
    MMAL_PARAM_EXPOSUREMETERINGMODE_T exposureMeterMode;
    MMAL_PARAM_AWBMODE_T awbMode;
+   float awb_gains_r;         /// Red gain used when awbMode is off, 0 = leave as is
+   float awb_gains_b;         /// Blue gain used when awbMode is off, 0 = leave as is
    MMAL_PARAM_IMAGEFX_T imageEffect;
    MMAL_PARAMETER_IMAGEFX_PARAMETERS_T imageEffectsParameters;
    MMAL_PARAM_COLOURFX_T colourEffects;
@@ -131,8 +151,58 @@ typedef struct
    int hflip;                 /// 0 or 1
    int vflip;                 /// 0 or 1
    PARAM_FLOAT_RECT_T  roi;   /// region of interest to use on the sensor. Normalised [0,1] values in the rect
+   MMAL_PARAM_FLICKERAVOID_T flickerAvoidMode;
+   int videoDenoise;          /// 0 or 1
+   int stillsDenoise;         /// 0 or 1
+   MMAL_PARAMETER_DRC_STRENGTH_T drcLevel;  /// Dynamic range compression
+   int enable_annotate;       /// ANNOTATE_* flags, 0 for no annotation
+   char annotate_string[MMAL_CAMERA_ANNOTATE_MAX_TEXT_LEN_V3]; /// Text shown with ANNOTATE_USER_TEXT
+   int annotate_text_size;    /// 6-160, 0 for the firmware's default
 } RASPICAM_CAMERA_PARAMETERS;
 
+/// Parameters applied by raspicamcontrol_apply_parameters(), one mmal set (or group of sets) each
+typedef enum
+{
+   RASPICAM_PARAM_SATURATION,
+   RASPICAM_PARAM_SHARPNESS,
+   RASPICAM_PARAM_CONTRAST,
+   RASPICAM_PARAM_BRIGHTNESS,
+   RASPICAM_PARAM_ISO,
+   RASPICAM_PARAM_VIDEO_STABILISATION,
+   RASPICAM_PARAM_EXPOSURE_COMPENSATION,
+   RASPICAM_PARAM_EXPOSURE_MODE,
+   RASPICAM_PARAM_SHUTTER_SPEED,
+   RASPICAM_PARAM_ANALOG_GAIN,
+   RASPICAM_PARAM_DIGITAL_GAIN,
+   RASPICAM_PARAM_METERING_MODE,
+   RASPICAM_PARAM_AWB_MODE,
+   RASPICAM_PARAM_AWB_GAINS,
+   RASPICAM_PARAM_IMAGE_FX,
+   RASPICAM_PARAM_COLOUR_FX,
+   RASPICAM_PARAM_ROTATION,
+   RASPICAM_PARAM_FLIPS,
+   RASPICAM_PARAM_ROI,
+   RASPICAM_PARAM_FLICKER_AVOID,
+   RASPICAM_PARAM_VIDEO_DENOISE,
+   RASPICAM_PARAM_STILLS_DENOISE,
+   RASPICAM_PARAM_DRC,
+   RASPICAM_PARAM_ANNOTATE,
+   RASPICAM_PARAM_COUNT
+} RASPICAM_PARAM_ID;
+
+/// What a camera component was last told, so only changes need sending
+typedef struct
+{
+   RASPICAM_CAMERA_PARAMETERS applied; /// Values the camera accepted
+   unsigned int stale;        /// Bitmask of 1 << RASPICAM_PARAM_*, the camera may not match applied
+   unsigned int sets;         /// Parameters sent by the last apply
+   int64_t apply_us;          /// Duration of the last apply
+   int64_t set_us[RASPICAM_PARAM_COUNT]; /// Duration of each parameter's most recent set
+   RASPICAM_CAMERA_PARAMETERS reported; /// Values last read back from the camera
+   unsigned int reported_valid;  /// Bitmask of 1 << RASPICAM_PARAM_*, reported is still current
+   unsigned int generation;      /// Bumped each time reported values are invalidated
+} RASPICAM_PARAMETER_CACHE;
+
 
 void raspicamcontrol_check_configuration(int min_gpu_mem);
 
@@ -142,6 +212,12 @@ int raspicamcontrol_cycle_test(MMAL_COMPONENT_T *camera);
 
 int raspicamcontrol_set_all_parameters(MMAL_COMPONENT_T *camera, const RASPICAM_CAMERA_PARAMETERS *params);
 int raspicamcontrol_get_all_parameters(MMAL_COMPONENT_T *camera, RASPICAM_CAMERA_PARAMETERS *params);
+int raspicamcontrol_apply_parameters(MMAL_COMPONENT_T *camera, RASPICAM_PARAMETER_CACHE *cache, const RASPICAM_CAMERA_PARAMETERS *params);
+void raspicamcontrol_cache_reset(RASPICAM_PARAMETER_CACHE *cache);
+void raspicamcontrol_cache_assume_defaults(RASPICAM_PARAMETER_CACHE *cache);
+void raspicamcontrol_cache_invalidate(RASPICAM_PARAMETER_CACHE *cache, uint32_t id);
+int raspicamcontrol_read_parameters(MMAL_COMPONENT_T *camera, RASPICAM_PARAMETER_CACHE *cache, RASPICAM_CAMERA_PARAMETERS *params);
+void raspicamcontrol_request_change_events(MMAL_COMPONENT_T *camera);
 void raspicamcontrol_dump_parameters(const RASPICAM_CAMERA_PARAMETERS *params);
 
 void raspicamcontrol_set_defaults(RASPICAM_CAMERA_PARAMETERS *params);
@@ -159,11 +235,20 @@ int raspicamcontrol_set_video_stabilisation(MMAL_COMPONENT_T *camera, int vstabi
 int raspicamcontrol_set_exposure_compensation(MMAL_COMPONENT_T *camera, int exp_comp);
 int raspicamcontrol_set_exposure_mode(MMAL_COMPONENT_T *camera, MMAL_PARAM_EXPOSUREMODE_T mode);
 int raspicamcontrol_set_awb_mode(MMAL_COMPONENT_T *camera, MMAL_PARAM_AWBMODE_T awb_mode);
+int raspicamcontrol_set_awb_gains(MMAL_COMPONENT_T *camera, float r_gain, float b_gain);
+int raspicamcontrol_set_shutter_speed(MMAL_COMPONENT_T *camera, int speed);
+int raspicamcontrol_set_gains(MMAL_COMPONENT_T *camera, float analog, float digital);
 int raspicamcontrol_set_imageFX(MMAL_COMPONENT_T *camera, MMAL_PARAM_IMAGEFX_T imageFX);
 int raspicamcontrol_set_colourFX(MMAL_COMPONENT_T *camera, const MMAL_PARAM_COLOURFX_T *colourFX);
 int raspicamcontrol_set_rotation(MMAL_COMPONENT_T *camera, int rotation);
 int raspicamcontrol_set_flips(MMAL_COMPONENT_T *camera, int hflip, int vflip);
 int raspicamcontrol_set_ROI(MMAL_COMPONENT_T *camera, PARAM_FLOAT_RECT_T rect);
+int raspicamcontrol_set_flicker_avoid_mode(MMAL_COMPONENT_T *camera, MMAL_PARAM_FLICKERAVOID_T mode);
+int raspicamcontrol_set_video_denoise(MMAL_COMPONENT_T *camera, int denoise);
+int raspicamcontrol_set_stills_denoise(MMAL_COMPONENT_T *camera, int denoise);
+int raspicamcontrol_set_DRC(MMAL_COMPONENT_T *camera, MMAL_PARAMETER_DRC_STRENGTH_T strength);
+int raspicamcontrol_set_annotate(MMAL_COMPONENT_T *camera, int flags, const char *text, int text_size);
+void raspicamcontrol_format_annotation(int flags, const char *text, int64_t now, char *out, size_t size);
 
 //Individual getting functions
 int raspicamcontrol_get_saturation(MMAL_COMPONENT_T *camera);
@@ -177,8 +262,15 @@ int raspicamcontrol_get_exposure_compensation(MMAL_COMPONENT_T *camera);
 MMAL_PARAM_THUMBNAIL_CONFIG_T raspicamcontrol_get_thumbnail_parameters(MMAL_COMPONENT_T *camera);
 MMAL_PARAM_EXPOSUREMODE_T raspicamcontrol_get_exposure_mode(MMAL_COMPONENT_T *camera);
 MMAL_PARAM_AWBMODE_T raspicamcontrol_get_awb_mode(MMAL_COMPONENT_T *camera);
+int raspicamcontrol_get_shutter_speed(MMAL_COMPONENT_T *camera);
 MMAL_PARAM_IMAGEFX_T raspicamcontrol_get_imageFX(MMAL_COMPONENT_T *camera);
 MMAL_PARAM_COLOURFX_T raspicamcontrol_get_colourFX(MMAL_COMPONENT_T *camera);
+int raspicamcontrol_get_rotation(MMAL_COMPONENT_T *camera);
+PARAM_FLOAT_RECT_T raspicamcontrol_get_ROI(MMAL_COMPONENT_T *camera);
+MMAL_PARAM_FLICKERAVOID_T raspicamcontrol_get_flicker_avoid_mode(MMAL_COMPONENT_T *camera);
+int raspicamcontrol_get_video_denoise(MMAL_COMPONENT_T *camera);
+int raspicamcontrol_get_stills_denoise(MMAL_COMPONENT_T *camera);
+MMAL_PARAMETER_DRC_STRENGTH_T raspicamcontrol_get_DRC(MMAL_COMPONENT_T *camera);
 
 
 #endif /* RASPICAMCONTROL_H_ */
@@ -53,8 +53,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <memory.h>
 #include <sysexits.h>
+#include <unistd.h>
 
 #include <gst/gst.h>
 
@@ -71,14 +73,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "interface/mmal/mmal_parameters_camera.h"
 
 #include "RaspiCapture.h"
+#include "RaspiRing.h"
 #include "RaspiCamControl.h"
 #include "RaspiPreview.h"
+#include "gstrpicam-meta.h"
 
 #include <semaphore.h>
 
-/// Camera number to use - we only have one camera, indexed from 0.
-#define CAMERA_NUMBER 0
-
 // Standard port setting for the camera component
 #define MMAL_CAMERA_PREVIEW_PORT 0
 #define MMAL_CAMERA_VIDEO_PORT 1
@@ -90,6 +91,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /// Video render needs at least 2 buffers.
 #define VIDEO_OUTPUT_BUFFERS_NUM 3
+/// Raw frames are wrapped rather than copied, so leave spares for the ones downstream holds
+#define RAW_OUTPUT_BUFFERS_NUM 5
 
 // Max bitrate we allow for recording
 const int MAX_BITRATE = 30000000;	// 30Mbits/s
@@ -97,9 +100,30 @@ const int MAX_BITRATE = 30000000;	// 30Mbits/s
 /// Interval at which we check for an failure abort during capture
 const int ABORT_INTERVAL = 100;	// ms
 
+/// Entries in each output ring, more than any port pool holds so a push can't fail
+#define OUTPUT_RING_SIZE 64
+
+/// Buffer flags ending a frame, as opposed to the motion vectors that follow one
+#define IS_FRAME_END(flags) (((flags) & (MMAL_BUFFER_HEADER_FLAG_FRAME_END | \
+					 MMAL_BUFFER_HEADER_FLAG_CODECSIDEINFO)) == \
+			     MMAL_BUFFER_HEADER_FLAG_FRAME_END)
+
 #define MAX_USER_EXIF_TAGS      32
 #define MAX_EXIF_PAYLOAD_LENGTH 128
 
+/// Camera settings reports kept, to match against frames still queued in the ring
+#define CAMERA_SETTINGS_HISTORY 8
+/// Relative change in exposure or gains between reports that still counts as settled
+#define SETTLE_TOLERANCE 0.02
+/// Settled reports in a row before exposure counts as stable
+#define SETTLE_REPORTS 5
+/// How often a streaming thread waiting for capture to start looks at exposure
+#define SETTLE_POLL_INTERVAL 20	// ms
+/// How long a still may take before raspi_capture_image() gives up on it
+#define STILL_TIMEOUT 10000	// ms
+/// Annotation flags whose text has to be rebuilt for every frame
+#define ANNOTATE_CHANGING (ANNOTATE_DATE_TEXT | ANNOTATE_TIME_TEXT | ANNOTATE_LATENCY_MARKER)
+
 int mmal_status_to_int(MMAL_STATUS_T status);
 
 /** Struct used to pass information in encoder port userdata to callback
@@ -109,8 +133,37 @@ typedef struct {
 	RASPIVID_STATE *state;	/// pointer to our state in case required in callback
 	VCOS_SEMAPHORE_T complete_semaphore;
 	int abort;		/// Set to 1 in callback if an error occurs to attempt to abort the capture
+	RASPIRING_T *output_ring;	/// Ring the video buffer callback hands buffers to
+	volatile gint queued_frames;	/// Complete frames (FRAME_END buffers) in output_ring
 } PORT_USERDATA;
 
+/** A MMAL_PARAMETER_CAMERA_SETTINGS report, and when it arrived
+ */
+typedef struct {
+	int64_t arrival;	/// raspiring_now() when the event came in
+	GstRpiCamSettings settings;
+} CAMERA_SETTINGS_RECORD;
+
+/** Raw video pool, kept alive while downstream holds frames wrapping its
+ * payloads. Each wrapped header's user_data points here.
+ */
+typedef struct {
+	gint refs;		/// One for the state, one per wrapped frame
+	gint active;		/// Cleared on teardown, so late frames aren't sent to the port again
+	MMAL_PORT_T *port;	/// Camera video port, whose component is held until the last unref
+	MMAL_POOL_T *pool;
+} RAW_POOL;
+
+/** A secondary output pushed on its own pad, see RASPI_AUX_STREAM
+ */
+typedef struct {
+	MMAL_PORT_T *port;	/// Output port feeding this stream
+	MMAL_POOL_T *pool;	/// Buffers sent to that port
+	RASPIRING_T *ring;	/// Filled buffers waiting for raspi_capture_fill_aux_buffer()
+	PORT_USERDATA callback_data;
+	volatile gint flushing;	/// Set to make raspi_capture_fill_aux_buffer() bail out
+} AUX_OUTPUT;
+
 struct RASPIVID_STATE_T {
 	RASPIVID_CONFIG *config;
 
@@ -122,6 +175,33 @@ struct RASPIVID_STATE_T {
 	int numExifTags;	/// Number of supplied tags
 	int enableExifTags;
 	RASPICAM_CAMERA_PARAMETERS camera_parameters;	/// Camera setup parameters
+	RASPICAM_PARAMETER_CACHE camera_parameter_cache;	/// What camera_component was last told, and reports
+	GMutex parameter_lock;	/// Serialises applying and reading back camera_parameter_cache
+	int annotate_flags;	/// Annotation asked for, before expanding. Under parameter_lock
+	char annotate_text[MMAL_CAMERA_ANNOTATE_MAX_TEXT_LEN_V3];
+	int annotate_text_size;
+	PARAM_FLOAT_RECT_T roi_target;	/// Last ROI asked for, where a transition ends up
+	PARAM_FLOAT_RECT_T roi_from;	/// Where the current transition started
+	gboolean roi_moving;	/// A transition is stepping the ROI once per frame
+	int64_t roi_start;	/// When the transition started
+	int64_t roi_duration;
+	int64_t roi_last_frame;	/// Frame time of the previous step, 0 before the first
+	int64_t roi_last_issued;	/// When the previous step was sent
+	guint64 roi_steps;	/// Steps sent, over all transitions
+	int64_t roi_step_latency;	/// How long the camera took to take the last step
+	int64_t roi_jitter;	/// How far the last step strayed from the frame clock
+	GMutex settings_lock;	/// Guards settings_history, written by the control callback
+	CAMERA_SETTINGS_RECORD settings_history[CAMERA_SETTINGS_HISTORY];	/// Latest camera settings reports
+	guint settings_count;	/// Reports received, settings_history is indexed modulo its size
+	int64_t settle_start;	/// When raspi_capture_start() ran, settling is timed from it
+	guint settle_reports;	/// Reports in a row within SETTLE_TOLERANCE of the one before
+	int64_t settled;	/// Arrival of the report exposure counted as stable at, 0 before
+	gboolean exposure_locked;	/// exposureLock has fixed locked_settings, under parameter_lock
+	GstRpiCamSettings locked_settings;	/// What exposure and white balance were held at
+	guint settle_first_report;	/// settings_count when raspi_capture_start() ran
+	gboolean settling;	/// skipUntilSettled is holding capture back until exposure settles
+	guint64 settle_skipped;	/// Sensor frames that went by before capture started
+	int64_t first_frame;	/// When the first frame after start was handed out, 0 before
 
 	MMAL_COMPONENT_T *camera_component;	/// Pointer to the camera component
 	MMAL_COMPONENT_T *encoder_component;	/// Pointer to the encoder component
@@ -136,12 +216,52 @@ struct RASPIVID_STATE_T {
 	MMAL_PORT_T *encoder_output_port;
 	MMAL_PORT_T *encoder_capture_output_port;
 
-	MMAL_POOL_T *encoder_pool;	/// Pointer to the pool of buffers used by encoder output port
+	MMAL_POOL_T *encoder_pool;	/// Pointer to the pool of buffers used by encoder output port (or camera video port for raw output)
+	RAW_POOL *raw_pool;	/// Owns encoder_pool for raw output
 	MMAL_POOL_T *encoder_capture_pool;
 
 	PORT_USERDATA callback_data;
+	PORT_USERDATA capture_callback_data;	/// Still capture's own userdata, so it never touches the video callback's
+	GMutex capture_lock;	/// Serialises raspi_capture_photo() on this camera
+
+	RASPIRING_T *encoded_ring;	/// Filled buffers waiting for raspi_capture_fill_buffer()
+	volatile gint flushing;	/// Set to make raspi_capture_fill_buffer() bail out
+	MMAL_BUFFER_HEADER_T *held_buffer;	/// Start of the next frame, read while waiting for motion vectors
+	RASPILATENCY_RECORD held_timing;	/// Timestamps of held_buffer
+	RASPILATENCY_RECORD frame_timing;	/// Timestamps of the last frame raspi_capture_fill_buffer() returned
+	int64_t stc_offset;	/// Monotonic clock minus the camera's STC, 0 if unknown
+	gboolean skip_to_idr;	/// Dropping frames until the encoder sends a key frame
+	guint64 dropped_frames;	/// Frames dropped by the leaky policy
+	guint64 handoff_histogram[RASPI_HANDOFF_BUCKETS];	/// Callback to fill_buffer latencies, by bit length in us
+
+	/* Simulcast substream: splitter -> resizer -> second encoder */
+	MMAL_COMPONENT_T *splitter_component;
+	MMAL_COMPONENT_T *resizer_component;
+	MMAL_COMPONENT_T *sub_encoder_component;
+
+	MMAL_CONNECTION_T *splitter_connection;	/// Camera video port to splitter
+	MMAL_CONNECTION_T *resizer_connection;	/// Splitter output 1 to resizer
+	MMAL_CONNECTION_T *sub_encoder_connection;	/// Resizer to substream encoder
+
+	AUX_OUTPUT aux[RASPI_AUX_STREAM_COUNT];	/// Substream and analytics outputs
+
+	GstVideoInfo analytics_raw_info;	/// Padded I420 layout of the preview port
+	GstVideoInfo analytics_packed_info;	/// Layout pushed on the analytics pad
+
+	GstVideoFormat raw_format;	/// Raw format on the video pad, GST_VIDEO_FORMAT_UNKNOWN when encoding
+	GstVideoInfo raw_info;	/// Padded layout of raw frames as the camera produces them
+	GstVideoInfo packed_info;	/// Default GStreamer layout, used when downstream can't take GstVideoMeta
+};
 
-	MMAL_QUEUE_T *encoded_buffer_q;
+/// Raw formats the camera video port can produce without an encoder
+static const struct {
+	GstVideoFormat format;
+	MMAL_FOURCC_T encoding;
+} raw_format_map[] = {
+	{GST_VIDEO_FORMAT_I420, MMAL_ENCODING_I420},
+	{GST_VIDEO_FORMAT_NV12, MMAL_ENCODING_NV12},
+	{GST_VIDEO_FORMAT_RGB, MMAL_ENCODING_RGB24},
+	{GST_VIDEO_FORMAT_BGR, MMAL_ENCODING_BGR24},
 };
 
 #if 0
@@ -224,6 +344,31 @@ void raspicapture_default_config(RASPIVID_CONFIG * config)
 	config->demoInterval = 250;	// ms
 	config->immutableInput = 1;
 	config->profile = MMAL_VIDEO_PROFILE_H264_HIGH;
+	config->encoding = MMAL_ENCODING_H264;
+	config->quantisationParameter = 0;	// Rate control by bitrate
+	config->useVideoMeta = 0;
+	config->inlineMotionVectors = 0;
+	config->motionDetect = 0;
+	config->cameraNum = 0;
+	config->leaky = RASPIVID_LEAKY_BLOCK;
+	config->maxQueueFrames = 0;	// No limit
+	config->maxQueueTime = 500;	// ms
+	config->exposureLock = 0;
+	config->skipUntilSettled = 0;
+	config->settleTimeout = 2000;	// ms
+	config->roiTransition = 0;	// Jump
+
+	config->substream.enable = 0;
+	config->substream.width = 640;
+	config->substream.height = 360;
+	config->substream.bitrate = 1000000;
+	config->substream.intraperiod = 0;	// Not set
+	config->substream.profile = MMAL_VIDEO_PROFILE_H264_HIGH;
+
+	config->analytics.enable = 0;
+	config->analytics.width = 320;
+	config->analytics.height = 240;
+	config->analytics.grayscale = 1;
 
 	// Setup preview window defaults
 	raspipreview_set_defaults(&config->preview_parameters);
@@ -245,8 +390,8 @@ static void dump_state(RASPIVID_STATE * state)
 		return;
 	}
 
-	fprintf(stderr, "Width %d, Height %d\n", state->config->width, state->config->height);
-	fprintf(stderr, "bitrate %d, framerate %d/%d, time delay %d\n",
+	RASPI_DEBUG("Width %d, Height %d", state->config->width, state->config->height);
+	RASPI_DEBUG("bitrate %d, framerate %d/%d, time delay %d",
 		state->config->bitrate, state->config->fps_n, state->config->fps_d,
 		state->config->timeout);
 	//fprintf(stderr, "H264 Profile %s\n", raspicli_unmap_xref(state->config->profile, profile_map, profile_map_size));
@@ -255,6 +400,238 @@ static void dump_state(RASPIVID_STATE * state)
 	raspicamcontrol_dump_parameters(&state->config->camera_parameters);
 }
 
+/**
+ * Map a GStreamer raw video format to the camera port encoding producing it
+ *
+ * @param format Raw video format from the negotiated caps
+ * @return the MMAL encoding, or 0 if the camera can't output that format
+ */
+MMAL_FOURCC_T raspi_capture_encoding_from_video_format(GstVideoFormat format)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(raw_format_map); i++) {
+		if (raw_format_map[i].format == format)
+			return raw_format_map[i].encoding;
+	}
+	return 0;
+}
+
+static GstVideoFormat video_format_from_encoding(MMAL_FOURCC_T encoding)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(raw_format_map); i++) {
+		if (raw_format_map[i].encoding == encoding)
+			return raw_format_map[i].format;
+	}
+	return GST_VIDEO_FORMAT_UNKNOWN;
+}
+
+/**
+ * Whether the camera preview port should feed the analytics stream. It can
+ * only do that when nothing is displaying the preview.
+ *
+ * @param state Pointer to state control struct
+ * @return TRUE if the preview port is repurposed
+ */
+static gboolean analytics_wanted(RASPIVID_STATE * state)
+{
+	return state->config->analytics.enable
+	    && !state->config->preview_parameters.wantPreview;
+}
+
+/**
+ * Whether the H264 encoder should put out motion vectors, for the caller
+ * or for its motion detection
+ *
+ * @param state Pointer to state control struct
+ * @return TRUE if each frame gets a GstRpiCamMotionVectorMeta
+ */
+static gboolean inline_vectors_wanted(RASPIVID_STATE * state)
+{
+	return state->config->inlineMotionVectors || state->config->motionDetect;
+}
+
+/**
+ * Work out the layout of raw frames on a camera output port.
+ *
+ * The camera pads each frame to VCOS_ALIGN_UP(width, 32) x VCOS_ALIGN_UP(height, 16),
+ * so describe that in info for GstVideoMeta, and keep the default packed
+ * layout in packed for downstream elements that need it.
+ *
+ * @param format Format of the frames
+ * @param encoding MMAL encoding set on the port
+ * @param width Visible width
+ * @param height Visible height
+ * @param info Receives the padded layout
+ * @param packed Receives the default GStreamer layout
+ */
+static void setup_raw_layout(GstVideoFormat format, MMAL_FOURCC_T encoding,
+			     guint width, guint height, GstVideoInfo * info, GstVideoInfo * packed)
+{
+	guint aligned_height = VCOS_ALIGN_UP(height, 16);
+	guint stride = mmal_encoding_width_to_stride(encoding, VCOS_ALIGN_UP(width, 32));
+
+	gst_video_info_set_format(packed, format, width, height);
+	*info = *packed;
+
+	info->offset[0] = 0;
+	info->stride[0] = stride;
+	info->size = stride * aligned_height;
+
+	switch (format) {
+	case GST_VIDEO_FORMAT_I420:
+		info->stride[1] = info->stride[2] = stride / 2;
+		info->offset[1] = stride * aligned_height;
+		info->offset[2] = info->offset[1] + (stride / 2) * (aligned_height / 2);
+		info->size = info->offset[2] + (stride / 2) * (aligned_height / 2);
+		break;
+	case GST_VIDEO_FORMAT_NV12:
+		info->stride[1] = stride;
+		info->offset[1] = stride * aligned_height;
+		info->size = info->offset[1] + stride * (aligned_height / 2);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Copy a padded raw frame into the default GStreamer layout.
+ *
+ * Only the planes of out are copied, so a GRAY8 out takes just the luma
+ * plane of an I420 frame.
+ *
+ * @param in Padded layout, from setup_raw_layout()
+ * @param out Layout to produce
+ * @param src Frame data as produced by the camera
+ * @param buf Buffer of out size to fill
+ */
+static void pack_raw_frame(const GstVideoInfo * in, const GstVideoInfo * out,
+			   const guint8 * src, GstBuffer * buf)
+{
+	GstMapInfo map;
+	guint p, row;
+
+	if (!gst_buffer_map(buf, &map, GST_MAP_WRITE))
+		return;
+
+	for (p = 0; p < GST_VIDEO_INFO_N_PLANES(out); p++) {
+		for (row = 0; row < GST_VIDEO_INFO_COMP_HEIGHT(out, p); row++) {
+			memcpy(map.data + GST_VIDEO_INFO_PLANE_OFFSET(out, p) +
+			       row * GST_VIDEO_INFO_PLANE_STRIDE(out, p),
+			       src + GST_VIDEO_INFO_PLANE_OFFSET(in, p) +
+			       row * GST_VIDEO_INFO_PLANE_STRIDE(in, p),
+			       GST_VIDEO_INFO_PLANE_STRIDE(out, p));
+		}
+	}
+
+	gst_buffer_unmap(buf, &map);
+}
+
+/**
+ * Convert a gain from the camera settings, 0 if the camera didn't fill it in
+ */
+static gdouble gain_value(MMAL_RATIONAL_T gain)
+{
+	return gain.den ? (gdouble) gain.num / gain.den : 0.0;
+}
+
+/* Whether two exposure or gain values are within SETTLE_TOLERANCE */
+static gboolean settings_close(gdouble a, gdouble b)
+{
+	return ABS(a - b) <= SETTLE_TOLERANCE * MAX(ABS(a), ABS(b));
+}
+
+/**
+ * Whether exposure and white balance stayed put between two reports.
+ * Exposure time and gain are compared as their product, the brightness
+ * they give, as the camera trades one for the other.
+ */
+static gboolean settings_steady(const GstRpiCamSettings * a, const GstRpiCamSettings * b)
+{
+	return settings_close(a->exposure_time * a->analog_gain * a->digital_gain,
+			      b->exposure_time * b->analog_gain * b->digital_gain)
+	    && settings_close(a->awb_red_gain, b->awb_red_gain)
+	    && settings_close(a->awb_blue_gain, b->awb_blue_gain);
+}
+
+/**
+ * Keep a camera settings report for the frames it describes. Called on
+ * the control port's callback thread.
+ *
+ * @param state Pointer to state control struct
+ * @param param The report
+ */
+static void record_camera_settings(RASPIVID_STATE * state,
+				   const MMAL_PARAMETER_CAMERA_SETTINGS_T * param)
+{
+	CAMERA_SETTINGS_RECORD *record, *previous = NULL;
+
+	g_mutex_lock(&state->settings_lock);
+	if (state->settings_count)
+		previous =
+		    &state->settings_history[(state->settings_count - 1) % CAMERA_SETTINGS_HISTORY];
+	record = &state->settings_history[state->settings_count++ % CAMERA_SETTINGS_HISTORY];
+	record->arrival = raspiring_now();
+	record->settings.exposure_time = param->exposure;
+	record->settings.analog_gain = gain_value(param->analog_gain);
+	record->settings.digital_gain = gain_value(param->digital_gain);
+	record->settings.awb_red_gain = gain_value(param->awb_red_gain);
+	record->settings.awb_blue_gain = gain_value(param->awb_blue_gain);
+	record->settings.focus_position = param->focus_position;
+
+	if (previous && settings_steady(&previous->settings, &record->settings))
+		state->settle_reports++;
+	else
+		state->settle_reports = 0;
+	if (state->settle_start && !state->settled && state->settle_reports >= SETTLE_REPORTS) {
+		state->settled = record->arrival;
+		RASPI_INFO("Exposure settled %" G_GINT64_FORMAT " us after start",
+			   state->settled - state->settle_start);
+	}
+	g_mutex_unlock(&state->settings_lock);
+
+	RASPI_LOG("Camera settings: exposure %u us, analog gain %.3f, digital gain %.3f",
+		  param->exposure, record->settings.analog_gain, record->settings.digital_gain);
+}
+
+/**
+ * Find the camera settings a frame was captured with. The camera reports
+ * a frame's settings once it is exposed, so that is the first report
+ * arriving after the exposure started.
+ *
+ * @param state Pointer to state control struct
+ * @param sensor Monotonic time the frame's exposure started, 0 for the latest settings
+ * @param settings Receives the settings
+ * @return FALSE if the camera hasn't reported any settings
+ */
+static gboolean find_camera_settings(RASPIVID_STATE * state, int64_t sensor,
+				     GstRpiCamSettings * settings)
+{
+	const CAMERA_SETTINGS_RECORD *match = NULL;
+	guint i, first;
+
+	g_mutex_lock(&state->settings_lock);
+	first = state->settings_count > CAMERA_SETTINGS_HISTORY ?
+	    state->settings_count - CAMERA_SETTINGS_HISTORY : 0;
+	/* Newest first, back to the last report arriving after the exposure */
+	for (i = state->settings_count; i > first; i--) {
+		const CAMERA_SETTINGS_RECORD *record =
+		    &state->settings_history[(i - 1) % CAMERA_SETTINGS_HISTORY];
+
+		if (match && (sensor == 0 || record->arrival < sensor))
+			break;
+		match = record;
+	}
+	if (match)
+		*settings = match->settings;
+	g_mutex_unlock(&state->settings_lock);
+
+	return match != NULL;
+}
+
 /**
  *  buffer header callback function for camera control
  *
@@ -265,9 +642,23 @@ static void dump_state(RASPIVID_STATE * state)
  */
 static void camera_control_callback(MMAL_PORT_T * port, MMAL_BUFFER_HEADER_T * buffer)
 {
-	puts("camera_control_callback");
+	RASPIVID_STATE *state = (RASPIVID_STATE *) port->userdata;
+
+	RASPI_LOG("Camera control callback, event 0x%08x", buffer->cmd);
 
 	if (buffer->cmd == MMAL_EVENT_PARAMETER_CHANGED) {
+		MMAL_EVENT_PARAMETER_CHANGED_T *param = (MMAL_EVENT_PARAMETER_CHANGED_T *) buffer->data;
+
+		if (state && param->hdr.id == MMAL_PARAMETER_CAMERA_SETTINGS) {
+			if (buffer->length >= sizeof(MMAL_PARAMETER_CAMERA_SETTINGS_T))
+				record_camera_settings(state,
+						       (MMAL_PARAMETER_CAMERA_SETTINGS_T *) param);
+		} else if (state) {
+			/* Read it back again next time it's asked for. Doesn't take
+			 * parameter_lock, an apply may be waiting on this thread */
+			raspicamcontrol_cache_invalidate(&state->camera_parameter_cache,
+							 param->hdr.id);
+		}
 	} else {
 		vcos_log_error("Received unexpected camera control callback event, 0x%08x",
 			       buffer->cmd);
@@ -288,7 +679,6 @@ static void encoder_capture_buffer_callback(MMAL_PORT_T * port, MMAL_BUFFER_HEAD
 {
 	//puts("encoder_capture_buffer_callback");
 	int complete = 0;
-	static int count = 0;
 
 	// We pass our file handle and other stuff in via the userdata field.
 
@@ -297,118 +687,1143 @@ static void encoder_capture_buffer_callback(MMAL_PORT_T * port, MMAL_BUFFER_HEAD
 	if (pData) {
 		int bytes_written = buffer->length;
 
-		if (buffer->length && pData->file_handle) {
-			mmal_buffer_header_mem_lock(buffer);
+		if (buffer->length && pData->file_handle) {
+			mmal_buffer_header_mem_lock(buffer);
+
+			bytes_written = fwrite(buffer->data, 1, buffer->length, pData->file_handle);
+			RASPI_LOG("Wrote %u bytes of still", buffer->length);
+
+			mmal_buffer_header_mem_unlock(buffer);
+		}
+		// We need to check we wrote what we wanted - it's possible we have run out of storage.
+		if (bytes_written != buffer->length) {
+			vcos_log_error("Unable to write buffer to file - aborting");
+			complete = 1;
+		}
+		// Now flag if we have completed
+		if (buffer->flags & (MMAL_BUFFER_HEADER_FLAG_FRAME_END |
+				     MMAL_BUFFER_HEADER_FLAG_TRANSMISSION_FAILED))
+			complete = 1;
+	} else {
+		vcos_log_error("Received a encoder buffer callback with no state");
+	}
+
+	// release buffer back to the pool
+	mmal_buffer_header_release(buffer);
+
+	// and send one back to the port (if still open)
+	if (port->is_enabled) {
+		MMAL_STATUS_T status = MMAL_SUCCESS;
+		MMAL_BUFFER_HEADER_T *new_buffer;
+
+		new_buffer = mmal_queue_get(pData->state->encoder_capture_pool->queue);
+
+		if (new_buffer) {
+			status = mmal_port_send_buffer(port, new_buffer);
+		}
+		if (!new_buffer || status != MMAL_SUCCESS)
+			vcos_log_error("Unable to return a buffer to the encoder port");
+	}
+
+	if (complete) {
+		//puts("semaphore post");
+		vcos_semaphore_post(&(pData->complete_semaphore));
+	}
+}
+
+/**
+ *  buffer header callback function for encoder
+ *
+ *  Callback will dump buffer data to the specific file
+ *
+ * @param port Pointer to port from which callback originated
+ * @param buffer mmal buffer header pointer
+ */
+static void encoder_buffer_callback(MMAL_PORT_T * port, MMAL_BUFFER_HEADER_T * buffer)
+{
+	//puts("encoder_buffer_callback");
+	PORT_USERDATA *pData = (PORT_USERDATA *) port->userdata;
+	int pushed;
+
+	if (pData == NULL) {
+		vcos_log_error("Received a encoder buffer callback with no state");
+		// release buffer back to the pool
+		mmal_buffer_header_release(buffer);
+		return;
+	}
+
+	RASPI_PROBE3(buffer_arrival, buffer->pts, buffer->length, buffer->flags);
+
+	/* Send buffer to GStreamer element for pushing to the pipeline */
+	pushed = raspiring_push(pData->output_ring, buffer, buffer->flags, buffer->pts);
+	if (!pushed) {
+		vcos_log_error("Output ring full, dropping buffer");
+		mmal_buffer_header_release(buffer);
+		return;
+	}
+	if (pushed < 0)
+		RASPI_WARNING("Could not wake the thread reading the output ring (%d)", errno);
+	if (IS_FRAME_END(buffer->flags))
+		g_atomic_int_inc(&pData->queued_frames);
+}
+
+/**
+ * Copy the contents of an output buffer header into a new GstBuffer
+ *
+ * @param state Pointer to state control struct
+ * @param buffer mmal buffer header from encoded_ring
+ * @return the new buffer, or NULL on allocation failure
+ */
+static GstBuffer *buffer_from_mmal(RASPIVID_STATE * state, MMAL_BUFFER_HEADER_T * buffer)
+{
+	GstBuffer *buf;
+
+	mmal_buffer_header_mem_lock(buffer);
+	if (state->raw_format != GST_VIDEO_FORMAT_UNKNOWN) {
+		/* Downstream can't handle the padding, so repack */
+		buf = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&state->packed_info), NULL);
+		if (buf)
+			pack_raw_frame(&state->raw_info, &state->packed_info, buffer->data, buf);
+	} else {
+		buf = gst_buffer_new_allocate(NULL, buffer->length, NULL);
+		if (buf)
+			gst_buffer_fill(buf, 0, buffer->data, buffer->length);
+	}
+	mmal_buffer_header_mem_unlock(buffer);
+
+	return buf;
+}
+
+/**
+ * Attach the encoder's inline motion vectors to the frame they belong to
+ *
+ * @param state Pointer to state control struct
+ * @param buf The complete H264 frame
+ * @param buffer CODECSIDEINFO buffer that followed the frame
+ */
+static void attach_motion_vectors(RASPIVID_STATE * state, GstBuffer * buf,
+				  MMAL_BUFFER_HEADER_T * buffer)
+{
+	/* The encoder adds one macroblock column beyond the frame width */
+	guint mb_width = (state->config->width + 15) / 16 + 1;
+	guint mb_height = (state->config->height + 15) / 16;
+	gint64 start = g_get_monotonic_time();
+
+	mmal_buffer_header_mem_lock(buffer);
+	if (!gst_buffer_add_rpi_cam_motion_vector_meta(buf, mb_width, mb_height, buffer->data,
+						       buffer->length))
+		GST_WARNING("%u bytes of motion vectors don't cover %ux%u macroblocks",
+			    buffer->length, mb_width, mb_height);
+	mmal_buffer_header_mem_unlock(buffer);
+
+	RASPI_LOG("Attached motion vectors in %" G_GINT64_FORMAT " us",
+		g_get_monotonic_time() - start);
+}
+
+/**
+ * Attach the camera settings the frame was captured with
+ *
+ * @param state Pointer to state control struct
+ * @param buf The complete frame
+ */
+static void attach_camera_settings(RASPIVID_STATE * state, GstBuffer * buf)
+{
+	GstRpiCamSettings settings;
+
+	if (find_camera_settings(state, state->frame_timing.sensor, &settings))
+		gst_buffer_add_rpi_cam_settings_meta(buf, &settings);
+}
+
+/**
+ * Hold exposure and white balance where they settled, for the settings
+ * left to the camera. Called with parameter_lock held.
+ *
+ * @param state Pointer to state control struct
+ * @param params Camera settings to adjust
+ */
+static void apply_exposure_lock(RASPIVID_STATE * state, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	const GstRpiCamSettings *locked = &state->locked_settings;
+
+	if (!state->exposure_locked)
+		return;
+
+	if (params->exposureMode == MMAL_PARAM_EXPOSUREMODE_AUTO)
+		params->exposureMode = MMAL_PARAM_EXPOSUREMODE_OFF;
+	if (params->shutter_speed == 0)
+		params->shutter_speed = locked->exposure_time;
+	if (params->analog_gain == 0)
+		params->analog_gain = locked->analog_gain;
+	if (params->digital_gain == 0)
+		params->digital_gain = locked->digital_gain;
+	if (params->awbMode == MMAL_PARAM_AWBMODE_AUTO) {
+		params->awbMode = MMAL_PARAM_AWBMODE_OFF;
+		params->awb_gains_r = locked->awb_red_gain;
+		params->awb_gains_b = locked->awb_blue_gain;
+	}
+}
+
+/**
+ * With exposureLock, fix exposure and white balance the first time they
+ * are found settled. Streaming thread only.
+ *
+ * @param state Pointer to state control struct
+ */
+static void check_exposure_lock(RASPIVID_STATE * state)
+{
+	RASPICAM_CAMERA_PARAMETERS params;
+	GstRpiCamSettings settings;
+	gboolean settled;
+	int result;
+
+	if (!state->config->exposureLock || state->exposure_locked)
+		return;
+
+	g_mutex_lock(&state->settings_lock);
+	settled = state->settled != 0;
+	g_mutex_unlock(&state->settings_lock);
+	if (!settled || !find_camera_settings(state, 0, &settings))
+		return;
+
+	g_mutex_lock(&state->parameter_lock);
+	state->locked_settings = settings;
+	state->exposure_locked = TRUE;
+	params = state->camera_parameter_cache.applied;
+	apply_exposure_lock(state, &params);
+	result = raspicamcontrol_apply_parameters(state->camera_component,
+						  &state->camera_parameter_cache, &params);
+	g_mutex_unlock(&state->parameter_lock);
+
+	if (result)
+		GST_WARNING("Camera refused %d settings while locking exposure", result);
+	RASPI_DEBUG("Locked exposure at %u us, gains %.2f x %.2f, AWB gains %.2f/%.2f",
+		    settings.exposure_time, settings.analog_gain, settings.digital_gain,
+		    settings.awb_red_gain, settings.awb_blue_gain);
+}
+
+/**
+ * Keep the annotation asked for, to expand into what the camera shows.
+ * Called with parameter_lock held.
+ *
+ * @param state Pointer to state control struct
+ * @param params Camera settings holding the annotation
+ */
+static void set_annotation(RASPIVID_STATE * state, const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	state->annotate_flags = params->enable_annotate;
+	g_strlcpy(state->annotate_text, params->annotate_string, sizeof(state->annotate_text));
+	state->annotate_text_size = params->annotate_text_size;
+}
+
+/**
+ * Fill in the annotation as the camera is to show it, with the date, time
+ * and latency marker expanded. Called with parameter_lock held.
+ *
+ * @param state Pointer to state control struct
+ * @param params Camera settings to adjust
+ */
+static void expand_annotation(RASPIVID_STATE * state, RASPICAM_CAMERA_PARAMETERS * params)
+{
+	params->enable_annotate = state->annotate_flags;
+	params->annotate_text_size = state->annotate_text_size;
+	raspicamcontrol_format_annotation(state->annotate_flags, state->annotate_text,
+					  raspiring_now(), params->annotate_string,
+					  sizeof(params->annotate_string));
+}
+
+static gboolean same_rect(PARAM_FLOAT_RECT_T a, PARAM_FLOAT_RECT_T b)
+{
+	return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+/**
+ * Head for a newly asked for ROI. With roiTransition set, the ROI moves
+ * there a step per frame from wherever it is now, otherwise it jumps.
+ * Called with parameter_lock held, from the streaming thread.
+ *
+ * @param state Pointer to state control struct
+ * @param target ROI asked for
+ */
+static void set_roi_target(RASPIVID_STATE * state, PARAM_FLOAT_RECT_T target)
+{
+	int transition = state->config->roiTransition;
+
+	if (same_rect(target, state->roi_target))
+		return;
+
+	state->roi_target = target;
+	state->roi_from = state->camera_parameter_cache.applied.roi;
+	state->roi_moving = transition > 0;
+	state->roi_start = raspiring_now();
+	state->roi_duration = (int64_t) transition * 1000;
+	state->roi_last_frame = 0;
+}
+
+/**
+ * Where the ROI should be for a frame captured at frame_time. The ROI
+ * eases in and out, so a zoom or pan starts and stops without a jerk.
+ *
+ * @param state Pointer to state control struct
+ * @param frame_time Capture time of the frame
+ * @param roi Receives the ROI
+ * @return TRUE once the transition has reached its target
+ */
+static gboolean step_roi(RASPIVID_STATE * state, int64_t frame_time, PARAM_FLOAT_RECT_T * roi)
+{
+	double t = (double) (frame_time - state->roi_start) / state->roi_duration;
+
+	if (t >= 1.0) {
+		*roi = state->roi_target;
+		return TRUE;
+	}
+	if (t < 0.0)
+		t = 0.0;
+	t = t * t * (3.0 - 2.0 * t);
+
+	roi->x = state->roi_from.x + (state->roi_target.x - state->roi_from.x) * t;
+	roi->y = state->roi_from.y + (state->roi_target.y - state->roi_from.y) * t;
+	roi->w = state->roi_from.w + (state->roi_target.w - state->roi_from.w) * t;
+	roi->h = state->roi_from.h + (state->roi_target.h - state->roi_from.h) * t;
+
+	return FALSE;
+}
+
+/**
+ * Count a step of an ROI transition. Jitter is how much the time between
+ * this step and the one before differs from the time between the frames
+ * they were worked out for, so it is 0 when steps follow the frame clock.
+ *
+ * @param state Pointer to state control struct
+ * @param frame_time Capture time of the frame the step was for
+ * @param issued When the step was sent
+ * @param took How long sending it took
+ */
+static void record_roi_step(RASPIVID_STATE * state, int64_t frame_time, int64_t issued,
+			    int64_t took)
+{
+	if (state->roi_last_frame)
+		state->roi_jitter = ABS((issued - state->roi_last_issued)
+					- (frame_time - state->roi_last_frame));
+	state->roi_last_frame = frame_time;
+	state->roi_last_issued = issued;
+	state->roi_step_latency = took;
+	state->roi_steps++;
+}
+
+/**
+ * Send the settings that change from frame to frame: an annotation
+ * showing the time or a latency marker, and the ROI while it moves. Both
+ * go out as one batch, at most once per frame, and the annotation only
+ * when its text changed, so the time costs a parameter set a second and
+ * the marker one a frame. Streaming thread only.
+ *
+ * @param state Pointer to state control struct
+ */
+static void update_frame_settings(RASPIVID_STATE * state)
+{
+	RASPICAM_CAMERA_PARAMETERS params;
+	int64_t frame_time, issued;
+	gboolean moving, arrived = FALSE;
+
+	/* annotate_flags and roi_moving are only written from this thread */
+	moving = state->roi_moving;
+	if (!state->camera_component || (!(state->annotate_flags & ANNOTATE_CHANGING) && !moving))
+		return;
+
+	frame_time = state->frame_timing.sensor ? state->frame_timing.sensor
+	    : state->frame_timing.arrival;
+
+	g_mutex_lock(&state->parameter_lock);
+	params = state->camera_parameter_cache.applied;
+	if (state->annotate_flags & ANNOTATE_CHANGING)
+		expand_annotation(state, &params);
+	if (moving)
+		arrived = step_roi(state, frame_time, &params.roi);
+	issued = raspiring_now();
+	raspicamcontrol_apply_parameters(state->camera_component, &state->camera_parameter_cache,
+					 &params);
+	if (moving) {
+		record_roi_step(state, frame_time, issued, raspiring_now() - issued);
+		state->roi_moving = !arrived;
+	}
+	g_mutex_unlock(&state->parameter_lock);
+}
+
+/**
+ * Release an output buffer back to the pool, and send one back to the
+ * output port (if still open)
+ *
+ * @param port Output port the buffer came from
+ * @param pool Pool of buffers for that port
+ * @param buffer mmal buffer header we are finished with
+ * @return TRUE if the port got a replacement buffer
+ */
+static gboolean recycle_output_buffer(MMAL_PORT_T * port, MMAL_POOL_T * pool,
+				      MMAL_BUFFER_HEADER_T * buffer)
+{
+	mmal_buffer_header_release(buffer);
+
+	if (port->is_enabled) {
+		MMAL_STATUS_T status = MMAL_SUCCESS;
+
+		buffer = mmal_queue_get(pool->queue);
+		if (buffer)
+			status = mmal_port_send_buffer(port, buffer);
+
+		if (!buffer || status != MMAL_SUCCESS) {
+			vcos_log_error("Unable to return a buffer to the encoder port");
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Drop a reference on the raw pool, destroying it with the last one
+ *
+ * @param raw_pool The raw pool
+ */
+static void raw_pool_unref(RAW_POOL * raw_pool)
+{
+	MMAL_COMPONENT_T *camera;
+
+	if (!g_atomic_int_dec_and_test(&raw_pool->refs))
+		return;
+
+	camera = raw_pool->port->component;
+	mmal_port_pool_destroy(raw_pool->port, raw_pool->pool);
+	mmal_component_release(camera);
+	g_free(raw_pool);
+}
+
+/* GstBuffer notify for wrapped raw frames: the header goes back to the
+ * camera once downstream is done with the frame */
+static void raw_frame_release(gpointer data)
+{
+	MMAL_BUFFER_HEADER_T *buffer = data;
+	RAW_POOL *raw_pool = buffer->user_data;
+
+	mmal_buffer_header_mem_unlock(buffer);
+	if (g_atomic_int_get(&raw_pool->active))
+		recycle_output_buffer(raw_pool->port, raw_pool->pool, buffer);
+	else
+		mmal_buffer_header_release(buffer);
+	raw_pool_unref(raw_pool);
+}
+
+/**
+ * Raw frames are wrapped without copying when downstream takes the padded
+ * layout through GstVideoMeta, or when there is no padding to remove
+ *
+ * @param state Pointer to state control struct
+ * @return TRUE if wrap_raw_frame() should be used
+ */
+static gboolean raw_frames_wrapped(RASPIVID_STATE * state)
+{
+	return state->raw_pool && (state->config->useVideoMeta
+				   || GST_VIDEO_INFO_SIZE(&state->raw_info) ==
+				   GST_VIDEO_INFO_SIZE(&state->packed_info));
+}
+
+/**
+ * Wrap a raw frame's payload in a GstBuffer without copying it. The
+ * GstBuffer owns the header from here on.
+ *
+ * @param state Pointer to state control struct
+ * @param buffer mmal buffer header from encoded_ring, holding a whole frame
+ * @return the new buffer
+ */
+static GstBuffer *wrap_raw_frame(RASPIVID_STATE * state, MMAL_BUFFER_HEADER_T * buffer)
+{
+	GstBuffer *buf;
+
+	g_atomic_int_inc(&state->raw_pool->refs);
+	buffer->user_data = state->raw_pool;
+
+	/* Stays locked for as long as the GstBuffer maps the payload */
+	mmal_buffer_header_mem_lock(buffer);
+	buf = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, buffer->data, buffer->length,
+					  0, buffer->length, buffer, raw_frame_release);
+	gst_buffer_add_video_meta_full(buf, GST_VIDEO_FRAME_FLAG_NONE, state->raw_format,
+				       state->config->width, state->config->height,
+				       GST_VIDEO_INFO_N_PLANES(&state->raw_info),
+				       state->raw_info.offset, state->raw_info.stride);
+
+	return buf;
+}
+
+/**
+ * Start video capture once skipUntilSettled has waited for it: exposure
+ * has settled or settleTimeout has passed. Until then the camera only
+ * runs its control loops and nothing reaches the encoder. Streaming
+ * thread only.
+ *
+ * @param state Pointer to state control struct
+ * @return FALSE if capture couldn't be started
+ */
+static gboolean start_settled_capture(RASPIVID_STATE * state)
+{
+	gboolean settled;
+	int64_t waited;
+	guint reports;
+
+	if (!state->settling)
+		return TRUE;
+
+	g_mutex_lock(&state->settings_lock);
+	settled = state->settled != 0;
+	waited = raspiring_now() - state->settle_start;
+	/* The camera reports settings once per sensor frame */
+	reports = state->settings_count - state->settle_first_report;
+	g_mutex_unlock(&state->settings_lock);
+
+	if (!settled) {
+		if (state->config->settleTimeout <= 0
+		    || waited < (int64_t) state->config->settleTimeout * 1000)
+			return TRUE;
+		GST_WARNING("Exposure not settled after %d ms, starting anyway",
+			    state->config->settleTimeout);
+	}
+
+	state->settling = FALSE;
+	state->settle_skipped = reports;
+	GST_DEBUG("Starting capture after %u frames while exposure settled", reports);
+
+	if (mmal_port_parameter_set_boolean(state->camera_video_port, MMAL_PARAMETER_CAPTURE, 1) !=
+	    MMAL_SUCCESS) {
+		vcos_log_error("Unable to start capture");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Take the next buffer of the main stream off the ring
+ *
+ * @param state Pointer to state control struct
+ * @param wait TRUE to sleep until a buffer arrives or raspi_capture_set_flushing()
+ * @param slot Receives the buffer's arrival time and flags
+ * @return The buffer, or NULL if there was none
+ */
+static MMAL_BUFFER_HEADER_T *take_encoded_buffer(RASPIVID_STATE * state, gboolean wait,
+						 RASPIRING_SLOT * slot)
+{
+	MMAL_BUFFER_HEADER_T *buffer;
+
+	if (wait) {
+		/* Nothing arrives before capture starts, look at exposure meanwhile.
+		 * raspi_capture_set_flushing() wakes the wait up to give up. */
+		do {
+			if (g_atomic_int_get(&state->flushing) || !start_settled_capture(state))
+				return NULL;
+			buffer = raspiring_wait(state->encoded_ring,
+						state->settling ? SETTLE_POLL_INTERVAL : -1, slot);
+		} while (buffer == NULL);
+	} else {
+		buffer = raspiring_pop(state->encoded_ring, slot);
+	}
+
+	if (buffer && IS_FRAME_END(buffer->flags))
+		g_atomic_int_add(&state->callback_data.queued_frames, -1);
+
+	return buffer;
+}
+
+/**
+ * Whether a main stream buffer can start decoding on its own: headers, an
+ * H264 key frame, or any frame of an intra-only format
+ *
+ * @param state Pointer to state control struct
+ * @param flags MMAL buffer flags
+ * @return TRUE if the buffer must not be dropped to catch up
+ */
+static gboolean is_sync_point(RASPIVID_STATE * state, uint32_t flags)
+{
+	if (state->encoder_component == NULL || state->config->encoding != MMAL_ENCODING_H264)
+		return TRUE;
+
+	return ! !(flags & (MMAL_BUFFER_HEADER_FLAG_KEYFRAME | MMAL_BUFFER_HEADER_FLAG_CONFIG));
+}
+
+/**
+ * Whether every frame of the main stream decodes on its own: raw frames
+ * and MJPEG, which the leaky policy can drop anywhere
+ *
+ * @param state Pointer to state control struct
+ * @return TRUE for intra-only output
+ */
+static gboolean is_intra_only(RASPIVID_STATE * state)
+{
+	return state->encoder_component == NULL || state->config->encoding != MMAL_ENCODING_H264;
+}
+
+/**
+ * Check the main stream backlog against maxQueueFrames and maxQueueTime
+ *
+ * @param state Pointer to state control struct
+ * @param oldest Receives the metadata of the oldest queued buffer
+ * @return TRUE if frames should be dropped
+ */
+static gboolean backlog_exceeded(RASPIVID_STATE * state, RASPIRING_SLOT * oldest)
+{
+	RASPIVID_CONFIG *config = state->config;
+
+	if (!raspiring_peek(state->encoded_ring, oldest))
+		return FALSE;
+
+	if (config->maxQueueFrames > 0
+	    && g_atomic_int_get(&state->callback_data.queued_frames) > config->maxQueueFrames)
+		return TRUE;
+
+	return config->maxQueueTime > 0
+	    && raspiring_now() - oldest->arrival > (int64_t) config->maxQueueTime * 1000;
+}
+
+/**
+ * Drop the oldest queued frame of the main stream, handing its buffers
+ * back to the encoder
+ *
+ * @param state Pointer to state control struct
+ */
+static void drop_oldest_frame(RASPIVID_STATE * state)
+{
+	MMAL_BUFFER_HEADER_T *buffer;
+	RASPIRING_SLOT slot;
+
+	while ((buffer = take_encoded_buffer(state, FALSE, &slot))) {
+		gboolean frame_end = IS_FRAME_END(slot.flags);
+
+		recycle_output_buffer(state->encoder_output_port, state->encoder_pool, buffer);
+		if (frame_end) {
+			state->dropped_frames++;
+			break;
+		}
+	}
+}
+
+/**
+ * Count how long a buffer waited between the encoder callback and the
+ * streaming thread picking it up, which is mostly the wakeup latency of
+ * the streaming thread
+ *
+ * @param state Pointer to state control struct
+ * @param latency Wait in microseconds
+ */
+static void record_handoff(RASPIVID_STATE * state, gint64 latency)
+{
+	guint bucket = latency > 0 ? g_bit_storage(latency) : 0;
+
+	RASPI_LOG("Buffer handed over after %" G_GINT64_FORMAT " us", latency);
+	state->handoff_histogram[MIN(bucket, RASPI_HANDOFF_BUCKETS - 1)]++;
+}
+
+/**
+ * Map a buffer pts from the camera's STC onto the monotonic clock
+ *
+ * @param state Pointer to state control struct
+ * @param pts Buffer pts in microseconds
+ * @return Monotonic time in microseconds, 0 if unknown
+ */
+static int64_t sensor_time(RASPIVID_STATE * state, int64_t pts)
+{
+	if (state->stc_offset == 0 || pts == MMAL_TIME_UNKNOWN)
+		return 0;
+
+	return pts + state->stc_offset;
+}
+
+/**
+ * Ask the encoder for a key frame, for when the frames before it were
+ * dropped
+ *
+ * @param state Pointer to state control struct
+ */
+static void request_key_frame(RASPIVID_STATE * state)
+{
+	state->skip_to_idr = TRUE;
+	if (mmal_port_parameter_set_boolean(state->encoder_output_port,
+					    MMAL_PARAMETER_VIDEO_REQUEST_I_FRAME,
+					    MMAL_TRUE) != MMAL_SUCCESS)
+		vcos_log_error("Unable to request an I-frame");
+}
+
+/**
+ * Apply the leaky policy before reading the next frame, so a slow
+ * downstream costs frames rather than ever growing latency
+ *
+ * @param state Pointer to state control struct
+ */
+static void apply_leaky_policy(RASPIVID_STATE * state)
+{
+	RASPIRING_SLOT oldest;
+	guint64 dropped = state->dropped_frames;
+
+	if (state->config->leaky == RASPIVID_LEAKY_BLOCK || state->held_buffer)
+		return;
+
+	while (backlog_exceeded(state, &oldest)) {
+		if (!is_intra_only(state)) {
+			/* Headers are only sent at the start, the stream can't do without them */
+			if (oldest.flags & MMAL_BUFFER_HEADER_FLAG_CONFIG)
+				break;
+			/* drop-oldest keeps key frames; drop-to-idr drops stale ones too
+			 * and starts again at the key frame it asks for */
+			if ((oldest.flags & MMAL_BUFFER_HEADER_FLAG_KEYFRAME)
+			    && state->config->leaky != RASPIVID_LEAKY_DROP_TO_IDR)
+				break;
+			if (state->config->leaky == RASPIVID_LEAKY_DROP_TO_IDR && !state->skip_to_idr)
+				request_key_frame(state);
+		}
+		drop_oldest_frame(state);
+	}
+
+	if (state->dropped_frames != dropped)
+		GST_DEBUG("Dropped %" G_GUINT64_FORMAT " frames to catch up",
+			  state->dropped_frames - dropped);
+}
+
+GstFlowReturn raspi_capture_fill_buffer(RASPIVID_STATE * state, GstBuffer ** bufp)
+{
+	GstBuffer *buf = NULL, *chunk;
+	MMAL_BUFFER_HEADER_T *buffer;
+	RASPIRING_SLOT slot;
+	RASPILATENCY_RECORD timing;
+	GstFlowReturn ret = GST_FLOW_OK;
+	gboolean frame_end = FALSE, is_config, gather, wrapped;
+	gboolean want_vectors = state->encoder_component != NULL
+	    && state->config->encoding == MMAL_ENCODING_H264 && inline_vectors_wanted(state);
+
+	apply_leaky_policy(state);
+
+	/* A JPEG frame can be split across several encoder buffers, but image/jpeg
+	 * needs one complete frame per GstBuffer, so gather up to FRAME_END.
+	 * With inline vectors, each H264 frame is followed by a CODECSIDEINFO
+	 * buffer, which is attached to the gathered frame as a meta. */
+	while (ret == GST_FLOW_OK) {
+		if (state->held_buffer) {
+			buffer = state->held_buffer;
+			timing = state->held_timing;
+			state->held_buffer = NULL;
+		} else {
+			buffer = take_encoded_buffer(state, TRUE, &slot);
+			if (buffer == NULL) {
+				ret = g_atomic_int_get(&state->flushing) ? GST_FLOW_FLUSHING :
+				    GST_FLOW_ERROR;
+				break;
+			}
+			timing.sensor = sensor_time(state, slot.pts);
+			timing.arrival = slot.arrival;
+			timing.dequeue = raspiring_now();
+			timing.pushed = 0;
+			record_handoff(state, timing.dequeue - timing.arrival);
+			RASPI_PROBE3(buffer_dequeue, slot.pts, timing.dequeue - timing.arrival,
+				     slot.flags);
+		}
+
+		if (state->skip_to_idr && !buf) {
+			if (buffer->flags & MMAL_BUFFER_HEADER_FLAG_KEYFRAME) {
+				state->skip_to_idr = FALSE;
+			} else if (!(buffer->flags & MMAL_BUFFER_HEADER_FLAG_CONFIG)) {
+				if (IS_FRAME_END(buffer->flags))
+					state->dropped_frames++;
+				if (!recycle_output_buffer(state->encoder_output_port,
+							   state->encoder_pool, buffer))
+					ret = GST_FLOW_ERROR;
+				continue;
+			}
+		}
+
+		if (buffer->flags & MMAL_BUFFER_HEADER_FLAG_CODECSIDEINFO) {
+			if (buf && frame_end)
+				attach_motion_vectors(state, buf, buffer);
+			if (!recycle_output_buffer(state->encoder_output_port, state->encoder_pool,
+						   buffer))
+				ret = GST_FLOW_ERROR;
+			if (buf)
+				break;
+			continue;
+		}
+
+		if (frame_end) {
+			/* The frame came without vectors; this buffer starts the next one */
+			state->held_buffer = buffer;
+			state->held_timing = timing;
+			break;
+		}
+
+		/* A video meta or repack would read past the end of a short frame */
+		if (state->raw_format != GST_VIDEO_FORMAT_UNKNOWN
+		    && buffer->length < GST_VIDEO_INFO_SIZE(&state->raw_info)) {
+			if (buffer->length)
+				GST_WARNING("Dropping a %u byte raw frame, expected %" G_GSIZE_FORMAT,
+					    buffer->length, GST_VIDEO_INFO_SIZE(&state->raw_info));
+			if (!recycle_output_buffer(state->encoder_output_port,
+						   state->encoder_pool, buffer))
+				ret = GST_FLOW_ERROR;
+			continue;
+		}
+
+		frame_end = ! !(buffer->flags & MMAL_BUFFER_HEADER_FLAG_FRAME_END);
+		is_config = ! !(buffer->flags & MMAL_BUFFER_HEADER_FLAG_CONFIG);
+
+		wrapped = raw_frames_wrapped(state);
+		if (wrapped)
+			chunk = wrap_raw_frame(state, buffer);
+		else
+			chunk = buffer_from_mmal(state, buffer);
+		if (chunk == NULL)
+			ret = GST_FLOW_ERROR;
+		else if (buf)
+			buf = gst_buffer_append(buf, chunk);
+		else {
+			buf = chunk;
+			state->frame_timing = timing;
+			if (is_config)
+				GST_BUFFER_FLAG_SET(buf, GST_BUFFER_FLAG_HEADER);
+			else if (!is_sync_point(state, buffer->flags))
+				GST_BUFFER_FLAG_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+		}
+
+		/* A wrapped frame's header goes back when downstream frees it */
+		if (!wrapped
+		    && !recycle_output_buffer(state->encoder_output_port, state->encoder_pool, buffer))
+			ret = GST_FLOW_ERROR;
+
+		if (state->config->encoding == MMAL_ENCODING_MJPEG)
+			gather = !frame_end;
+		else
+			gather = want_vectors && !is_config;
+		if (!gather)
+			break;
+	}
+
+	/* Part of a frame is no use to anyone */
+	if (ret == GST_FLOW_FLUSHING && buf) {
+		gst_buffer_unref(buf);
+		buf = NULL;
+	}
+
+	if (buf && !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER)) {
+		attach_camera_settings(state, buf);
+		update_frame_settings(state);
+		if (!state->first_frame)
+			state->first_frame = raspiring_now();
+	}
+
+	check_exposure_lock(state);
+
+	*bufp = buf;
+
+	return ret;
+}
+
+/**
+ * Wait for the next buffer of a secondary stream.
+ *
+ * raspi_capture_set_aux_flushing() wakes the wait up to give up, and it
+ * also rechecks every ABORT_INTERVAL.
+ *
+ * @param state Pointer to state control struct
+ * @param stream Which secondary stream to read
+ * @param bufp Receives the H264 data or the packed raw frame
+ * @return GST_FLOW_OK, GST_FLOW_FLUSHING or GST_FLOW_ERROR
+ */
+GstFlowReturn raspi_capture_fill_aux_buffer(RASPIVID_STATE * state, RASPI_AUX_STREAM stream,
+					    GstBuffer ** bufp)
+{
+	AUX_OUTPUT *aux = &state->aux[stream];
+	GstBuffer *buf;
+	MMAL_BUFFER_HEADER_T *buffer = NULL;
+	GstFlowReturn ret = GST_FLOW_ERROR;
+
+	*bufp = NULL;
+	if (aux->pool == NULL)
+		return GST_FLOW_ERROR;
+
+	while (buffer == NULL) {
+		if (g_atomic_int_get(&aux->flushing))
+			return GST_FLOW_FLUSHING;
+		buffer = raspiring_wait(aux->ring, ABORT_INTERVAL, NULL);
+	}
+
+	mmal_buffer_header_mem_lock(buffer);
+	if (stream == RASPI_AUX_ANALYTICS) {
+		buf = NULL;
+		if (buffer->length >= GST_VIDEO_INFO_SIZE(&state->analytics_raw_info)) {
+			buf = gst_buffer_new_allocate(NULL,
+						      GST_VIDEO_INFO_SIZE(&state->analytics_packed_info),
+						      NULL);
+			if (buf)
+				pack_raw_frame(&state->analytics_raw_info,
+					       &state->analytics_packed_info, buffer->data, buf);
+		}
+	} else {
+		buf = gst_buffer_new_allocate(NULL, buffer->length, NULL);
+		if (buf)
+			gst_buffer_fill(buf, 0, buffer->data, buffer->length);
+	}
+	if (buf)
+		ret = GST_FLOW_OK;
+	mmal_buffer_header_mem_unlock(buffer);
+
+	*bufp = buf;
+
+	if (!recycle_output_buffer(aux->port, aux->pool, buffer))
+		ret = GST_FLOW_ERROR;
+
+	return ret;
+}
+
+/**
+ * Make raspi_capture_fill_buffer() return GST_FLOW_FLUSHING instead of
+ * waiting for the next frame, so the streaming thread can be unblocked.
+ * Safe from any thread.
+ *
+ * @param state Pointer to state control struct
+ * @param flushing TRUE to flush, FALSE to resume
+ */
+void raspi_capture_set_flushing(RASPIVID_STATE * state, gboolean flushing)
+{
+	g_atomic_int_set(&state->flushing, flushing);
+	if (flushing && state->encoded_ring && !raspiring_wake(state->encoded_ring))
+		RASPI_WARNING("Could not wake the streaming thread (%d)", errno);
+}
+
+/**
+ * Make raspi_capture_fill_aux_buffer() return GST_FLOW_FLUSHING instead of
+ * waiting, so the task reading that stream can be stopped
+ *
+ * @param state Pointer to state control struct
+ * @param stream Which secondary stream
+ * @param flushing TRUE to flush, FALSE to resume
+ */
+void raspi_capture_set_aux_flushing(RASPIVID_STATE * state, RASPI_AUX_STREAM stream,
+				    gboolean flushing)
+{
+	g_atomic_int_set(&state->aux[stream].flushing, flushing);
+	if (flushing && state->aux[stream].ring && !raspiring_wake(state->aux[stream].ring))
+		RASPI_WARNING("Could not wake the task of secondary stream %d (%d)", stream, errno);
+}
+
+/**
+ * How long exposure and gains took to settle after raspi_capture_start()
+ *
+ * @param state Pointer to state control struct
+ * @return Microseconds, 0 if they haven't settled yet
+ */
+gint64 raspi_capture_get_exposure_settle_time(RASPIVID_STATE * state)
+{
+	gint64 settle_time = 0;
+
+	g_mutex_lock(&state->settings_lock);
+	if (state->settled)
+		settle_time = state->settled - state->settle_start;
+	g_mutex_unlock(&state->settings_lock);
+
+	return settle_time;
+}
+
+/**
+ * How long after raspi_capture_start() the first frame was handed out,
+ * and how many sensor frames skipUntilSettled let go by before it. Call from the
+ * thread calling raspi_capture_fill_buffer().
+ *
+ * @param state Pointer to state control struct
+ * @param skipped Receives the frames skipped
+ * @return Microseconds, 0 before the first frame
+ */
+gint64 raspi_capture_get_first_frame_time(RASPIVID_STATE * state, guint64 * skipped)
+{
+	gint64 settle_start;
+
+	g_mutex_lock(&state->settings_lock);
+	settle_start = state->settle_start;
+	g_mutex_unlock(&state->settings_lock);
 
-			bytes_written = fwrite(buffer->data, 1, buffer->length, pData->file_handle);
-			printf
-			    ("\n buffer->data = %d, buffer->length = %d, pData->file_handle = %d\n",
-			     buffer->data, buffer->length, pData->file_handle);
+	*skipped = state->settle_skipped;
 
-			mmal_buffer_header_mem_unlock(buffer);
-		}
-		// We need to check we wrote what we wanted - it's possible we have run out of storage.
-		if (bytes_written != buffer->length) {
-			vcos_log_error("Unable to write buffer to file - aborting");
-			complete = 1;
-		}
-		// Now flag if we have completed
-		if (buffer->flags & (MMAL_BUFFER_HEADER_FLAG_FRAME_END |
-				     MMAL_BUFFER_HEADER_FLAG_TRANSMISSION_FAILED))
-			complete = 1;
-		if (!complete)
-			count++;
-	} else {
-		vcos_log_error("Received a encoder buffer callback with no state");
-	}
+	return state->first_frame ? state->first_frame - settle_start : 0;
+}
 
-	// release buffer back to the pool
-	mmal_buffer_header_release(buffer);
+/**
+ * How ROI transitions have been keeping up. Call from the thread calling
+ * raspi_capture_fill_buffer().
+ *
+ * @param state Pointer to state control struct
+ * @param latency Receives how long the camera took to take the last step
+ * @param jitter Receives how far the last step strayed from the frame clock
+ * @return Steps sent so far
+ */
+guint64 raspi_capture_get_roi_steps(RASPIVID_STATE * state, gint64 * latency, gint64 * jitter)
+{
+	*latency = state->roi_step_latency;
+	*jitter = state->roi_jitter;
 
-	// and send one back to the port (if still open)
-	if (port->is_enabled) {
-		MMAL_STATUS_T status = MMAL_SUCCESS;
-		MMAL_BUFFER_HEADER_T *new_buffer;
+	return state->roi_steps;
+}
 
-		new_buffer = mmal_queue_get(pData->state->encoder_capture_pool->queue);
+/**
+ * How the main stream's output buffers are spread out. Call from the
+ * thread calling raspi_capture_fill_buffer().
+ *
+ * @param state Pointer to state control struct
+ * @param ring_depth Receives the number of buffers waiting to be read
+ * @param pool_free Receives the number of buffers the encoder can fill
+ */
+void raspi_capture_get_queue_state(RASPIVID_STATE * state, guint * ring_depth, guint * pool_free)
+{
+	MMAL_POOL_T *pool = state->encoder_pool;
+	guint depth = raspiring_length(state->encoded_ring);
+	guint idle = depth + (state->held_buffer ? 1 : 0);
 
-		if (new_buffer) {
-			status = mmal_port_send_buffer(port, new_buffer);
-		}
-		if (!new_buffer || status != MMAL_SUCCESS)
-			vcos_log_error("Unable to return a buffer to the encoder port");
-	}
+	*ring_depth = depth;
+	*pool_free = 0;
+	if (pool == NULL)
+		return;
 
-	if (complete) {
-		//printf("\ncount = %d\n", count);
-		//puts("semaphore post");
-		vcos_semaphore_post(&(pData->complete_semaphore));
-	}
+	idle += mmal_queue_length(pool->queue);
+	*pool_free = pool->headers_num > idle ? pool->headers_num - idle : 0;
 }
 
 /**
- *  buffer header callback function for encoder
+ * Size of the buffers the main stream comes out of the encoder, or the
+ * camera for raw video, in. An encoded frame may span several of them.
  *
- *  Callback will dump buffer data to the specific file
- *
- * @param port Pointer to port from which callback originated
- * @param buffer mmal buffer header pointer
+ * @param state Pointer to state control struct
+ * @return Bytes per buffer
  */
-static void encoder_buffer_callback(MMAL_PORT_T * port, MMAL_BUFFER_HEADER_T * buffer)
+gsize raspi_capture_get_buffer_size(RASPIVID_STATE * state)
 {
-	//puts("encoder_buffer_callback");
-	PORT_USERDATA *pData = (PORT_USERDATA *) port->userdata;
-	RASPIVID_STATE *state = pData->state;
+	return state->encoder_output_port ? state->encoder_output_port->buffer_size : 0;
+}
 
-	if (pData == NULL) {
-		vcos_log_error("Received a encoder buffer callback with no state");
-		// release buffer back to the pool
-		mmal_buffer_header_release(buffer);
-		return;
-	}
+/**
+ * Timestamps of the frame raspi_capture_fill_buffer() returned last.
+ * The pushed time is left for the caller to fill in.
+ *
+ * @param state Pointer to state control struct
+ * @param record Receives the timestamps
+ */
+void raspi_capture_get_frame_timing(RASPIVID_STATE * state, RASPILATENCY_RECORD * record)
+{
+	*record = state->frame_timing;
+}
 
-	/* Send buffer to GStreamer element for pushing to the pipeline */
-	mmal_queue_put(state->encoded_buffer_q, buffer);
+/**
+ * Copy out how long buffers waited between the encoder callback and
+ * raspi_capture_fill_buffer(). Bucket n counts latencies needing n bits
+ * in microseconds, so bucket 0 is under 1us and bucket n is below 2^n us.
+ *
+ * @param state Pointer to state control struct
+ * @param buckets Receives RASPI_HANDOFF_BUCKETS counts
+ */
+void raspi_capture_get_handoff_histogram(RASPIVID_STATE * state, guint64 * buckets)
+{
+	memcpy(buckets, state->handoff_histogram, sizeof(state->handoff_histogram));
 }
 
-GstFlowReturn raspi_capture_fill_buffer(RASPIVID_STATE * state, GstBuffer ** bufp)
+/**
+ * Frames of the main stream dropped so far by the leaky policy
+ *
+ * @param state Pointer to state control struct
+ * @return Number of dropped frames
+ */
+guint64 raspi_capture_get_dropped_frames(RASPIVID_STATE * state)
 {
-	// puts("raspi_capture_fill_buffer");
-	GstBuffer *buf;
-	MMAL_BUFFER_HEADER_T *buffer;
-	GstFlowReturn ret = GST_FLOW_ERROR;
+	return state->dropped_frames;
+}
 
-	/* FIXME: Use our own interruptible cond wait: */
-	buffer = mmal_queue_wait(state->encoded_buffer_q);
+/**
+ * Change the encoder quantisation on the fly. Takes effect from the next
+ * encoded frame.
+ *
+ * @param state Pointer to state control struct
+ * @param qp Quantisation parameter, or 0 to go back to bitrate control
+ * @return TRUE if the encoder accepted the change
+ */
+gboolean raspi_capture_set_quantisation(RASPIVID_STATE * state, int qp)
+{
+	MMAL_PORT_T *encoder_output;
+	MMAL_STATUS_T status;
 
-	mmal_buffer_header_mem_lock(buffer);
-	buf = gst_buffer_new_allocate(NULL, buffer->length, NULL);
-	if (buf) {
-		gst_buffer_fill(buf, 0, buffer->data, buffer->length);
-		ret = GST_FLOW_OK;
+	if (!state->encoder_component)
+		return TRUE;
+
+	encoder_output = state->encoder_component->output[0];
+	/* With rate control the full range is allowed again */
+	status = mmal_port_parameter_set_uint32(encoder_output, MMAL_PARAMETER_VIDEO_ENCODE_MIN_QUANT,
+						qp ? qp : 1);
+	if (status == MMAL_SUCCESS)
+		status = mmal_port_parameter_set_uint32(encoder_output,
+							MMAL_PARAMETER_VIDEO_ENCODE_MAX_QUANT,
+							qp ? qp : 51);
+	RASPI_PROBE2(parameter_set, MMAL_PARAMETER_VIDEO_ENCODE_MIN_QUANT, status);
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("Unable to change quantisation");
+		return FALSE;
 	}
 
-	mmal_buffer_header_mem_unlock(buffer);
-
-	*bufp = buf;
-	// release buffer back to the pool
-	mmal_buffer_header_release(buffer);
+	return TRUE;
+}
 
-	// and send one back to the port (if still open)
-	if (state->encoder_output_port->is_enabled) {
-		MMAL_STATUS_T status = MMAL_SUCCESS;
+/**
+ * Change camera settings on the fly, sending only those that differ from
+ * what the camera was last given. Once exposureLock has fixed exposure,
+ * the settings left to the camera stay fixed. A new ROI is moved to over
+ * roiTransition, a step per frame. Streaming thread only.
+ *
+ * @param state Pointer to state control struct
+ * @param params New camera settings
+ * @return TRUE if the camera accepted every change
+ */
+gboolean raspi_capture_update_camera_parameters(RASPIVID_STATE * state,
+						const RASPICAM_CAMERA_PARAMETERS * params)
+{
+	RASPICAM_CAMERA_PARAMETERS wanted = *params;
+	int result;
+
+	if (!state->camera_component)
+		return TRUE;
+
+	g_mutex_lock(&state->parameter_lock);
+	apply_exposure_lock(state, &wanted);
+	set_annotation(state, params);
+	expand_annotation(state, &wanted);
+	set_roi_target(state, params->roi);
+	if (state->roi_moving)
+		wanted.roi = state->camera_parameter_cache.applied.roi;
+	result = raspicamcontrol_apply_parameters(state->camera_component,
+						  &state->camera_parameter_cache, &wanted);
+	g_mutex_unlock(&state->parameter_lock);
+
+	return result == 0;
+}
 
-		buffer = mmal_queue_get(state->encoder_pool->queue);
-		if (buffer)
-			status = mmal_port_send_buffer(state->encoder_output_port, buffer);
+/**
+ * Get the camera settings in effect, as the camera reports them. Only
+ * settings that changed since the last call are read from the camera.
+ *
+ * @param state Pointer to state control struct
+ * @param params Receives the settings
+ * @return FALSE if there is no camera to ask
+ */
+gboolean raspi_capture_get_camera_parameters(RASPIVID_STATE * state,
+					     RASPICAM_CAMERA_PARAMETERS * params)
+{
+	if (!state->camera_component)
+		return FALSE;
 
-		if (!buffer || status != MMAL_SUCCESS) {
-			vcos_log_error("Unable to return a buffer to the encoder port");
-			ret = GST_FLOW_ERROR;
-		}
-	}
+	g_mutex_lock(&state->parameter_lock);
+	raspicamcontrol_read_parameters(state->camera_component, &state->camera_parameter_cache,
+					params);
+	/* The camera has the annotation expanded, give back what was asked for */
+	params->enable_annotate = state->annotate_flags;
+	g_strlcpy(params->annotate_string, state->annotate_text, sizeof(params->annotate_string));
+	params->annotate_text_size = state->annotate_text_size;
+	g_mutex_unlock(&state->parameter_lock);
 
-	return ret;
+	return TRUE;
 }
 
 /**
@@ -421,7 +1836,7 @@ GstFlowReturn raspi_capture_fill_buffer(RASPIVID_STATE * state, GstBuffer ** buf
  */
 static MMAL_STATUS_T create_camera_component(RASPIVID_STATE * state)
 {
-	puts("create_camera_component");
+	RASPI_DEBUG("Creating camera component");
 	MMAL_COMPONENT_T *camera = NULL;
 	MMAL_STATUS_T status;
 
@@ -433,12 +1848,24 @@ static MMAL_STATUS_T create_camera_component(RASPIVID_STATE * state)
 		goto error;
 	}
 
+	/* Pick the sensor before anything else is configured */
+	MMAL_PARAMETER_INT32_T camera_num =
+	    { {MMAL_PARAMETER_CAMERA_NUM, sizeof(camera_num)}, state->config->cameraNum };
+
+	status = mmal_port_parameter_set(camera->control, &camera_num.hdr);
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("Could not select camera %d : error %d", state->config->cameraNum,
+			       status);
+		goto error;
+	}
+
 	if (!camera->output_num) {
 		status = MMAL_ENOSYS;
 		vcos_log_error("Camera doesn't have output ports");
 		goto error;
 	}
 	// Enable the camera, and tell it its control callback function
+	camera->control->userdata = (struct MMAL_PORT_USERDATA_T *)state;
 	status = mmal_port_enable(camera->control, camera_control_callback);
 
 	if (status != MMAL_SUCCESS) {
@@ -446,6 +1873,19 @@ static MMAL_STATUS_T create_camera_component(RASPIVID_STATE * state)
 		goto error;
 	}
 
+	raspicamcontrol_request_change_events(camera);
+
+	/* Exposure and gains the control loops chose, for each frame */
+	MMAL_PARAMETER_CHANGE_EVENT_REQUEST_T change_event_request =
+	    { {MMAL_PARAMETER_CHANGE_EVENT_REQUEST, sizeof(change_event_request)},
+	MMAL_PARAMETER_CAMERA_SETTINGS, 1
+	};
+
+	status = mmal_port_parameter_set(camera->control, &change_event_request.hdr);
+	if (status != MMAL_SUCCESS)
+		vcos_log_error("No camera settings events : error %d", status);
+	status = MMAL_SUCCESS;
+
 	state->camera_component = camera;
 
 	return status;
@@ -459,16 +1899,16 @@ static MMAL_STATUS_T create_camera_component(RASPIVID_STATE * state)
 
 MMAL_STATUS_T raspi_capture_set_format_and_start(RASPIVID_STATE * state)
 {
-	puts("raspi_capture_set_format_and_start");
+	RASPI_DEBUG("Setting the camera format and starting it");
 	MMAL_COMPONENT_T *camera = NULL;
 	MMAL_STATUS_T status;
 	MMAL_ES_FORMAT_T *format;
 	MMAL_PORT_T *preview_port = NULL, *video_port = NULL, *still_port = NULL;
+	RASPICAM_CAMERA_PARAMETERS wanted;
 
 	//  set up the camera configuration
 
-	printf("\nstate->config->width = %d\n"
-	       "state->config->height = %d\n", state->config->width, state->config->height);
+	RASPI_DEBUG("Camera configured for %dx%d", state->config->width, state->config->height);
 
 	MMAL_PARAMETER_CAMERA_CONFIG_T cam_config = {
 		{MMAL_PARAMETER_CAMERA_CONFIG, sizeof(cam_config)}
@@ -482,7 +1922,8 @@ MMAL_STATUS_T raspi_capture_set_format_and_start(RASPIVID_STATE * state)
 		.num_preview_video_frames = 3,
 		.stills_capture_circular_buffer_height = 0,
 		.fast_preview_resume = 0,
-		.use_stc_timestamp = MMAL_PARAM_TIMESTAMP_MODE_RESET_STC
+		/* Raw, so buffer pts share MMAL_PARAMETER_SYSTEM_TIME's base */
+		.use_stc_timestamp = MMAL_PARAM_TIMESTAMP_MODE_RAW_STC
 	};
 
 	camera = state->camera_component;
@@ -499,16 +1940,29 @@ MMAL_STATUS_T raspi_capture_set_format_and_start(RASPIVID_STATE * state)
 
 	format = preview_port->format;
 
-	format->encoding = MMAL_ENCODING_OPAQUE;
-	format->encoding_variant = MMAL_ENCODING_I420;
-
-	format->encoding = MMAL_ENCODING_OPAQUE;
-	format->es->video.width = state->config->width;
-	format->es->video.height = state->config->height;
-	format->es->video.crop.x = 0;
-	format->es->video.crop.y = 0;
-	format->es->video.crop.width = state->config->width;
-	format->es->video.crop.height = state->config->height;
+	if (analytics_wanted(state)) {
+		// Nothing displays the preview, so have the ISP scale it down for analytics
+		RASPIVID_ANALYTICS_CONFIG *analytics = &state->config->analytics;
+
+		format->encoding = MMAL_ENCODING_I420;
+		format->encoding_variant = 0;
+		format->es->video.width = VCOS_ALIGN_UP(analytics->width, 32);
+		format->es->video.height = VCOS_ALIGN_UP(analytics->height, 16);
+		format->es->video.crop.x = 0;
+		format->es->video.crop.y = 0;
+		format->es->video.crop.width = analytics->width;
+		format->es->video.crop.height = analytics->height;
+	} else {
+		format->encoding = MMAL_ENCODING_OPAQUE;
+		format->encoding_variant = MMAL_ENCODING_I420;
+
+		format->es->video.width = state->config->width;
+		format->es->video.height = state->config->height;
+		format->es->video.crop.x = 0;
+		format->es->video.crop.y = 0;
+		format->es->video.crop.width = state->config->width;
+		format->es->video.crop.height = state->config->height;
+	}
 	format->es->video.frame_rate.num = state->config->fps_n;
 	format->es->video.frame_rate.den = state->config->fps_d;
 
@@ -518,11 +1972,19 @@ MMAL_STATUS_T raspi_capture_set_format_and_start(RASPIVID_STATE * state)
 	// Set the encode format on the video  port
 
 	format = video_port->format;
-	format->encoding_variant = MMAL_ENCODING_I420;
+	if (state->raw_format != GST_VIDEO_FORMAT_UNKNOWN) {
+		// Raw frames go straight to GStreamer, padded the way the ISP writes them
+		format->encoding = state->config->encoding;
+		format->encoding_variant = 0;
+		format->es->video.width = VCOS_ALIGN_UP(state->config->width, 32);
+		format->es->video.height = VCOS_ALIGN_UP(state->config->height, 16);
+	} else {
+		format->encoding_variant = MMAL_ENCODING_I420;
 
-	format->encoding = MMAL_ENCODING_OPAQUE;
-	format->es->video.width = state->config->width;
-	format->es->video.height = state->config->height;
+		format->encoding = MMAL_ENCODING_OPAQUE;
+		format->es->video.width = state->config->width;
+		format->es->video.height = state->config->height;
+	}
 	format->es->video.crop.x = 0;
 	format->es->video.crop.y = 0;
 	format->es->video.crop.width = state->config->width;
@@ -562,10 +2024,17 @@ MMAL_STATUS_T raspi_capture_set_format_and_start(RASPIVID_STATE * state)
 	status = mmal_component_enable(camera);
 	vcos_assert(status == MMAL_SUCCESS);
 
-	raspicamcontrol_set_all_parameters(camera, &state->config->camera_parameters);
+	/* A new camera starts out on the defaults, so only the differences need sending */
+	raspicamcontrol_cache_assume_defaults(&state->camera_parameter_cache);
+	wanted = state->config->camera_parameters;
+	set_annotation(state, &wanted);
+	expand_annotation(state, &wanted);
+	state->roi_target = wanted.roi;
+	state->roi_moving = FALSE;
+	raspicamcontrol_apply_parameters(camera, &state->camera_parameter_cache, &wanted);
 
 	if (state->config->verbose)
-		fprintf(stderr, "Camera component done\n");
+		RASPI_DEBUG("Camera component done");
 
  error:
 	return status;
@@ -689,7 +2158,7 @@ static MMAL_STATUS_T create_encoder_capture_component(RASPIVID_STATE * state)
 	state->encoder_capture_component = encoder;
 
 	if (state->config->verbose)
-		fprintf(stderr, "Encoder component done\n");
+		RASPI_DEBUG("Encoder component done");
 
 	return status;
 
@@ -712,6 +2181,7 @@ static void destroy_encoder_captureimage_component(RASPIVID_STATE * state)
 	// Get rid of any port buffers first
 	if (state->encoder_capture_pool) {
 		mmal_port_pool_destroy(state->encoder_capture_component->output[0], state->encoder_capture_pool);
+		state->encoder_capture_pool = NULL;
 	}
 
 	if (state->encoder_capture_component) {
@@ -721,16 +2191,36 @@ static void destroy_encoder_captureimage_component(RASPIVID_STATE * state)
 }
 
 /**
- * Create the encoder component, set up its ports
+ * Settings for one video encoder instance, so the main and the simulcast
+ * encoders can share the setup code
+ */
+typedef struct {
+	MMAL_FOURCC_T encoding;	/// H264 or MJPEG
+	int bitrate;		/// Target bitrate, ignored when quantisationParameter is set
+	int intraperiod;	/// Key frame interval, 0 for the encoder default
+	int profile;		/// H264 profile
+	int quantisationParameter;	/// Fixed QP, or 0 for bitrate control
+	int inlineVectors;	/// Follow each H264 frame with its motion vectors
+} ENCODER_SETTINGS;
+
+/**
+ * Create a video encoder component, set up its ports and output pool
  *
  * @param state Pointer to state control struct
+ * @param settings Encoder configuration
+ * @param input_format Format to commit on the encoder input, or NULL to
+ *                     leave it to the connection
+ * @param encoder_out Receives the created component
+ * @param pool_out Receives the output port buffer pool
  *
  * @return MMAL_SUCCESS if all OK, something else otherwise
  *
  */
-static MMAL_STATUS_T create_encoder_component(RASPIVID_STATE * state)
+static MMAL_STATUS_T create_video_encoder(RASPIVID_STATE * state,
+					  const ENCODER_SETTINGS * settings,
+					  MMAL_ES_FORMAT_T * input_format,
+					  MMAL_COMPONENT_T ** encoder_out, MMAL_POOL_T ** pool_out)
 {
-	puts("create_encoder_component");
 	MMAL_COMPONENT_T *encoder = 0;
 	MMAL_PORT_T *encoder_input = NULL, *encoder_output = NULL;
 	MMAL_STATUS_T status;
@@ -752,13 +2242,26 @@ static MMAL_STATUS_T create_encoder_component(RASPIVID_STATE * state)
 	encoder_input = encoder->input[0];
 	encoder_output = encoder->output[0];
 
+	if (input_format) {
+		mmal_format_copy(encoder_input->format, input_format);
+		status = mmal_port_format_commit(encoder_input);
+		if (status != MMAL_SUCCESS) {
+			vcos_log_error("Unable to set format on video encoder input port");
+			goto error;
+		}
+	}
+
 	// We want same format on input and output
 	mmal_format_copy(encoder_output->format, encoder_input->format);
 
-	// Only supporting H264 at the moment
-	encoder_output->format->encoding = MMAL_ENCODING_H264;
+	// H264, or MJPEG for intra-only streams
+	encoder_output->format->encoding = settings->encoding;
 
-	encoder_output->format->bitrate = state->config->bitrate;
+	// A fixed quantisation replaces rate control
+	if (settings->quantisationParameter)
+		encoder_output->format->bitrate = 0;
+	else
+		encoder_output->format->bitrate = settings->bitrate;
 
 	encoder_output->buffer_size = encoder_output->buffer_size_recommended;
 
@@ -793,9 +2296,35 @@ static MMAL_STATUS_T create_encoder_component(RASPIVID_STATE * state)
 
 	}
 
-	if (state->config->intraperiod) {
+	if (settings->quantisationParameter) {
+		MMAL_PARAMETER_UINT32_T param = {
+			{MMAL_PARAMETER_VIDEO_ENCODE_INITIAL_QUANT, sizeof(param)}
+			, settings->quantisationParameter
+		};
+		status = mmal_port_parameter_set(encoder_output, &param.hdr);
+		if (status != MMAL_SUCCESS) {
+			vcos_log_error("Unable to set initial QP");
+			goto error;
+		}
+
+		param.hdr.id = MMAL_PARAMETER_VIDEO_ENCODE_MIN_QUANT;
+		status = mmal_port_parameter_set(encoder_output, &param.hdr);
+		if (status != MMAL_SUCCESS) {
+			vcos_log_error("Unable to set min QP");
+			goto error;
+		}
+
+		param.hdr.id = MMAL_PARAMETER_VIDEO_ENCODE_MAX_QUANT;
+		status = mmal_port_parameter_set(encoder_output, &param.hdr);
+		if (status != MMAL_SUCCESS) {
+			vcos_log_error("Unable to set max QP");
+			goto error;
+		}
+	}
+
+	if (settings->encoding == MMAL_ENCODING_H264 && settings->intraperiod) {
 		MMAL_PARAMETER_UINT32_T param = { {MMAL_PARAMETER_INTRAPERIOD, sizeof(param)}
-		, state->config->intraperiod
+		, settings->intraperiod
 		};
 		status = mmal_port_parameter_set(encoder_output, &param.hdr);
 		if (status != MMAL_SUCCESS) {
@@ -805,59 +2334,311 @@ static MMAL_STATUS_T create_encoder_component(RASPIVID_STATE * state)
 
 	}
 
-	{
+	if (settings->encoding == MMAL_ENCODING_H264) {
 		MMAL_PARAMETER_VIDEO_PROFILE_T param;
 		param.hdr.id = MMAL_PARAMETER_PROFILE;
 		param.hdr.size = sizeof(param);
 
-		param.profile[0].profile = state->config->profile;
+		param.profile[0].profile = settings->profile;
 		param.profile[0].level = MMAL_VIDEO_LEVEL_H264_4;	// This is the only value supported
 
 		status = mmal_port_parameter_set(encoder_output, &param.hdr);
 		if (status != MMAL_SUCCESS) {
-			vcos_log_error("Unable to set H264 profile");
+			vcos_log_error("Unable to set H264 profile");
+			goto error;
+		}
+	}
+
+	if (settings->encoding == MMAL_ENCODING_H264 && settings->inlineVectors) {
+		status = mmal_port_parameter_set_boolean(encoder_output,
+							 MMAL_PARAMETER_VIDEO_ENCODE_INLINE_VECTORS,
+							 1);
+		if (status != MMAL_SUCCESS) {
+			vcos_log_error("Unable to enable inline motion vectors");
+			goto error;
+		}
+	}
+
+	if (mmal_port_parameter_set_boolean
+	    (encoder_input, MMAL_PARAMETER_VIDEO_IMMUTABLE_INPUT,
+	     state->config->immutableInput) != MMAL_SUCCESS) {
+		vcos_log_error("Unable to set immutable input flag");
+		// Continue rather than abort..
+	}
+	//  Enable component
+	status = mmal_component_enable(encoder);
+
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("Unable to enable video encoder component");
+		goto error;
+	}
+
+	/* Create pool of buffer headers for the output port to consume */
+	pool =
+	    mmal_port_pool_create(encoder_output, encoder_output->buffer_num,
+				  encoder_output->buffer_size);
+	if (!pool) {
+		vcos_log_error("Failed to create buffer header pool for encoder output port %s",
+			       encoder_output->name);
+	}
+
+	*pool_out = pool;
+	*encoder_out = encoder;
+
+	return status;
+
+ error:
+	if (encoder)
+		mmal_component_destroy(encoder);
+
+	return status;
+}
+
+/**
+ * Create the encoder component, set up its ports
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ *
+ */
+static MMAL_STATUS_T create_encoder_component(RASPIVID_STATE * state)
+{
+	RASPI_DEBUG("Creating encoder component");
+	ENCODER_SETTINGS settings = {
+		.encoding = state->config->encoding,
+		.bitrate = state->config->bitrate,
+		.intraperiod = state->config->intraperiod,
+		.profile = state->config->profile,
+		.quantisationParameter = state->config->quantisationParameter,
+		.inlineVectors = inline_vectors_wanted(state)
+	};
+	MMAL_STATUS_T status;
+
+	status = create_video_encoder(state, &settings, NULL,
+				      &state->encoder_component, &state->encoder_pool);
+	if (status != MMAL_SUCCESS)
+		return status;
+
+	state->encoder_output_port = state->encoder_component->output[0];
+
+	if (state->config->verbose)
+		RASPI_DEBUG("Encoder component done");
+
+	return status;
+}
+
+/**
+ * Create the simulcast chain: a splitter on the camera video port, with
+ * output 0 feeding the main encoder and output 1 going through the ISP
+ * resizer into a second H264 encoder at the substream size.
+ *
+ * Must be called once the camera video port format has been committed.
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ */
+static MMAL_STATUS_T create_substream_components(RASPIVID_STATE * state)
+{
+	RASPIVID_SUBSTREAM_CONFIG *sub = &state->config->substream;
+	ENCODER_SETTINGS settings = {
+		.encoding = MMAL_ENCODING_H264,
+		.bitrate = sub->bitrate,
+		.intraperiod = sub->intraperiod,
+		.profile = sub->profile,
+		.quantisationParameter = 0
+	};
+	MMAL_COMPONENT_T *splitter = NULL, *resizer = NULL;
+	MMAL_PORT_T *camera_video_port = state->camera_component->output[MMAL_CAMERA_VIDEO_PORT];
+	MMAL_ES_FORMAT_T *format;
+	MMAL_STATUS_T status;
+	int i;
+
+	/* Splitter, passing the camera format through to both outputs */
+	status = mmal_component_create(MMAL_COMPONENT_DEFAULT_VIDEO_SPLITTER, &splitter);
+	if (status != MMAL_SUCCESS || splitter->output_num < 2) {
+		vcos_log_error("Unable to create video splitter component");
+		goto error;
+	}
+
+	mmal_format_copy(splitter->input[0]->format, camera_video_port->format);
+	splitter->input[0]->buffer_num = VIDEO_OUTPUT_BUFFERS_NUM;
+	status = mmal_port_format_commit(splitter->input[0]);
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("Unable to set format on splitter input port");
+		goto error;
+	}
+
+	for (i = 0; i < 2; i++) {
+		format = splitter->output[i]->format;
+		mmal_format_copy(format, splitter->input[0]->format);
+		/* The resizer can't take opaque buffers, so unpack for it */
+		if (i == 1) {
+			format->encoding = MMAL_ENCODING_I420;
+			format->encoding_variant = MMAL_ENCODING_I420;
+		}
+		status = mmal_port_format_commit(splitter->output[i]);
+		if (status != MMAL_SUCCESS) {
+			vcos_log_error("Unable to set format on splitter output port %d", i);
 			goto error;
 		}
 	}
 
-	if (mmal_port_parameter_set_boolean
-	    (encoder_input, MMAL_PARAMETER_VIDEO_IMMUTABLE_INPUT,
-	     state->config->immutableInput) != MMAL_SUCCESS) {
-		vcos_log_error("Unable to set immutable input flag");
-		// Continue rather than abort..
+	status = mmal_component_enable(splitter);
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("Unable to enable splitter component");
+		goto error;
+	}
+
+	/* ISP resizer, scaling splitter output 1 down to the substream size */
+	status = mmal_component_create("vc.ril.resize", &resizer);
+	if (status != MMAL_SUCCESS || !resizer->input_num || !resizer->output_num) {
+		vcos_log_error("Unable to create resizer component");
+		goto error;
 	}
-	//  Enable component
-	status = mmal_component_enable(encoder);
 
+	mmal_format_copy(resizer->input[0]->format, splitter->output[1]->format);
+	status = mmal_port_format_commit(resizer->input[0]);
 	if (status != MMAL_SUCCESS) {
-		vcos_log_error("Unable to enable video encoder component");
+		vcos_log_error("Unable to set format on resizer input port");
 		goto error;
 	}
 
-	/* Create pool of buffer headers for the output port to consume */
-	pool =
-	    mmal_port_pool_create(encoder_output, encoder_output->buffer_num,
-				  encoder_output->buffer_size);
-	if (!pool) {
-		vcos_log_error("Failed to create buffer header pool for encoder output port %s",
-			       encoder_output->name);
+	format = resizer->output[0]->format;
+	mmal_format_copy(format, resizer->input[0]->format);
+	format->es->video.width = VCOS_ALIGN_UP(sub->width, 32);
+	format->es->video.height = VCOS_ALIGN_UP(sub->height, 16);
+	format->es->video.crop.x = 0;
+	format->es->video.crop.y = 0;
+	format->es->video.crop.width = sub->width;
+	format->es->video.crop.height = sub->height;
+	status = mmal_port_format_commit(resizer->output[0]);
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("Unable to set format on resizer output port");
+		goto error;
+	}
+
+	status = mmal_component_enable(resizer);
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("Unable to enable resizer component");
+		goto error;
 	}
 
-	state->encoder_pool = pool;
-	state->encoder_component = encoder;
+	status = create_video_encoder(state, &settings, resizer->output[0]->format,
+				      &state->sub_encoder_component,
+				      &state->aux[RASPI_AUX_SUBSTREAM].pool);
+	if (status != MMAL_SUCCESS)
+		goto error;
+
+	state->splitter_component = splitter;
+	state->resizer_component = resizer;
+	state->aux[RASPI_AUX_SUBSTREAM].port = state->sub_encoder_component->output[0];
 
 	if (state->config->verbose)
-		fprintf(stderr, "Encoder component done\n");
+		RASPI_DEBUG("Substream components done");
 
-	return status;
+	return MMAL_SUCCESS;
 
  error:
-	if (encoder)
-		mmal_component_destroy(encoder);
+	if (status == MMAL_SUCCESS)
+		status = MMAL_ENOSYS;
+	if (resizer)
+		mmal_component_destroy(resizer);
+	if (splitter)
+		mmal_component_destroy(splitter);
 
 	return status;
 }
 
+/**
+ * Hand back any queued buffers of a secondary stream and destroy its pool
+ *
+ * @param state Pointer to state control struct
+ * @param stream Which secondary stream
+ */
+static void destroy_aux_pool(RASPIVID_STATE * state, RASPI_AUX_STREAM stream)
+{
+	AUX_OUTPUT *aux = &state->aux[stream];
+
+	if (aux->ring) {
+		MMAL_BUFFER_HEADER_T *buffer;
+
+		while ((buffer = raspiring_pop(aux->ring, NULL)))
+			mmal_buffer_header_release(buffer);
+	}
+
+	if (aux->pool) {
+		mmal_port_pool_destroy(aux->port, aux->pool);
+		aux->pool = NULL;
+	}
+}
+
+/**
+ * Create the buffer pool that turns the camera preview port into the
+ * analytics stream. The port format was set up by
+ * raspi_capture_set_format_and_start().
+ *
+ * @param state Pointer to state control struct
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ */
+static MMAL_STATUS_T create_analytics_pool(RASPIVID_STATE * state)
+{
+	RASPIVID_ANALYTICS_CONFIG *analytics = &state->config->analytics;
+	MMAL_PORT_T *preview_port = state->camera_component->output[MMAL_CAMERA_PREVIEW_PORT];
+	AUX_OUTPUT *aux = &state->aux[RASPI_AUX_ANALYTICS];
+
+	setup_raw_layout(GST_VIDEO_FORMAT_I420, MMAL_ENCODING_I420,
+			 analytics->width, analytics->height,
+			 &state->analytics_raw_info, &state->analytics_packed_info);
+	if (analytics->grayscale)
+		gst_video_info_set_format(&state->analytics_packed_info, GST_VIDEO_FORMAT_GRAY8,
+					  analytics->width, analytics->height);
+
+	preview_port->buffer_size = preview_port->buffer_size_recommended;
+	if (preview_port->buffer_size < preview_port->buffer_size_min)
+		preview_port->buffer_size = preview_port->buffer_size_min;
+	if (preview_port->buffer_num < preview_port->buffer_num_recommended)
+		preview_port->buffer_num = preview_port->buffer_num_recommended;
+
+	aux->pool = mmal_port_pool_create(preview_port, preview_port->buffer_num,
+					  preview_port->buffer_size);
+	if (!aux->pool) {
+		vcos_log_error("Failed to create buffer header pool for camera preview port %s",
+			       preview_port->name);
+		return MMAL_ENOMEM;
+	}
+	aux->port = preview_port;
+
+	return MMAL_SUCCESS;
+}
+
+/**
+ * Destroy the simulcast splitter, resizer and encoder
+ *
+ * @param state Pointer to state control struct
+ *
+ */
+static void destroy_substream_components(RASPIVID_STATE * state)
+{
+	destroy_aux_pool(state, RASPI_AUX_SUBSTREAM);
+
+	if (state->sub_encoder_component) {
+		mmal_component_destroy(state->sub_encoder_component);
+		state->sub_encoder_component = NULL;
+	}
+
+	if (state->resizer_component) {
+		mmal_component_destroy(state->resizer_component);
+		state->resizer_component = NULL;
+	}
+
+	if (state->splitter_component) {
+		mmal_component_destroy(state->splitter_component);
+		state->splitter_component = NULL;
+	}
+}
+
 /**
  * Destroy the encoder component
  *
@@ -866,16 +2647,31 @@ static MMAL_STATUS_T create_encoder_component(RASPIVID_STATE * state)
  */
 static void destroy_encoder_component(RASPIVID_STATE * state)
 {
-	/* Empty the buffer header q */
-	while (mmal_queue_length(state->encoded_buffer_q)) {
-		MMAL_BUFFER_HEADER_T *buffer = mmal_queue_get(state->encoded_buffer_q);
-		mmal_buffer_header_release(buffer);
+	if (state->held_buffer) {
+		mmal_buffer_header_release(state->held_buffer);
+		state->held_buffer = NULL;
+	}
+
+	/* Empty the buffer header ring */
+	if (state->encoded_ring) {
+		MMAL_BUFFER_HEADER_T *buffer;
+
+		while ((buffer = raspiring_pop(state->encoded_ring, NULL)))
+			mmal_buffer_header_release(buffer);
+		raspiring_destroy(state->encoded_ring);
+		state->encoded_ring = NULL;
 	}
-	mmal_queue_destroy(state->encoded_buffer_q);
 
 	// Get rid of any port buffers first
-	if (state->encoder_pool) {
-		mmal_port_pool_destroy(state->encoder_component->output[0], state->encoder_pool);
+	if (state->raw_pool) {
+		/* Frames still downstream keep the pool until they are freed */
+		g_atomic_int_set(&state->raw_pool->active, 0);
+		raw_pool_unref(state->raw_pool);
+		state->raw_pool = NULL;
+		state->encoder_pool = NULL;
+	} else if (state->encoder_pool) {
+		mmal_port_pool_destroy(state->encoder_output_port, state->encoder_pool);
+		state->encoder_pool = NULL;
 	}
 
 	if (state->encoder_component) {
@@ -884,6 +2680,48 @@ static void destroy_encoder_component(RASPIVID_STATE * state)
 	}
 }
 
+/**
+ * Create the buffer pool for raw output straight from the camera video port,
+ * used in place of the encoder when raw caps are negotiated
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ */
+static MMAL_STATUS_T create_raw_video_pool(RASPIVID_STATE * state)
+{
+	MMAL_PORT_T *video_port = state->camera_component->output[MMAL_CAMERA_VIDEO_PORT];
+
+	video_port->buffer_size = video_port->buffer_size_recommended;
+	if (video_port->buffer_size < video_port->buffer_size_min)
+		video_port->buffer_size = video_port->buffer_size_min;
+
+	if (video_port->buffer_num < RAW_OUTPUT_BUFFERS_NUM)
+		video_port->buffer_num = RAW_OUTPUT_BUFFERS_NUM;
+
+	GST_DEBUG("raw video buffer size is %u", (guint) video_port->buffer_size);
+
+	state->encoder_pool =
+	    mmal_port_pool_create(video_port, video_port->buffer_num, video_port->buffer_size);
+	if (!state->encoder_pool) {
+		vcos_log_error("Failed to create buffer header pool for camera video port %s",
+			       video_port->name);
+		return MMAL_ENOMEM;
+	}
+
+	/* Wrapped frames may outlive the state, so the pool holds the camera */
+	state->raw_pool = g_new0(RAW_POOL, 1);
+	state->raw_pool->refs = 1;
+	state->raw_pool->active = 1;
+	state->raw_pool->port = video_port;
+	state->raw_pool->pool = state->encoder_pool;
+	mmal_component_acquire(state->camera_component);
+
+	state->encoder_output_port = video_port;
+
+	return MMAL_SUCCESS;
+}
+
 
 /**
  * Connect two specific ports together
@@ -913,6 +2751,26 @@ static MMAL_STATUS_T connect_ports(MMAL_PORT_T * output_port, MMAL_PORT_T * inpu
 	return status;
 }
 
+/**
+ * Send all the buffers of a pool to an output port
+ *
+ * @param port Output port to feed
+ * @param pool Pool created for that port
+ */
+static void send_pool_buffers(MMAL_PORT_T * port, MMAL_POOL_T * pool)
+{
+	int num = mmal_queue_length(pool->queue);
+	int q;
+
+	for (q = 0; q < num; q++) {
+		MMAL_BUFFER_HEADER_T *buffer = mmal_queue_get(pool->queue);
+		if (!buffer)
+			vcos_log_error("Unable to get a required buffer %d from pool queue", q);
+		if (mmal_port_send_buffer(port, buffer) != MMAL_SUCCESS)
+			vcos_log_error("Unable to send a buffer to output port %s (%d)", port->name, q);
+	}
+}
+
 /**
  * Checks if specified port is valid and enabled, then disables it
  *
@@ -992,21 +2850,23 @@ static MMAL_STATUS_T add_exif_tag(RASPIVID_STATE * state, const char *exif_tag)
 static void add_exif_tags(RASPIVID_STATE * state)
 {
 	time_t rawtime;
-	struct tm *timeinfo;
+	struct tm timeinfo;
 	char time_buf[32];
 	char exif_buf[128];
+	GstRpiCamSettings settings;
 	int i;
 
 	add_exif_tag(state, "IFD0.Model=RP_OV5647");
 	add_exif_tag(state, "IFD0.Make=RaspberryPi");
 
+	/* Stills can be taken on several cameras at once */
 	time(&rawtime);
-	timeinfo = localtime(&rawtime);
+	localtime_r(&rawtime, &timeinfo);
 
 	snprintf(time_buf, sizeof(time_buf),
 		 "%04d:%02d:%02d %02d:%02d:%02d",
-		 timeinfo->tm_year + 1900, timeinfo->tm_mon + 1, timeinfo->tm_mday,
-		 timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+		 timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
+		 timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
 
 	snprintf(exif_buf, sizeof(exif_buf), "EXIF.DateTimeDigitized=%s", time_buf);
 	add_exif_tag(state, exif_buf);
@@ -1017,6 +2877,23 @@ static void add_exif_tags(RASPIVID_STATE * state)
 	snprintf(exif_buf, sizeof(exif_buf), "IFD0.DateTime=%s", time_buf);
 	add_exif_tag(state, exif_buf);
 
+	/* The still is taken with the settings of the latest frame */
+	if (find_camera_settings(state, 0, &settings)) {
+		snprintf(exif_buf, sizeof(exif_buf), "EXIF.ExposureTime=%u/1000000",
+			 settings.exposure_time);
+		add_exif_tag(state, exif_buf);
+
+		snprintf(exif_buf, sizeof(exif_buf), "EXIF.ISOSpeedRatings=%u",
+			 (guint) (settings.analog_gain * settings.digital_gain * 100 + 0.5));
+		add_exif_tag(state, exif_buf);
+
+		snprintf(exif_buf, sizeof(exif_buf),
+			 "EXIF.UserComment=analog_gain=%.3f digital_gain=%.3f"
+			 " awb_red_gain=%.3f awb_blue_gain=%.3f", settings.analog_gain,
+			 settings.digital_gain, settings.awb_red_gain, settings.awb_blue_gain);
+		add_exif_tag(state, exif_buf);
+	}
+
 	// Now send any user supplied tags
 
 	for (i = 0; i < state->numExifTags && i < MAX_USER_EXIF_TAGS; i++) {
@@ -1055,7 +2932,10 @@ MMAL_STATUS_T create_filenames(char **finalName, char **tempName, char *pattern,
 /**
  * raspi_capture_image:
  *
- * Capture image and save as jpeg format
+ * Capture image and save as jpeg format. Gives up if the encoder hasn't
+ * finished the image after STILL_TIMEOUT.
+ *
+ * @return TRUE if the image was written
  */
 gboolean raspi_capture_image(RASPIVID_STATE * state, const char *filename)
 {
@@ -1064,169 +2944,195 @@ gboolean raspi_capture_image(RASPIVID_STATE * state, const char *filename)
 	char *use_filename = NULL;	// Temporary filename while image being written
 	char *final_filename = NULL;	// Name that file gets once writing complete
 	MMAL_STATUS_T status = MMAL_SUCCESS;
-	VCOS_STATUS_T vcos_status;
-
-	/* Stop encoder of video h264 */
-	//status = mmal_port_disable(state->encoder_output_port);
-	//mmal_port_parameter_set_boolean(state->camera_video_port, MMAL_PARAMETER_CAPTURE, 0);
+	gboolean written = FALSE;
+	int num, q;
 
 	/* Open the file */
 	if (filename) {
-		vcos_assert(use_filename == NULL && final_filename == NULL);
-
 		/* Create file name */
-		status = create_filenames(&final_filename, &use_filename, filename, frame);
+		status = create_filenames(&final_filename, &use_filename, (char *)filename, frame);
 
 		if (status != MMAL_SUCCESS) {
 			vcos_log_error("Unable to create filenames");
-			vcos_assert(0);
+			return FALSE;
 		}
 
 		output_file = fopen(use_filename, "wb");
-		vcos_assert(output_file);
-		//}
+		if (!output_file) {
+			vcos_log_error("Unable to open %s: %s", use_filename, strerror(errno));
+			goto out;
+		}
 
-		state->callback_data.file_handle = output_file;
+		state->capture_callback_data.file_handle = output_file;
 	}
 
-	int num, q;
-
 	add_exif_tags(state);
 
-	/* Enable the encoder output port */
-	state->encoder_capture_output_port->userdata =
-	    (struct MMAL_PORT_USERDATA_T *)&state->callback_data;
+	state->capture_callback_data.state = state;
+	state->capture_callback_data.abort = 0;
+
+	if (vcos_semaphore_create(&(state->capture_callback_data.complete_semaphore),
+				  "RaspiStill-sem", 0) != VCOS_SUCCESS) {
+		vcos_log_error("Unable to create still capture semaphore");
+		goto out;
+	}
 
 	/* Enable the encoder output port and tell it its callback function */
+	state->encoder_capture_output_port->userdata =
+	    (struct MMAL_PORT_USERDATA_T *)&state->capture_callback_data;
 	status =
 	    mmal_port_enable(state->encoder_capture_output_port, encoder_capture_buffer_callback);
-	vcos_assert(status == MMAL_SUCCESS);
-
-	vcos_status =
-	    vcos_semaphore_create(&(state->callback_data.complete_semaphore), "RaspiStill-sem", 0);
-	vcos_assert(status == MMAL_SUCCESS);
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("Unable to enable still encoder output port (%u)", status);
+		goto out_semaphore;
+	}
 
 	/* Send all the buffers to the encoder output port */
 	num = mmal_queue_length(state->encoder_capture_pool->queue);
 
 	for (q = 0; q < num; q++) {
-		puts("for loop [image]");
 		MMAL_BUFFER_HEADER_T *buffer = mmal_queue_get(state->encoder_capture_pool->queue);
-		vcos_assert(buffer);
 
-		status = mmal_port_send_buffer(state->encoder_capture_output_port, buffer);
-		vcos_assert(status == MMAL_SUCCESS);
+		if (!buffer || mmal_port_send_buffer(state->encoder_capture_output_port,
+						     buffer) != MMAL_SUCCESS)
+			vcos_log_error("Unable to send a buffer to the still encoder (%d)", q);
 	}
 
 	status =
 	    mmal_port_parameter_set_boolean(state->camera_still_port, MMAL_PARAMETER_CAPTURE, 1);
-	vcos_assert(status == MMAL_SUCCESS);
-
+	if (status != MMAL_SUCCESS)
+		vcos_log_error("Unable to start still capture (%u)", status);
 	/* Wait until capture image done */
-	vcos_semaphore_wait(&(state->callback_data.complete_semaphore));
-
-	/* Ensure we don't die if get callback with no open file */
-	state->callback_data.file_handle = NULL;
-
-	if (output_file != stdout) {
-		rename_file(&state, output_file, final_filename, use_filename, frame);
-	} else {
-		fflush(output_file);
-	}
+	else if (vcos_semaphore_wait_timeout(&(state->capture_callback_data.complete_semaphore),
+					     STILL_TIMEOUT) != VCOS_SUCCESS)
+		vcos_log_error("Still capture timed out after %d ms", STILL_TIMEOUT);
+	else
+		written = TRUE;
 
-	/* Disable encoder output port */
-	status = mmal_port_disable(state->encoder_capture_output_port);
+	/* Disable encoder output port, after which no more callbacks come */
+	mmal_port_disable(state->encoder_capture_output_port);
 
-	/* Enable encoder of video h264 */
-	//status = mmal_port_enable(state->encoder_output_port, encoder_buffer_callback);
-	// mmal_port_parameter_set_boolean(state->camera_video_port, MMAL_PARAMETER_CAPTURE, 0);
+ out_semaphore:
+	vcos_semaphore_delete(&(state->capture_callback_data.complete_semaphore));
 
-	//}
-
-	if (use_filename) {
-		free(use_filename);
-		use_filename = NULL;
-	}
-	if (final_filename) {
-		free(final_filename);
-		final_filename = NULL;
+ out:
+	/* Ensure we don't die if get callback with no open file */
+	state->capture_callback_data.file_handle = NULL;
+
+	if (output_file) {
+		if (written) {
+			rename_file(state, output_file, final_filename, use_filename, frame);
+		} else {
+			fclose(output_file);
+			unlink(use_filename);
+		}
 	}
 
-	vcos_semaphore_delete(&(state->callback_data.complete_semaphore));
-
-	vcos_semaphore_delete(&(state->callback_data.complete_semaphore));
+	free(use_filename);
+	free(final_filename);
 
+	return written;
 }
 
-static RASPIVID_STATE *mState;
-/*
- * Lock dataManager
- **/
-#define LOCK_DATA_MANAGER(x) \
-	while (dataManagerMutex) \
-	usleep(1000); \
-	x = 1
-#define UNLOCK_DATA_MANAGER(x) x = 0
-static int dataManagerMutex;
-
-
-static void capture_image_setup(RASPIVID_STATE * state)
+/**
+ * Create the JPEG encoder and connect the camera's still port to it
+ *
+ * @param state Pointer to state control struct
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ */
+static MMAL_STATUS_T capture_image_setup(RASPIVID_STATE * state)
 {
-	puts("capture_image_setup()");
-	
-	MMAL_PORT_T *encoder_capture_input_port = NULL;
-	MMAL_STATUS_T status = MMAL_SUCCESS;
+	MMAL_STATUS_T status;
+
+	RASPI_DEBUG("Setting up still capture");
 
 	/* Create jpeg encoder */
 	if ((status = create_encoder_capture_component(state)) != MMAL_SUCCESS) {
 		vcos_log_error("%s: Failed to create encode capture component", __func__);
-		raspipreview_destroy(&state->config->preview_parameters);
-		destroy_camera_component(state);
-		return NULL;
+		return status;
 	}
 
 	/* Connect camera capture port to jpeg encoder */
-	encoder_capture_input_port = state->encoder_capture_component->input[0];
 	state->encoder_capture_output_port = state->encoder_capture_component->output[0];
 	status =
-	    connect_ports(state->camera_still_port, encoder_capture_input_port,
+	    connect_ports(state->camera_still_port, state->encoder_capture_component->input[0],
 			  &state->encoder_capture_connection);
-	vcos_assert(status == MMAL_SUCCESS);
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("%s: Failed to connect camera to still encoder (%u)", __func__,
+			       status);
+		state->encoder_capture_connection = NULL;
+		destroy_encoder_captureimage_component(state);
+	}
+
+	return status;
+}
+
+/**
+ * Undo capture_image_setup(), leaving the still port free for the next
+ * still
+ *
+ * @param state Pointer to state control struct
+ */
+static void capture_image_teardown(RASPIVID_STATE * state)
+{
+	if (state->encoder_capture_connection) {
+		mmal_connection_disable(state->encoder_capture_connection);
+		mmal_connection_destroy(state->encoder_capture_connection);
+		state->encoder_capture_connection = NULL;
+	}
+
+	if (state->encoder_capture_component)
+		mmal_component_disable(state->encoder_capture_component);
+
+	destroy_encoder_captureimage_component(state);
+	state->encoder_capture_output_port = NULL;
 }
 
-char *raspi_capture_photo(const char *username)
+/**
+ * Take a JPEG still on this capture's camera. Stills on the same state are
+ * serialised; different states (cameras) don't share anything.
+ *
+ * @param state Pointer to state control struct
+ * @param username Prefix for the file name
+ * @return Newly allocated file name, free with g_free(), or NULL if the
+ * still failed
+ */
+char *raspi_capture_photo(RASPIVID_STATE * state, const char *username)
 {
-	puts("RaspiCapture.c[line 1119]: raspberry_capture_photo");
+	int64_t started, took;
+	char *name;
+	struct tm tm;
+	time_t t = time(NULL);
 
 	/** Wait until previous capture finish */
-	LOCK_DATA_MANAGER(dataManagerMutex);
-	
+	g_mutex_lock(&state->capture_lock);
+
 	/** 
 	 * Create file's name
 	 * File name format: ddmmyy_hhmmss.jpg
 	 */
-	static char name[100] = { 0 };
+	localtime_r(&t, &tm);
 
-	time_t t = time(NULL);
-	struct tm tm = *localtime(&t);
+	name = g_strdup_printf("%s_%d%d%d_%d%d%d.jpg", username, tm.tm_mday, tm.tm_mon + 1,
+			       tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+	started = raspiring_now();
+	RASPI_PROBE1(still_start, name);
 
-	sprintf(name, "%s_%d%d%d_%d%d%d.jpg", username, tm.tm_mday, tm.tm_mon + 1,
-		tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+	/* Initialize capture image component, and start capture image */
+	if (capture_image_setup(state) != MMAL_SUCCESS || !raspi_capture_image(state, name)) {
+		g_free(name);
+		name = NULL;
+	}
+
+	capture_image_teardown(state);
 
-	/* Initialize capture image component */
-	capture_image_setup(mState);
+	took = raspiring_now() - started;
+	RASPI_PROBE2(still_end, name, took);
+	RASPI_DEBUG("Still %s took %" G_GINT64_FORMAT " us", name ? name : "(failed)", took);
 
-	/* Start capture image */
-	raspi_capture_image(mState, name);
+	g_mutex_unlock(&state->capture_lock);
 
-	/* Destroy commopent */
-	if (mState->encoder_capture_component)
-		mmal_component_disable(mState->encoder_capture_component);
-		
-	destroy_encoder_captureimage_component(mState);
-	
-	UNLOCK_DATA_MANAGER(dataManagerMutex);
-	
 	return name;
 }
 
@@ -1237,8 +3143,9 @@ char *raspi_capture_photo(const char *username)
  */
 RASPIVID_STATE *raspi_capture_setup(RASPIVID_CONFIG * config)
 {
-	puts("raspi_capture_setup");
+	RASPI_DEBUG("Setting up capture");
 	RASPIVID_STATE *state;
+	int i;
 
 	MMAL_STATUS_T status = MMAL_SUCCESS;
 
@@ -1247,26 +3154,22 @@ RASPIVID_STATE *raspi_capture_setup(RASPIVID_CONFIG * config)
 
 	/* Apply passed in config */
 	state->config = config;
+	g_mutex_init(&state->capture_lock);
+	g_mutex_init(&state->parameter_lock);
+	g_mutex_init(&state->settings_lock);
 
 	/* Create camera component */
 	if ((status = create_camera_component(state)) != MMAL_SUCCESS) {
 		vcos_log_error("%s: Failed to create camera component", __func__);
-		return NULL;
+		goto error;
 	}
 
-	/* Create preview */
-	if ((status = raspipreview_create(&state->config->preview_parameters)) != MMAL_SUCCESS) {
+	/* Create preview, unless its port is going to feed the analytics stream */
+	if (!analytics_wanted(state) &&
+	    (status = raspipreview_create(&state->config->preview_parameters)) != MMAL_SUCCESS) {
 		vcos_log_error("%s: Failed to create preview component", __func__);
 		destroy_camera_component(state);
-		return NULL;
-	}
-
-	/* Create h264 encoder */
-	if ((status = create_encoder_component(state)) != MMAL_SUCCESS) {
-		vcos_log_error("%s: Failed to create encode component", __func__);
-		raspipreview_destroy(&state->config->preview_parameters);
-		destroy_camera_component(state);
-		return NULL;
+		goto error;
 	}
 
 	/* Create jpeg encoder */
@@ -1277,14 +3180,58 @@ RASPIVID_STATE *raspi_capture_setup(RASPIVID_CONFIG * config)
 	   return NULL;
 	   } */
 
-	/* Config camera components */
+	/* Config camera components. The h264 encoder (or raw pool) is created in
+	 * raspi_capture_start(), once caps have been negotiated */
+	state->raw_format = GST_VIDEO_FORMAT_UNKNOWN;
 	status = raspi_capture_set_format_and_start(state);
 	vcos_assert(status == MMAL_SUCCESS);
 
-	/* Create queue to hold data from encoder video h264 port, then send to gstreamer */
-	state->encoded_buffer_q = mmal_queue_create();
+	/* Create rings to hold data from encoder video h264 port, then send to gstreamer */
+	state->encoded_ring = raspiring_create(OUTPUT_RING_SIZE);
+	for (i = 0; i < RASPI_AUX_STREAM_COUNT; i++)
+		state->aux[i].ring = raspiring_create(OUTPUT_RING_SIZE);
 
 	return state;
+
+ error:
+	g_mutex_clear(&state->capture_lock);
+	g_mutex_clear(&state->parameter_lock);
+	g_mutex_clear(&state->settings_lock);
+	free(state);
+	return NULL;
+}
+
+/**
+ * Work out the offset between the camera's STC, which buffer timestamps
+ * are taken on, and the monotonic clock ring arrival times use
+ *
+ * @param state Pointer to state control struct
+ */
+static void calibrate_stc(RASPIVID_STATE * state)
+{
+	MMAL_PARAMETER_CAMERA_CONFIG_T cam_config = {
+		{MMAL_PARAMETER_CAMERA_CONFIG, sizeof(cam_config)}
+	};
+	uint64_t stc;
+	int64_t before, after;
+
+	state->stc_offset = 0;
+	if (mmal_port_parameter_get(state->camera_component->control, &cam_config.hdr) != MMAL_SUCCESS
+	    || cam_config.use_stc_timestamp != MMAL_PARAM_TIMESTAMP_MODE_RAW_STC) {
+		vcos_log_error("Camera isn't stamping buffers with the raw STC, no sensor timestamps");
+		return;
+	}
+
+	before = raspiring_now();
+	if (mmal_port_parameter_get_uint64(state->camera_video_port, MMAL_PARAMETER_SYSTEM_TIME,
+					   &stc) != MMAL_SUCCESS) {
+		vcos_log_error("Unable to read the camera STC, no sensor timestamps");
+		return;
+	}
+	after = raspiring_now();
+
+	/* Take the middle of the round trip to the GPU */
+	state->stc_offset = before + (after - before) / 2 - (int64_t) stc;
 }
 
 /**
@@ -1299,27 +3246,60 @@ gboolean raspi_capture_start(RASPIVID_STATE * state)
 	MMAL_PORT_T *camera_preview_port = NULL;
 	MMAL_PORT_T *preview_input_port = NULL;
 	MMAL_PORT_T *encoder_input_port = NULL;
+	int i;
 	if (state->config->verbose) {
 		dump_state(state);
 	}
+
+	state->raw_format = video_format_from_encoding(state->config->encoding);
+	if (state->raw_format != GST_VIDEO_FORMAT_UNKNOWN)
+		setup_raw_layout(state->raw_format, state->config->encoding,
+				 state->config->width, state->config->height,
+				 &state->raw_info, &state->packed_info);
+
 	if ((status = raspi_capture_set_format_and_start(state)) != MMAL_SUCCESS) {
 		return FALSE;
 	}
+
+	if (state->raw_format != GST_VIDEO_FORMAT_UNKNOWN) {
+		/* Raw output bypasses the encoder entirely */
+		status = create_raw_video_pool(state);
+	} else {
+		status = create_encoder_component(state);
+	}
+	if (status != MMAL_SUCCESS) {
+		vcos_log_error("%s: Failed to create video output", __func__);
+		return FALSE;
+	}
+
+	if (analytics_wanted(state) && (status = create_analytics_pool(state)) != MMAL_SUCCESS) {
+		vcos_log_error("%s: Failed to create analytics pool", __func__);
+		return FALSE;
+	}
+
+	if (state->config->substream.enable) {
+		if (state->raw_format != GST_VIDEO_FORMAT_UNKNOWN) {
+			vcos_log_error("%s: Substream needs an encoded main stream, disabling it",
+				       __func__);
+		} else if ((status = create_substream_components(state)) != MMAL_SUCCESS) {
+			vcos_log_error("%s: Failed to create substream components", __func__);
+			return FALSE;
+		}
+	}
+
 	if (state->config->verbose)
-		fprintf(stderr, "Starting component connection stage\n");
+		RASPI_DEBUG("Starting component connection stage");
 	camera_preview_port = state->camera_component->output[MMAL_CAMERA_PREVIEW_PORT];
-	preview_input_port = state->config->preview_parameters.preview_component->input[0];
-	encoder_input_port = state->encoder_component->input[0];
 	state->camera_video_port = state->camera_component->output[MMAL_CAMERA_VIDEO_PORT];
 	state->camera_still_port = state->camera_component->output[MMAL_CAMERA_CAPTURE_PORT];
-	state->encoder_output_port = state->encoder_component->output[0];
 	if (state->config->preview_parameters.wantPreview) {
 		if (state->config->verbose) {
-			fprintf(stderr, "Connecting camera preview port to preview input port\n");
-			fprintf(stderr, "Starting video preview\n");
+			RASPI_DEBUG("Connecting camera preview port to preview input port");
+			RASPI_DEBUG("Starting video preview");
 		}
 
 		/* Connect camera to preview */
+		preview_input_port = state->config->preview_parameters.preview_component->input[0];
 		status =
 		    connect_ports(camera_preview_port, preview_input_port,
 				  &state->preview_connection);
@@ -1328,26 +3308,55 @@ gboolean raspi_capture_start(RASPIVID_STATE * state)
 			return FALSE;
 		}
 	}
-	if (state->config->verbose)
-		fprintf(stderr, "Connecting camera stills port to encoder input port\n");
+	if (state->splitter_component) {
+		if (state->config->verbose)
+			RASPI_DEBUG("Connecting camera video port through splitter to both encoders");
+
+		/* camera -> splitter, splitter 0 -> encoder, splitter 1 -> resizer -> sub encoder */
+		status = connect_ports(state->camera_video_port,
+				       state->splitter_component->input[0],
+				       &state->splitter_connection);
+		if (status == MMAL_SUCCESS)
+			status = connect_ports(state->splitter_component->output[0],
+					       state->encoder_component->input[0],
+					       &state->encoder_connection);
+		if (status == MMAL_SUCCESS)
+			status = connect_ports(state->splitter_component->output[1],
+					       state->resizer_component->input[0],
+					       &state->resizer_connection);
+		if (status == MMAL_SUCCESS)
+			status = connect_ports(state->resizer_component->output[0],
+					       state->sub_encoder_component->input[0],
+					       &state->sub_encoder_connection);
+		if (status != MMAL_SUCCESS) {
+			vcos_log_error("%s: Failed to connect the simulcast chain", __func__);
+			goto error;
+		}
+	} else if (state->encoder_component) {
+		if (state->config->verbose)
+			RASPI_DEBUG("Connecting camera video port to encoder input port");
 
-	/* Now connect the camera to the encoder */
-	status =
-	    connect_ports(state->camera_video_port, encoder_input_port, &state->encoder_connection);
-	if (status != MMAL_SUCCESS) {
-		if (state->config->preview_parameters.wantPreview)
-			mmal_connection_destroy(state->preview_connection);
-		vcos_log_error("%s: Failed to connect camera video port to encoder input",
-			       __func__);
-		return FALSE;
+		/* Now connect the camera to the encoder */
+		encoder_input_port = state->encoder_component->input[0];
+		status =
+		    connect_ports(state->camera_video_port, encoder_input_port,
+				  &state->encoder_connection);
+		if (status != MMAL_SUCCESS) {
+			if (state->config->preview_parameters.wantPreview)
+				mmal_connection_destroy(state->preview_connection);
+			vcos_log_error("%s: Failed to connect camera video port to encoder input",
+				       __func__);
+			return FALSE;
+		}
 	}
 
 	/* Set up our userdata - this is passed though to the callback where we need the information. */
 	state->callback_data.state = state;
 	state->callback_data.abort = 0;
+	state->callback_data.output_ring = state->encoded_ring;
 	state->encoder_output_port->userdata = (struct MMAL_PORT_USERDATA_T *)&state->callback_data;
 	if (state->config->verbose)
-		fprintf(stderr, "Enabling encoder output port\n");
+		RASPI_DEBUG("Enabling encoder output port");
 
 	/* Enable the encoder output port and tell it its callback function */
 	status = mmal_port_enable(state->encoder_output_port, encoder_buffer_callback);
@@ -1355,44 +3364,63 @@ gboolean raspi_capture_start(RASPIVID_STATE * state)
 		vcos_log_error("Failed to setup encoder output");
 		goto error;
 	}
+
+	/* Secondary outputs share the encoder callback, each with its own ring */
+	for (i = 0; i < RASPI_AUX_STREAM_COUNT; i++) {
+		AUX_OUTPUT *aux = &state->aux[i];
+
+		if (!aux->pool)
+			continue;
+
+		aux->callback_data.state = state;
+		aux->callback_data.output_ring = aux->ring;
+		aux->port->userdata = (struct MMAL_PORT_USERDATA_T *)&aux->callback_data;
+		g_atomic_int_set(&aux->flushing, FALSE);
+
+		status = mmal_port_enable(aux->port, encoder_buffer_callback);
+		if (status != MMAL_SUCCESS) {
+			vcos_log_error("Failed to setup output port %s", aux->port->name);
+			goto error;
+		}
+	}
 	if (state->config->demoMode) {
 
 		/* Run for the user specific time.. */
 		int num_iterations = state->config->timeout / state->config->demoInterval;
 		int i;
 		if (state->config->verbose)
-			fprintf(stderr, "Running in demo mode\n");
+			RASPI_DEBUG("Running in demo mode");
 		for (i = 0; state->config->timeout == 0 || i < num_iterations; i++) {
 			raspicamcontrol_cycle_test(state->camera_component);
 			vcos_sleep(state->config->demoInterval);
 		}
 	}
 
-	/* Save state for capture photo  */
-	mState = calloc(1, sizeof(RASPIVID_STATE));
-	mState = state;
-
 	if (state->config->verbose)
-		fprintf(stderr, "Starting video capture\n");
-	if (mmal_port_parameter_set_boolean(state->camera_video_port, MMAL_PARAMETER_CAPTURE, 1) !=
-	    MMAL_SUCCESS) {
+		RASPI_DEBUG("Starting video capture");
+	/* Exposure starts settling now */
+	g_mutex_lock(&state->settings_lock);
+	state->settle_start = raspiring_now();
+	state->settle_reports = 0;
+	state->settled = 0;
+	state->settle_first_report = state->settings_count;
+	g_mutex_unlock(&state->settings_lock);
+	state->settling = state->config->skipUntilSettled;
+	state->settle_skipped = 0;
+	state->first_frame = 0;
+	/* skipUntilSettled leaves starting capture to the streaming thread */
+	if (!state->settling
+	    && mmal_port_parameter_set_boolean(state->camera_video_port, MMAL_PARAMETER_CAPTURE,
+					       1) != MMAL_SUCCESS) {
 		goto error;
 	}
+	calibrate_stc(state);
 
-	/* Send all the buffers to the encoder output port */
-	{
-		int num = mmal_queue_length(state->encoder_pool->queue);
-		int q;
-		for (q = 0; q < num; q++) {
-			MMAL_BUFFER_HEADER_T *buffer = mmal_queue_get(state->encoder_pool->queue);
-			if (!buffer)
-				vcos_log_error("Unable to get a required buffer %d from pool queue",
-					       q);
-			if (mmal_port_send_buffer(state->encoder_output_port, buffer) !=
-			    MMAL_SUCCESS)
-				vcos_log_error
-				    ("Unable to send a buffer to encoder output port (%d)", q);
-		}
+	/* Send all the buffers to the encoder output port(s) */
+	send_pool_buffers(state->encoder_output_port, state->encoder_pool);
+	for (i = 0; i < RASPI_AUX_STREAM_COUNT; i++) {
+		if (state->aux[i].pool)
+			send_pool_buffers(state->aux[i].port, state->aux[i].pool);
 	}
 
 	return (status == MMAL_SUCCESS);
@@ -1407,20 +3435,41 @@ gboolean raspi_capture_start(RASPIVID_STATE * state)
 
 void raspi_capture_stop(RASPIVID_STATE * state)
 {
+	int i;
+
 	if (state->config->verbose)
-		fprintf(stderr, "Closing down\n");
+		RASPI_DEBUG("Closing down");
 
 	if (state->config->preview_parameters.wantPreview)
 		mmal_connection_destroy(state->preview_connection);
-	mmal_connection_destroy(state->encoder_connection);
+	if (state->encoder_connection) {
+		mmal_connection_destroy(state->encoder_connection);
+		state->encoder_connection = NULL;
+	}
+	if (state->sub_encoder_connection) {
+		mmal_connection_destroy(state->sub_encoder_connection);
+		state->sub_encoder_connection = NULL;
+	}
+	if (state->resizer_connection) {
+		mmal_connection_destroy(state->resizer_connection);
+		state->resizer_connection = NULL;
+	}
+	if (state->splitter_connection) {
+		mmal_connection_destroy(state->splitter_connection);
+		state->splitter_connection = NULL;
+	}
 
 	/* Disable all our ports that are not handled by connections */
 	check_disable_port(state->camera_still_port);
 	check_disable_port(state->encoder_output_port);
+	for (i = 0; i < RASPI_AUX_STREAM_COUNT; i++)
+		check_disable_port(state->aux[i].port);
 }
 
 void raspi_capture_free(RASPIVID_STATE * state)
 {
+	int i;
+
 	// Can now close our file. Note disabling ports may flush buffers which causes
 	// problems if we have already closed the file!
 	if (state->output_file && state->output_file != stdout)
@@ -1430,19 +3479,34 @@ void raspi_capture_free(RASPIVID_STATE * state)
 	if (state->encoder_component)
 		mmal_component_disable(state->encoder_component);
 
+	if (state->sub_encoder_component)
+		mmal_component_disable(state->sub_encoder_component);
+	if (state->resizer_component)
+		mmal_component_disable(state->resizer_component);
+	if (state->splitter_component)
+		mmal_component_disable(state->splitter_component);
+
 	if (state->config->preview_parameters.preview_component)
 		mmal_component_disable(state->config->preview_parameters.preview_component);
 
 	if (state->camera_component)
 		mmal_component_disable(state->camera_component);
 
+	destroy_substream_components(state);
 	destroy_encoder_component(state);
 	raspipreview_destroy(&state->config->preview_parameters);
+	destroy_aux_pool(state, RASPI_AUX_ANALYTICS);
 	destroy_camera_component(state);
 
+	for (i = 0; i < RASPI_AUX_STREAM_COUNT; i++)
+		raspiring_destroy(state->aux[i].ring);
+
+	g_mutex_clear(&state->capture_lock);
+	g_mutex_clear(&state->parameter_lock);
+	g_mutex_clear(&state->settings_lock);
+
 	if (state->config->verbose)
-		fprintf(stderr,
-			"Close down completed, all components disconnected, disabled and destroyed\n\n");
+		RASPI_DEBUG("Close down completed, all components disconnected, disabled and destroyed");
 
 	free(state);
 }
@@ -46,6 +46,7 @@
 
 #include <glib.h>
 #include <inttypes.h>
+#include <gst/video/video.h>
 
 #include "interface/mmal/mmal_common.h"
 #include "interface/mmal/mmal_types.h"
@@ -53,19 +54,65 @@
 #include "interface/mmal/mmal_component.h"
 #include "RaspiCamControl.h"
 #include "RaspiPreview.h"
+#include "RaspiLatency.h"
 
 GST_DEBUG_CATEGORY_EXTERN (gst_rpi_cam_src_debug);
 #define GST_CAT_DEFAULT gst_rpi_cam_src_debug
 
-#undef fprintf
-#define fprintf(f,...) GST_LOG(__VA_ARGS__)
+#include "RaspiTrace.h"
 G_BEGIN_DECLS
 
+/** Settings for the simulcast substream: a second, downscaled H264 stream
+ *  encoded alongside the main one
+ */
+typedef struct
+{
+   int enable;                         /// !0 to create the substream pipeline
+   int width;                          /// Substream width
+   int height;                         /// Substream height
+   int bitrate;                        /// Substream bitrate
+   int intraperiod;                    /// Substream key frame rate, 0 for the encoder default
+   int profile;                        /// Substream H264 profile
+} RASPIVID_SUBSTREAM_CONFIG;
+
+/** Settings for the analytics stream: the camera preview port, scaled down
+ *  by the ISP and output raw, when no preview is displayed
+ */
+typedef struct
+{
+   int enable;                         /// !0 to repurpose the preview port
+   int width;                          /// Analytics frame width
+   int height;                         /// Analytics frame height
+   int grayscale;                      /// !0 to output the luma plane only (GRAY8), else I420
+} RASPIVID_ANALYTICS_CONFIG;
+
+/** What to do when frames back up because downstream is slow
+ */
+typedef enum
+{
+   RASPIVID_LEAKY_BLOCK,               /// Never drop, the encoder stalls once its pool runs dry
+   RASPIVID_LEAKY_DROP_OLDEST,         /// Drop the oldest frames, but never an H264 key frame or headers
+   RASPIVID_LEAKY_DROP_TO_IDR          /// Drop everything but headers up to the next IDR, requesting one
+} RASPIVID_LEAKY_T;
+
+/// Power of two buckets of raspi_capture_get_handoff_histogram(), the last one open ended
+#define RASPI_HANDOFF_BUCKETS 20
+
+/** Secondary streams, each pushed on its own pad
+ */
+typedef enum
+{
+   RASPI_AUX_SUBSTREAM,                /// Downscaled H264 simulcast stream
+   RASPI_AUX_ANALYTICS,                /// Raw frames from the preview port
+   RASPI_AUX_STREAM_COUNT
+} RASPI_AUX_STREAM;
+
 /** Structure containing all state information for the current run
  */
 typedef struct
 {
    int verbose; /// !0 if want detailed run information
+   int cameraNum;                      /// Camera to use on boards with more than one, indexed from 0
    
    int timeout;                        /// Time taken before frame is grabbed and app then shuts down. Units are milliseconds
    int width;                          /// Requested width of image
@@ -79,6 +126,20 @@ typedef struct
    int immutableInput;                 /// Flag to specify whether encoder works in place or creates a new buffer. Result is preview can display either
                                        /// the camera output or the encoder output (with compression artifacts)
    int profile;                        /// H264 profile to use for encoding
+   MMAL_FOURCC_T encoding;             /// Output encoding: H264, MJPEG, or a raw format taken straight from the camera video port
+   int quantisationParameter;          /// Fixed encoder QP, or 0 to use bitrate control
+   int useVideoMeta;                   /// Downstream understands GstVideoMeta, so raw frames are pushed with their padded strides
+   int inlineMotionVectors;            /// Attach the H264 encoder's motion vectors to each frame as GstRpiCamMotionVectorMeta
+   int motionDetect;                   /// Motion detection reads the vectors, so attach them even without inlineMotionVectors
+   RASPIVID_LEAKY_T leaky;             /// Backpressure policy once the queue exceeds the limits below
+   int maxQueueFrames;                 /// Frames that may wait to be pushed, 0 for no limit
+   int maxQueueTime;                   /// Milliseconds the oldest frame may wait to be pushed, 0 for no limit
+   int exposureLock;                   /// Fix exposure, gains and white balance once they settle after start
+   int skipUntilSettled;               /// Start capturing only once exposure has settled after start
+   int settleTimeout;                  /// Milliseconds skipUntilSettled waits at most, 0 for no limit
+   int roiTransition;                  /// Milliseconds a change of ROI is spread over, 0 to jump straight to it
+   RASPIVID_SUBSTREAM_CONFIG substream;          /// Simulcast substream parameters
+   RASPIVID_ANALYTICS_CONFIG analytics;          /// Analytics stream parameters
    RASPIPREVIEW_PARAMETERS preview_parameters;   /// Preview setup parameters
    RASPICAM_CAMERA_PARAMETERS camera_parameters; /// Camera setup parameters
 } RASPIVID_CONFIG;
@@ -92,6 +153,23 @@ gboolean raspi_capture_start(RASPIVID_STATE *state);
 GstFlowReturn raspi_capture_fill_buffer(RASPIVID_STATE *state, GstBuffer **buf);
 void raspi_capture_stop(RASPIVID_STATE *state);
 void raspi_capture_free(RASPIVID_STATE *state);
+gboolean raspi_capture_set_quantisation(RASPIVID_STATE *state, int qp);
+gboolean raspi_capture_update_camera_parameters(RASPIVID_STATE *state, const RASPICAM_CAMERA_PARAMETERS *params);
+gboolean raspi_capture_get_camera_parameters(RASPIVID_STATE *state, RASPICAM_CAMERA_PARAMETERS *params);
+GstFlowReturn raspi_capture_fill_aux_buffer(RASPIVID_STATE *state, RASPI_AUX_STREAM stream, GstBuffer **buf);
+void raspi_capture_set_flushing(RASPIVID_STATE *state, gboolean flushing);
+void raspi_capture_set_aux_flushing(RASPIVID_STATE *state, RASPI_AUX_STREAM stream, gboolean flushing);
+guint64 raspi_capture_get_dropped_frames(RASPIVID_STATE *state);
+void raspi_capture_get_handoff_histogram(RASPIVID_STATE *state, guint64 *buckets);
+void raspi_capture_get_frame_timing(RASPIVID_STATE *state, RASPILATENCY_RECORD *record);
+void raspi_capture_get_queue_state(RASPIVID_STATE *state, guint *ring_depth, guint *pool_free);
+gsize raspi_capture_get_buffer_size(RASPIVID_STATE *state);
+gint64 raspi_capture_get_exposure_settle_time(RASPIVID_STATE *state);
+gint64 raspi_capture_get_first_frame_time(RASPIVID_STATE *state, guint64 *skipped);
+guint64 raspi_capture_get_roi_steps(RASPIVID_STATE *state, gint64 *latency, gint64 *jitter);
+
+MMAL_FOURCC_T raspi_capture_encoding_from_video_format(GstVideoFormat format);
+char *raspi_capture_photo(RASPIVID_STATE *state, const char *username);
 
 G_END_DECLS
 
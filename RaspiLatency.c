@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RaspiLatency.h"
+
+struct RASPILATENCY_T {
+	RASPILATENCY_RECORD *records;
+	unsigned int capacity;
+	unsigned int next;	/// Slot the next record goes in
+	unsigned int count;	/// Records held, up to capacity
+	int64_t *scratch;	/// Durations of one stage, sorted by raspilatency_summarise()
+};
+
+static const char *stage_names[RASPILATENCY_STAGE_COUNT] = {
+	"capture", "queue", "push", "total"
+};
+
+/**
+ * Create a trace
+ *
+ * @param capacity Number of most recent frames kept
+ * @return The trace, or NULL on failure
+ */
+RASPILATENCY_T *raspilatency_create(unsigned int capacity)
+{
+	RASPILATENCY_T *trace;
+
+	if (capacity == 0)
+		return NULL;
+
+	trace = calloc(1, sizeof(*trace));
+	if (trace == NULL)
+		return NULL;
+
+	trace->records = calloc(capacity, sizeof(*trace->records));
+	trace->scratch = calloc(capacity, sizeof(*trace->scratch));
+	if (trace->records == NULL || trace->scratch == NULL) {
+		raspilatency_destroy(trace);
+		return NULL;
+	}
+	trace->capacity = capacity;
+
+	return trace;
+}
+
+/**
+ * Free a trace
+ *
+ * @param trace Trace to free, may be NULL
+ */
+void raspilatency_destroy(RASPILATENCY_T * trace)
+{
+	if (trace == NULL)
+		return;
+
+	free(trace->records);
+	free(trace->scratch);
+	free(trace);
+}
+
+/**
+ * Add a frame, overwriting the oldest one once the trace is full
+ *
+ * @param trace Trace to add to
+ * @param record Timestamps of the frame
+ */
+void raspilatency_record(RASPILATENCY_T * trace, const RASPILATENCY_RECORD * record)
+{
+	trace->records[trace->next] = *record;
+	if (++trace->next == trace->capacity)
+		trace->next = 0;
+	if (trace->count < trace->capacity)
+		trace->count++;
+}
+
+/**
+ * Name of a stage, for messages and logs
+ *
+ * @param stage The stage
+ * @return Static string
+ */
+const char *raspilatency_stage_name(RASPILATENCY_STAGE stage)
+{
+	return stage < RASPILATENCY_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+static int compare_durations(const void *a, const void *b)
+{
+	int64_t da = *(const int64_t *)a, db = *(const int64_t *)b;
+
+	return da < db ? -1 : da > db;
+}
+
+/**
+ * Start and end timestamps of a stage
+ *
+ * @param record Frame timestamps
+ * @param stage The stage
+ * @param start Receives the start of the stage
+ * @param end Receives the end of the stage
+ */
+static void stage_bounds(const RASPILATENCY_RECORD * record, RASPILATENCY_STAGE stage,
+			 int64_t * start, int64_t * end)
+{
+	switch (stage) {
+	case RASPILATENCY_STAGE_CAPTURE:
+		*start = record->sensor;
+		*end = record->arrival;
+		break;
+	case RASPILATENCY_STAGE_QUEUE:
+		*start = record->arrival;
+		*end = record->dequeue;
+		break;
+	case RASPILATENCY_STAGE_PUSH:
+		*start = record->dequeue;
+		*end = record->pushed;
+		break;
+	default:
+		*start = record->sensor;
+		*end = record->pushed;
+		break;
+	}
+}
+
+/**
+ * Nearest rank percentile of sorted durations
+ */
+static int64_t percentile(const int64_t * sorted, unsigned int count, unsigned int pct)
+{
+	unsigned int rank = (count * pct + 99) / 100;
+
+	return sorted[rank ? rank - 1 : 0];
+}
+
+/**
+ * Work out the percentiles of every stage over the frames in the trace.
+ * Frames missing either timestamp of a stage don't count towards it.
+ *
+ * @param trace Trace to summarise
+ * @param summary Receives RASPILATENCY_STAGE_COUNT entries
+ */
+void raspilatency_summarise(RASPILATENCY_T * trace, RASPILATENCY_PERCENTILES * summary)
+{
+	unsigned int stage, i, n;
+
+	for (stage = 0; stage < RASPILATENCY_STAGE_COUNT; stage++) {
+		RASPILATENCY_PERCENTILES *out = &summary[stage];
+
+		for (i = 0, n = 0; i < trace->count; i++) {
+			int64_t start, end;
+
+			stage_bounds(&trace->records[i], stage, &start, &end);
+			if (start && end)
+				trace->scratch[n++] = end - start;
+		}
+
+		memset(out, 0, sizeof(*out));
+		out->count = n;
+		if (n == 0)
+			continue;
+
+		qsort(trace->scratch, n, sizeof(*trace->scratch), compare_durations);
+		out->p50 = percentile(trace->scratch, n, 50);
+		out->p95 = percentile(trace->scratch, n, 95);
+		out->p99 = percentile(trace->scratch, n, 99);
+		out->max = trace->scratch[n - 1];
+	}
+}
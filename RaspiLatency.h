@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPILATENCY_H_
+#define RASPILATENCY_H_
+
+#include <stdint.h>
+
+/* Fixed size trace of per-frame timestamps, summarised into percentiles
+ * per pipeline stage.
+ *
+ * Only the thread pushing frames writes to it, and recording a frame is a
+ * struct copy into the next slot, so it is cheap enough to leave on.
+ * All times are CLOCK_MONOTONIC microseconds, as from raspiring_now().
+ */
+
+/// Stages of a frame's trip through the element, each the time between two timestamps
+typedef enum
+{
+   RASPILATENCY_STAGE_CAPTURE,         /// Sensor timestamp to encoder callback
+   RASPILATENCY_STAGE_QUEUE,           /// Encoder callback to dequeue by the streaming thread
+   RASPILATENCY_STAGE_PUSH,            /// Dequeue to return from pushing downstream
+   RASPILATENCY_STAGE_TOTAL,           /// Sensor timestamp to return from pushing
+   RASPILATENCY_STAGE_COUNT
+} RASPILATENCY_STAGE;
+
+/// Timestamps of one frame, 0 where unknown
+typedef struct
+{
+   int64_t sensor;                     /// Buffer pts, mapped onto the monotonic clock
+   int64_t arrival;                    /// Encoder callback
+   int64_t dequeue;                    /// Taken off the ring by raspi_capture_fill_buffer()
+   int64_t pushed;                     /// Downstream returned the buffer's push
+} RASPILATENCY_RECORD;
+
+/// Percentiles of one stage over the frames in the trace, in microseconds
+typedef struct
+{
+   unsigned int count;                 /// Frames with both timestamps of the stage
+   int64_t p50;
+   int64_t p95;
+   int64_t p99;
+   int64_t max;
+} RASPILATENCY_PERCENTILES;
+
+typedef struct RASPILATENCY_T RASPILATENCY_T;
+
+RASPILATENCY_T *raspilatency_create(unsigned int capacity);
+void raspilatency_destroy(RASPILATENCY_T *trace);
+void raspilatency_record(RASPILATENCY_T *trace, const RASPILATENCY_RECORD *record);
+void raspilatency_summarise(RASPILATENCY_T *trace, RASPILATENCY_PERCENTILES *summary);
+const char *raspilatency_stage_name(RASPILATENCY_STAGE stage);
+
+#endif /* RASPILATENCY_H_ */
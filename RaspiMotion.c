@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RaspiMotion.h"
+
+struct RASPIMOTION_STATE_T {
+	RASPIMOTION_PARAMETERS params;
+	int mb_width;		/// Macroblock columns, including the encoder's extra column
+	int mb_height;		/// Macroblock rows
+	unsigned char *mask;	/// 1 for each macroblock inside a watched region
+	int motion_run;		/// Consecutive motion frames so far
+	int still_run;		/// Consecutive still frames so far
+	int active;		/// Motion currently reported
+};
+
+/**
+ * Assign a default set of parameters to the passed in parameter block
+ *
+ * @param params Pointer to parameter block
+ *
+ */
+void raspimotion_set_defaults(RASPIMOTION_PARAMETERS * params)
+{
+	params->magnitude = 16;	// Vector length of 4
+	params->sad = 0;
+	params->min_blocks = 10;
+	params->trigger_frames = 3;
+	params->release_frames = 30;
+	params->num_regions = 0;
+}
+
+/**
+ * Parse a list of regions to watch
+ *
+ * @param params Pointer to parameter block, receives the regions
+ * @param regions "x,y,w,h" normalised rectangles separated by ';', or
+ *                NULL/empty for the whole frame
+ * @return Number of regions parsed, -1 if the string is malformed
+ */
+int raspimotion_parse_regions(RASPIMOTION_PARAMETERS * params, const char *regions)
+{
+	const char *p = regions;
+	int n = 0;
+
+	params->num_regions = 0;
+	if (p == NULL)
+		return 0;
+
+	while (*p) {
+		RASPIMOTION_REGION *r;
+		int used = 0;
+
+		if (n == RASPIMOTION_MAX_REGIONS)
+			return -1;
+
+		r = &params->regions[n];
+		if (sscanf(p, " %f , %f , %f , %f %n", &r->x, &r->y, &r->w, &r->h, &used) != 4)
+			return -1;
+		if (r->x < 0 || r->y < 0 || r->w <= 0 || r->h <= 0)
+			return -1;
+
+		n++;
+		p += used;
+		if (*p == ';')
+			p++;
+		else if (*p)
+			return -1;
+	}
+
+	params->num_regions = n;
+	return n;
+}
+
+/**
+ * Build the macroblock mask for the watched regions
+ *
+ * @param state Detector state, with params and dimensions set
+ */
+static void build_mask(RASPIMOTION_STATE * state)
+{
+	/* The last column is padding added by the encoder, never watch it */
+	int cols = state->mb_width - 1;
+	int x, y, i;
+
+	memset(state->mask, 0, state->mb_width * state->mb_height);
+
+	for (y = 0; y < state->mb_height; y++) {
+		for (x = 0; x < cols; x++) {
+			float cx = (x + 0.5f) / cols;
+			float cy = (y + 0.5f) / state->mb_height;
+			int inside = state->params.num_regions == 0;
+
+			for (i = 0; i < state->params.num_regions && !inside; i++) {
+				const RASPIMOTION_REGION *r = &state->params.regions[i];
+				inside = cx >= r->x && cx < r->x + r->w && cy >= r->y && cy < r->y + r->h;
+			}
+
+			state->mask[y * state->mb_width + x] = inside;
+		}
+	}
+}
+
+/**
+ * Create a detector for frames of a given macroblock size
+ *
+ * @param params Detection parameters, copied
+ * @param mb_width Macroblock columns in each vector buffer
+ * @param mb_height Macroblock rows in each vector buffer
+ * @return New detector, or NULL on error
+ */
+RASPIMOTION_STATE *raspimotion_create(const RASPIMOTION_PARAMETERS * params, int mb_width,
+				      int mb_height)
+{
+	RASPIMOTION_STATE *state;
+
+	if (mb_width < 2 || mb_height < 1)
+		return NULL;
+
+	state = calloc(1, sizeof(RASPIMOTION_STATE));
+	if (state == NULL)
+		return NULL;
+
+	state->params = *params;
+	state->mb_width = mb_width;
+	state->mb_height = mb_height;
+	state->mask = malloc(mb_width * mb_height);
+	if (state->mask == NULL) {
+		free(state);
+		return NULL;
+	}
+
+	build_mask(state);
+
+	return state;
+}
+
+/**
+ * Destroy a detector
+ *
+ * @param state Detector to free, may be NULL
+ */
+void raspimotion_destroy(RASPIMOTION_STATE * state)
+{
+	if (state == NULL)
+		return;
+
+	free(state->mask);
+	free(state);
+}
+
+/**
+ * Check a detector was made for frames of this size
+ *
+ * @return !0 if it was
+ */
+int raspimotion_matches(const RASPIMOTION_STATE * state, int mb_width, int mb_height)
+{
+	return state->mb_width == mb_width && state->mb_height == mb_height;
+}
+
+/**
+ * Run the detector on the vectors of one frame
+ *
+ * A frame counts as a motion frame when at least min_blocks watched
+ * macroblocks move. Motion starts after trigger_frames motion frames in a
+ * row and stops after release_frames still frames in a row.
+ *
+ * @param state Detector state
+ * @param vectors mb_width * mb_height vectors
+ * @param moving_blocks If not NULL, receives the number of moving watched macroblocks
+ * @return Whether motion started or stopped on this frame
+ */
+RASPIMOTION_EVENT raspimotion_process(RASPIMOTION_STATE * state, const RASPIMOTION_VECTOR * vectors,
+				      int *moving_blocks)
+{
+	const RASPIMOTION_PARAMETERS *params = &state->params;
+	int n = state->mb_width * state->mb_height;
+	int moving = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		const RASPIMOTION_VECTOR *v = &vectors[i];
+		int magnitude;
+
+		if (!state->mask[i])
+			continue;
+
+		magnitude = v->x_vector * v->x_vector + v->y_vector * v->y_vector;
+		if (magnitude >= params->magnitude && (params->sad == 0 || v->sad >= params->sad))
+			moving++;
+	}
+
+	if (moving_blocks)
+		*moving_blocks = moving;
+
+	if (moving >= params->min_blocks) {
+		state->still_run = 0;
+		state->motion_run++;
+		if (!state->active && state->motion_run >= params->trigger_frames) {
+			state->active = 1;
+			return RASPIMOTION_EVENT_START;
+		}
+	} else {
+		state->motion_run = 0;
+		state->still_run++;
+		if (state->active && state->still_run >= params->release_frames) {
+			state->active = 0;
+			return RASPIMOTION_EVENT_STOP;
+		}
+	}
+
+	return RASPIMOTION_EVENT_NONE;
+}
+
+/**
+ * @return !0 while motion is being reported
+ */
+int raspimotion_is_active(const RASPIMOTION_STATE * state)
+{
+	return state->active;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPIMOTION_H_
+#define RASPIMOTION_H_
+
+/* Motion detection on the H264 encoder's inline motion vectors.
+ *
+ * Plain C with no GStreamer or MMAL dependency, so recorded vector dumps
+ * can be fed through raspimotion_process() offline, as tests/motion-test
+ * does.
+ */
+
+/// Maximum number of regions that can be watched
+#define RASPIMOTION_MAX_REGIONS 8
+
+/// One macroblock of motion data, as laid out by the encoder
+typedef struct
+{
+   signed char x_vector;
+   signed char y_vector;
+   unsigned short sad;
+} RASPIMOTION_VECTOR;
+
+/// Area to watch, normalised [0,1] values in the rect
+typedef struct
+{
+   float x;
+   float y;
+   float w;
+   float h;
+} RASPIMOTION_REGION;
+
+typedef struct
+{
+   int magnitude;                      /// Squared vector length at which a macroblock counts as moving
+   int sad;                            /// SAD at which a macroblock counts as moving, 0 to only use vectors
+   int min_blocks;                     /// Moving macroblocks a frame needs to count as a motion frame
+   int trigger_frames;                 /// Consecutive motion frames before motion is reported
+   int release_frames;                 /// Consecutive still frames before motion is reported over
+   int num_regions;                    /// Number of regions, 0 to watch the whole frame
+   RASPIMOTION_REGION regions[RASPIMOTION_MAX_REGIONS];
+} RASPIMOTION_PARAMETERS;
+
+typedef enum
+{
+   RASPIMOTION_EVENT_NONE,             /// Nothing changed
+   RASPIMOTION_EVENT_START,            /// Motion started on this frame
+   RASPIMOTION_EVENT_STOP              /// Motion ended on this frame
+} RASPIMOTION_EVENT;
+
+typedef struct RASPIMOTION_STATE_T RASPIMOTION_STATE;
+
+void raspimotion_set_defaults(RASPIMOTION_PARAMETERS *params);
+int raspimotion_parse_regions(RASPIMOTION_PARAMETERS *params, const char *regions);
+
+RASPIMOTION_STATE *raspimotion_create(const RASPIMOTION_PARAMETERS *params, int mb_width, int mb_height);
+void raspimotion_destroy(RASPIMOTION_STATE *state);
+int raspimotion_matches(const RASPIMOTION_STATE *state, int mb_width, int mb_height);
+
+RASPIMOTION_EVENT raspimotion_process(RASPIMOTION_STATE *state, const RASPIMOTION_VECTOR *vectors, int *moving_blocks);
+int raspimotion_is_active(const RASPIMOTION_STATE *state);
+
+#endif /* RASPIMOTION_H_ */
@@ -188,10 +188,10 @@ void raspipreview_set_defaults(RASPIPREVIEW_PARAMETERS * state)
  */
 void raspipreview_dump_parameters(RASPIPREVIEW_PARAMETERS * state)
 {
-	fprintf(stderr, "Preview %s, Full screen %s\n", state->wantPreview ? "Yes" : "No",
+	RASPI_DEBUG("Preview %s, Full screen %s", state->wantPreview ? "Yes" : "No",
 		state->wantFullScreenPreview ? "Yes" : "No");
 
-	fprintf(stderr, "Preview window %d,%d,%d,%d\nOpacity %d\n", state->previewWindow.x,
+	RASPI_DEBUG("Preview window %d,%d,%d,%d, opacity %d", state->previewWindow.x,
 		state->previewWindow.y, state->previewWindow.width,
 		state->previewWindow.height, state->opacity);
 };
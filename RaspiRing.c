@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "RaspiRing.h"
+
+/* head is only written by the producer and tail only by the consumer, so
+ * each gets its own cache line and the two sides never bounce a line they
+ * both write. */
+struct RASPIRING_T {
+	RASPIRING_SLOT *slots;
+	unsigned int mask;	/// Capacity - 1, capacity is a power of two
+	int eventfd;		/// Written by the producer to wake a sleeping consumer
+
+	unsigned int head __attribute__ ((aligned(RASPIRING_CACHE_LINE)));	/// Next slot to fill
+
+	unsigned int tail __attribute__ ((aligned(RASPIRING_CACHE_LINE)));	/// Next slot to read
+	int waiting;		/// Set while the consumer sleeps on the eventfd
+	int woken;		/// Set by raspiring_wake() to end the current wait
+};
+
+/**
+ * Current CLOCK_MONOTONIC time, the clock slot arrival times are taken on
+ *
+ * @return Time in microseconds
+ */
+int64_t raspiring_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Create a ring
+ *
+ * @param capacity Minimum number of entries, rounded up to a power of two
+ * @return The ring, or NULL on failure
+ */
+RASPIRING_T *raspiring_create(unsigned int capacity)
+{
+	RASPIRING_T *ring;
+	unsigned int size = 1;
+
+	while (size < capacity)
+		size <<= 1;
+
+	if (posix_memalign((void **)&ring, RASPIRING_CACHE_LINE, sizeof(*ring)))
+		return NULL;
+	memset(ring, 0, sizeof(*ring));
+
+	if (posix_memalign((void **)&ring->slots, RASPIRING_CACHE_LINE,
+			   size * sizeof(RASPIRING_SLOT))) {
+		free(ring);
+		return NULL;
+	}
+	memset(ring->slots, 0, size * sizeof(RASPIRING_SLOT));
+	ring->mask = size - 1;
+
+	ring->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ring->eventfd < 0) {
+		free(ring->slots);
+		free(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+/**
+ * Destroy a ring. Anything still in it must already have been popped.
+ *
+ * @param ring The ring, may be NULL
+ */
+void raspiring_destroy(RASPIRING_T *ring)
+{
+	if (ring == NULL)
+		return;
+
+	close(ring->eventfd);
+	free(ring->slots);
+	free(ring);
+}
+
+/**
+ * Add an entry. Only ever called from the producer thread.
+ *
+ * @param ring The ring
+ * @param item What to hand over, must not be NULL
+ * @param flags Stored with the item
+ * @param pts Stored with the item
+ * @return 1 if added, 0 if the ring was full, -1 if added but the
+ * sleeping consumer couldn't be woken
+ */
+int raspiring_push(RASPIRING_T *ring, void *item, uint32_t flags, int64_t pts)
+{
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	RASPIRING_SLOT *slot;
+	uint64_t one = 1;
+
+	if (head - tail > ring->mask)
+		return 0;
+
+	slot = &ring->slots[head & ring->mask];
+	slot->item = item;
+	slot->arrival = raspiring_now();
+	slot->pts = pts;
+	slot->flags = flags;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	/* Pairs with the fence in raspiring_wait(): either we see the consumer
+	 * waiting, or it sees the new head before it sleeps. Only the first
+	 * push after it went to sleep pays for waking it, the ones made while
+	 * it is still waking up find the flag already cleared. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED)
+	    && __atomic_exchange_n(&ring->waiting, 0, __ATOMIC_RELAXED)) {
+		if (write(ring->eventfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+			return -1;
+	}
+
+	return 1;
+}
+
+/**
+ * Take the oldest entry without waiting. Only ever called from the
+ * consumer thread.
+ *
+ * @param ring The ring
+ * @param slot If not NULL, receives a copy of the entry's metadata
+ * @return The item, or NULL if the ring was empty
+ */
+void *raspiring_pop(RASPIRING_T *ring, RASPIRING_SLOT *slot)
+{
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	RASPIRING_SLOT *entry;
+	void *item;
+
+	if (head == tail)
+		return NULL;
+
+	entry = &ring->slots[tail & ring->mask];
+	item = entry->item;
+	if (slot)
+		*slot = *entry;
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return item;
+}
+
+/**
+ * Look at the oldest entry without taking it. Only ever called from the
+ * consumer thread.
+ *
+ * @param ring The ring
+ * @param slot If not NULL, receives a copy of the entry's metadata
+ * @return The item, or NULL if the ring was empty
+ */
+void *raspiring_peek(RASPIRING_T *ring, RASPIRING_SLOT *slot)
+{
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	RASPIRING_SLOT *entry;
+
+	if (head == tail)
+		return NULL;
+
+	entry = &ring->slots[tail & ring->mask];
+	if (slot)
+		*slot = *entry;
+
+	return entry->item;
+}
+
+/**
+ * Take the oldest entry, sleeping on the eventfd while the ring is empty.
+ * Only ever called from the consumer thread.
+ *
+ * @param ring The ring
+ * @param timeout_ms How long to wait, -1 to wait until an item or raspiring_wake()
+ * @param slot If not NULL, receives a copy of the entry's metadata
+ * @return The item, or NULL on timeout, raspiring_wake() or error
+ */
+void *raspiring_wait(RASPIRING_T *ring, int timeout_ms, RASPIRING_SLOT *slot)
+{
+	struct pollfd pfd;
+	uint64_t count;
+	void *item;
+	int ret;
+
+	while ((item = raspiring_pop(ring, slot)) == NULL) {
+		__atomic_store_n(&ring->waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		/* The producer may have pushed before it could see us waiting */
+		item = raspiring_pop(ring, slot);
+		if (item || __atomic_exchange_n(&ring->woken, 0, __ATOMIC_ACQ_REL)) {
+			__atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+			break;
+		}
+
+		pfd.fd = ring->eventfd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		ret = poll(&pfd, 1, timeout_ms);
+		__atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+
+		if (ret > 0 && read(ring->eventfd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+			return NULL;
+		if (ret == 0 || (ret < 0 && errno != EINTR))
+			return raspiring_pop(ring, slot);
+		if (__atomic_exchange_n(&ring->woken, 0, __ATOMIC_ACQ_REL))
+			return raspiring_pop(ring, slot);
+	}
+
+	return item;
+}
+
+/**
+ * Make the current (or next) raspiring_wait() return even if the ring is
+ * empty. Safe to call from any thread.
+ *
+ * @param ring The ring
+ * @return 1 if done, 0 if a sleeping consumer couldn't be woken
+ */
+int raspiring_wake(RASPIRING_T *ring)
+{
+	uint64_t one = 1;
+
+	__atomic_store_n(&ring->woken, 1, __ATOMIC_RELEASE);
+	return write(ring->eventfd, &one, sizeof(one)) == sizeof(one) || errno == EAGAIN;
+}
+
+/**
+ * Number of entries waiting. Exact from the consumer thread, a snapshot
+ * from anywhere else.
+ *
+ * @param ring The ring
+ * @return Entries in the ring
+ */
+unsigned int raspiring_length(RASPIRING_T *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+	    __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPIRING_H_
+#define RASPIRING_H_
+
+#include <stdint.h>
+
+/* Bounded single producer / single consumer ring used to hand buffers from
+ * an MMAL port callback to the thread that pushes them downstream.
+ *
+ * The producer never takes a lock or makes a syscall unless the consumer
+ * has said it is sleeping, in which case one eventfd write wakes it.
+ * Plain C with no GStreamer or MMAL dependency, so it can be exercised
+ * off target.
+ */
+
+#define RASPIRING_CACHE_LINE 64
+
+/// One entry in the ring, padded to a cache line so neighbouring slots don't share one
+typedef struct
+{
+   void *item;                         /// What was pushed
+   int64_t arrival;                    /// CLOCK_MONOTONIC time of the push, in microseconds
+   int64_t pts;                        /// Timestamp supplied by the producer
+   uint32_t flags;                     /// Flags supplied by the producer
+} __attribute__ ((aligned (RASPIRING_CACHE_LINE))) RASPIRING_SLOT;
+
+typedef struct RASPIRING_T RASPIRING_T;
+
+RASPIRING_T *raspiring_create(unsigned int capacity);
+void raspiring_destroy(RASPIRING_T *ring);
+
+int raspiring_push(RASPIRING_T *ring, void *item, uint32_t flags, int64_t pts);
+void *raspiring_pop(RASPIRING_T *ring, RASPIRING_SLOT *slot);
+void *raspiring_peek(RASPIRING_T *ring, RASPIRING_SLOT *slot);
+void *raspiring_wait(RASPIRING_T *ring, int timeout_ms, RASPIRING_SLOT *slot);
+int raspiring_wake(RASPIRING_T *ring);
+
+unsigned int raspiring_length(RASPIRING_T *ring);
+int64_t raspiring_now(void);
+
+#endif /* RASPIRING_H_ */
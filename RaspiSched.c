@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "RaspiSched.h"
+
+/**
+ * Assign a default set of parameters: no pinning, normal scheduling
+ *
+ * @param params Pointer to parameter block
+ */
+void raspisched_set_defaults(RASPISCHED_PARAMETERS * params)
+{
+	params->cpu_mask = 0;
+	params->policy = SCHED_OTHER;
+	params->priority = 0;
+}
+
+/**
+ * Whether the parameters ask for anything at all
+ *
+ * @param params Pointer to parameter block
+ * @return !0 if applying them would be a no-op
+ */
+int raspisched_is_default(const RASPISCHED_PARAMETERS * params)
+{
+	return params->cpu_mask == 0 && params->policy == SCHED_OTHER;
+}
+
+/**
+ * Pin the calling thread and switch its scheduling class. Each part is
+ * attempted on its own, so missing privileges for a real-time class still
+ * leave the affinity applied.
+ *
+ * @param params Pointer to parameter block
+ * @param error Receives the errno of the last failure, may be NULL
+ * @return 0 if all applied, else RASPISCHED_*_FAILED bits
+ */
+int raspisched_apply_current_thread(const RASPISCHED_PARAMETERS * params, int *error)
+{
+	struct sched_param param;
+	int failed = 0, ret;
+
+	if (params->cpu_mask) {
+		cpu_set_t set;
+		unsigned int cpu;
+
+		CPU_ZERO(&set);
+		for (cpu = 0; cpu < sizeof(params->cpu_mask) * 8; cpu++) {
+			if (params->cpu_mask & (1u << cpu))
+				CPU_SET(cpu, &set);
+		}
+
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (ret != 0) {
+			failed |= RASPISCHED_AFFINITY_FAILED;
+			if (error)
+				*error = ret;
+		}
+	}
+
+	memset(&param, 0, sizeof(param));
+	if (params->policy != SCHED_OTHER) {
+		int min = sched_get_priority_min(params->policy);
+		int max = sched_get_priority_max(params->policy);
+
+		param.sched_priority = params->priority;
+		if (param.sched_priority < min)
+			param.sched_priority = min;
+		if (param.sched_priority > max)
+			param.sched_priority = max;
+	}
+
+	ret = pthread_setschedparam(pthread_self(), params->policy, &param);
+	if (ret != 0) {
+		/* Typically EPERM without CAP_SYS_NICE: stay where we are */
+		failed |= RASPISCHED_POLICY_FAILED;
+		if (error)
+			*error = ret;
+	}
+
+	return failed;
+}
+
+/**
+ * Read the calling thread's affinity and scheduling class, to put back
+ * later with raspisched_apply_current_thread()
+ *
+ * @param params Receives the settings, with CPUs past the mask's width left out
+ * @return 0 if read, else an errno value
+ */
+int raspisched_get_current_thread(RASPISCHED_PARAMETERS * params)
+{
+	struct sched_param param;
+	cpu_set_t set;
+	unsigned int cpu;
+	int ret;
+
+	ret = pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+	if (ret != 0)
+		return ret;
+
+	params->cpu_mask = 0;
+	for (cpu = 0; cpu < sizeof(params->cpu_mask) * 8; cpu++) {
+		if (CPU_ISSET(cpu, &set))
+			params->cpu_mask |= 1u << cpu;
+	}
+
+	ret = pthread_getschedparam(pthread_self(), &params->policy, &param);
+	if (ret != 0)
+		return ret;
+	params->priority = param.sched_priority;
+
+	return 0;
+}
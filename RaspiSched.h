@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPISCHED_H_
+#define RASPISCHED_H_
+
+/* CPU affinity and scheduling class for the calling thread.
+ *
+ * Real-time classes need CAP_SYS_NICE (or an RLIMIT_RTPRIO allowance);
+ * without it the thread simply stays in the normal class.
+ */
+
+/// Outcome of raspisched_apply_current_thread(), as a bit mask
+#define RASPISCHED_AFFINITY_FAILED   (1 << 0)
+#define RASPISCHED_POLICY_FAILED     (1 << 1)
+
+typedef struct
+{
+   unsigned int cpu_mask;              /// Bit n set to allow CPU n, 0 to leave affinity alone
+   int policy;                         /// SCHED_OTHER, SCHED_FIFO or SCHED_RR
+   int priority;                       /// Real-time priority, 1-99, ignored for SCHED_OTHER
+} RASPISCHED_PARAMETERS;
+
+void raspisched_set_defaults(RASPISCHED_PARAMETERS *params);
+int raspisched_is_default(const RASPISCHED_PARAMETERS *params);
+int raspisched_apply_current_thread(const RASPISCHED_PARAMETERS *params, int *error);
+int raspisched_get_current_thread(RASPISCHED_PARAMETERS *params);
+
+#endif /* RASPISCHED_H_ */
@@ -0,0 +1,875 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include <gst/gst.h>
+
+#include "RaspiShm.h"
+
+GST_DEBUG_CATEGORY_EXTERN(gst_rpi_cam_src_debug);
+#define GST_CAT_DEFAULT gst_rpi_cam_src_debug
+#include "RaspiTrace.h"
+
+#define RASPISHM_MAGIC 0x48535052	/* "RPSH" */
+#define RASPISHM_VERSION 2
+
+#define CACHE_LINE 64
+#define PAGE_ALIGN(x) (((x) + 4095) & ~(size_t)4095)
+
+/// Largest header AU kept for late joiners
+#define CONFIG_MAX 4096
+#define CAPS_MAX 2048
+
+/// Descriptors per slot, so a lagging consumer notices it fell behind
+#define DESCS_PER_SLOT 8
+
+/// Set in SHM_SLOT.readers while the broker fills the slot
+#define WRITER 0x80000000u
+
+/// Hold counts per consumer, padded so consumers don't share cache lines
+#define HOLDS_STRIDE(slots) (((slots) + CACHE_LINE / 4 - 1) & ~(CACHE_LINE / 4 - 1))
+
+/* Everything below lives in the shared mapping, so it only holds offsets
+ * and plain values, never pointers. */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t desc_count;
+	uint64_t slot_size;
+	uint64_t data_offset;	/// Offset of the first slot's data
+	uint64_t total_size;
+	uint32_t alive;		/// Cleared when the broker shuts down
+	uint32_t waiters;	/// Consumers sleeping on notify
+
+	uint32_t notify __attribute__ ((aligned(CACHE_LINE)));	/// Futex word, bumped on every publish
+	uint64_t write_seq;	/// Sequence number the next AU gets, AUs start at 1
+	uint64_t idr_seq;	/// Last key frame AU, 0 if none yet
+
+	uint32_t config_lock __attribute__ ((aligned(CACHE_LINE)));	/// Seqlock, odd while config or caps change
+	uint32_t config_size;
+	char config[CONFIG_MAX];	/// Last header AU, for late joiners
+	char caps[CAPS_MAX];
+
+	RASPISHM_STATS stats;
+} SHM_HEADER;
+
+typedef struct {
+	uint64_t seq;		/// AU described, 0 while being rewritten
+	uint32_t slot;
+	uint32_t flags;
+	uint64_t size;
+	int64_t pts;
+	int64_t dts;
+	int64_t published;
+} __attribute__ ((aligned(CACHE_LINE))) SHM_DESC;
+
+typedef struct {
+	uint32_t readers;	/// Consumers holding the slot, plus WRITER while it is filled
+	uint64_t seq;		/// AU the slot holds
+} __attribute__ ((aligned(CACHE_LINE))) SHM_SLOT;
+
+/// Pointers into one process' view of the mapping
+typedef struct {
+	SHM_HEADER *hdr;
+	SHM_DESC *descs;
+	SHM_SLOT *slots;
+	uint32_t *holds;	/// Slots each consumer holds, RASPISHM_MAX_CLIENTS tables
+	unsigned char *data;
+	size_t size;
+} SHM_MAP;
+
+struct RASPISHM_SERVER_T {
+	SHM_MAP map;
+	int memfd;
+	int listen_fd;
+	int wake_pipe[2];	/// Written to stop the accept thread
+	int client_fds[RASPISHM_MAX_CLIENTS];	/// Consumer connections, -1 where free
+	pthread_t thread;
+	char *socket_path;
+	int pending_slot;	/// Slot claimed by raspishm_server_begin(), -1 if none
+	size_t pending_size;
+	unsigned int next_slot;	/// Where to start looking for a free slot
+};
+
+struct RASPISHM_CLIENT_T {
+	SHM_MAP map;
+	int sock;		/// Connection to the broker, closing it gives our slots back
+	uint32_t *held;		/// Our table in SHM_MAP.holds
+	uint64_t next_seq;	/// Next AU to read
+	int started;		/// The joining AUs have been picked
+	int wait_key;		/// Skip AUs until a key frame
+	int discont;		/// AUs were missed since the last one returned
+	int refs;		/// One for the client, one per AU held
+	char config[CONFIG_MAX];	/// Header AU handed out on joining
+};
+
+static int64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void map_layout(SHM_MAP * map, void *base, size_t size)
+{
+	map->hdr = base;
+	map->descs = (SHM_DESC *) ((char *)base + PAGE_ALIGN(sizeof(SHM_HEADER)));
+	map->slots = (SHM_SLOT *) (map->descs + map->hdr->desc_count);
+	map->holds = (uint32_t *) (map->slots + map->hdr->slot_count);
+	map->data = (unsigned char *)base + map->hdr->data_offset;
+	map->size = size;
+}
+
+static int futex(uint32_t * addr, int op, uint32_t val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static void notify_consumers(SHM_HEADER * hdr)
+{
+	__atomic_add_fetch(&hdr->notify, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&hdr->waiters, __ATOMIC_SEQ_CST))
+		futex(&hdr->notify, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+/**
+ * Hand the memfd to a consumer that connected to the socket
+ *
+ * @param sock Connected socket
+ * @param fd File descriptor to pass
+ * @param id Consumer's index in SHM_MAP.holds
+ * @return 0 if sent, -1 otherwise
+ */
+static int send_fd(int sock, int fd, unsigned char id)
+{
+	struct iovec iov = { &id, 1 };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+/**
+ * Receive the memfd from the broker
+ *
+ * @param sock Connected socket
+ * @param id Receives our index in SHM_MAP.holds
+ * @return The file descriptor, or -1
+ */
+static int recv_fd(int sock, unsigned char *id)
+{
+	struct iovec iov = { id, 1 };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	int fd = -1;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+		return -1;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+	return fd;
+}
+
+/**
+ * Give back the slots a consumer held when it went away, and free its entry
+ *
+ * @param server The broker
+ * @param id Consumer's index in client_fds
+ */
+static void reclaim_client(RASPISHM_SERVER_T * server, unsigned int id)
+{
+	SHM_MAP *map = &server->map;
+	uint32_t *held = map->holds + (size_t) id * HOLDS_STRIDE(map->hdr->slot_count);
+	uint64_t reclaimed = 0;
+	unsigned int i;
+
+	/* The consumer only closes its socket once it has released every AU, so
+	 * anything still counted here belonged to a consumer that died */
+	for (i = 0; i < map->hdr->slot_count; i++) {
+		uint32_t count = __atomic_exchange_n(&held[i], 0, __ATOMIC_ACQ_REL);
+
+		if (count) {
+			__atomic_fetch_sub(&map->slots[i].readers, count, __ATOMIC_RELEASE);
+			reclaimed += count;
+		}
+	}
+	if (reclaimed) {
+		RASPI_WARNING("Broker consumer %u went away holding %" PRIu64 " AUs", id, reclaimed);
+		__atomic_add_fetch(&map->hdr->stats.reclaimed, reclaimed, __ATOMIC_RELAXED);
+	}
+
+	close(server->client_fds[id]);
+	server->client_fds[id] = -1;
+}
+
+/* Accept thread: every consumer that connects gets the memfd and an entry
+ * in the holds tables, which is reclaimed when its connection closes */
+static void *server_thread(void *data)
+{
+	RASPISHM_SERVER_T *server = data;
+	struct pollfd pfd[2 + RASPISHM_MAX_CLIENTS];
+	unsigned int ids[RASPISHM_MAX_CLIENTS];
+
+	pfd[0].fd = server->listen_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = server->wake_pipe[0];
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		unsigned int i, count = 0;
+		int sock;
+
+		for (i = 0; i < RASPISHM_MAX_CLIENTS; i++) {
+			if (server->client_fds[i] < 0)
+				continue;
+			pfd[2 + count].fd = server->client_fds[i];
+			pfd[2 + count].events = POLLIN;
+			ids[count++] = i;
+		}
+
+		if (poll(pfd, 2 + count, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (pfd[1].revents)
+			break;
+
+		/* Consumers never write, so a readable connection has closed */
+		for (i = 0; i < count; i++) {
+			char byte;
+
+			if (pfd[2 + i].revents && read(pfd[2 + i].fd, &byte, 1) <= 0)
+				reclaim_client(server, ids[i]);
+		}
+
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+
+		sock = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (sock < 0)
+			continue;
+		for (i = 0; i < RASPISHM_MAX_CLIENTS && server->client_fds[i] >= 0; i++) ;
+		if (i == RASPISHM_MAX_CLIENTS) {
+			RASPI_WARNING("Broker has too many consumers, turning one away");
+			close(sock);
+		} else if (send_fd(sock, server->memfd, i) < 0) {
+			RASPI_WARNING("Broker failed to pass the buffer to a consumer (%d)", errno);
+			close(sock);
+		} else {
+			server->client_fds[i] = sock;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Create the broker: the shared mapping and the socket consumers connect to
+ *
+ * @param socket_path Unix socket path, replaced if it exists
+ * @param slots Number of AUs the mapping holds
+ * @param slot_size Largest AU that can be published
+ * @return The broker, or NULL on failure
+ */
+RASPISHM_SERVER_T *raspishm_server_create(const char *socket_path, unsigned int slots,
+					  size_t slot_size)
+{
+	RASPISHM_SERVER_T *server;
+	struct sockaddr_un addr;
+	size_t meta_size, total;
+	unsigned int desc_count = slots * DESCS_PER_SLOT;
+	unsigned int i;
+	void *base;
+
+	if (slots < 2 || strlen(socket_path) >= sizeof(addr.sun_path))
+		return NULL;
+
+	server = calloc(1, sizeof(*server));
+	if (server == NULL)
+		return NULL;
+	server->memfd = server->listen_fd = -1;
+	server->wake_pipe[0] = server->wake_pipe[1] = -1;
+	server->pending_slot = -1;
+	for (i = 0; i < RASPISHM_MAX_CLIENTS; i++)
+		server->client_fds[i] = -1;
+
+	slot_size = PAGE_ALIGN(slot_size);
+	meta_size = PAGE_ALIGN(sizeof(SHM_HEADER)) +
+	    PAGE_ALIGN(desc_count * sizeof(SHM_DESC) + slots * sizeof(SHM_SLOT) +
+		       RASPISHM_MAX_CLIENTS * HOLDS_STRIDE(slots) * sizeof(uint32_t));
+	total = meta_size + slots * slot_size;
+
+	server->memfd = memfd_create("rpicamsrc-broker", MFD_CLOEXEC);
+	if (server->memfd < 0 || ftruncate(server->memfd, total) < 0)
+		goto error;
+
+	base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, server->memfd, 0);
+	if (base == MAP_FAILED)
+		goto error;
+
+	/* ftruncate() zeroed the mapping, so only the non-zero fields need setting */
+	((SHM_HEADER *) base)->desc_count = desc_count;
+	((SHM_HEADER *) base)->slot_count = slots;
+	map_layout(&server->map, base, total);
+	server->map.hdr->magic = RASPISHM_MAGIC;
+	server->map.hdr->version = RASPISHM_VERSION;
+	server->map.hdr->slot_size = slot_size;
+	server->map.hdr->data_offset = meta_size;
+	server->map.hdr->total_size = total;
+	server->map.hdr->write_seq = 1;
+	server->map.data = (unsigned char *)base + meta_size;
+	__atomic_store_n(&server->map.hdr->alive, 1, __ATOMIC_RELEASE);
+
+	server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (server->listen_fd < 0)
+		goto error;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+	unlink(socket_path);
+	if (bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+	    || listen(server->listen_fd, 8) < 0)
+		goto error;
+	server->socket_path = strdup(socket_path);
+
+	if (pipe2(server->wake_pipe, O_CLOEXEC) < 0)
+		goto error;
+	if (pthread_create(&server->thread, NULL, server_thread, server) != 0) {
+		close(server->wake_pipe[0]);
+		close(server->wake_pipe[1]);
+		server->wake_pipe[0] = server->wake_pipe[1] = -1;
+		goto error;
+	}
+
+	return server;
+
+ error:
+	RASPI_ERROR("Unable to create broker on %s (%d)", socket_path, errno);
+	raspishm_server_destroy(server);
+	return NULL;
+}
+
+/**
+ * Shut the broker down. Consumers see it go away on their next read, and
+ * their mappings stay valid until they let go of them.
+ *
+ * @param server The broker, may be NULL
+ */
+void raspishm_server_destroy(RASPISHM_SERVER_T * server)
+{
+	unsigned int i;
+
+	if (server == NULL)
+		return;
+
+	if (server->wake_pipe[1] >= 0) {
+		if (write(server->wake_pipe[1], "x", 1) < 0)
+			RASPI_ERROR("Unable to stop the broker's accept thread");
+		pthread_join(server->thread, NULL);
+		close(server->wake_pipe[0]);
+		close(server->wake_pipe[1]);
+	}
+
+	for (i = 0; i < RASPISHM_MAX_CLIENTS; i++)
+		if (server->client_fds[i] >= 0)
+			close(server->client_fds[i]);
+	if (server->listen_fd >= 0)
+		close(server->listen_fd);
+	if (server->socket_path) {
+		unlink(server->socket_path);
+		free(server->socket_path);
+	}
+
+	if (server->map.hdr) {
+		__atomic_store_n(&server->map.hdr->alive, 0, __ATOMIC_RELEASE);
+		notify_consumers(server->map.hdr);
+		munmap(server->map.hdr, server->map.size);
+	}
+	if (server->memfd >= 0)
+		close(server->memfd);
+
+	free(server);
+}
+
+/**
+ * Set the caps string consumers negotiate with
+ *
+ * @param server The broker
+ * @param caps Caps in string form
+ */
+void raspishm_server_set_caps(RASPISHM_SERVER_T * server, const char *caps)
+{
+	SHM_HEADER *hdr = server->map.hdr;
+
+	__atomic_add_fetch(&hdr->config_lock, 1, __ATOMIC_ACQ_REL);
+	strncpy(hdr->caps, caps, CAPS_MAX - 1);
+	__atomic_add_fetch(&hdr->config_lock, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Claim a slot for the next AU. The caller fills it in place, which is the
+ * only copy the AU ever gets, then calls raspishm_server_commit().
+ *
+ * @param server The broker
+ * @param size Size of the AU
+ * @return Where to write the AU, or NULL if it has to be dropped
+ */
+void *raspishm_server_begin(RASPISHM_SERVER_T * server, size_t size)
+{
+	SHM_MAP *map = &server->map;
+	uint64_t idr_seq = map->hdr->idr_seq;
+	unsigned int i;
+
+	/* An AU begun but never committed gives its slot back */
+	if (server->pending_slot >= 0) {
+		__atomic_fetch_and(&map->slots[server->pending_slot].readers, ~WRITER,
+				   __ATOMIC_RELEASE);
+		server->pending_slot = -1;
+	}
+
+	if (size > map->hdr->slot_size) {
+		map->hdr->stats.dropped++;
+		return NULL;
+	}
+
+	for (i = 0; i < map->hdr->slot_count; i++) {
+		unsigned int slot = (server->next_slot + i) % map->hdr->slot_count;
+		uint32_t expected = 0;
+
+		/* Keep the last key frame for late joiners */
+		if (idr_seq && map->slots[slot].seq == idr_seq)
+			continue;
+
+		/* Fails while any consumer still holds the slot */
+		if (__atomic_compare_exchange_n(&map->slots[slot].readers, &expected, WRITER, 0,
+						__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&map->slots[slot].seq, 0, __ATOMIC_RELEASE);
+			server->pending_slot = slot;
+			server->pending_size = size;
+			server->next_slot = slot + 1;
+			return map->data + (size_t) slot *map->hdr->slot_size;
+		}
+	}
+
+	map->hdr->stats.dropped++;
+	return NULL;
+}
+
+/**
+ * Publish the AU written since raspishm_server_begin() and wake consumers
+ *
+ * @param server The broker
+ * @param pts Timestamp to pass on, -1 if none
+ * @param dts Decode timestamp to pass on, -1 if none
+ * @param flags RASPISHM_FLAG_KEYFRAME and/or RASPISHM_FLAG_CONFIG
+ */
+void raspishm_server_commit(RASPISHM_SERVER_T * server, int64_t pts, int64_t dts, uint32_t flags)
+{
+	SHM_MAP *map = &server->map;
+	SHM_HEADER *hdr = map->hdr;
+	int slot = server->pending_slot;
+	uint64_t seq = hdr->write_seq;
+	SHM_DESC *desc = &map->descs[seq % hdr->desc_count];
+
+	if (slot < 0)
+		return;
+	server->pending_slot = -1;
+
+	/* Consumers treat a descriptor whose seq changed under them as gone */
+	__atomic_store_n(&desc->seq, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&desc->slot, slot, __ATOMIC_RELAXED);
+	__atomic_store_n(&desc->flags, flags, __ATOMIC_RELAXED);
+	__atomic_store_n(&desc->size, server->pending_size, __ATOMIC_RELAXED);
+	__atomic_store_n(&desc->pts, pts, __ATOMIC_RELAXED);
+	__atomic_store_n(&desc->dts, dts, __ATOMIC_RELAXED);
+	__atomic_store_n(&desc->published, now_us(), __ATOMIC_RELAXED);
+	__atomic_store_n(&desc->seq, seq, __ATOMIC_RELEASE);
+	__atomic_store_n(&map->slots[slot].seq, seq, __ATOMIC_RELEASE);
+
+	if ((flags & RASPISHM_FLAG_CONFIG) && server->pending_size <= CONFIG_MAX) {
+		__atomic_add_fetch(&hdr->config_lock, 1, __ATOMIC_ACQ_REL);
+		memcpy(hdr->config, map->data + (size_t) slot * hdr->slot_size,
+		       server->pending_size);
+		hdr->config_size = server->pending_size;
+		__atomic_add_fetch(&hdr->config_lock, 1, __ATOMIC_RELEASE);
+		hdr->stats.bytes_copied += server->pending_size;
+	}
+	if (flags & RASPISHM_FLAG_KEYFRAME)
+		__atomic_store_n(&hdr->idr_seq, seq, __ATOMIC_RELEASE);
+
+	__atomic_store_n(&hdr->write_seq, seq + 1, __ATOMIC_RELEASE);
+	__atomic_fetch_and(&map->slots[slot].readers, ~WRITER, __ATOMIC_RELEASE);
+
+	hdr->stats.published++;
+	hdr->stats.bytes_copied += server->pending_size;
+
+	notify_consumers(hdr);
+}
+
+/**
+ * Read the broker's counters
+ *
+ * @param server The broker
+ * @param stats Receives the counters
+ */
+void raspishm_server_get_stats(RASPISHM_SERVER_T * server, RASPISHM_STATS * stats)
+{
+	*stats = server->map.hdr->stats;
+}
+
+/**
+ * Connect to a broker and map its AUs
+ *
+ * @param socket_path Unix socket the broker listens on
+ * @return The consumer, or NULL if there is no broker there
+ */
+RASPISHM_CLIENT_T *raspishm_client_connect(const char *socket_path)
+{
+	RASPISHM_CLIENT_T *client;
+	struct sockaddr_un addr;
+	struct stat st;
+	unsigned char id;
+	void *base;
+	int sock, fd;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		return NULL;
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return NULL;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(sock);
+		return NULL;
+	}
+	/* The connection stays open: the broker reclaims our slots once it closes */
+	fd = recv_fd(sock, &id);
+	if (fd < 0 || id >= RASPISHM_MAX_CLIENTS)
+		goto error;
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(SHM_HEADER))
+		goto error;
+	base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	fd = -1;
+	if (base == MAP_FAILED)
+		goto error;
+
+	if (((SHM_HEADER *) base)->magic != RASPISHM_MAGIC
+	    || ((SHM_HEADER *) base)->version != RASPISHM_VERSION
+	    || ((SHM_HEADER *) base)->total_size != (uint64_t) st.st_size) {
+		RASPI_ERROR("%s is not a compatible broker", socket_path);
+		munmap(base, st.st_size);
+		goto error;
+	}
+
+	client = calloc(1, sizeof(*client));
+	if (client == NULL) {
+		munmap(base, st.st_size);
+		goto error;
+	}
+	map_layout(&client->map, base, st.st_size);
+	client->sock = sock;
+	client->held = client->map.holds + (size_t) id * HOLDS_STRIDE(client->map.hdr->slot_count);
+	client->refs = 1;
+
+	return client;
+
+ error:
+	if (fd >= 0)
+		close(fd);
+	close(sock);
+	return NULL;
+}
+
+static void client_unref(RASPISHM_CLIENT_T * client)
+{
+	if (__atomic_sub_fetch(&client->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		munmap(client->map.hdr, client->map.size);
+		close(client->sock);
+		free(client);
+	}
+}
+
+/**
+ * Disconnect. The mapping goes away once every AU has been released too.
+ *
+ * @param client The consumer, may be NULL
+ */
+void raspishm_client_destroy(RASPISHM_CLIENT_T * client)
+{
+	if (client)
+		client_unref(client);
+}
+
+/**
+ * Copy the broker's caps string
+ *
+ * @param client The consumer
+ * @param caps Receives the caps
+ * @param size Size of caps
+ * @return 1 if the broker has set caps, 0 otherwise
+ */
+int raspishm_client_get_caps(RASPISHM_CLIENT_T * client, char *caps, size_t size)
+{
+	SHM_HEADER *hdr = client->map.hdr;
+	uint32_t lock;
+
+	if (size == 0)
+		return 0;
+
+	do {
+		lock = __atomic_load_n(&hdr->config_lock, __ATOMIC_ACQUIRE);
+		strncpy(caps, hdr->caps, size - 1);
+		caps[size - 1] = '\0';
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((lock & 1) || lock != __atomic_load_n(&hdr->config_lock, __ATOMIC_RELAXED));
+
+	return caps[0] != '\0';
+}
+
+/* Copy the cached header AU, returning its size (0 if none) */
+static size_t read_config(RASPISHM_CLIENT_T * client)
+{
+	SHM_HEADER *hdr = client->map.hdr;
+	uint32_t lock, size;
+
+	do {
+		lock = __atomic_load_n(&hdr->config_lock, __ATOMIC_ACQUIRE);
+		size = hdr->config_size;
+		if (size > CONFIG_MAX)
+			size = 0;
+		memcpy(client->config, hdr->config, size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((lock & 1) || lock != __atomic_load_n(&hdr->config_lock, __ATOMIC_RELAXED));
+
+	return size;
+}
+
+/* Take hold of AU seq, returns 1 if it is still in the mapping */
+static int claim(RASPISHM_CLIENT_T * client, uint64_t seq, RASPISHM_AU * au)
+{
+	SHM_MAP *map = &client->map;
+	SHM_DESC *desc = &map->descs[seq % map->hdr->desc_count];
+	SHM_SLOT *slot;
+	uint32_t index;
+
+	if (__atomic_load_n(&desc->seq, __ATOMIC_ACQUIRE) != seq)
+		return 0;
+	index = __atomic_load_n(&desc->slot, __ATOMIC_RELAXED);
+	au->flags = __atomic_load_n(&desc->flags, __ATOMIC_RELAXED);
+	au->size = __atomic_load_n(&desc->size, __ATOMIC_RELAXED);
+	au->pts = __atomic_load_n(&desc->pts, __ATOMIC_RELAXED);
+	au->dts = __atomic_load_n(&desc->dts, __ATOMIC_RELAXED);
+	au->published = __atomic_load_n(&desc->published, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&desc->seq, __ATOMIC_RELAXED) != seq || index >= map->hdr->slot_count)
+		return 0;
+
+	/* Holding the slot stops the broker reusing it; if it got there first
+	 * the slot no longer has our AU */
+	slot = &map->slots[index];
+	if ((__atomic_fetch_add(&slot->readers, 1, __ATOMIC_SEQ_CST) & WRITER)
+	    || __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) != seq) {
+		__atomic_fetch_sub(&slot->readers, 1, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	au->data = map->data + (size_t) index * map->hdr->slot_size;
+	au->seq = seq;
+	au->slot = index;
+	/* Counted after the slot, so dying in between leaks a hold rather than
+	 * letting the broker take back one we never had */
+	__atomic_add_fetch(&client->held[index], 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&client->refs, 1, __ATOMIC_ACQ_REL);
+
+	return 1;
+}
+
+/* Sleep until the broker publishes, returns 0 on timeout */
+static int wait_publish(SHM_HEADER * hdr, uint32_t notify, int timeout_ms)
+{
+	struct timespec ts, *timeout = NULL;
+	int ret;
+
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+		timeout = &ts;
+	}
+
+	__atomic_add_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+	ret = futex(&hdr->notify, FUTEX_WAIT, notify, timeout);
+	__atomic_sub_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return !(ret < 0 && errno == ETIMEDOUT);
+}
+
+/**
+ * Get the next AU without copying it. A new consumer starts with the
+ * stream headers and the last key frame; one that fell behind skips ahead
+ * to the next key frame, with RASPISHM_FLAG_DISCONT set.
+ *
+ * @param client The consumer
+ * @param au Receives the AU, hand it back with raspishm_client_release()
+ * @param timeout_ms How long to wait, -1 for ever
+ * @return 1 with an AU, 0 on timeout, -1 if the broker has gone
+ */
+int raspishm_client_next(RASPISHM_CLIENT_T * client, RASPISHM_AU * au, int timeout_ms)
+{
+	SHM_HEADER *hdr = client->map.hdr;
+	uint64_t write_seq;
+	uint32_t notify;
+	size_t size;
+
+	if (!client->started) {
+		client->started = 1;
+		client->wait_key = 1;
+		client->next_seq = __atomic_load_n(&hdr->idr_seq, __ATOMIC_ACQUIRE);
+		if (client->next_seq == 0)
+			client->next_seq = __atomic_load_n(&hdr->write_seq, __ATOMIC_ACQUIRE);
+
+		/* Headers first, so a decoder can start at the key frame */
+		size = read_config(client);
+		if (size) {
+			memset(au, 0, sizeof(*au));
+			au->data = client->config;
+			au->size = size;
+			au->pts = au->dts = -1;
+			au->published = now_us();
+			au->flags = RASPISHM_FLAG_CONFIG;
+			au->slot = -1;
+			__atomic_add_fetch(&client->refs, 1, __ATOMIC_ACQ_REL);
+			return 1;
+		}
+	}
+
+	for (;;) {
+		if (!__atomic_load_n(&hdr->alive, __ATOMIC_ACQUIRE))
+			return -1;
+
+		notify = __atomic_load_n(&hdr->notify, __ATOMIC_SEQ_CST);
+		write_seq = __atomic_load_n(&hdr->write_seq, __ATOMIC_SEQ_CST);
+		if (client->next_seq >= write_seq) {
+			if (!wait_publish(hdr, notify, timeout_ms))
+				return 0;
+			continue;
+		}
+
+		/* Too far behind for the descriptors to still be there */
+		if (write_seq - client->next_seq >= hdr->desc_count) {
+			client->next_seq = write_seq - 1;
+			client->wait_key = client->discont = 1;
+		}
+
+		if (!claim(client, client->next_seq++, au)) {
+			client->wait_key = client->discont = 1;
+			continue;
+		}
+
+		if (client->wait_key
+		    && !(au->flags & (RASPISHM_FLAG_KEYFRAME | RASPISHM_FLAG_CONFIG))) {
+			raspishm_client_release(client, au);
+			client->discont = 1;
+			continue;
+		}
+		if (au->flags & RASPISHM_FLAG_KEYFRAME)
+			client->wait_key = 0;
+		if (client->discont)
+			au->flags |= RASPISHM_FLAG_DISCONT;
+		client->discont = 0;
+
+		return 1;
+	}
+}
+
+/**
+ * Hand an AU back so the broker can reuse its slot. Safe from any thread,
+ * and after raspishm_client_destroy().
+ *
+ * @param client The consumer
+ * @param au AU from raspishm_client_next()
+ */
+void raspishm_client_release(RASPISHM_CLIENT_T * client, const RASPISHM_AU * au)
+{
+	if (au->slot >= 0) {
+		__atomic_sub_fetch(&client->held[au->slot], 1, __ATOMIC_RELEASE);
+		__atomic_fetch_sub(&client->map.slots[au->slot].readers, 1, __ATOMIC_RELEASE);
+	}
+
+	client_unref(client);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPISHM_H_
+#define RASPISHM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shared memory broker for encoded access units.
+ *
+ * One process owns the camera and publishes each AU into a memfd shared
+ * with any number of consumer processes. Consumers connect to a unix
+ * socket to receive the memfd, then read AUs straight out of the mapping
+ * without copying. A slot stays untouched while a consumer holds it, and
+ * the slot holding the last key frame is kept so late joiners can start
+ * decoding at once.
+ *
+ * Each consumer keeps its socket open and counts the slots it holds in its
+ * own table in the mapping, so when a consumer dies the broker sees the
+ * socket close and gives its slots back. Up to RASPISHM_MAX_CLIENTS
+ * consumers can be connected at once.
+ */
+
+/// Default unix socket path
+#define RASPISHM_DEFAULT_SOCKET "/tmp/rpicamsrc-broker"
+
+/// Consumers connected at once, more are turned away
+#define RASPISHM_MAX_CLIENTS 16
+
+#define RASPISHM_FLAG_KEYFRAME  (1 << 0)   /// AU can be decoded on its own
+#define RASPISHM_FLAG_CONFIG    (1 << 1)   /// AU holds stream headers (SPS/PPS)
+#define RASPISHM_FLAG_DISCONT   (1 << 2)   /// Set by the consumer side when AUs were missed
+
+/// An access unit as seen by a consumer
+typedef struct
+{
+   const void *data;                   /// Points into the shared mapping, valid until released
+   size_t size;                        /// Bytes of data
+   int64_t pts;                        /// Timestamp given by the broker, CLOCK_MONOTONIC nanoseconds, -1 if none
+   int64_t dts;                        /// Decode timestamp given by the broker, same clock, -1 if none
+   int64_t published;                  /// CLOCK_MONOTONIC time the broker published it, in microseconds
+   uint64_t seq;                       /// Sequence number, increasing by one per published AU
+   uint32_t flags;                     /// RASPISHM_FLAG_*
+   int slot;                           /// Slot held, -1 for AUs that live in consumer memory
+} RASPISHM_AU;
+
+typedef struct
+{
+   uint64_t published;                 /// AUs published
+   uint64_t dropped;                   /// AUs that found no free slot, or didn't fit one
+   uint64_t bytes_copied;              /// Bytes copied into the mapping, the only copy made
+   uint64_t reclaimed;                 /// Slot holds given back for consumers that went away
+} RASPISHM_STATS;
+
+typedef struct RASPISHM_SERVER_T RASPISHM_SERVER_T;
+typedef struct RASPISHM_CLIENT_T RASPISHM_CLIENT_T;
+
+RASPISHM_SERVER_T *raspishm_server_create(const char *socket_path, unsigned int slots, size_t slot_size);
+void raspishm_server_destroy(RASPISHM_SERVER_T *server);
+void raspishm_server_set_caps(RASPISHM_SERVER_T *server, const char *caps);
+void *raspishm_server_begin(RASPISHM_SERVER_T *server, size_t size);
+void raspishm_server_commit(RASPISHM_SERVER_T *server, int64_t pts, int64_t dts, uint32_t flags);
+void raspishm_server_get_stats(RASPISHM_SERVER_T *server, RASPISHM_STATS *stats);
+
+RASPISHM_CLIENT_T *raspishm_client_connect(const char *socket_path);
+void raspishm_client_destroy(RASPISHM_CLIENT_T *client);
+int raspishm_client_get_caps(RASPISHM_CLIENT_T *client, char *caps, size_t size);
+int raspishm_client_next(RASPISHM_CLIENT_T *client, RASPISHM_AU *au, int timeout_ms);
+void raspishm_client_release(RASPISHM_CLIENT_T *client, const RASPISHM_AU *au);
+
+#endif /* RASPISHM_H_ */
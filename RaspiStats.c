@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "RaspiStats.h"
+
+#define LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+/* Only one thread ever writes each counter, so no read-modify-write is needed */
+#define BUMP(field, by) STORE(field, LOAD(field) + (by))
+
+/**
+ * Clear all counters, before a capture starts
+ *
+ * @param stats Statistics to clear
+ */
+void raspistats_reset(RASPISTATS_T * stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Count a frame handed downstream. Called from the streaming thread only.
+ *
+ * @param stats Statistics to update
+ * @param now Current time
+ * @param size Frame size in bytes
+ * @param keyframe !0 if the frame is a key frame
+ * @param late !0 if the frame waited over a frame period to be picked up
+ */
+void raspistats_frame(RASPISTATS_T * stats, int64_t now, uint32_t size, int keyframe, int late)
+{
+	if (stats->first_frame == 0) {
+		STORE(stats->first_frame, now);
+		stats->window_start = now;
+	}
+	STORE(stats->last_frame, now);
+	BUMP(stats->frames, 1);
+	BUMP(stats->bytes, size);
+	if (late)
+		BUMP(stats->late_frames, 1);
+
+	if (keyframe) {
+		if (stats->keyframes)
+			STORE(stats->keyframe_interval, stats->frames - stats->last_keyframe);
+		stats->last_keyframe = stats->frames;
+		BUMP(stats->keyframes, 1);
+	}
+
+	stats->window_frames++;
+	stats->window_bytes += size;
+	if (now - stats->window_start >= RASPISTATS_WINDOW_US) {
+		int64_t span = now - stats->window_start;
+
+		STORE(stats->window_fps_milli, (uint32_t) (stats->window_frames * 1000000000 / span));
+		STORE(stats->window_bitrate, stats->window_bytes * 8 * 1000000 / span);
+		stats->window_start = now;
+		stats->window_frames = 0;
+		stats->window_bytes = 0;
+	}
+}
+
+/**
+ * Record the queue state seen when a frame was taken. Called from the
+ * streaming thread only.
+ *
+ * @param stats Statistics to update
+ * @param ring_depth Buffers still waiting in the output ring
+ * @param pool_free Output buffers the encoder has to write into
+ * @param dropped_frames Total frames dropped by the leaky policy
+ */
+void raspistats_queue(RASPISTATS_T * stats, uint32_t ring_depth, uint32_t pool_free,
+		      uint64_t dropped_frames)
+{
+	STORE(stats->ring_depth, ring_depth);
+	STORE(stats->pool_free, pool_free);
+	STORE(stats->dropped_frames, dropped_frames);
+
+	/* Count each time the encoder ran out, not every frame it stayed out */
+	if (pool_free == 0 && !stats->pool_was_empty)
+		BUMP(stats->encoder_stalls, 1);
+	stats->pool_was_empty = pool_free == 0;
+}
+
+/**
+ * Count a batch of camera settings sent while streaming. Called from the
+ * streaming thread only.
+ *
+ * @param stats Statistics to update
+ * @param latency Time the camera took to accept them
+ */
+void raspistats_parameters(RASPISTATS_T * stats, int64_t latency)
+{
+	BUMP(stats->parameter_applies, 1);
+	STORE(stats->parameter_apply_last, latency);
+	if (latency > LOAD(stats->parameter_apply_max))
+		STORE(stats->parameter_apply_max, latency);
+}
+
+/**
+ * Record how long exposure took to settle after start. Called from the
+ * streaming thread only.
+ *
+ * @param stats Statistics to update
+ * @param settle_time Time from start until exposure and gains settled
+ */
+void raspistats_exposure_settled(RASPISTATS_T * stats, int64_t settle_time)
+{
+	STORE(stats->exposure_settle_time, settle_time);
+}
+
+/**
+ * Record how the stream started: when the first frame came out and how
+ * many were skipped before it. Called from the streaming thread only.
+ *
+ * @param stats Statistics to update
+ * @param first_frame_time Time from start until the first frame
+ * @param skipped Frames skipped while exposure settled
+ */
+void raspistats_startup(RASPISTATS_T * stats, int64_t first_frame_time, uint64_t skipped)
+{
+	STORE(stats->first_good_frame_time, first_frame_time);
+	STORE(stats->startup_skipped, skipped);
+}
+
+/**
+ * Record the ROI transition steps sent so far, with the latency and
+ * jitter of the latest. Called from the streaming thread only, after
+ * each frame, so no step is missed from the maximums.
+ *
+ * @param stats Statistics to update
+ * @param steps Steps sent so far
+ * @param latency How long the camera took to take the latest step
+ * @param jitter How far the latest step strayed from the frame clock
+ */
+void raspistats_roi(RASPISTATS_T * stats, uint64_t steps, int64_t latency, int64_t jitter)
+{
+	if (steps == LOAD(stats->roi_steps))
+		return;
+
+	STORE(stats->roi_steps, steps);
+	STORE(stats->roi_step_latency_last, latency);
+	if (latency > LOAD(stats->roi_step_latency_max))
+		STORE(stats->roi_step_latency_max, latency);
+	STORE(stats->roi_jitter_last, jitter);
+	if (jitter > LOAD(stats->roi_jitter_max))
+		STORE(stats->roi_jitter_max, jitter);
+}
+
+/**
+ * Count a still taken. Called from the still capture worker only.
+ *
+ * @param stats Statistics to update
+ * @param latency Time from the trigger to the file being written
+ */
+void raspistats_still(RASPISTATS_T * stats, int64_t latency)
+{
+	BUMP(stats->stills, 1);
+	BUMP(stats->still_latency_total, latency);
+	STORE(stats->still_latency_last, latency);
+	if (latency > LOAD(stats->still_latency_max))
+		STORE(stats->still_latency_max, latency);
+}
+
+/**
+ * Take a snapshot of the counters, with rates worked out. Any thread.
+ *
+ * @param stats Statistics to read
+ * @param now Current time
+ * @param snapshot Receives the values
+ */
+void raspistats_snapshot(RASPISTATS_T * stats, int64_t now, RASPISTATS_SNAPSHOT * snapshot)
+{
+	int64_t first = LOAD(stats->first_frame), last = LOAD(stats->last_frame);
+	int64_t span = last - first;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->frames = LOAD(stats->frames);
+	snapshot->bytes = LOAD(stats->bytes);
+	snapshot->keyframes = LOAD(stats->keyframes);
+	snapshot->keyframe_interval = LOAD(stats->keyframe_interval);
+	snapshot->ring_depth = LOAD(stats->ring_depth);
+	snapshot->pool_free = LOAD(stats->pool_free);
+	snapshot->dropped_frames = LOAD(stats->dropped_frames);
+	snapshot->late_frames = LOAD(stats->late_frames);
+	snapshot->encoder_stalls = LOAD(stats->encoder_stalls);
+	snapshot->parameter_applies = LOAD(stats->parameter_applies);
+	snapshot->parameter_apply_last = LOAD(stats->parameter_apply_last);
+	snapshot->parameter_apply_max = LOAD(stats->parameter_apply_max);
+	snapshot->exposure_settle_time = LOAD(stats->exposure_settle_time);
+	snapshot->first_good_frame_time = LOAD(stats->first_good_frame_time);
+	snapshot->startup_skipped = LOAD(stats->startup_skipped);
+	snapshot->roi_steps = LOAD(stats->roi_steps);
+	snapshot->roi_step_latency_last = LOAD(stats->roi_step_latency_last);
+	snapshot->roi_step_latency_max = LOAD(stats->roi_step_latency_max);
+	snapshot->roi_jitter_last = LOAD(stats->roi_jitter_last);
+	snapshot->roi_jitter_max = LOAD(stats->roi_jitter_max);
+
+	/* A window that ended long ago says nothing about now */
+	if (first && now - last < RASPISTATS_WINDOW_US) {
+		snapshot->fps = LOAD(stats->window_fps_milli) / 1000.0;
+		snapshot->bitrate = LOAD(stats->window_bitrate);
+	}
+	if (first && span > 0) {
+		snapshot->average_fps = (snapshot->frames - 1) * 1000000.0 / span;
+		snapshot->average_bitrate = snapshot->bytes * 8 * 1000000 / span;
+	}
+
+	snapshot->stills = LOAD(stats->stills);
+	snapshot->still_latency_last = LOAD(stats->still_latency_last);
+	snapshot->still_latency_max = LOAD(stats->still_latency_max);
+	if (snapshot->stills)
+		snapshot->still_latency_average =
+		    LOAD(stats->still_latency_total) / (int64_t) snapshot->stills;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPISTATS_H_
+#define RASPISTATS_H_
+
+#include <stdint.h>
+
+/* Running statistics of a capture.
+ *
+ * The streaming thread and the still capture worker each update their own
+ * counters with relaxed atomics, and any thread can take a snapshot
+ * without a lock. Fields of a snapshot are each consistent on their own,
+ * not with each other. Times are microseconds on the clock of
+ * raspiring_now().
+ */
+
+/// Length of the window instantaneous rates are measured over
+#define RASPISTATS_WINDOW_US 1000000
+
+typedef struct
+{
+   /* Updated by the streaming thread */
+   uint64_t frames;
+   uint64_t bytes;
+   uint64_t keyframes;
+   uint64_t late_frames;               /// Frames that waited over a frame period for the streaming thread
+   uint64_t encoder_stalls;            /// Times the encoder was found without a free output buffer
+   uint64_t dropped_frames;            /// Frames dropped by the leaky policy
+   int64_t first_frame;                /// Time of the first frame, 0 before it
+   int64_t last_frame;
+   uint32_t window_fps_milli;          /// Frames per 1000 seconds over the last complete window
+   uint64_t window_bitrate;            /// Bits per second over the last complete window
+   uint32_t keyframe_interval;         /// Frames from the previous key frame to the last one
+   uint32_t ring_depth;                /// Buffers waiting for the streaming thread
+   uint32_t pool_free;                 /// Output buffers the encoder has to write into
+   uint64_t parameter_applies;         /// Batches of camera settings sent while streaming
+   int64_t parameter_apply_last;
+   int64_t parameter_apply_max;
+   int64_t exposure_settle_time;       /// From start until exposure and gains stopped moving, 0 until then
+   int64_t first_good_frame_time;      /// From start until the first frame was handed out, 0 until then
+   uint64_t startup_skipped;           /// Frames skipped at start while exposure settled
+   uint64_t roi_steps;                 /// ROI transition steps sent to the camera
+   int64_t roi_step_latency_last;
+   int64_t roi_step_latency_max;
+   int64_t roi_jitter_last;            /// How far a step strayed from the frame clock
+   int64_t roi_jitter_max;
+
+   /* Updated by the still capture worker */
+   uint64_t stills;
+   int64_t still_latency_last;
+   int64_t still_latency_max;
+   int64_t still_latency_total;
+
+   /* Private to the streaming thread */
+   int64_t window_start;
+   uint64_t window_frames;
+   uint64_t window_bytes;
+   uint64_t last_keyframe;             /// Value of frames at the last key frame
+   int pool_was_empty;
+} RASPISTATS_T;
+
+/// Values derived from the counters at one point in time
+typedef struct
+{
+   uint64_t frames;
+   uint64_t bytes;
+   double fps;                         /// Over the last complete window
+   double average_fps;                 /// Since the first frame
+   uint64_t bitrate;                   /// Bits per second over the last complete window
+   uint64_t average_bitrate;           /// Bits per second since the first frame
+   uint64_t keyframes;
+   uint32_t keyframe_interval;
+   uint32_t ring_depth;
+   uint32_t pool_free;
+   uint64_t dropped_frames;
+   uint64_t late_frames;
+   uint64_t encoder_stalls;
+   uint64_t parameter_applies;
+   int64_t parameter_apply_last;
+   int64_t parameter_apply_max;
+   int64_t exposure_settle_time;
+   int64_t first_good_frame_time;
+   uint64_t startup_skipped;
+   uint64_t roi_steps;
+   int64_t roi_step_latency_last;
+   int64_t roi_step_latency_max;
+   int64_t roi_jitter_last;
+   int64_t roi_jitter_max;
+   uint64_t stills;
+   int64_t still_latency_last;
+   int64_t still_latency_average;
+   int64_t still_latency_max;
+} RASPISTATS_SNAPSHOT;
+
+void raspistats_reset(RASPISTATS_T *stats);
+void raspistats_frame(RASPISTATS_T *stats, int64_t now, uint32_t size, int keyframe, int late);
+void raspistats_queue(RASPISTATS_T *stats, uint32_t ring_depth, uint32_t pool_free,
+                      uint64_t dropped_frames);
+void raspistats_parameters(RASPISTATS_T *stats, int64_t latency);
+void raspistats_exposure_settled(RASPISTATS_T *stats, int64_t settle_time);
+void raspistats_startup(RASPISTATS_T *stats, int64_t first_frame_time, uint64_t skipped);
+void raspistats_roi(RASPISTATS_T *stats, uint64_t steps, int64_t latency, int64_t jitter);
+void raspistats_still(RASPISTATS_T *stats, int64_t latency);
+void raspistats_snapshot(RASPISTATS_T *stats, int64_t now, RASPISTATS_SNAPSHOT *snapshot);
+
+#endif /* RASPISTATS_H_ */
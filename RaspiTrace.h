@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RASPITRACE_H_
+#define RASPITRACE_H_
+
+#include <gst/gst.h>
+
+/* Logging and static tracepoints for the capture code.
+ *
+ * RASPI_ERROR() .. RASPI_LOG() go to the GStreamer debug log of the
+ * including file's GST_CAT_DEFAULT. Levels above RASPI_TRACE_LEVEL are
+ * compiled out, arguments and all, so per-buffer RASPI_LOG() calls cost
+ * nothing in a release build. Nothing here writes to stdout.
+ *
+ * RASPI_PROBE*() are USDT probes (provider "rpicamsrc") when built with
+ * HAVE_SYS_SDT_H: a nop until a tracer such as perf, bpftrace or
+ * SystemTap attaches, e.g.
+ *   bpftrace -e 'usdt:/path/to/binary:rpicamsrc:buffer_dequeue { @ = hist(arg1); }'
+ * Without sys/sdt.h they compile to nothing.
+ */
+
+#define RASPI_TRACE_NONE    0
+#define RASPI_TRACE_ERROR   1
+#define RASPI_TRACE_WARNING 2
+#define RASPI_TRACE_INFO    3
+#define RASPI_TRACE_DEBUG   4
+#define RASPI_TRACE_LOG     5
+
+/// Most verbose level compiled in, override with -DRASPI_TRACE_LEVEL=n
+#ifndef RASPI_TRACE_LEVEL
+#define RASPI_TRACE_LEVEL RASPI_TRACE_DEBUG
+#endif
+
+#define RASPI_TRACE_NOTHING G_STMT_START { } G_STMT_END
+
+#if RASPI_TRACE_LEVEL >= RASPI_TRACE_ERROR
+#define RASPI_ERROR(...) GST_ERROR(__VA_ARGS__)
+#else
+#define RASPI_ERROR(...) RASPI_TRACE_NOTHING
+#endif
+
+#if RASPI_TRACE_LEVEL >= RASPI_TRACE_WARNING
+#define RASPI_WARNING(...) GST_WARNING(__VA_ARGS__)
+#else
+#define RASPI_WARNING(...) RASPI_TRACE_NOTHING
+#endif
+
+#if RASPI_TRACE_LEVEL >= RASPI_TRACE_INFO
+#define RASPI_INFO(...) GST_INFO(__VA_ARGS__)
+#else
+#define RASPI_INFO(...) RASPI_TRACE_NOTHING
+#endif
+
+#if RASPI_TRACE_LEVEL >= RASPI_TRACE_DEBUG
+#define RASPI_DEBUG(...) GST_DEBUG(__VA_ARGS__)
+#else
+#define RASPI_DEBUG(...) RASPI_TRACE_NOTHING
+#endif
+
+#if RASPI_TRACE_LEVEL >= RASPI_TRACE_LOG
+#define RASPI_LOG(...) GST_LOG(__VA_ARGS__)
+#else
+#define RASPI_LOG(...) RASPI_TRACE_NOTHING
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define RASPI_PROBE(name) DTRACE_PROBE(rpicamsrc, name)
+#define RASPI_PROBE1(name, a) DTRACE_PROBE1(rpicamsrc, name, a)
+#define RASPI_PROBE2(name, a, b) DTRACE_PROBE2(rpicamsrc, name, a, b)
+#define RASPI_PROBE3(name, a, b, c) DTRACE_PROBE3(rpicamsrc, name, a, b, c)
+#else
+#define RASPI_PROBE(name) RASPI_TRACE_NOTHING
+#define RASPI_PROBE1(name, a) RASPI_TRACE_NOTHING
+#define RASPI_PROBE2(name, a, b) RASPI_TRACE_NOTHING
+#define RASPI_PROBE3(name, a, b, c) RASPI_TRACE_NOTHING
+#endif
+
+/* Probes, with their arguments:
+ *   buffer_arrival(pts, length, flags)  encoder or camera callback got a buffer
+ *   buffer_dequeue(pts, wait_us, flags) streaming thread took it off the ring
+ *   still_start(filename)
+ *   still_end(filename, duration_us)
+ *   parameter_set(parameter_id, status) a camera or encoder parameter was
+ *                                       changed, id 0 for the whole set
+ */
+
+#endif /* RASPITRACE_H_ */
@@ -241,4 +241,151 @@ GType gst_rpi_cam_src_flicker_avoidance_get_type(void)
 	return the_type;
 }
 
+GType gst_rpi_cam_src_drc_level_get_type(void)
+{
+	static GType the_type = 0;
+
+	if (the_type == 0) {
+		static const GEnumValue values[] = {
+			{GST_RPI_CAM_SRC_DRC_LEVEL_OFF,
+			 "GST_RPI_CAM_SRC_DRC_LEVEL_OFF",
+			 "off"},
+			{GST_RPI_CAM_SRC_DRC_LEVEL_LOW,
+			 "GST_RPI_CAM_SRC_DRC_LEVEL_LOW",
+			 "low"},
+			{GST_RPI_CAM_SRC_DRC_LEVEL_MEDIUM,
+			 "GST_RPI_CAM_SRC_DRC_LEVEL_MEDIUM",
+			 "medium"},
+			{GST_RPI_CAM_SRC_DRC_LEVEL_HIGH,
+			 "GST_RPI_CAM_SRC_DRC_LEVEL_HIGH",
+			 "high"},
+			{0, NULL, NULL}
+		};
+		the_type =
+		    g_enum_register_static(g_intern_static_string("GstRpiCamSrcDRCLevel"),
+					   values);
+	}
+	return the_type;
+}
+
+GType gst_rpi_cam_src_annotation_mode_get_type(void)
+{
+	static GType the_type = 0;
+
+	if (the_type == 0) {
+		static const GFlagsValue values[] = {
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_CUSTOM_TEXT,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_CUSTOM_TEXT",
+			 "custom-text"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_DATE,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_DATE",
+			 "date"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_TIME,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_TIME",
+			 "time"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_SHUTTER_SETTINGS,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_SHUTTER_SETTINGS",
+			 "shutter-settings"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_CAF_SETTINGS,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_CAF_SETTINGS",
+			 "caf-settings"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_GAIN_SETTINGS,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_GAIN_SETTINGS",
+			 "gain-settings"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_LENS_SETTINGS,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_LENS_SETTINGS",
+			 "lens-settings"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_MOTION_SETTINGS,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_MOTION_SETTINGS",
+			 "motion-settings"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_FRAME_NUMBER,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_FRAME_NUMBER",
+			 "frame-number"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_BLACK_BACKGROUND,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_BLACK_BACKGROUND",
+			 "black-background"},
+			{GST_RPI_CAM_SRC_ANNOTATION_MODE_LATENCY_MARKER,
+			 "GST_RPI_CAM_SRC_ANNOTATION_MODE_LATENCY_MARKER",
+			 "latency-marker"},
+			{0, NULL, NULL}
+		};
+		the_type =
+		    g_flags_register_static(g_intern_static_string("GstRpiCamSrcAnnotationMode"),
+					    values);
+	}
+	return the_type;
+}
+
+GType gst_rpi_cam_src_h264_profile_get_type(void)
+{
+	static GType the_type = 0;
+
+	if (the_type == 0) {
+		static const GEnumValue values[] = {
+			{GST_RPI_CAM_SRC_H264_PROFILE_BASELINE,
+			 "GST_RPI_CAM_SRC_H264_PROFILE_BASELINE",
+			 "baseline"},
+			{GST_RPI_CAM_SRC_H264_PROFILE_MAIN,
+			 "GST_RPI_CAM_SRC_H264_PROFILE_MAIN",
+			 "main"},
+			{GST_RPI_CAM_SRC_H264_PROFILE_HIGH,
+			 "GST_RPI_CAM_SRC_H264_PROFILE_HIGH",
+			 "high"},
+			{0, NULL, NULL}
+		};
+		the_type =
+		    g_enum_register_static(g_intern_static_string("GstRpiCamSrcH264Profile"),
+					   values);
+	}
+	return the_type;
+}
+
+GType gst_rpi_cam_src_leaky_get_type(void)
+{
+	static GType the_type = 0;
+
+	if (the_type == 0) {
+		static const GEnumValue values[] = {
+			{GST_RPI_CAM_SRC_LEAKY_BLOCK,
+			 "GST_RPI_CAM_SRC_LEAKY_BLOCK",
+			 "block"},
+			{GST_RPI_CAM_SRC_LEAKY_DROP_OLDEST,
+			 "GST_RPI_CAM_SRC_LEAKY_DROP_OLDEST",
+			 "drop-oldest"},
+			{GST_RPI_CAM_SRC_LEAKY_DROP_TO_IDR,
+			 "GST_RPI_CAM_SRC_LEAKY_DROP_TO_IDR",
+			 "drop-to-idr"},
+			{0, NULL, NULL}
+		};
+		the_type =
+		    g_enum_register_static(g_intern_static_string("GstRpiCamSrcLeaky"),
+					   values);
+	}
+	return the_type;
+}
+
+GType gst_rpi_cam_src_scheduling_policy_get_type(void)
+{
+	static GType the_type = 0;
+
+	if (the_type == 0) {
+		static const GEnumValue values[] = {
+			{GST_RPI_CAM_SRC_SCHEDULING_NORMAL,
+			 "GST_RPI_CAM_SRC_SCHEDULING_NORMAL",
+			 "normal"},
+			{GST_RPI_CAM_SRC_SCHEDULING_FIFO,
+			 "GST_RPI_CAM_SRC_SCHEDULING_FIFO",
+			 "fifo"},
+			{GST_RPI_CAM_SRC_SCHEDULING_RR,
+			 "GST_RPI_CAM_SRC_SCHEDULING_RR",
+			 "rr"},
+			{0, NULL, NULL}
+		};
+		the_type =
+		    g_enum_register_static(g_intern_static_string("GstRpiCamSrcSchedulingPolicy"),
+					   values);
+	}
+	return the_type;
+}
+
 /* Generated data ends here */
@@ -25,6 +25,20 @@ GType gst_rpi_cam_src_image_effect_get_type	(void) G_GNUC_CONST;
 #define GST_RPI_CAM_TYPE_RPI_CAM_SRC_FLICKER_AVOIDANCE	(gst_rpi_cam_src_flicker_avoidance_get_type())
 GType gst_rpi_cam_src_flicker_avoidance_get_type	(void) G_GNUC_CONST;
 
+#define GST_RPI_CAM_TYPE_RPI_CAM_SRC_DRC_LEVEL	(gst_rpi_cam_src_drc_level_get_type())
+GType gst_rpi_cam_src_drc_level_get_type	(void) G_GNUC_CONST;
+
+#define GST_RPI_CAM_TYPE_RPI_CAM_SRC_ANNOTATION_MODE	(gst_rpi_cam_src_annotation_mode_get_type())
+GType gst_rpi_cam_src_annotation_mode_get_type	(void) G_GNUC_CONST;
+
+#define GST_RPI_CAM_TYPE_RPI_CAM_SRC_H264_PROFILE	(gst_rpi_cam_src_h264_profile_get_type())
+GType gst_rpi_cam_src_h264_profile_get_type	(void) G_GNUC_CONST;
+
+#define GST_RPI_CAM_TYPE_RPI_CAM_SRC_LEAKY	(gst_rpi_cam_src_leaky_get_type())
+GType gst_rpi_cam_src_leaky_get_type	(void) G_GNUC_CONST;
+#define GST_RPI_CAM_TYPE_RPI_CAM_SRC_SCHEDULING_POLICY	(gst_rpi_cam_src_scheduling_policy_get_type())
+GType gst_rpi_cam_src_scheduling_policy_get_type	(void) G_GNUC_CONST;
+
 G_END_DECLS
 
 #endif /* __GSTRPICAM_ENUM_TYPES_H__ */
@@ -0,0 +1,242 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013 Jan Schmidt <jan@centricular.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:gstrpicam-meta
+ *
+ * #GstRpiCamMotionVectorMeta carries the motion vectors the camera's H264
+ * encoder exports inline, so motion can be detected without decoding.
+ *
+ * #GstRpiCamSettingsMeta carries the exposure time and gains the camera
+ * used for a frame, so brightness can be normalised without looking at
+ * the pixels.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "gstrpicam-meta.h"
+
+static gboolean gst_rpi_cam_motion_vector_meta_init(GstMeta * meta, gpointer params,
+						    GstBuffer * buffer)
+{
+	GstRpiCamMotionVectorMeta *mvmeta = (GstRpiCamMotionVectorMeta *) meta;
+
+	mvmeta->mb_width = 0;
+	mvmeta->mb_height = 0;
+	mvmeta->vectors = NULL;
+
+	return TRUE;
+}
+
+static void gst_rpi_cam_motion_vector_meta_free(GstMeta * meta, GstBuffer * buffer)
+{
+	GstRpiCamMotionVectorMeta *mvmeta = (GstRpiCamMotionVectorMeta *) meta;
+
+	g_free(mvmeta->vectors);
+	mvmeta->vectors = NULL;
+}
+
+static gboolean gst_rpi_cam_motion_vector_meta_transform(GstBuffer * dest, GstMeta * meta,
+							 GstBuffer * buffer, GQuark type,
+							 gpointer data)
+{
+	GstRpiCamMotionVectorMeta *mvmeta = (GstRpiCamMotionVectorMeta *) meta;
+
+	/* Vectors describe the whole frame, so only plain copies of all of it
+	 * keep them */
+	if (!GST_META_TRANSFORM_IS_COPY(type) || ((GstMetaTransformCopy *) data)->region)
+		return FALSE;
+
+	return gst_buffer_add_rpi_cam_motion_vector_meta(dest, mvmeta->mb_width,
+							 mvmeta->mb_height,
+							 (const guint8 *)mvmeta->vectors,
+							 mvmeta->mb_width * mvmeta->mb_height *
+							 sizeof(GstRpiCamMotionVector)) != NULL;
+}
+
+GType gst_rpi_cam_motion_vector_meta_api_get_type(void)
+{
+	static volatile GType type;
+	static const gchar *tags[] = { NULL };
+
+	if (g_once_init_enter(&type)) {
+		GType _type = gst_meta_api_type_register("GstRpiCamMotionVectorMetaAPI", tags);
+		g_once_init_leave(&type, _type);
+	}
+	return type;
+}
+
+const GstMetaInfo *gst_rpi_cam_motion_vector_meta_get_info(void)
+{
+	static const GstMetaInfo *meta_info = NULL;
+
+	if (g_once_init_enter(&meta_info)) {
+		const GstMetaInfo *mi =
+		    gst_meta_register(GST_RPI_CAM_MOTION_VECTOR_META_API_TYPE,
+				      "GstRpiCamMotionVectorMeta",
+				      sizeof(GstRpiCamMotionVectorMeta),
+				      gst_rpi_cam_motion_vector_meta_init,
+				      gst_rpi_cam_motion_vector_meta_free,
+				      gst_rpi_cam_motion_vector_meta_transform);
+		g_once_init_leave(&meta_info, mi);
+	}
+	return meta_info;
+}
+
+/**
+ * gst_buffer_add_rpi_cam_motion_vector_meta:
+ * @buffer: a #GstBuffer
+ * @mb_width: macroblock columns in @data
+ * @mb_height: macroblock rows in @data
+ * @data: vectors as exported by the encoder
+ * @size: size of @data in bytes
+ *
+ * Attach a copy of the encoder's motion vectors to @buffer.
+ *
+ * Returns: the new meta, or NULL if @size doesn't match the macroblock grid
+ */
+GstRpiCamMotionVectorMeta *gst_buffer_add_rpi_cam_motion_vector_meta(GstBuffer * buffer,
+								      guint mb_width,
+								      guint mb_height,
+								      const guint8 * data, gsize size)
+{
+	GstRpiCamMotionVectorMeta *mvmeta;
+	gsize vectors_size = mb_width * mb_height * sizeof(GstRpiCamMotionVector);
+
+	g_return_val_if_fail(GST_IS_BUFFER(buffer), NULL);
+
+	if (size < vectors_size)
+		return NULL;
+
+	mvmeta = (GstRpiCamMotionVectorMeta *) gst_buffer_add_meta(buffer,
+								   GST_RPI_CAM_MOTION_VECTOR_META_INFO,
+								   NULL);
+	mvmeta->mb_width = mb_width;
+	mvmeta->mb_height = mb_height;
+	/* Not g_memdup(), deprecated in newer GLib, nor g_memdup2(), missing in older */
+	mvmeta->vectors = g_malloc(vectors_size);
+	memcpy(mvmeta->vectors, data, vectors_size);
+
+	return mvmeta;
+}
+
+static gboolean gst_rpi_cam_settings_meta_init(GstMeta * meta, gpointer params,
+					       GstBuffer * buffer)
+{
+	GstRpiCamSettingsMeta *smeta = (GstRpiCamSettingsMeta *) meta;
+
+	memset(&smeta->settings, 0, sizeof(smeta->settings));
+
+	return TRUE;
+}
+
+static gboolean gst_rpi_cam_settings_meta_transform(GstBuffer * dest, GstMeta * meta,
+						    GstBuffer * buffer, GQuark type,
+						    gpointer data)
+{
+	GstRpiCamSettingsMeta *smeta = (GstRpiCamSettingsMeta *) meta;
+
+	/* Settings hold for every part of the frame, so any copy keeps them */
+	if (!GST_META_TRANSFORM_IS_COPY(type))
+		return FALSE;
+
+	return gst_buffer_add_rpi_cam_settings_meta(dest, &smeta->settings) != NULL;
+}
+
+GType gst_rpi_cam_settings_meta_api_get_type(void)
+{
+	static volatile GType type;
+	static const gchar *tags[] = { NULL };
+
+	if (g_once_init_enter(&type)) {
+		GType _type = gst_meta_api_type_register("GstRpiCamSettingsMetaAPI", tags);
+		g_once_init_leave(&type, _type);
+	}
+	return type;
+}
+
+const GstMetaInfo *gst_rpi_cam_settings_meta_get_info(void)
+{
+	static const GstMetaInfo *meta_info = NULL;
+
+	if (g_once_init_enter(&meta_info)) {
+		const GstMetaInfo *mi =
+		    gst_meta_register(GST_RPI_CAM_SETTINGS_META_API_TYPE,
+				      "GstRpiCamSettingsMeta",
+				      sizeof(GstRpiCamSettingsMeta),
+				      gst_rpi_cam_settings_meta_init,
+				      NULL,
+				      gst_rpi_cam_settings_meta_transform);
+		g_once_init_leave(&meta_info, mi);
+	}
+	return meta_info;
+}
+
+/**
+ * gst_buffer_add_rpi_cam_settings_meta:
+ * @buffer: a #GstBuffer
+ * @settings: settings the frame in @buffer was captured with
+ *
+ * Attach a copy of @settings to @buffer.
+ *
+ * Returns: the new meta
+ */
+GstRpiCamSettingsMeta *gst_buffer_add_rpi_cam_settings_meta(GstBuffer * buffer,
+							    const GstRpiCamSettings * settings)
+{
+	GstRpiCamSettingsMeta *smeta;
+
+	g_return_val_if_fail(GST_IS_BUFFER(buffer), NULL);
+	g_return_val_if_fail(settings != NULL, NULL);
+
+	smeta = (GstRpiCamSettingsMeta *) gst_buffer_add_meta(buffer,
+							      GST_RPI_CAM_SETTINGS_META_INFO,
+							      NULL);
+	smeta->settings = *settings;
+
+	return smeta;
+}
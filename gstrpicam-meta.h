@@ -0,0 +1,152 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013 Jan Schmidt <jan@centricular.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_RPICAM_META_H__
+#define __GST_RPICAM_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* One entry per macroblock, as laid out by the H264 encoder when
+ * MMAL_PARAMETER_VIDEO_ENCODE_INLINE_VECTORS is on */
+typedef struct
+{
+  gint8 x_vector;
+  gint8 y_vector;
+  guint16 sad;
+} GstRpiCamMotionVector;
+
+typedef struct _GstRpiCamMotionVectorMeta GstRpiCamMotionVectorMeta;
+
+/**
+ * GstRpiCamMotionVectorMeta:
+ * @meta: parent #GstMeta
+ * @mb_width: macroblock columns, including the extra column the encoder adds
+ * @mb_height: macroblock rows
+ * @vectors: @mb_width * @mb_height vectors, row by row
+ *
+ * Motion vectors the encoder produced for the frame in the buffer
+ */
+struct _GstRpiCamMotionVectorMeta
+{
+  GstMeta meta;
+
+  guint mb_width;
+  guint mb_height;
+  GstRpiCamMotionVector *vectors;
+};
+
+GType gst_rpi_cam_motion_vector_meta_api_get_type (void);
+#define GST_RPI_CAM_MOTION_VECTOR_META_API_TYPE \
+  (gst_rpi_cam_motion_vector_meta_api_get_type())
+
+const GstMetaInfo *gst_rpi_cam_motion_vector_meta_get_info (void);
+#define GST_RPI_CAM_MOTION_VECTOR_META_INFO \
+  (gst_rpi_cam_motion_vector_meta_get_info())
+
+#define gst_buffer_get_rpi_cam_motion_vector_meta(b) \
+  ((GstRpiCamMotionVectorMeta*)gst_buffer_get_meta((b),GST_RPI_CAM_MOTION_VECTOR_META_API_TYPE))
+
+GstRpiCamMotionVectorMeta *
+gst_buffer_add_rpi_cam_motion_vector_meta (GstBuffer * buffer,
+    guint mb_width, guint mb_height, const guint8 * data, gsize size);
+
+/**
+ * GstRpiCamSettings:
+ * @exposure_time: exposure time in microseconds
+ * @analog_gain: sensor analog gain
+ * @digital_gain: ISP digital gain
+ * @awb_red_gain: red channel gain chosen by white balance
+ * @awb_blue_gain: blue channel gain chosen by white balance
+ * @focus_position: lens position, 0 for fixed focus modules
+ *
+ * What the camera's control loops chose for a frame, as reported by
+ * MMAL_PARAMETER_CAMERA_SETTINGS change events
+ */
+typedef struct
+{
+  guint exposure_time;
+  gdouble analog_gain;
+  gdouble digital_gain;
+  gdouble awb_red_gain;
+  gdouble awb_blue_gain;
+  guint focus_position;
+} GstRpiCamSettings;
+
+typedef struct _GstRpiCamSettingsMeta GstRpiCamSettingsMeta;
+
+/**
+ * GstRpiCamSettingsMeta:
+ * @meta: parent #GstMeta
+ * @settings: camera settings in effect for the frame in the buffer
+ *
+ * Exposure, gains and focus the frame in the buffer was captured with.
+ * rpicamsrc attaches it to every video frame, and writes the same values
+ * into the EXIF tags of stills.
+ */
+struct _GstRpiCamSettingsMeta
+{
+  GstMeta meta;
+
+  GstRpiCamSettings settings;
+};
+
+GType gst_rpi_cam_settings_meta_api_get_type (void);
+#define GST_RPI_CAM_SETTINGS_META_API_TYPE \
+  (gst_rpi_cam_settings_meta_api_get_type())
+
+const GstMetaInfo *gst_rpi_cam_settings_meta_get_info (void);
+#define GST_RPI_CAM_SETTINGS_META_INFO \
+  (gst_rpi_cam_settings_meta_get_info())
+
+#define gst_buffer_get_rpi_cam_settings_meta(b) \
+  ((GstRpiCamSettingsMeta*)gst_buffer_get_meta((b),GST_RPI_CAM_SETTINGS_META_API_TYPE))
+
+GstRpiCamSettingsMeta *
+gst_buffer_add_rpi_cam_settings_meta (GstBuffer * buffer,
+    const GstRpiCamSettings * settings);
+
+G_END_DECLS
+
+#endif /* __GST_RPICAM_META_H__ */
@@ -1,5 +1,6 @@
 #include "interface/mmal/util/mmal_util_params.h"
 #include "interface/mmal/mmal_parameters_camera.h"
+#include <sched.h>
 
 typedef enum {
     GST_RPI_CAM_SRC_EXPOSURE_MODE_OFF = MMAL_PARAM_EXPOSUREMODE_OFF,
@@ -69,3 +70,44 @@ typedef enum {
   GST_RPI_CAM_SRC_FLICKERAVOID_50HZ = MMAL_PARAM_FLICKERAVOID_50HZ,
   GST_RPI_CAM_SRC_FLICKERAVOID_60HZ = MMAL_PARAM_FLICKERAVOID_60HZ
 } GstRpiCamSrcFlickerAvoidance;
+
+typedef enum {
+  GST_RPI_CAM_SRC_DRC_LEVEL_OFF = MMAL_PARAMETER_DRC_STRENGTH_OFF,
+  GST_RPI_CAM_SRC_DRC_LEVEL_LOW = MMAL_PARAMETER_DRC_STRENGTH_LOW,
+  GST_RPI_CAM_SRC_DRC_LEVEL_MEDIUM = MMAL_PARAMETER_DRC_STRENGTH_MEDIUM,
+  GST_RPI_CAM_SRC_DRC_LEVEL_HIGH = MMAL_PARAMETER_DRC_STRENGTH_HIGH
+} GstRpiCamSrcDRCLevel;
+
+/* Same values as the ANNOTATE_* flags */
+typedef enum {
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_CUSTOM_TEXT = 1,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_DATE = 4,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_TIME = 8,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_SHUTTER_SETTINGS = 16,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_CAF_SETTINGS = 32,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_GAIN_SETTINGS = 64,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_LENS_SETTINGS = 128,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_MOTION_SETTINGS = 256,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_FRAME_NUMBER = 512,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_BLACK_BACKGROUND = 1024,
+  GST_RPI_CAM_SRC_ANNOTATION_MODE_LATENCY_MARKER = 2048
+} GstRpiCamSrcAnnotationMode;
+
+typedef enum {
+  GST_RPI_CAM_SRC_H264_PROFILE_BASELINE = MMAL_VIDEO_PROFILE_H264_BASELINE,
+  GST_RPI_CAM_SRC_H264_PROFILE_MAIN = MMAL_VIDEO_PROFILE_H264_MAIN,
+  GST_RPI_CAM_SRC_H264_PROFILE_HIGH = MMAL_VIDEO_PROFILE_H264_HIGH
+} GstRpiCamSrcH264Profile;
+
+/* Same values as RASPIVID_LEAKY_T */
+typedef enum {
+  GST_RPI_CAM_SRC_LEAKY_BLOCK = 0,
+  GST_RPI_CAM_SRC_LEAKY_DROP_OLDEST = 1,
+  GST_RPI_CAM_SRC_LEAKY_DROP_TO_IDR = 2
+} GstRpiCamSrcLeaky;
+
+typedef enum {
+  GST_RPI_CAM_SRC_SCHEDULING_NORMAL = SCHED_OTHER,
+  GST_RPI_CAM_SRC_SCHEDULING_FIFO = SCHED_FIFO,
+  GST_RPI_CAM_SRC_SCHEDULING_RR = SCHED_RR
+} GstRpiCamSrcSchedulingPolicy;
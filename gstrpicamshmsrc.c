@@ -0,0 +1,356 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013 Jan Schmidt <jan@centricular.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-rpicamshmsrc
+ *
+ * Source element receiving the camera stream from an rpicamsrc running in
+ * broker mode, possibly in another process. Access units are pushed
+ * straight out of the broker's shared memory without copying. A new
+ * consumer starts with the stream headers and the last key frame, and one
+ * that falls behind skips ahead to the next key frame.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch -v -m rpicamsrc broker-socket=/tmp/cam0 ! h264parse ! mp4mux ! filesink location=rec.mp4
+ * gst-launch -v -m rpicamshmsrc socket-path=/tmp/cam0 ! h264parse ! rtph264pay ! udpsink host=192.168.1.2 port=5000
+ * ]| Record in one process while another streams the same camera
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstrpicamshmsrc.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_rpi_cam_shm_src_debug);
+#define GST_CAT_DEFAULT gst_rpi_cam_shm_src_debug
+
+/// How often a waiting create() checks whether it was unlocked
+#define WAIT_INTERVAL 100	// ms
+
+/// Longest caps string the broker passes on
+#define CAPS_MAX 2048
+
+enum {
+	PROP_0,
+	PROP_SOCKET_PATH,
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src",
+								   GST_PAD_SRC,
+								   GST_PAD_ALWAYS,
+								   GST_STATIC_CAPS_ANY);
+
+/* Keeps an AU held in the broker's memory for as long as a buffer wraps it */
+typedef struct {
+	RASPISHM_CLIENT_T *client;
+	RASPISHM_AU au;
+} AuHold;
+
+#define gst_rpi_cam_shm_src_parent_class parent_class
+G_DEFINE_TYPE(GstRpiCamShmSrc, gst_rpi_cam_shm_src, GST_TYPE_PUSH_SRC);
+
+static void gst_rpi_cam_shm_src_set_property(GObject * object, guint prop_id,
+					     const GValue * value, GParamSpec * pspec);
+static void gst_rpi_cam_shm_src_get_property(GObject * object, guint prop_id,
+					     GValue * value, GParamSpec * pspec);
+static void gst_rpi_cam_shm_src_finalize(GObject * object);
+static gboolean gst_rpi_cam_shm_src_start(GstBaseSrc * parent);
+static gboolean gst_rpi_cam_shm_src_stop(GstBaseSrc * parent);
+static gboolean gst_rpi_cam_shm_src_unlock(GstBaseSrc * parent);
+static gboolean gst_rpi_cam_shm_src_unlock_stop(GstBaseSrc * parent);
+static GstCaps *gst_rpi_cam_shm_src_get_caps(GstBaseSrc * bsrc, GstCaps * filter);
+static GstFlowReturn gst_rpi_cam_shm_src_create(GstPushSrc * parent, GstBuffer ** buf);
+
+static void gst_rpi_cam_shm_src_class_init(GstRpiCamShmSrcClass * klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+	GstBaseSrcClass *basesrc_class;
+	GstPushSrcClass *pushsrc_class;
+
+	gobject_class = (GObjectClass *) klass;
+	gstelement_class = (GstElementClass *) klass;
+	basesrc_class = (GstBaseSrcClass *) klass;
+	pushsrc_class = (GstPushSrcClass *) klass;
+
+	gobject_class->set_property = gst_rpi_cam_shm_src_set_property;
+	gobject_class->get_property = gst_rpi_cam_shm_src_get_property;
+	gobject_class->finalize = gst_rpi_cam_shm_src_finalize;
+
+	g_object_class_install_property(gobject_class, PROP_SOCKET_PATH,
+					g_param_spec_string("socket-path", "Socket path",
+							    "Socket of the rpicamsrc broker to read from",
+							    RASPISHM_DEFAULT_SOCKET,
+							    G_PARAM_READWRITE |
+							    G_PARAM_STATIC_STRINGS));
+
+	gst_element_class_set_static_metadata(gstelement_class,
+					      "Raspberry Pi Camera Broker Source",
+					      "Source/Video",
+					      "Camera stream shared by an rpicamsrc broker",
+					      "Jan Schmidt <jan@centricular.com>");
+
+	gst_element_class_add_pad_template(gstelement_class,
+					   gst_static_pad_template_get(&src_template));
+
+	basesrc_class->start = GST_DEBUG_FUNCPTR(gst_rpi_cam_shm_src_start);
+	basesrc_class->stop = GST_DEBUG_FUNCPTR(gst_rpi_cam_shm_src_stop);
+	basesrc_class->unlock = GST_DEBUG_FUNCPTR(gst_rpi_cam_shm_src_unlock);
+	basesrc_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_rpi_cam_shm_src_unlock_stop);
+	basesrc_class->get_caps = GST_DEBUG_FUNCPTR(gst_rpi_cam_shm_src_get_caps);
+	pushsrc_class->create = GST_DEBUG_FUNCPTR(gst_rpi_cam_shm_src_create);
+
+	GST_DEBUG_CATEGORY_INIT(gst_rpi_cam_shm_src_debug, "rpicamshmsrc", 0,
+				"rpicamshmsrc debug");
+}
+
+static void gst_rpi_cam_shm_src_init(GstRpiCamShmSrc * src)
+{
+	gst_base_src_set_format(GST_BASE_SRC(src), GST_FORMAT_TIME);
+	gst_base_src_set_live(GST_BASE_SRC(src), TRUE);
+	/* Buffers carry the broker's timestamps, see gst_rpi_cam_shm_src_timestamp() */
+	src->socket_path = g_strdup(RASPISHM_DEFAULT_SOCKET);
+}
+
+static void gst_rpi_cam_shm_src_finalize(GObject * object)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(object);
+
+	g_free(src->socket_path);
+
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void
+gst_rpi_cam_shm_src_set_property(GObject * object, guint prop_id,
+				 const GValue * value, GParamSpec * pspec)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(object);
+
+	switch (prop_id) {
+	case PROP_SOCKET_PATH:
+		g_free(src->socket_path);
+		src->socket_path = g_value_dup_string(value);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+}
+
+static void
+gst_rpi_cam_shm_src_get_property(GObject * object, guint prop_id,
+				 GValue * value, GParamSpec * pspec)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(object);
+
+	switch (prop_id) {
+	case PROP_SOCKET_PATH:
+		g_value_set_string(value, src->socket_path);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+}
+
+static gboolean gst_rpi_cam_shm_src_start(GstBaseSrc * parent)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(parent);
+
+	src->client = raspishm_client_connect(src->socket_path);
+	if (src->client == NULL) {
+		GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, ("No camera broker found"),
+				  ("Could not connect to %s", src->socket_path));
+		return FALSE;
+	}
+
+	src->received = 0;
+	src->latency_total = src->latency_max = 0;
+
+	return TRUE;
+}
+
+static gboolean gst_rpi_cam_shm_src_stop(GstBaseSrc * parent)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(parent);
+
+	if (src->received)
+		GST_INFO_OBJECT(src, "Received %" G_GUINT64_FORMAT " AUs without copying, "
+				"fan-out latency avg %" G_GINT64_FORMAT " us, max %"
+				G_GINT64_FORMAT " us", src->received,
+				src->latency_total / (gint64) src->received, src->latency_max);
+
+	/* Buffers still downstream keep the mapping alive until they are freed */
+	raspishm_client_destroy(src->client);
+	src->client = NULL;
+
+	return TRUE;
+}
+
+static gboolean gst_rpi_cam_shm_src_unlock(GstBaseSrc * parent)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(parent);
+
+	g_atomic_int_set(&src->flushing, TRUE);
+	return TRUE;
+}
+
+static gboolean gst_rpi_cam_shm_src_unlock_stop(GstBaseSrc * parent)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(parent);
+
+	g_atomic_int_set(&src->flushing, FALSE);
+	return TRUE;
+}
+
+static GstCaps *gst_rpi_cam_shm_src_get_caps(GstBaseSrc * bsrc, GstCaps * filter)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(bsrc);
+	gchar caps_str[CAPS_MAX];
+	GstCaps *caps = NULL;
+
+	/* The broker publishes its caps once it has negotiated */
+	if (src->client && raspishm_client_get_caps(src->client, caps_str, sizeof(caps_str)))
+		caps = gst_caps_from_string(caps_str);
+	if (caps == NULL)
+		caps = gst_pad_get_pad_template_caps(GST_BASE_SRC_PAD(bsrc));
+
+	if (filter) {
+		GstCaps *tmp = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+
+		gst_caps_unref(caps);
+		caps = tmp;
+	}
+
+	return caps;
+}
+
+static void gst_rpi_cam_shm_src_release_au(gpointer data)
+{
+	AuHold *hold = data;
+
+	raspishm_client_release(hold->client, &hold->au);
+	g_slice_free(AuHold, hold);
+}
+
+/* Map the broker's CLOCK_MONOTONIC timestamps onto our running time, so
+ * consumers keep the camera's timing rather than their arrival times. AUs
+ * without one, like the headers handed to late joiners, get the time now. */
+static void gst_rpi_cam_shm_src_timestamp(GstRpiCamShmSrc * src, GstBuffer * buf,
+					  const RASPISHM_AU * au)
+{
+	GstClock *clock = gst_element_get_clock(GST_ELEMENT(src));
+	GstClockTime now, base_time;
+	gint64 offset;
+
+	if (clock == NULL)
+		return;
+
+	now = gst_clock_get_time(clock);
+	base_time = gst_element_get_base_time(GST_ELEMENT(src));
+	gst_object_unref(clock);
+
+	/* Running time minus monotonic time; AUs from before we started clamp to 0 */
+	offset = (gint64) (now - base_time) - g_get_monotonic_time() * GST_USECOND;
+	if (au->pts >= 0)
+		GST_BUFFER_PTS(buf) = MAX(au->pts + offset, 0);
+	else
+		GST_BUFFER_PTS(buf) = now - base_time;
+	if (au->dts >= 0)
+		GST_BUFFER_DTS(buf) = MAX(au->dts + offset, 0);
+	else
+		GST_BUFFER_DTS(buf) = GST_BUFFER_PTS(buf);
+}
+
+static GstFlowReturn gst_rpi_cam_shm_src_create(GstPushSrc * parent, GstBuffer ** buf)
+{
+	GstRpiCamShmSrc *src = GST_RPICAMSHMSRC(parent);
+	AuHold *hold = g_slice_new(AuHold);
+	gint64 latency;
+	int ret;
+
+	do {
+		if (g_atomic_int_get(&src->flushing)) {
+			g_slice_free(AuHold, hold);
+			return GST_FLOW_FLUSHING;
+		}
+		ret = raspishm_client_next(src->client, &hold->au, WAIT_INTERVAL);
+	} while (ret == 0);
+
+	if (ret < 0) {
+		g_slice_free(AuHold, hold);
+		GST_INFO_OBJECT(src, "Camera broker went away");
+		return GST_FLOW_EOS;
+	}
+
+	latency = g_get_monotonic_time() - hold->au.published;
+	src->received++;
+	src->latency_total += latency;
+	src->latency_max = MAX(src->latency_max, latency);
+	GST_LOG_OBJECT(src, "AU %" G_GUINT64_FORMAT " of %" G_GSIZE_FORMAT " bytes, "
+		       "fan-out latency %" G_GINT64_FORMAT " us", hold->au.seq, hold->au.size,
+		       latency);
+
+	/* Wrap the broker's memory; the AU is released when the buffer is freed */
+	hold->client = src->client;
+	*buf = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, (gpointer) hold->au.data,
+					   hold->au.size, 0, hold->au.size, hold,
+					   gst_rpi_cam_shm_src_release_au);
+
+	if (!(hold->au.flags & (RASPISHM_FLAG_KEYFRAME | RASPISHM_FLAG_CONFIG)))
+		GST_BUFFER_FLAG_SET(*buf, GST_BUFFER_FLAG_DELTA_UNIT);
+	if (hold->au.flags & RASPISHM_FLAG_CONFIG)
+		GST_BUFFER_FLAG_SET(*buf, GST_BUFFER_FLAG_HEADER);
+	if (hold->au.flags & RASPISHM_FLAG_DISCONT)
+		GST_BUFFER_FLAG_SET(*buf, GST_BUFFER_FLAG_DISCONT);
+	gst_rpi_cam_shm_src_timestamp(src, *buf, &hold->au);
+
+	return GST_FLOW_OK;
+}
@@ -50,7 +50,49 @@
  * <title>Example launch line</title>
  * |[
  * gst-launch -v -m rpicamsrc ! fakesink
- * ]|
+ * ]| Capture H264
+ * |[
+ * gst-launch -v -m rpicamsrc ! video/x-raw,format=I420,width=1280,height=720 ! fakesink
+ * ]| Capture raw frames straight from the camera, bypassing the encoder
+ * |[
+ * gst-launch -v -m rpicamsrc quantisation-parameter=20 ! image/jpeg,width=1280,height=720 ! fakesink
+ * ]| Capture intra-only MJPEG at a fixed quality
+ * |[
+ * gst-launch -v -m rpicamsrc name=cam sub-width=640 sub-height=360 sub-bitrate=1000000 \
+ *     cam.src ! h264parse ! mp4mux ! filesink location=main.mp4 \
+ *     cam.subsrc_0 ! h264parse ! rtph264pay ! udpsink host=192.168.1.2 port=5000
+ * ]| Record 1080p while streaming a 640x360 substream encoded by the GPU
+ * |[
+ * gst-launch -v -m rpicamsrc name=cam preview=false analytics-width=320 analytics-height=240 \
+ *     cam.src ! h264parse ! mp4mux ! filesink location=main.mp4 \
+ *     cam.analytics ! video/x-raw,format=GRAY8 ! fakesink
+ * ]| Record while feeding a 320x240 luma stream, scaled by the ISP, to analytics
+ * |[
+ * gst-launch -v -m rpicamsrc motion-detect=true motion-regions="0.5,0,0.5,1" \
+ *     motion-capture-prefix=door ! h264parse ! fakesink
+ * ]| Post rpicamsrc-motion messages and take a still when the right half of the frame moves
+ * |[
+ * gst-launch -v -m rpicamsrc leaky=drop-to-idr max-queue-time=200 ! h264parse ! \
+ *     rtph264pay ! udpsink host=192.168.1.2 port=5000
+ * ]| Stream over a lossy link, skipping to the next IDR instead of falling behind
+ * |[
+ * gst-launch -v -m rpicamsrc camera-number=0 preview=false ! h264parse ! mp4mux ! filesink location=cam0.mp4 \
+ *     rpicamsrc camera-number=1 preview=false ! h264parse ! mp4mux ! filesink location=cam1.mp4
+ * ]| Record both cameras of a compute module in one process
+ * |[
+ * gst-launch -v -m rpicamsrc broker-socket=/tmp/cam0 ! h264parse ! mp4mux ! filesink location=rec.mp4
+ * ]| Record, while also sharing the stream with rpicamshmsrc in other processes
+ * |[
+ * gst-launch -v -m rpicamsrc streaming-cpu-mask=0x8 streaming-scheduling-policy=fifo \
+ *     streaming-priority=50 ! h264parse ! fakesink
+ * ]| Run the streaming thread on core 3 at real-time priority (needs CAP_SYS_NICE)
+ * |[
+ * gst-launch -v -m rpicamsrc latency-tracing=true ! h264parse ! rtph264pay ! \
+ *     udpsink host=192.168.1.2 port=5000
+ * ]| Post rpicamsrc-latency messages with per-stage latency percentiles every second
+ * |[
+ * gst-launch -v -m rpicamsrc stats-interval=5000 ! h264parse ! fakesink
+ * ]| Post rpicamsrc-stats messages with framerate, bitrate and queue depths every 5 seconds
  * </refsect2>
  */
 
@@ -58,13 +100,20 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
+#include <string.h>
+
 #include <gst/gst.h>
 #include <gst/video/video.h>
 
 #include "gstrpicamsrc.h"
+#include "gstrpicamshmsrc.h"
 #include "gstrpicam_types.h"
 #include "gstrpicam-enum-types.h"
+#include "gstrpicam-meta.h"
 #include "RaspiCapture.h"
+#include "RaspiMotion.h"
+#include "RaspiRing.h"
 
 #include "bcm_host.h"
 #include "interface/vcos/vcos.h"
@@ -100,8 +149,20 @@ enum {
 	PROP_VIDEO_STABILISATION,
 	PROP_EXPOSURE_COMPENSATION,
 	PROP_EXPOSURE_MODE,
+	PROP_SHUTTER_SPEED,
+	PROP_ANALOG_GAIN,
+	PROP_DIGITAL_GAIN,
 	PROP_EXPOSURE_METERING_MODE,
 	PROP_AWB_MODE,
+	PROP_AWB_GAIN_RED,
+	PROP_AWB_GAIN_BLUE,
+	PROP_FLICKER_AVOIDANCE,
+	PROP_VIDEO_DENOISE,
+	PROP_STILL_DENOISE,
+	PROP_DRC,
+	PROP_ANNOTATION_MODE,
+	PROP_ANNOTATION_TEXT,
+	PROP_ANNOTATION_TEXT_SIZE,
 	PROP_IMAGE_EFFECT,
 	PROP_IMAGE_EFFECT_PARAMS,
 	PROP_COLOUR_EFFECTS,
@@ -112,6 +173,43 @@ enum {
 	PROP_ROI_Y,
 	PROP_ROI_W,
 	PROP_ROI_H,
+	PROP_ROI_TRANSITION,
+	PROP_EXPOSURE_LOCK,
+	PROP_SKIP_UNTIL_SETTLED,
+	PROP_SETTLE_TIMEOUT,
+	PROP_QUANTISATION_PARAMETER,
+	PROP_SUB_WIDTH,
+	PROP_SUB_HEIGHT,
+	PROP_SUB_BITRATE,
+	PROP_SUB_KEYFRAME_INTERVAL,
+	PROP_SUB_PROFILE,
+	PROP_ANALYTICS_WIDTH,
+	PROP_ANALYTICS_HEIGHT,
+	PROP_INLINE_MOTION_VECTORS,
+	PROP_MOTION_DETECT,
+	PROP_MOTION_THRESHOLD,
+	PROP_MOTION_SAD_THRESHOLD,
+	PROP_MOTION_MIN_BLOCKS,
+	PROP_MOTION_TRIGGER_FRAMES,
+	PROP_MOTION_RELEASE_FRAMES,
+	PROP_MOTION_REGIONS,
+	PROP_MOTION_CAPTURE_PREFIX,
+	PROP_LEAKY,
+	PROP_MAX_QUEUE_FRAMES,
+	PROP_MAX_QUEUE_TIME,
+	PROP_CAMERA_NUMBER,
+	PROP_BROKER_SOCKET,
+	PROP_BROKER_SLOTS,
+	PROP_STREAMING_CPU_MASK,
+	PROP_STREAMING_SCHEDULING_POLICY,
+	PROP_STREAMING_PRIORITY,
+	PROP_CAPTURE_CPU_MASK,
+	PROP_CAPTURE_SCHEDULING_POLICY,
+	PROP_CAPTURE_PRIORITY,
+	PROP_LATENCY_TRACING,
+	PROP_LATENCY_INTERVAL,
+	PROP_STATS,
+	PROP_STATS_INTERVAL,
 };
 
 #define BITRATE_DEFAULT 17000000	/* 17Mbit/s default for 1080p */
@@ -128,6 +226,17 @@ enum {
 #define EXPOSURE_MODE_DEFAULT GST_RPI_CAM_SRC_EXPOSURE_MODE_AUTO
 #define EXPOSURE_METERING_MODE_DEFAULT GST_RPI_CAM_SRC_EXPOSURE_METERING_MODE_AVERAGE
 
+#define SUB_WIDTH_DEFAULT 640
+#define SUB_HEIGHT_DEFAULT 360
+#define SUB_BITRATE_DEFAULT 1000000
+#define SUB_PROFILE_DEFAULT GST_RPI_CAM_SRC_H264_PROFILE_HIGH
+
+#define ANALYTICS_WIDTH_DEFAULT 320
+#define ANALYTICS_HEIGHT_DEFAULT 240
+
+/* Frames the latency percentiles are taken over */
+#define LATENCY_TRACE_FRAMES 512
+
 /*
    params->exposureMode = MMAL_PARAM_EXPOSUREMODE_AUTO;
    params->exposureMeterMode = MMAL_PARAM_EXPOSUREMETERINGMODE_AVERAGE;
@@ -142,8 +251,9 @@ enum {
    params->roi.w = params->roi.h = 1.0;
 */
 
-#define RAW_AND_JPEG_CAPS \
-  GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL) ";" \
+#define RAW_CAPS \
+  GST_VIDEO_CAPS_MAKE ("{ I420, NV12, RGB, BGR }")
+#define JPEG_CAPS \
   "image/jpeg,"                                   \
   "width = " GST_VIDEO_SIZE_RANGE ","             \
   "height = " GST_VIDEO_SIZE_RANGE ","            \
@@ -160,7 +270,21 @@ enum {
 static GstStaticPadTemplate video_src_template = GST_STATIC_PAD_TEMPLATE("src",
 									 GST_PAD_SRC,
 									 GST_PAD_ALWAYS,
-									 GST_STATIC_CAPS( /*RAW_AND_JPEG_CAPS "; " */ H264_CAPS)
+									 GST_STATIC_CAPS(H264_CAPS "; " JPEG_CAPS "; " RAW_CAPS)
+    );
+
+static GstStaticPadTemplate sub_src_template = GST_STATIC_PAD_TEMPLATE("subsrc_%u",
+								       GST_PAD_SRC,
+								       GST_PAD_REQUEST,
+								       GST_STATIC_CAPS(H264_CAPS)
+    );
+
+static GstStaticPadTemplate analytics_src_template = GST_STATIC_PAD_TEMPLATE("analytics",
+									     GST_PAD_SRC,
+									     GST_PAD_REQUEST,
+									     GST_STATIC_CAPS
+									     (GST_VIDEO_CAPS_MAKE
+									      ("{ GRAY8, I420 }"))
     );
 
 #define gst_rpi_cam_src_parent_class parent_class
@@ -172,11 +296,37 @@ static void gst_rpi_cam_src_get_property(GObject * object, guint prop_id,
 					 GValue * value, GParamSpec * pspec);
 static gboolean gst_rpi_cam_src_start(GstBaseSrc * parent);
 static gboolean gst_rpi_cam_src_stop(GstBaseSrc * parent);
+static gboolean gst_rpi_cam_src_unlock(GstBaseSrc * parent);
+static gboolean gst_rpi_cam_src_unlock_stop(GstBaseSrc * parent);
 static gboolean gst_rpi_cam_src_decide_allocation(GstBaseSrc * src, GstQuery * query);
 static GstFlowReturn gst_rpi_cam_src_create(GstPushSrc * parent, GstBuffer ** buf);
 static GstCaps *gst_rpi_cam_src_get_caps(GstBaseSrc * src, GstCaps * filter);
 static gboolean gst_rpi_cam_src_set_caps(GstBaseSrc * src, GstCaps * caps);
 static GstCaps *gst_rpi_cam_src_fixate(GstBaseSrc * basesrc, GstCaps * caps);
+static GstPad *gst_rpi_cam_src_request_new_pad(GstElement * element, GstPadTemplate * templ,
+					       const gchar * name, const GstCaps * caps);
+static void gst_rpi_cam_src_release_pad(GstElement * element, GstPad * pad);
+static gboolean gst_rpi_cam_src_aux_activate_mode(GstPad * pad, GstObject * parent,
+						  GstPadMode mode, gboolean active);
+static void gst_rpi_cam_src_aux_stop_task(GstRpiCamSrc * src, RASPI_AUX_STREAM stream);
+static GstCaps *gst_rpi_cam_src_aux_negotiate(GstRpiCamSrc * src, RASPI_AUX_STREAM stream);
+static void gst_rpi_cam_src_aux_loop(GstPad * pad);
+static void gst_rpi_cam_src_finalize(GObject * object);
+static void gst_rpi_cam_src_detect_motion(GstRpiCamSrc * src, GstBuffer * buf);
+static void gst_rpi_cam_src_capture_still(gpointer data, gpointer user_data);
+static void gst_rpi_cam_src_post_qos(GstRpiCamSrc * src);
+static void gst_rpi_cam_src_start_broker(GstRpiCamSrc * src);
+static void gst_rpi_cam_src_publish(GstRpiCamSrc * src, GstBuffer * buf);
+static void gst_rpi_cam_src_apply_scheduling(GstRpiCamSrc * src,
+					     const RASPISCHED_PARAMETERS * params,
+					     const gchar * thread);
+static gboolean gst_rpi_cam_src_post_message(GstElement * element, GstMessage * message);
+static void gst_rpi_cam_src_log_handoffs(GstRpiCamSrc * src);
+static void gst_rpi_cam_src_trace_latency(GstRpiCamSrc * src);
+static void gst_rpi_cam_src_update_stats(GstRpiCamSrc * src, GstBuffer * buf);
+static void gst_rpi_cam_src_apply_camera_parameters(GstRpiCamSrc * src);
+static void gst_rpi_cam_src_apply_quantisation(GstRpiCamSrc * src);
+static GstStructure *gst_rpi_cam_src_get_stats(GstRpiCamSrc * src);
 
 static void gst_rpi_cam_src_class_init(GstRpiCamSrcClass * klass)
 {
@@ -192,6 +342,7 @@ static void gst_rpi_cam_src_class_init(GstRpiCamSrcClass * klass)
 
 	gobject_class->set_property = gst_rpi_cam_src_set_property;
 	gobject_class->get_property = gst_rpi_cam_src_get_property;
+	gobject_class->finalize = gst_rpi_cam_src_finalize;
 
 	g_object_class_install_property(gobject_class, PROP_BITRATE,
 					g_param_spec_int("bitrate", "Bitrate",
@@ -227,56 +378,86 @@ static void gst_rpi_cam_src_class_init(GstRpiCamSrcClass * klass)
 							 "Image capture sharpness", -100, 100,
 							 SHARPNESS_DEFAULT,
 							 G_PARAM_READWRITE |
-							 G_PARAM_STATIC_STRINGS));
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_CONTRAST,
 					g_param_spec_int("contrast", "Contrast",
 							 "Image capture contrast", -100, 100,
 							 CONTRAST_DEFAULT,
 							 G_PARAM_READWRITE |
-							 G_PARAM_STATIC_STRINGS));
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_BRIGHTNESS,
 					g_param_spec_int("brightness", "Brightness",
 							 "Image capture brightness", 0, 100,
 							 BRIGHTNESS_DEFAULT,
 							 G_PARAM_READWRITE |
-							 G_PARAM_STATIC_STRINGS));
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_SATURATION,
 					g_param_spec_int("saturation", "Saturation",
 							 "Image capture saturation", -100, 100,
 							 SATURATION_DEFAULT,
 							 G_PARAM_READWRITE |
-							 G_PARAM_STATIC_STRINGS));
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_ISO,
 					g_param_spec_int("iso", "ISO",
 							 "ISO value to use (0 = Auto)", 0, 3200, 0,
 							 G_PARAM_READWRITE |
-							 G_PARAM_STATIC_STRINGS));
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_VIDEO_STABILISATION,
 					g_param_spec_boolean("video-stabilisation",
 							     "Video Stabilisation",
 							     "Enable or disable video stabilisation",
 							     FALSE,
 							     G_PARAM_READWRITE |
-							     G_PARAM_STATIC_STRINGS));
+							     G_PARAM_STATIC_STRINGS |
+							     GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_EXPOSURE_COMPENSATION,
 					g_param_spec_int("exposure-compensation", "EV compensation",
 							 "Exposure Value compensation", -10, 10, 0,
 							 G_PARAM_READWRITE |
-							 G_PARAM_STATIC_STRINGS));
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_EXPOSURE_MODE,
 					g_param_spec_enum("exposure-mode", "Exposure Mode",
 							  "Camera exposure mode to use",
 							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_EXPOSURE_MODE,
 							  EXPOSURE_MODE_DEFAULT,
 							  G_PARAM_READWRITE |
-							  G_PARAM_STATIC_STRINGS));
+							  G_PARAM_STATIC_STRINGS |
+							  GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_SHUTTER_SPEED,
+					g_param_spec_int("shutter-speed", "Shutter speed",
+							 "Exposure time in microseconds (0 = auto)",
+							 0, 6000000, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_ANALOG_GAIN,
+					g_param_spec_float("analog-gain", "Analog gain",
+							   "Sensor analog gain (0 = auto)",
+							   0, 16.0, 0,
+							   G_PARAM_READWRITE |
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_DIGITAL_GAIN,
+					g_param_spec_float("digital-gain", "Digital gain",
+							   "ISP digital gain (0 = auto)",
+							   0, 16.0, 0,
+							   G_PARAM_READWRITE |
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_EXPOSURE_METERING_MODE,
 					g_param_spec_enum("metering-mode", "Exposure Metering Mode",
 							  "Camera exposure metering mode to use",
 							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_EXPOSURE_METERING_MODE,
 							  EXPOSURE_METERING_MODE_DEFAULT,
 							  G_PARAM_READWRITE |
-							  G_PARAM_STATIC_STRINGS));
+							  G_PARAM_STATIC_STRINGS |
+							  GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_AWB_MODE,
 					g_param_spec_enum("awb-mode",
 							  "Automatic White Balance Mode",
@@ -284,14 +465,86 @@ static void gst_rpi_cam_src_class_init(GstRpiCamSrcClass * klass)
 							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_AWB_MODE,
 							  GST_RPI_CAM_SRC_AWB_MODE_AUTO,
 							  G_PARAM_READWRITE |
-							  G_PARAM_STATIC_STRINGS));
+							  G_PARAM_STATIC_STRINGS |
+							  GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_AWB_GAIN_RED,
+					g_param_spec_float("awb-gain-red", "AWB red gain",
+							   "Red gain, used when awb-mode is off",
+							   0, 8.0, 0,
+							   G_PARAM_READWRITE |
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_AWB_GAIN_BLUE,
+					g_param_spec_float("awb-gain-blue", "AWB blue gain",
+							   "Blue gain, used when awb-mode is off",
+							   0, 8.0, 0,
+							   G_PARAM_READWRITE |
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_FLICKER_AVOIDANCE,
+					g_param_spec_enum("flicker-avoidance", "Flicker avoidance",
+							  "Keep exposure in step with mains lighting",
+							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_FLICKER_AVOIDANCE,
+							  GST_RPI_CAM_SRC_FLICKERAVOID_OFF,
+							  G_PARAM_READWRITE |
+							  G_PARAM_STATIC_STRINGS |
+							  GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_VIDEO_DENOISE,
+					g_param_spec_boolean("video-denoise", "Video denoise",
+							     "Run the ISP's denoise stage on video frames, "
+							     "which costs time on every frame",
+							     TRUE,
+							     G_PARAM_READWRITE |
+							     G_PARAM_STATIC_STRINGS |
+							     GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_STILL_DENOISE,
+					g_param_spec_boolean("still-denoise", "Still denoise",
+							     "Run the ISP's denoise stage on stills",
+							     TRUE,
+							     G_PARAM_READWRITE |
+							     G_PARAM_STATIC_STRINGS |
+							     GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_DRC,
+					g_param_spec_enum("drc", "DRC",
+							  "Dynamic range compression strength, run by "
+							  "the ISP on every frame",
+							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_DRC_LEVEL,
+							  GST_RPI_CAM_SRC_DRC_LEVEL_OFF,
+							  G_PARAM_READWRITE |
+							  G_PARAM_STATIC_STRINGS |
+							  GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_ANNOTATION_MODE,
+					g_param_spec_flags("annotation-mode", "Annotation mode",
+							   "What the camera draws over each frame; "
+							   "latency-marker draws @ and the monotonic "
+							   "time in microseconds it was sent",
+							   GST_RPI_CAM_TYPE_RPI_CAM_SRC_ANNOTATION_MODE,
+							   0,
+							   G_PARAM_READWRITE |
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_ANNOTATION_TEXT,
+					g_param_spec_string("annotation-text", "Annotation text",
+							    "Text shown with annotation-mode custom-text",
+							    "",
+							    G_PARAM_READWRITE |
+							    G_PARAM_STATIC_STRINGS |
+							    GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_ANNOTATION_TEXT_SIZE,
+					g_param_spec_int("annotation-text-size", "Annotation text size",
+							 "Height of the annotation text, 6 to 160 "
+							 "(0 = default)", 0, 160, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_IMAGE_EFFECT,
 					g_param_spec_enum("image-effect", "Image effect",
 							  "Visual FX to apply to the image",
 							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_IMAGE_EFFECT,
 							  GST_RPI_CAM_SRC_IMAGEFX_NONE,
 							  G_PARAM_READWRITE |
-							  G_PARAM_STATIC_STRINGS));
+							  G_PARAM_STATIC_STRINGS |
+							  GST_PARAM_MUTABLE_PLAYING));
 #if 0
 	PROP_IMAGE_EFFECT_PARAMS, PROP_COLOUR_EFFECTS,
 #endif
@@ -300,41 +553,302 @@ static void gst_rpi_cam_src_class_init(GstRpiCamSrcClass * klass)
 							     "Rotate captured image (0, 90, 180, 270 degrees)",
 							     0, 270, 0,
 							     G_PARAM_READWRITE |
-							     G_PARAM_STATIC_STRINGS));
+							     G_PARAM_STATIC_STRINGS |
+							     GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_HFLIP,
 					g_param_spec_boolean("hflip", "Horizontal Flip",
 							     "Flip capture horizontally", FALSE,
 							     G_PARAM_READWRITE |
-							     G_PARAM_STATIC_STRINGS));
+							     G_PARAM_STATIC_STRINGS |
+							     GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_VFLIP,
 					g_param_spec_boolean("vflip", "Vertical Flip",
 							     "Flip capture vertically", FALSE,
 							     G_PARAM_READWRITE |
-							     G_PARAM_STATIC_STRINGS));
+							     G_PARAM_STATIC_STRINGS |
+							     GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_ROI_X,
 					g_param_spec_float("roi-x", "ROI X",
 							   "Normalised region-of-interest X coord",
 							   0, 1.0, 0,
 							   G_PARAM_READWRITE |
-							   G_PARAM_STATIC_STRINGS));
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_ROI_Y,
 					g_param_spec_float("roi-y", "ROI Y",
 							   "Normalised region-of-interest Y coord",
 							   0, 1.0, 0,
 							   G_PARAM_READWRITE |
-							   G_PARAM_STATIC_STRINGS));
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_ROI_W,
 					g_param_spec_float("roi-w", "ROI W",
 							   "Normalised region-of-interest W coord",
 							   0, 1.0, 1.0,
 							   G_PARAM_READWRITE |
-							   G_PARAM_STATIC_STRINGS));
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
 	g_object_class_install_property(gobject_class, PROP_ROI_H,
 					g_param_spec_float("roi-h", "ROI H",
 							   "Normalised region-of-interest H coord",
 							   0, 1.0, 1.0,
 							   G_PARAM_READWRITE |
+							   G_PARAM_STATIC_STRINGS |
+							   GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_ROI_TRANSITION,
+					g_param_spec_int("roi-transition", "ROI transition",
+							 "Milliseconds a change of region of interest "
+							 "is spread over, moving the crop a step per "
+							 "frame (0 = jump)", 0, 60000, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_EXPOSURE_LOCK,
+					g_param_spec_boolean("exposure-lock", "Exposure lock",
+							     "Hold whatever exposure and white balance is "
+							     "still automatic once it has settled after "
+							     "starting",
+							     FALSE,
+							     G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_SKIP_UNTIL_SETTLED,
+					g_param_spec_boolean("skip-until-settled", "Skip until settled",
+							     "Only start capturing frames once exposure "
+							     "and white balance have settled",
+							     FALSE,
+							     G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_SETTLE_TIMEOUT,
+					g_param_spec_int("settle-timeout", "Settle timeout",
+							 "Milliseconds skip-until-settled waits at most "
+							 "(0 = no limit)", 0, 60000, 2000,
+							 G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_QUANTISATION_PARAMETER,
+					g_param_spec_int("quantisation-parameter",
+							 "Quantisation Parameter",
+							 "Fixed encoder quantisation, overriding bitrate control. "
+							 "Can be changed while playing (0 = use bitrate)",
+							 0, 51, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS |
+							 GST_PARAM_MUTABLE_PLAYING));
+	g_object_class_install_property(gobject_class, PROP_SUB_WIDTH,
+					g_param_spec_int("sub-width", "Substream width",
+							 "Width of the substream on the subsrc_%u pad",
+							 16, 1920, SUB_WIDTH_DEFAULT,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_SUB_HEIGHT,
+					g_param_spec_int("sub-height", "Substream height",
+							 "Height of the substream on the subsrc_%u pad",
+							 16, 1080, SUB_HEIGHT_DEFAULT,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_SUB_BITRATE,
+					g_param_spec_int("sub-bitrate", "Substream bitrate",
+							 "Bitrate of the substream on the subsrc_%u pad",
+							 1, BITRATE_HIGHEST, SUB_BITRATE_DEFAULT,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_SUB_KEYFRAME_INTERVAL,
+					g_param_spec_int("sub-keyframe-interval",
+							 "Substream keyframe interval",
+							 "Frames between substream key frames (0 = encoder default)",
+							 0, G_MAXINT, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_SUB_PROFILE,
+					g_param_spec_enum("sub-profile", "Substream profile",
+							  "H264 profile of the substream",
+							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_H264_PROFILE,
+							  SUB_PROFILE_DEFAULT,
+							  G_PARAM_READWRITE |
+							  G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_ANALYTICS_WIDTH,
+					g_param_spec_int("analytics-width", "Analytics width",
+							 "Width of the frames on the analytics pad",
+							 16, 1920, ANALYTICS_WIDTH_DEFAULT,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_ANALYTICS_HEIGHT,
+					g_param_spec_int("analytics-height", "Analytics height",
+							 "Height of the frames on the analytics pad",
+							 16, 1080, ANALYTICS_HEIGHT_DEFAULT,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_INLINE_MOTION_VECTORS,
+					g_param_spec_boolean("inline-motion-vectors",
+							     "Inline motion vectors",
+							     "Attach the H264 encoder's motion vectors to "
+							     "each frame as GstRpiCamMotionVectorMeta",
+							     FALSE,
+							     G_PARAM_READWRITE |
+							     G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MOTION_DETECT,
+					g_param_spec_boolean("motion-detect", "Motion detection",
+							     "Detect motion from the encoder's motion vectors "
+							     "and post rpicamsrc-motion messages "
+							     "(turns on inline-motion-vectors)",
+							     FALSE,
+							     G_PARAM_READWRITE |
+							     G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MOTION_THRESHOLD,
+					g_param_spec_int("motion-threshold", "Motion threshold",
+							 "Squared vector length at which a macroblock counts as moving",
+							 1, 2 * 128 * 128, 16,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MOTION_SAD_THRESHOLD,
+					g_param_spec_int("motion-sad-threshold", "Motion SAD threshold",
+							 "SAD a moving macroblock also needs (0 = ignore SAD)",
+							 0, G_MAXUINT16, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MOTION_MIN_BLOCKS,
+					g_param_spec_int("motion-min-blocks", "Motion min blocks",
+							 "Moving macroblocks needed for a frame to show motion",
+							 1, G_MAXINT, 10,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MOTION_TRIGGER_FRAMES,
+					g_param_spec_int("motion-trigger-frames", "Motion trigger frames",
+							 "Consecutive motion frames before motion starts",
+							 1, G_MAXINT, 3,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MOTION_RELEASE_FRAMES,
+					g_param_spec_int("motion-release-frames", "Motion release frames",
+							 "Consecutive still frames before motion stops",
+							 1, G_MAXINT, 30,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MOTION_REGIONS,
+					g_param_spec_string("motion-regions", "Motion regions",
+							    "Normalised x,y,w,h rectangles to watch, separated "
+							    "by ';' (empty = whole frame)",
+							    NULL,
+							    G_PARAM_READWRITE |
+							    G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MOTION_CAPTURE_PREFIX,
+					g_param_spec_string("motion-capture-prefix",
+							    "Motion capture prefix",
+							    "Take a still, named with this prefix, whenever "
+							    "motion starts (NULL = no stills)",
+							    NULL,
+							    G_PARAM_READWRITE |
+							    G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_LEAKY,
+					g_param_spec_enum("leaky", "Leaky",
+							  "What to do when frames back up because "
+							  "downstream is slow",
+							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_LEAKY,
+							  GST_RPI_CAM_SRC_LEAKY_BLOCK,
+							  G_PARAM_READWRITE |
+							  G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MAX_QUEUE_FRAMES,
+					g_param_spec_int("max-queue-frames", "Max queue frames",
+							 "Frames that may wait to be pushed before the "
+							 "leaky policy drops (0 = no limit)",
+							 0, G_MAXINT, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_MAX_QUEUE_TIME,
+					g_param_spec_int("max-queue-time", "Max queue time",
+							 "Milliseconds a frame may wait to be pushed before "
+							 "the leaky policy drops (0 = no limit)",
+							 0, G_MAXINT, 500,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CAMERA_NUMBER,
+					g_param_spec_int("camera-number", "Camera number",
+							 "Camera to use on boards with more than one "
+							 "(compute module), indexed from 0",
+							 0, 3, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_BROKER_SOCKET,
+					g_param_spec_string("broker-socket", "Broker socket",
+							    "Share the video stream through shared memory "
+							    "with rpicamshmsrc elements connecting to this "
+							    "socket (NULL = no broker)",
+							    NULL,
+							    G_PARAM_READWRITE |
+							    G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_BROKER_SLOTS,
+					g_param_spec_int("broker-slots", "Broker slots",
+							 "Frames kept in the broker's shared memory",
+							 4, 256, 32,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_STREAMING_CPU_MASK,
+					g_param_spec_uint("streaming-cpu-mask", "Streaming CPU mask",
+							  "CPUs the streaming thread may run on, bit n for "
+							  "CPU n (0 = any)",
+							  0, G_MAXUINT, 0,
+							  G_PARAM_READWRITE |
+							  G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_STREAMING_SCHEDULING_POLICY,
+					g_param_spec_enum("streaming-scheduling-policy",
+							  "Streaming scheduling policy",
+							  "Scheduling class of the streaming thread, real-time "
+							  "classes fall back to normal without CAP_SYS_NICE",
+							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_SCHEDULING_POLICY,
+							  GST_RPI_CAM_SRC_SCHEDULING_NORMAL,
+							  G_PARAM_READWRITE |
+							  G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_STREAMING_PRIORITY,
+					g_param_spec_int("streaming-priority", "Streaming priority",
+							 "Real-time priority of the streaming thread",
+							 1, 99, 1,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CAPTURE_CPU_MASK,
+					g_param_spec_uint("capture-cpu-mask", "Capture CPU mask",
+							  "CPUs the still capture worker may run on, bit n for "
+							  "CPU n (0 = any)",
+							  0, G_MAXUINT, 0,
+							  G_PARAM_READWRITE |
+							  G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CAPTURE_SCHEDULING_POLICY,
+					g_param_spec_enum("capture-scheduling-policy",
+							  "Capture scheduling policy",
+							  "Scheduling class of the still capture worker, real-time "
+							  "classes fall back to normal without CAP_SYS_NICE",
+							  GST_RPI_CAM_TYPE_RPI_CAM_SRC_SCHEDULING_POLICY,
+							  GST_RPI_CAM_SRC_SCHEDULING_NORMAL,
+							  G_PARAM_READWRITE |
+							  G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CAPTURE_PRIORITY,
+					g_param_spec_int("capture-priority", "Capture priority",
+							 "Real-time priority of the still capture worker",
+							 1, 99, 1,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_LATENCY_TRACING,
+					g_param_spec_boolean("latency-tracing", "Latency tracing",
+							     "Trace each frame from sensor timestamp to "
+							     "push and post rpicamsrc-latency messages",
+							     FALSE,
+							     G_PARAM_READWRITE |
+							     G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_LATENCY_INTERVAL,
+					g_param_spec_int("latency-interval", "Latency interval",
+							 "Milliseconds between rpicamsrc-latency messages",
+							 100, G_MAXINT, 1000,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_STATS,
+					g_param_spec_boxed("stats", "Statistics",
+							   "Framerate, bitrate, queue depths, drops and "
+							   "still captures of the running capture",
+							   GST_TYPE_STRUCTURE,
+							   G_PARAM_READABLE |
 							   G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_STATS_INTERVAL,
+					g_param_spec_int("stats-interval", "Statistics interval",
+							 "Milliseconds between rpicamsrc-stats messages "
+							 "(0 = no messages)",
+							 0, G_MAXINT, 0,
+							 G_PARAM_READWRITE |
+							 G_PARAM_STATIC_STRINGS));
 
 	gst_element_class_set_static_metadata(gstelement_class,
 					      "Raspberry Pi Camera Source",
@@ -344,9 +858,19 @@ static void gst_rpi_cam_src_class_init(GstRpiCamSrcClass * klass)
 
 	gst_element_class_add_pad_template(gstelement_class,
 					   gst_static_pad_template_get(&video_src_template));
+	gst_element_class_add_pad_template(gstelement_class,
+					   gst_static_pad_template_get(&sub_src_template));
+	gst_element_class_add_pad_template(gstelement_class,
+					   gst_static_pad_template_get(&analytics_src_template));
+
+	gstelement_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_request_new_pad);
+	gstelement_class->release_pad = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_release_pad);
+	gstelement_class->post_message = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_post_message);
 
 	basesrc_class->start = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_start);
 	basesrc_class->stop = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_stop);
+	basesrc_class->unlock = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_unlock);
+	basesrc_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_unlock_stop);
 	basesrc_class->decide_allocation = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_decide_allocation);
 	basesrc_class->get_caps = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_get_caps);
 	basesrc_class->set_caps = GST_DEBUG_FUNCPTR(gst_rpi_cam_src_set_caps);
@@ -363,16 +887,43 @@ static void gst_rpi_cam_src_init(GstRpiCamSrc * src)
 	raspicapture_default_config(&src->capture_config);
 
 	src->capture_config.verbose = 1;
+	raspimotion_set_defaults(&src->motion_params);
+	src->broker_slots = 32;
+	raspisched_set_defaults(&src->streaming_sched);
+	src->streaming_sched.priority = 1;
+	raspisched_set_defaults(&src->capture_sched);
+	src->capture_sched.priority = 1;
+	src->latency_interval = 1000;
+	g_mutex_init(&src->state_lock);
 	/* do-timestamping by default for now. FIXME: Implement proper timestamping */
 	gst_base_src_set_do_timestamp(GST_BASE_SRC(src), TRUE);
 }
 
+static void gst_rpi_cam_src_finalize(GObject * object)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(object);
+
+	g_free(src->motion_regions);
+	g_free(src->motion_capture_prefix);
+	g_free(src->broker_socket);
+	g_mutex_clear(&src->state_lock);
+
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* Picture settings that can change while playing */
+#define IS_CAMERA_PROPERTY(prop_id) ((prop_id) >= PROP_SHARPNESS && (prop_id) <= PROP_ROI_TRANSITION)
+
 static void
 gst_rpi_cam_src_set_property(GObject * object, guint prop_id,
 			     const GValue * value, GParamSpec * pspec)
 {
 	GstRpiCamSrc *src = GST_RPICAMSRC(object);
 
+	/* The streaming thread copies camera_parameters under the object lock */
+	if (IS_CAMERA_PROPERTY(prop_id))
+		GST_OBJECT_LOCK(src);
+
 	switch (prop_id) {
 	case PROP_BITRATE:
 		src->capture_config.bitrate = g_value_get_int(value);
@@ -415,6 +966,15 @@ gst_rpi_cam_src_set_property(GObject * object, guint prop_id,
 	case PROP_EXPOSURE_MODE:
 		src->capture_config.camera_parameters.exposureMode = g_value_get_enum(value);
 		break;
+	case PROP_SHUTTER_SPEED:
+		src->capture_config.camera_parameters.shutter_speed = g_value_get_int(value);
+		break;
+	case PROP_ANALOG_GAIN:
+		src->capture_config.camera_parameters.analog_gain = g_value_get_float(value);
+		break;
+	case PROP_DIGITAL_GAIN:
+		src->capture_config.camera_parameters.digital_gain = g_value_get_float(value);
+		break;
 	case PROP_EXPOSURE_METERING_MODE:
 		src->capture_config.camera_parameters.exposureMeterMode = g_value_get_enum(value);
 		break;
@@ -424,6 +984,35 @@ gst_rpi_cam_src_set_property(GObject * object, guint prop_id,
 	case PROP_AWB_MODE:
 		src->capture_config.camera_parameters.awbMode = g_value_get_enum(value);
 		break;
+	case PROP_AWB_GAIN_RED:
+		src->capture_config.camera_parameters.awb_gains_r = g_value_get_float(value);
+		break;
+	case PROP_AWB_GAIN_BLUE:
+		src->capture_config.camera_parameters.awb_gains_b = g_value_get_float(value);
+		break;
+	case PROP_FLICKER_AVOIDANCE:
+		src->capture_config.camera_parameters.flickerAvoidMode = g_value_get_enum(value);
+		break;
+	case PROP_VIDEO_DENOISE:
+		src->capture_config.camera_parameters.videoDenoise = g_value_get_boolean(value);
+		break;
+	case PROP_STILL_DENOISE:
+		src->capture_config.camera_parameters.stillsDenoise = g_value_get_boolean(value);
+		break;
+	case PROP_DRC:
+		src->capture_config.camera_parameters.drcLevel = g_value_get_enum(value);
+		break;
+	case PROP_ANNOTATION_MODE:
+		src->capture_config.camera_parameters.enable_annotate = g_value_get_flags(value);
+		break;
+	case PROP_ANNOTATION_TEXT:
+		g_strlcpy(src->capture_config.camera_parameters.annotate_string,
+			  g_value_get_string(value) ? g_value_get_string(value) : "",
+			  sizeof(src->capture_config.camera_parameters.annotate_string));
+		break;
+	case PROP_ANNOTATION_TEXT_SIZE:
+		src->capture_config.camera_parameters.annotate_text_size = g_value_get_int(value);
+		break;
 	case PROP_IMAGE_EFFECT:
 		src->capture_config.camera_parameters.imageEffect = g_value_get_enum(value);
 		break;
@@ -445,16 +1034,174 @@ gst_rpi_cam_src_set_property(GObject * object, guint prop_id,
 	case PROP_ROI_H:
 		src->capture_config.camera_parameters.roi.h = g_value_get_float(value);
 		break;
+	case PROP_ROI_TRANSITION:
+		src->capture_config.roiTransition = g_value_get_int(value);
+		break;
+	case PROP_EXPOSURE_LOCK:
+		src->capture_config.exposureLock = g_value_get_boolean(value);
+		break;
+	case PROP_SKIP_UNTIL_SETTLED:
+		src->capture_config.skipUntilSettled = g_value_get_boolean(value);
+		break;
+	case PROP_SETTLE_TIMEOUT:
+		src->capture_config.settleTimeout = g_value_get_int(value);
+		break;
+	case PROP_QUANTISATION_PARAMETER:
+		/* Sent from the streaming thread, see gst_rpi_cam_src_create() */
+		GST_OBJECT_LOCK(src);
+		src->capture_config.quantisationParameter = g_value_get_int(value);
+		g_atomic_int_set(&src->quantisation_changed, 1);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_SUB_WIDTH:
+		src->capture_config.substream.width = g_value_get_int(value);
+		break;
+	case PROP_SUB_HEIGHT:
+		src->capture_config.substream.height = g_value_get_int(value);
+		break;
+	case PROP_SUB_BITRATE:
+		src->capture_config.substream.bitrate = g_value_get_int(value);
+		break;
+	case PROP_SUB_KEYFRAME_INTERVAL:
+		src->capture_config.substream.intraperiod = g_value_get_int(value);
+		break;
+	case PROP_SUB_PROFILE:
+		src->capture_config.substream.profile = g_value_get_enum(value);
+		break;
+	case PROP_ANALYTICS_WIDTH:
+		src->capture_config.analytics.width = g_value_get_int(value);
+		break;
+	case PROP_ANALYTICS_HEIGHT:
+		src->capture_config.analytics.height = g_value_get_int(value);
+		break;
+	case PROP_INLINE_MOTION_VECTORS:
+		src->capture_config.inlineMotionVectors = g_value_get_boolean(value);
+		break;
+	case PROP_MOTION_DETECT:
+		src->motion_detect = g_value_get_boolean(value);
+		break;
+	/* The streaming thread picks motion settings up under the object lock */
+	case PROP_MOTION_THRESHOLD:
+		GST_OBJECT_LOCK(src);
+		src->motion_params.magnitude = g_value_get_int(value);
+		src->motion_params_changed = TRUE;
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_SAD_THRESHOLD:
+		GST_OBJECT_LOCK(src);
+		src->motion_params.sad = g_value_get_int(value);
+		src->motion_params_changed = TRUE;
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_MIN_BLOCKS:
+		GST_OBJECT_LOCK(src);
+		src->motion_params.min_blocks = g_value_get_int(value);
+		src->motion_params_changed = TRUE;
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_TRIGGER_FRAMES:
+		GST_OBJECT_LOCK(src);
+		src->motion_params.trigger_frames = g_value_get_int(value);
+		src->motion_params_changed = TRUE;
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_RELEASE_FRAMES:
+		GST_OBJECT_LOCK(src);
+		src->motion_params.release_frames = g_value_get_int(value);
+		src->motion_params_changed = TRUE;
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_REGIONS:
+		GST_OBJECT_LOCK(src);
+		g_free(src->motion_regions);
+		src->motion_regions = g_value_dup_string(value);
+		if (raspimotion_parse_regions(&src->motion_params, src->motion_regions) < 0)
+			GST_WARNING_OBJECT(src, "Invalid motion-regions \"%s\", watching the "
+					   "whole frame", src->motion_regions);
+		src->motion_params_changed = TRUE;
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_CAPTURE_PREFIX:
+		GST_OBJECT_LOCK(src);
+		g_free(src->motion_capture_prefix);
+		src->motion_capture_prefix = g_value_dup_string(value);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_LEAKY:
+		src->capture_config.leaky = g_value_get_enum(value);
+		break;
+	case PROP_MAX_QUEUE_FRAMES:
+		src->capture_config.maxQueueFrames = g_value_get_int(value);
+		break;
+	case PROP_MAX_QUEUE_TIME:
+		src->capture_config.maxQueueTime = g_value_get_int(value);
+		break;
+	case PROP_CAMERA_NUMBER:
+		src->capture_config.cameraNum = g_value_get_int(value);
+		break;
+	case PROP_BROKER_SOCKET:
+		g_free(src->broker_socket);
+		src->broker_socket = g_value_dup_string(value);
+		break;
+	case PROP_BROKER_SLOTS:
+		src->broker_slots = g_value_get_int(value);
+		break;
+	case PROP_STREAMING_CPU_MASK:
+		src->streaming_sched.cpu_mask = g_value_get_uint(value);
+		break;
+	case PROP_STREAMING_SCHEDULING_POLICY:
+		src->streaming_sched.policy = g_value_get_enum(value);
+		break;
+	case PROP_STREAMING_PRIORITY:
+		src->streaming_sched.priority = g_value_get_int(value);
+		break;
+	case PROP_CAPTURE_CPU_MASK:
+		src->capture_sched.cpu_mask = g_value_get_uint(value);
+		break;
+	case PROP_CAPTURE_SCHEDULING_POLICY:
+		src->capture_sched.policy = g_value_get_enum(value);
+		break;
+	case PROP_CAPTURE_PRIORITY:
+		src->capture_sched.priority = g_value_get_int(value);
+		break;
+	case PROP_LATENCY_TRACING:
+		src->latency_tracing = g_value_get_boolean(value);
+		break;
+	case PROP_LATENCY_INTERVAL:
+		src->latency_interval = g_value_get_int(value);
+		break;
+	case PROP_STATS_INTERVAL:
+		src->stats_interval = g_value_get_int(value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
 	}
+
+	if (IS_CAMERA_PROPERTY(prop_id)) {
+		g_atomic_int_set(&src->camera_parameters_changed, 1);
+		GST_OBJECT_UNLOCK(src);
+	}
 }
 
 static void
 gst_rpi_cam_src_get_property(GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
 {
 	GstRpiCamSrc *src = GST_RPICAMSRC(object);
+	RASPICAM_CAMERA_PARAMETERS camera;
+
+	/* While running, report what the camera is actually using. Reading it
+	 * back can take a while, so only state_lock is held for that, which
+	 * stop() needs before freeing capture_state */
+	if (IS_CAMERA_PROPERTY(prop_id)) {
+		GST_OBJECT_LOCK(src);
+		camera = src->capture_config.camera_parameters;
+		GST_OBJECT_UNLOCK(src);
+		g_mutex_lock(&src->state_lock);
+		if (src->capture_state)
+			raspi_capture_get_camera_parameters(src->capture_state, &camera);
+		g_mutex_unlock(&src->state_lock);
+	}
 
 	switch (prop_id) {
 	case PROP_BITRATE:
@@ -474,59 +1221,220 @@ gst_rpi_cam_src_get_property(GObject * object, guint prop_id, GValue * value, GP
 		g_value_set_int(value, src->capture_config.preview_parameters.opacity);
 		break;
 	case PROP_SHARPNESS:
-		g_value_set_int(value, src->capture_config.camera_parameters.sharpness);
+		g_value_set_int(value, camera.sharpness);
 		break;
 	case PROP_CONTRAST:
-		g_value_set_int(value, src->capture_config.camera_parameters.contrast);
+		g_value_set_int(value, camera.contrast);
 		break;
 	case PROP_BRIGHTNESS:
-		g_value_set_int(value, src->capture_config.camera_parameters.brightness);
+		g_value_set_int(value, camera.brightness);
 		break;
 	case PROP_SATURATION:
-		g_value_set_int(value, src->capture_config.camera_parameters.saturation);
+		g_value_set_int(value, camera.saturation);
 		break;
 	case PROP_ISO:
-		g_value_set_int(value, src->capture_config.camera_parameters.ISO);
+		g_value_set_int(value, camera.ISO);
 		break;
 	case PROP_VIDEO_STABILISATION:
 		g_value_set_boolean(value,
-				    ! !(src->capture_config.camera_parameters.videoStabilisation));
+				    ! !(camera.videoStabilisation));
 		break;
 	case PROP_EXPOSURE_COMPENSATION:
-		g_value_set_int(value, src->capture_config.camera_parameters.exposureCompensation);
+		g_value_set_int(value, camera.exposureCompensation);
 		break;
 	case PROP_EXPOSURE_MODE:
-		g_value_set_enum(value, src->capture_config.camera_parameters.exposureMode);
+		g_value_set_enum(value, camera.exposureMode);
+		break;
+	case PROP_SHUTTER_SPEED:
+		g_value_set_int(value, camera.shutter_speed);
+		break;
+	case PROP_ANALOG_GAIN:
+		g_value_set_float(value, camera.analog_gain);
+		break;
+	case PROP_DIGITAL_GAIN:
+		g_value_set_float(value, camera.digital_gain);
 		break;
 	case PROP_EXPOSURE_METERING_MODE:
-		g_value_set_enum(value, src->capture_config.camera_parameters.exposureMeterMode);
+		g_value_set_enum(value, camera.exposureMeterMode);
 		break;
 	case PROP_ROTATION:
-		g_value_set_int(value, src->capture_config.camera_parameters.rotation);
+		g_value_set_int(value, camera.rotation);
 		break;
 	case PROP_AWB_MODE:
-		g_value_set_enum(value, src->capture_config.camera_parameters.awbMode);
+		g_value_set_enum(value, camera.awbMode);
+		break;
+	case PROP_AWB_GAIN_RED:
+		g_value_set_float(value, camera.awb_gains_r);
+		break;
+	case PROP_AWB_GAIN_BLUE:
+		g_value_set_float(value, camera.awb_gains_b);
+		break;
+	case PROP_FLICKER_AVOIDANCE:
+		g_value_set_enum(value, camera.flickerAvoidMode);
+		break;
+	case PROP_VIDEO_DENOISE:
+		g_value_set_boolean(value, ! !(camera.videoDenoise));
+		break;
+	case PROP_STILL_DENOISE:
+		g_value_set_boolean(value, ! !(camera.stillsDenoise));
+		break;
+	case PROP_DRC:
+		g_value_set_enum(value, camera.drcLevel);
+		break;
+	case PROP_ANNOTATION_MODE:
+		g_value_set_flags(value, camera.enable_annotate);
+		break;
+	case PROP_ANNOTATION_TEXT:
+		g_value_set_string(value, camera.annotate_string);
+		break;
+	case PROP_ANNOTATION_TEXT_SIZE:
+		g_value_set_int(value, camera.annotate_text_size);
 		break;
 	case PROP_IMAGE_EFFECT:
-		g_value_set_enum(value, src->capture_config.camera_parameters.imageEffect);
+		g_value_set_enum(value, camera.imageEffect);
 		break;
 	case PROP_HFLIP:
-		g_value_set_boolean(value, ! !(src->capture_config.camera_parameters.hflip));
+		g_value_set_boolean(value, ! !(camera.hflip));
 		break;
 	case PROP_VFLIP:
-		g_value_set_boolean(value, ! !(src->capture_config.camera_parameters.vflip));
+		g_value_set_boolean(value, ! !(camera.vflip));
 		break;
 	case PROP_ROI_X:
-		g_value_set_float(value, src->capture_config.camera_parameters.roi.x);
+		g_value_set_float(value, camera.roi.x);
 		break;
 	case PROP_ROI_Y:
-		g_value_set_float(value, src->capture_config.camera_parameters.roi.y);
+		g_value_set_float(value, camera.roi.y);
 		break;
 	case PROP_ROI_W:
-		g_value_set_float(value, src->capture_config.camera_parameters.roi.w);
+		g_value_set_float(value, camera.roi.w);
 		break;
 	case PROP_ROI_H:
-		g_value_set_float(value, src->capture_config.camera_parameters.roi.h);
+		g_value_set_float(value, camera.roi.h);
+		break;
+	case PROP_ROI_TRANSITION:
+		g_value_set_int(value, src->capture_config.roiTransition);
+		break;
+	case PROP_EXPOSURE_LOCK:
+		g_value_set_boolean(value, src->capture_config.exposureLock);
+		break;
+	case PROP_SKIP_UNTIL_SETTLED:
+		g_value_set_boolean(value, src->capture_config.skipUntilSettled);
+		break;
+	case PROP_SETTLE_TIMEOUT:
+		g_value_set_int(value, src->capture_config.settleTimeout);
+		break;
+	case PROP_QUANTISATION_PARAMETER:
+		g_value_set_int(value, src->capture_config.quantisationParameter);
+		break;
+	case PROP_SUB_WIDTH:
+		g_value_set_int(value, src->capture_config.substream.width);
+		break;
+	case PROP_SUB_HEIGHT:
+		g_value_set_int(value, src->capture_config.substream.height);
+		break;
+	case PROP_SUB_BITRATE:
+		g_value_set_int(value, src->capture_config.substream.bitrate);
+		break;
+	case PROP_SUB_KEYFRAME_INTERVAL:
+		g_value_set_int(value, src->capture_config.substream.intraperiod);
+		break;
+	case PROP_SUB_PROFILE:
+		g_value_set_enum(value, src->capture_config.substream.profile);
+		break;
+	case PROP_ANALYTICS_WIDTH:
+		g_value_set_int(value, src->capture_config.analytics.width);
+		break;
+	case PROP_ANALYTICS_HEIGHT:
+		g_value_set_int(value, src->capture_config.analytics.height);
+		break;
+	case PROP_INLINE_MOTION_VECTORS:
+		g_value_set_boolean(value, src->capture_config.inlineMotionVectors);
+		break;
+	case PROP_MOTION_DETECT:
+		g_value_set_boolean(value, src->motion_detect);
+		break;
+	case PROP_MOTION_THRESHOLD:
+		GST_OBJECT_LOCK(src);
+		g_value_set_int(value, src->motion_params.magnitude);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_SAD_THRESHOLD:
+		GST_OBJECT_LOCK(src);
+		g_value_set_int(value, src->motion_params.sad);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_MIN_BLOCKS:
+		GST_OBJECT_LOCK(src);
+		g_value_set_int(value, src->motion_params.min_blocks);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_TRIGGER_FRAMES:
+		GST_OBJECT_LOCK(src);
+		g_value_set_int(value, src->motion_params.trigger_frames);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_RELEASE_FRAMES:
+		GST_OBJECT_LOCK(src);
+		g_value_set_int(value, src->motion_params.release_frames);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_REGIONS:
+		GST_OBJECT_LOCK(src);
+		g_value_set_string(value, src->motion_regions);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_MOTION_CAPTURE_PREFIX:
+		GST_OBJECT_LOCK(src);
+		g_value_set_string(value, src->motion_capture_prefix);
+		GST_OBJECT_UNLOCK(src);
+		break;
+	case PROP_LEAKY:
+		g_value_set_enum(value, src->capture_config.leaky);
+		break;
+	case PROP_MAX_QUEUE_FRAMES:
+		g_value_set_int(value, src->capture_config.maxQueueFrames);
+		break;
+	case PROP_MAX_QUEUE_TIME:
+		g_value_set_int(value, src->capture_config.maxQueueTime);
+		break;
+	case PROP_CAMERA_NUMBER:
+		g_value_set_int(value, src->capture_config.cameraNum);
+		break;
+	case PROP_BROKER_SOCKET:
+		g_value_set_string(value, src->broker_socket);
+		break;
+	case PROP_BROKER_SLOTS:
+		g_value_set_int(value, src->broker_slots);
+		break;
+	case PROP_STREAMING_CPU_MASK:
+		g_value_set_uint(value, src->streaming_sched.cpu_mask);
+		break;
+	case PROP_STREAMING_SCHEDULING_POLICY:
+		g_value_set_enum(value, src->streaming_sched.policy);
+		break;
+	case PROP_STREAMING_PRIORITY:
+		g_value_set_int(value, src->streaming_sched.priority);
+		break;
+	case PROP_CAPTURE_CPU_MASK:
+		g_value_set_uint(value, src->capture_sched.cpu_mask);
+		break;
+	case PROP_CAPTURE_SCHEDULING_POLICY:
+		g_value_set_enum(value, src->capture_sched.policy);
+		break;
+	case PROP_CAPTURE_PRIORITY:
+		g_value_set_int(value, src->capture_sched.priority);
+		break;
+	case PROP_LATENCY_TRACING:
+		g_value_set_boolean(value, src->latency_tracing);
+		break;
+	case PROP_LATENCY_INTERVAL:
+		g_value_set_int(value, src->latency_interval);
+		break;
+	case PROP_STATS:
+		g_value_take_boxed(value, gst_rpi_cam_src_get_stats(src));
+		break;
+	case PROP_STATS_INTERVAL:
+		g_value_set_int(value, src->stats_interval);
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -537,10 +1445,39 @@ gst_rpi_cam_src_get_property(GObject * object, guint prop_id, GValue * value, GP
 static gboolean gst_rpi_cam_src_start(GstBaseSrc * parent)
 {
 	GstRpiCamSrc *src = GST_RPICAMSRC(parent);
+	RASPIVID_STATE *state;
+
 	GST_LOG_OBJECT(src, "In src_start()");
-	src->capture_state = raspi_capture_setup(&src->capture_config);
-	if (src->capture_state == NULL)
+	/* Leaves inline-motion-vectors as the application set it */
+	src->capture_config.motionDetect = src->motion_detect;
+	/* Setting up the camera applies whatever is set now */
+	g_atomic_int_set(&src->camera_parameters_changed, 0);
+	g_atomic_int_set(&src->quantisation_changed, 0);
+	state = raspi_capture_setup(&src->capture_config);
+	if (state == NULL)
 		return FALSE;
+	g_mutex_lock(&src->state_lock);
+	src->capture_state = state;
+	g_mutex_unlock(&src->state_lock);
+
+	/* An exclusive pool keeps one worker thread of its own, which is
+	 * what capture_sched gets applied to */
+	src->capture_sched_applied = FALSE;
+	/* motion-capture-prefix can be set while playing, so have the pool ready */
+	if (src->motion_detect)
+		src->capture_pool = g_thread_pool_new(gst_rpi_cam_src_capture_still, src, 1,
+						      TRUE, NULL);
+
+	raspistats_reset(&src->stats);
+	src->stats_posted = raspiring_now();
+
+	if (src->latency_tracing) {
+		src->latency = raspilatency_create(LATENCY_TRACE_FRAMES);
+		if (src->latency == NULL)
+			GST_WARNING_OBJECT(src, "Could not allocate the latency trace");
+		memset(&src->latency_pending, 0, sizeof(src->latency_pending));
+		src->latency_reported = raspiring_now();
+	}
 
 	return TRUE;
 }
@@ -548,10 +1485,68 @@ static gboolean gst_rpi_cam_src_start(GstBaseSrc * parent)
 static gboolean gst_rpi_cam_src_stop(GstBaseSrc * parent)
 {
 	GstRpiCamSrc *src = GST_RPICAMSRC(parent);
+	RASPIVID_STATE *state;
+	int i;
+
+	for (i = 0; i < RASPI_AUX_STREAM_COUNT; i++) {
+		gst_rpi_cam_src_aux_stop_task(src, i);
+		gst_caps_replace(&src->aux_caps[i], NULL);
+	}
+	/* Let a motion triggered still finish before the camera goes away */
+	if (src->capture_pool) {
+		g_thread_pool_free(src->capture_pool, TRUE, TRUE);
+		src->capture_pool = NULL;
+	}
+	raspimotion_destroy(src->motion);
+	src->motion = NULL;
+	src->frames_pushed = src->frames_dropped = 0;
 	if (src->started)
-		raspi_capture_stop(src->capture_state);
-	raspi_capture_free(src->capture_state);
+		gst_rpi_cam_src_log_handoffs(src);
+	raspilatency_destroy(src->latency);
+	src->latency = NULL;
+	if (src->broker) {
+		RASPISHM_STATS stats;
+
+		raspishm_server_get_stats(src->broker, &stats);
+		GST_INFO_OBJECT(src, "Broker published %" G_GUINT64_FORMAT " frames, dropped %"
+				G_GUINT64_FORMAT ", copied %" G_GUINT64_FORMAT " bytes, reclaimed %"
+				G_GUINT64_FORMAT " from dead consumers", stats.published,
+				stats.dropped, stats.bytes_copied, stats.reclaimed);
+		raspishm_server_destroy(src->broker);
+		src->broker = NULL;
+	}
+	/* Property reads and unlock() use capture_state under state_lock */
+	g_mutex_lock(&src->state_lock);
+	state = src->capture_state;
 	src->capture_state = NULL;
+	g_mutex_unlock(&src->state_lock);
+	if (src->started)
+		raspi_capture_stop(state);
+	raspi_capture_free(state);
+	return TRUE;
+}
+
+/* Called from outside the streaming thread to get create() out of a wait
+ * for a frame that may never come */
+static gboolean gst_rpi_cam_src_unlock(GstBaseSrc * parent)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(parent);
+
+	g_mutex_lock(&src->state_lock);
+	if (src->capture_state)
+		raspi_capture_set_flushing(src->capture_state, TRUE);
+	g_mutex_unlock(&src->state_lock);
+	return TRUE;
+}
+
+static gboolean gst_rpi_cam_src_unlock_stop(GstBaseSrc * parent)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(parent);
+
+	g_mutex_lock(&src->state_lock);
+	if (src->capture_state)
+		raspi_capture_set_flushing(src->capture_state, FALSE);
+	g_mutex_unlock(&src->state_lock);
 	return TRUE;
 }
 
@@ -580,11 +1575,26 @@ static gboolean gst_rpi_cam_src_set_caps(GstBaseSrc * bsrc, GstCaps * caps)
 {
 	GstRpiCamSrc *src = GST_RPICAMSRC(bsrc);
 	GstVideoInfo info;
+	GstStructure *structure;
+	MMAL_FOURCC_T encoding = MMAL_ENCODING_H264;
 
 	GST_DEBUG_OBJECT(src, "In set_caps %" GST_PTR_FORMAT, caps);
 	if (!gst_video_info_from_caps(&info, caps))
 		return FALSE;
 
+	structure = gst_caps_get_structure(caps, 0);
+	if (gst_structure_has_name(structure, "image/jpeg")) {
+		encoding = MMAL_ENCODING_MJPEG;
+	} else if (gst_structure_has_name(structure, "video/x-raw")) {
+		encoding = raspi_capture_encoding_from_video_format(GST_VIDEO_INFO_FORMAT(&info));
+		if (encoding == 0) {
+			GST_ERROR_OBJECT(src, "Unsupported raw format %s",
+					 gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(&info)));
+			return FALSE;
+		}
+	}
+
+	src->capture_config.encoding = encoding;
 	src->capture_config.width = info.width;
 	src->capture_config.height = info.height;
 	src->capture_config.fps_n = info.fps_n;
@@ -595,7 +1605,14 @@ static gboolean gst_rpi_cam_src_set_caps(GstBaseSrc * bsrc, GstCaps * caps)
 
 static gboolean gst_rpi_cam_src_decide_allocation(GstBaseSrc * bsrc, GstQuery * query)
 {
+	GstRpiCamSrc *src = GST_RPICAMSRC(bsrc);
+
 	GST_LOG_OBJECT(bsrc, "In decide_allocation");
+
+	/* Raw frames carry the camera's padding, which needs GstVideoMeta downstream */
+	src->capture_config.useVideoMeta =
+	    gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL);
+
 	return GST_BASE_SRC_CLASS(parent_class)->decide_allocation(bsrc, query);
 }
 
@@ -629,27 +1646,766 @@ static GstFlowReturn gst_rpi_cam_src_create(GstPushSrc * parent, GstBuffer ** bu
 {
 	GstRpiCamSrc *src = GST_RPICAMSRC(parent);
 	GstFlowReturn ret;
+	int i;
+
+	/* Being called again means downstream returned from the last push */
+	if (src->latency)
+		gst_rpi_cam_src_trace_latency(src);
 
 	if (!src->started) {
+		/* Analytics caps decide what the capture copies out, so settle them first */
+		for (i = 0; i < RASPI_AUX_STREAM_COUNT; i++) {
+			if (src->aux_srcpad[i])
+				gst_caps_replace(&src->aux_caps[i],
+						 gst_rpi_cam_src_aux_negotiate(src, i));
+		}
+
 		if (!raspi_capture_start(src->capture_state))
 			return GST_FLOW_ERROR;
 		src->started = TRUE;
+
+		if (src->broker_socket)
+			gst_rpi_cam_src_start_broker(src);
+
+		/* The secondary outputs only exist once the capture has started */
+		for (i = 0; i < RASPI_AUX_STREAM_COUNT; i++) {
+			GstPad *pad = src->aux_srcpad[i];
+
+			if (pad && GST_PAD_IS_ACTIVE(pad))
+				gst_pad_start_task(pad, (GstTaskFunction) gst_rpi_cam_src_aux_loop,
+						   pad, NULL);
+		}
 	}
 
+	/* Between frames, so a burst of property changes goes out as one */
+	if (g_atomic_int_get(&src->camera_parameters_changed))
+		gst_rpi_cam_src_apply_camera_parameters(src);
+	if (g_atomic_int_get(&src->quantisation_changed))
+		gst_rpi_cam_src_apply_quantisation(src);
+
 	/* FIXME: Use custom allocator */
 	ret = raspi_capture_fill_buffer(src->capture_state, buf);
 	if (*buf)
 		GST_LOG_OBJECT(src, "Made buffer of size %" G_GSIZE_FORMAT,
 			       gst_buffer_get_size(*buf));
 
+	if (*buf && src->motion_detect)
+		gst_rpi_cam_src_detect_motion(src, *buf);
+
+	if (*buf) {
+		src->frames_pushed++;
+		gst_rpi_cam_src_post_qos(src);
+		gst_rpi_cam_src_update_stats(src, *buf);
+	}
+
+	if (*buf && src->broker)
+		gst_rpi_cam_src_publish(src, *buf);
+
+	if (*buf && src->latency)
+		raspi_capture_get_frame_timing(src->capture_state, &src->latency_pending);
+
 	return ret;
 }
 
+/* Send the picture settings changed since the last frame. Streaming
+ * thread only. */
+static void gst_rpi_cam_src_apply_camera_parameters(GstRpiCamSrc * src)
+{
+	RASPICAM_CAMERA_PARAMETERS params;
+	gint64 started, took;
+
+	GST_OBJECT_LOCK(src);
+	params = src->capture_config.camera_parameters;
+	g_atomic_int_set(&src->camera_parameters_changed, 0);
+	GST_OBJECT_UNLOCK(src);
+
+	started = raspiring_now();
+	if (!raspi_capture_update_camera_parameters(src->capture_state, &params))
+		GST_WARNING_OBJECT(src, "Camera refused some settings, they will be sent again "
+				   "with the next change");
+	took = raspiring_now() - started;
+
+	raspistats_parameters(&src->stats, took);
+	GST_DEBUG_OBJECT(src, "Applied camera settings in %" G_GINT64_FORMAT " us", took);
+}
+
+/* Send a quantisation-parameter changed while playing. Streaming thread
+ * only. */
+static void gst_rpi_cam_src_apply_quantisation(GstRpiCamSrc * src)
+{
+	int qp;
+
+	GST_OBJECT_LOCK(src);
+	qp = src->capture_config.quantisationParameter;
+	g_atomic_int_set(&src->quantisation_changed, 0);
+	GST_OBJECT_UNLOCK(src);
+
+	if (!raspi_capture_set_quantisation(src->capture_state, qp))
+		GST_WARNING_OBJECT(src, "Encoder refused quantisation %d", qp);
+}
+
+/* Set up the shared memory broker, now the video caps are known */
+static void gst_rpi_cam_src_start_broker(GstRpiCamSrc * src)
+{
+	GstCaps *caps = gst_pad_get_current_caps(GST_BASE_SRC_PAD(src));
+	RASPIVID_CONFIG *config = &src->capture_config;
+	gsize slot_size;
+	gchar *caps_str;
+
+	gst_video_info_init(&src->broker_info);
+	if (config->encoding == MMAL_ENCODING_H264 || config->encoding == MMAL_ENCODING_MJPEG) {
+		/* A generous encoded frame, a JPEG can come close to the I420 one */
+		if (config->encoding == MMAL_ENCODING_H264)
+			slot_size = config->width * config->height / 2;
+		else
+			slot_size = config->width * config->height * 3 / 2;
+		slot_size = MAX(slot_size, raspi_capture_get_buffer_size(src->capture_state));
+	} else if (caps && gst_video_info_from_caps(&src->broker_info, caps)) {
+		/* Raw frames are published packed, as the caps describe them */
+		slot_size = GST_VIDEO_INFO_SIZE(&src->broker_info);
+	} else {
+		GST_ELEMENT_WARNING(src, RESOURCE, OPEN_WRITE, ("Could not start the camera broker"),
+				    ("No raw video layout to publish, not sharing the stream"));
+		if (caps)
+			gst_caps_unref(caps);
+		return;
+	}
+	src->broker_slot_size = slot_size;
+
+	src->broker = raspishm_server_create(src->broker_socket, src->broker_slots, slot_size);
+	if (src->broker == NULL) {
+		GST_ELEMENT_WARNING(src, RESOURCE, OPEN_WRITE, ("Could not start the camera broker"),
+				    ("Failed to set up %s, not sharing the stream",
+				     src->broker_socket));
+	} else {
+		if (caps) {
+			caps_str = gst_caps_to_string(caps);
+			raspishm_server_set_caps(src->broker, caps_str);
+			g_free(caps_str);
+		}
+		GST_INFO_OBJECT(src, "Sharing the stream on %s", src->broker_socket);
+	}
+
+	if (caps)
+		gst_caps_unref(caps);
+}
+
+/* Copy a raw frame into dest laid out as broker_info, whatever strides
+ * the camera gave it */
+static gboolean gst_rpi_cam_src_pack_frame(GstRpiCamSrc * src, GstBuffer * buf, gpointer dest)
+{
+	gsize size = GST_VIDEO_INFO_SIZE(&src->broker_info);
+	GstVideoFrame in, out;
+	GstBuffer *packed;
+	gboolean ok = FALSE;
+
+	packed = gst_buffer_new_wrapped_full(0, dest, size, 0, size, NULL, NULL);
+	if (gst_video_frame_map(&in, &src->broker_info, buf, GST_MAP_READ)) {
+		if (gst_video_frame_map(&out, &src->broker_info, packed, GST_MAP_WRITE)) {
+			ok = gst_video_frame_copy(&out, &in);
+			gst_video_frame_unmap(&out);
+		}
+		gst_video_frame_unmap(&in);
+	}
+	gst_buffer_unref(packed);
+
+	return ok;
+}
+
+/* Copy the frame into the broker's shared memory for rpicamshmsrc consumers */
+static void gst_rpi_cam_src_publish(GstRpiCamSrc * src, GstBuffer * buf)
+{
+	gboolean raw = GST_VIDEO_INFO_FORMAT(&src->broker_info) != GST_VIDEO_FORMAT_UNKNOWN;
+	gsize size = raw ? GST_VIDEO_INFO_SIZE(&src->broker_info) : gst_buffer_get_size(buf);
+	gint64 pts = -1, dts = -1;
+	guint32 flags = 0;
+	GstClock *clock;
+	gpointer dest;
+
+	dest = raspishm_server_begin(src->broker, size);
+	if (dest == NULL) {
+		if (size > src->broker_slot_size)
+			GST_WARNING_OBJECT(src, "Dropped a %" G_GSIZE_FORMAT " byte frame, broker "
+					   "slots only hold %" G_GSIZE_FORMAT, size,
+					   src->broker_slot_size);
+		else
+			GST_LOG_OBJECT(src, "Broker has no free slot for a frame");
+		return;
+	}
+	if (raw) {
+		/* Left uncommitted, the slot is given back by the next frame */
+		if (!gst_rpi_cam_src_pack_frame(src, buf, dest)) {
+			GST_WARNING_OBJECT(src, "Could not pack a raw frame for the broker");
+			return;
+		}
+	} else {
+		gst_buffer_extract(buf, 0, dest, size);
+	}
+
+	if (GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER))
+		flags |= RASPISHM_FLAG_CONFIG;
+	else if (!GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT))
+		flags |= RASPISHM_FLAG_KEYFRAME;
+
+	/* Consumers run their own pipeline clock, so pass timestamps on as
+	 * CLOCK_MONOTONIC times. basesrc only stamps the buffer after create(),
+	 * so stamp it here the same way to keep both copies in step. */
+	clock = gst_element_get_clock(GST_ELEMENT(src));
+	if (clock) {
+		GstClockTime now = gst_clock_get_time(clock);
+		GstClockTime base_time = gst_element_get_base_time(GST_ELEMENT(src));
+		gint64 monotonic = g_get_monotonic_time() * GST_USECOND;
+
+		if (!GST_BUFFER_DTS_IS_VALID(buf) && !GST_BUFFER_PTS_IS_VALID(buf))
+			GST_BUFFER_DTS(buf) = GST_BUFFER_PTS(buf) = now - base_time;
+		if (GST_BUFFER_PTS_IS_VALID(buf))
+			pts = (gint64) (GST_BUFFER_PTS(buf) + base_time - now) + monotonic;
+		if (GST_BUFFER_DTS_IS_VALID(buf))
+			dts = (gint64) (GST_BUFFER_DTS(buf) + base_time - now) + monotonic;
+		gst_object_unref(clock);
+	}
+	raspishm_server_commit(src->broker, pts, dts, flags);
+}
+
+/* Tell the application about frames the leaky policy dropped since the last buffer */
+static void gst_rpi_cam_src_post_qos(GstRpiCamSrc * src)
+{
+	guint64 dropped = raspi_capture_get_dropped_frames(src->capture_state);
+	GstClockTime running_time = GST_CLOCK_TIME_NONE;
+	GstClock *clock;
+	GstMessage *msg;
+
+	if (dropped == src->frames_dropped)
+		return;
+
+	GST_INFO_OBJECT(src, "Leaky policy dropped %" G_GUINT64_FORMAT " frames (%"
+			G_GUINT64_FORMAT " in total)", dropped - src->frames_dropped, dropped);
+	src->frames_dropped = dropped;
+
+	clock = gst_element_get_clock(GST_ELEMENT(src));
+	if (clock) {
+		running_time = gst_clock_get_time(clock) - GST_ELEMENT(src)->base_time;
+		gst_object_unref(clock);
+	}
+
+	msg = gst_message_new_qos(GST_OBJECT(src), TRUE, running_time, GST_CLOCK_TIME_NONE,
+				  GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE);
+	gst_message_set_qos_stats(msg, GST_FORMAT_BUFFERS, src->frames_pushed, dropped);
+	gst_element_post_message(GST_ELEMENT(src), msg);
+}
+
+/* Post an rpicamsrc-motion message for motion starting or stopping */
+static void gst_rpi_cam_src_post_motion(GstRpiCamSrc * src, gboolean motion, int moving)
+{
+	GST_INFO_OBJECT(src, "Motion %s, %d moving blocks", motion ? "started" : "stopped",
+			moving);
+	gst_element_post_message(GST_ELEMENT(src),
+				 gst_message_new_element(GST_OBJECT(src),
+							 gst_structure_new("rpicamsrc-motion",
+									   "motion", G_TYPE_BOOLEAN,
+									   motion,
+									   "moving-blocks", G_TYPE_INT,
+									   moving, NULL)));
+}
+
+/* Feed the frame's motion vectors to the detector, and act on motion starting or stopping */
+static void gst_rpi_cam_src_detect_motion(GstRpiCamSrc * src, GstBuffer * buf)
+{
+	GstRpiCamMotionVectorMeta *meta = gst_buffer_get_rpi_cam_motion_vector_meta(buf);
+	RASPIMOTION_PARAMETERS params;
+	RASPIMOTION_EVENT event;
+	gchar *prefix;
+	gboolean changed;
+	gint64 start;
+	int moving;
+
+	if (meta == NULL)
+		return;
+
+	GST_OBJECT_LOCK(src);
+	params = src->motion_params;
+	changed = src->motion_params_changed;
+	src->motion_params_changed = FALSE;
+	GST_OBJECT_UNLOCK(src);
+
+	/* The detector keeps its own copy of the settings, so start it again,
+	 * ending any motion it was reporting */
+	if (src->motion && (changed
+			    || !raspimotion_matches(src->motion, meta->mb_width, meta->mb_height))) {
+		if (raspimotion_is_active(src->motion))
+			gst_rpi_cam_src_post_motion(src, FALSE, 0);
+		raspimotion_destroy(src->motion);
+		src->motion = NULL;
+	}
+	if (src->motion == NULL) {
+		src->motion = raspimotion_create(&params, meta->mb_width,
+						 meta->mb_height);
+		if (src->motion == NULL)
+			return;
+	}
+
+	start = g_get_monotonic_time();
+	/* GstRpiCamMotionVector and RASPIMOTION_VECTOR share the encoder's layout */
+	event = raspimotion_process(src->motion, (const RASPIMOTION_VECTOR *)meta->vectors, &moving);
+	GST_LOG_OBJECT(src, "Motion detection: %d moving blocks in %" G_GINT64_FORMAT " us",
+		       moving, g_get_monotonic_time() - start);
+
+	if (event == RASPIMOTION_EVENT_NONE)
+		return;
+
+	gst_rpi_cam_src_post_motion(src, event == RASPIMOTION_EVENT_START, moving);
+
+	if (event != RASPIMOTION_EVENT_START || !src->capture_pool)
+		return;
+
+	GST_OBJECT_LOCK(src);
+	prefix = g_strdup(src->motion_capture_prefix);
+	GST_OBJECT_UNLOCK(src);
+	if (prefix)
+		g_thread_pool_push(src->capture_pool, prefix, NULL);
+}
+
+/* Thread pool function taking a motion triggered still */
+static void gst_rpi_cam_src_capture_still(gpointer data, gpointer user_data)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(user_data);
+	gchar *prefix = data;
+	gchar *filename;
+	gint64 started;
+
+	if (!src->capture_sched_applied) {
+		gst_rpi_cam_src_apply_scheduling(src, &src->capture_sched, "still capture worker");
+		src->capture_sched_applied = TRUE;
+	}
+
+	started = raspiring_now();
+	filename = raspi_capture_photo(src->capture_state, prefix);
+	g_free(prefix);
+	if (!filename) {
+		GST_WARNING_OBJECT(src, "Motion triggered still failed");
+		return;
+	}
+	raspistats_still(&src->stats, raspiring_now() - started);
+	GST_INFO_OBJECT(src, "Motion triggered still %s", filename);
+
+	gst_element_post_message(GST_ELEMENT(src),
+				 gst_message_new_element(GST_OBJECT(src),
+							 gst_structure_new("rpicamsrc-still",
+									   "filename", G_TYPE_STRING,
+									   filename, NULL)));
+	g_free(filename);
+}
+
+/* Pin the calling thread and set its scheduling class. Missing
+ * privileges only cost a warning, the thread then keeps running as before */
+static void gst_rpi_cam_src_apply_scheduling(GstRpiCamSrc * src,
+					     const RASPISCHED_PARAMETERS * params,
+					     const gchar * thread)
+{
+	int failed, error = 0;
+
+	if (raspisched_is_default(params))
+		return;
+
+	failed = raspisched_apply_current_thread(params, &error);
+	if (failed & RASPISCHED_AFFINITY_FAILED)
+		GST_WARNING_OBJECT(src, "Could not pin the %s to CPU mask 0x%x: %s",
+				   thread, params->cpu_mask, g_strerror(error));
+	if (failed & RASPISCHED_POLICY_FAILED)
+		GST_WARNING_OBJECT(src, "Could not give the %s real-time priority %d: %s%s",
+				   thread, params->priority, g_strerror(error),
+				   error == EPERM ? " (needs CAP_SYS_NICE or RLIMIT_RTPRIO)" : "");
+	if (!failed)
+		GST_INFO_OBJECT(src, "Applied CPU mask 0x%x, policy %d, priority %d to the %s",
+				params->cpu_mask, params->policy, params->priority, thread);
+}
+
+/* Task threads come from a shared pool, so streaming_sched is applied
+ * when a thread enters the source pad's task and undone when it leaves.
+ * Stream status messages are posted from the task thread itself. */
+static gboolean gst_rpi_cam_src_post_message(GstElement * element, GstMessage * message)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(element);
+	GstStreamStatusType type;
+	GstElement *owner;
+	int error;
+
+	if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS
+	    && GST_MESSAGE_SRC(message) == GST_OBJECT(GST_BASE_SRC_PAD(src))) {
+		gst_message_parse_stream_status(message, &type, &owner);
+		if (type == GST_STREAM_STATUS_TYPE_ENTER
+		    && !raspisched_is_default(&src->streaming_sched)) {
+			error = raspisched_get_current_thread(&src->streaming_saved);
+			if (error == 0) {
+				gst_rpi_cam_src_apply_scheduling(src, &src->streaming_sched,
+								 "streaming thread");
+				src->streaming_sched_applied = TRUE;
+			} else {
+				GST_WARNING_OBJECT(src, "Could not read the streaming thread's "
+						   "scheduling: %s", g_strerror(error));
+			}
+		} else if (type == GST_STREAM_STATUS_TYPE_LEAVE && src->streaming_sched_applied) {
+			raspisched_apply_current_thread(&src->streaming_saved, NULL);
+			src->streaming_sched_applied = FALSE;
+		}
+	}
+
+	return GST_ELEMENT_CLASS(parent_class)->post_message(element, message);
+}
+
+/* Log how long frames waited for the streaming thread, to see what the
+ * scheduling properties buy */
+static void gst_rpi_cam_src_log_handoffs(GstRpiCamSrc * src)
+{
+	guint64 buckets[RASPI_HANDOFF_BUCKETS];
+	int i;
+
+	raspi_capture_get_handoff_histogram(src->capture_state, buckets);
+	for (i = 0; i < RASPI_HANDOFF_BUCKETS; i++) {
+		if (buckets[i] == 0)
+			continue;
+		if (i == RASPI_HANDOFF_BUCKETS - 1)
+			GST_INFO_OBJECT(src, "Handoff >= %u us: %" G_GUINT64_FORMAT,
+					1u << (i - 1), buckets[i]);
+		else
+			GST_INFO_OBJECT(src, "Handoff < %u us: %" G_GUINT64_FORMAT,
+					1u << i, buckets[i]);
+	}
+}
+
+/* Count a frame about to be pushed, and post rpicamsrc-stats once
+ * stats-interval has passed. Runs on the streaming thread. */
+static void gst_rpi_cam_src_update_stats(GstRpiCamSrc * src, GstBuffer * buf)
+{
+	RASPIVID_CONFIG *config = &src->capture_config;
+	RASPILATENCY_RECORD timing;
+	guint ring_depth, pool_free;
+	guint64 skipped, roi_steps;
+	gint64 first_frame_time, roi_latency, roi_jitter;
+	gint64 now = raspiring_now(), period = 0;
+	gboolean keyframe;
+
+	/* Late means it waited for us longer than a frame lasts */
+	raspi_capture_get_frame_timing(src->capture_state, &timing);
+	if (config->fps_n > 0)
+		period = gst_util_uint64_scale_int(G_USEC_PER_SEC, config->fps_d, config->fps_n);
+
+	keyframe = !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT)
+	    && !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER);
+	raspistats_frame(&src->stats, now, gst_buffer_get_size(buf), keyframe,
+			 period > 0 && timing.dequeue - timing.arrival > period);
+
+	raspi_capture_get_queue_state(src->capture_state, &ring_depth, &pool_free);
+	raspistats_queue(&src->stats, ring_depth, pool_free, src->frames_dropped);
+	raspistats_exposure_settled(&src->stats,
+				    raspi_capture_get_exposure_settle_time(src->capture_state));
+	first_frame_time = raspi_capture_get_first_frame_time(src->capture_state, &skipped);
+	raspistats_startup(&src->stats, first_frame_time, skipped);
+	roi_steps = raspi_capture_get_roi_steps(src->capture_state, &roi_latency, &roi_jitter);
+	raspistats_roi(&src->stats, roi_steps, roi_latency, roi_jitter);
+
+	if (src->stats_interval <= 0
+	    || now - src->stats_posted < (gint64) src->stats_interval * 1000)
+		return;
+	src->stats_posted = now;
+
+	gst_element_post_message(GST_ELEMENT(src),
+				 gst_message_new_element(GST_OBJECT(src),
+							 gst_rpi_cam_src_get_stats(src)));
+}
+
+/* Statistics as a new "rpicamsrc-stats" structure, with times in
+ * microseconds. Safe from any thread. */
+static GstStructure *gst_rpi_cam_src_get_stats(GstRpiCamSrc * src)
+{
+	RASPISTATS_SNAPSHOT snap;
+
+	raspistats_snapshot(&src->stats, raspiring_now(), &snap);
+
+	return gst_structure_new("rpicamsrc-stats",
+				 "frames", G_TYPE_UINT64, snap.frames,
+				 "bytes", G_TYPE_UINT64, snap.bytes,
+				 "fps", G_TYPE_DOUBLE, snap.fps,
+				 "average-fps", G_TYPE_DOUBLE, snap.average_fps,
+				 "bitrate", G_TYPE_UINT64, snap.bitrate,
+				 "average-bitrate", G_TYPE_UINT64, snap.average_bitrate,
+				 "keyframes", G_TYPE_UINT64, snap.keyframes,
+				 "keyframe-interval", G_TYPE_UINT, snap.keyframe_interval,
+				 "queue-depth", G_TYPE_UINT, snap.ring_depth,
+				 "encoder-pool-free", G_TYPE_UINT, snap.pool_free,
+				 "encoder-stalls", G_TYPE_UINT64, snap.encoder_stalls,
+				 "dropped-frames", G_TYPE_UINT64, snap.dropped_frames,
+				 "late-frames", G_TYPE_UINT64, snap.late_frames,
+				 "parameter-applies", G_TYPE_UINT64, snap.parameter_applies,
+				 "parameter-apply-latency", G_TYPE_INT64, snap.parameter_apply_last,
+				 "parameter-apply-latency-max", G_TYPE_INT64, snap.parameter_apply_max,
+				 "stills", G_TYPE_UINT64, snap.stills,
+				 "still-latency", G_TYPE_INT64, snap.still_latency_last,
+				 "still-latency-average", G_TYPE_INT64, snap.still_latency_average,
+				 "still-latency-max", G_TYPE_INT64, snap.still_latency_max,
+				 "exposure-settle-time", G_TYPE_INT64, snap.exposure_settle_time,
+				 "first-frame-time", G_TYPE_INT64, snap.first_good_frame_time,
+				 "startup-skipped-frames", G_TYPE_UINT64, snap.startup_skipped,
+				 "roi-steps", G_TYPE_UINT64, snap.roi_steps,
+				 "roi-step-latency", G_TYPE_INT64, snap.roi_step_latency_last,
+				 "roi-step-latency-max", G_TYPE_INT64, snap.roi_step_latency_max,
+				 "roi-jitter", G_TYPE_INT64, snap.roi_jitter_last,
+				 "roi-jitter-max", G_TYPE_INT64, snap.roi_jitter_max, NULL);
+}
+
+/* Complete the trace of the frame pushed last, and post the per-stage
+ * percentiles once latency-interval has passed */
+static void gst_rpi_cam_src_trace_latency(GstRpiCamSrc * src)
+{
+	RASPILATENCY_PERCENTILES summary[RASPILATENCY_STAGE_COUNT];
+	GstStructure *s;
+	gint64 now = raspiring_now();
+	int stage;
+
+	if (src->latency_pending.arrival) {
+		src->latency_pending.pushed = now;
+		raspilatency_record(src->latency, &src->latency_pending);
+		src->latency_pending.arrival = 0;
+	}
+
+	if (now - src->latency_reported < (gint64) src->latency_interval * 1000)
+		return;
+	src->latency_reported = now;
+
+	raspilatency_summarise(src->latency, summary);
+	s = gst_structure_new_empty("rpicamsrc-latency");
+	for (stage = 0; stage < RASPILATENCY_STAGE_COUNT; stage++) {
+		const gchar *name = raspilatency_stage_name(stage);
+		gchar *field;
+
+		if (summary[stage].count == 0)
+			continue;
+
+		/* Microseconds, as e.g. queue-p95, over stage-frames frames */
+		field = g_strdup_printf("%s-frames", name);
+		gst_structure_set(s, field, G_TYPE_UINT, summary[stage].count, NULL);
+		g_free(field);
+		field = g_strdup_printf("%s-p50", name);
+		gst_structure_set(s, field, G_TYPE_INT64, summary[stage].p50, NULL);
+		g_free(field);
+		field = g_strdup_printf("%s-p95", name);
+		gst_structure_set(s, field, G_TYPE_INT64, summary[stage].p95, NULL);
+		g_free(field);
+		field = g_strdup_printf("%s-p99", name);
+		gst_structure_set(s, field, G_TYPE_INT64, summary[stage].p99, NULL);
+		g_free(field);
+		field = g_strdup_printf("%s-max", name);
+		gst_structure_set(s, field, G_TYPE_INT64, summary[stage].max, NULL);
+		g_free(field);
+
+		GST_DEBUG_OBJECT(src, "Latency %s: p50 %" G_GINT64_FORMAT " p95 %" G_GINT64_FORMAT
+				 " p99 %" G_GINT64_FORMAT " us over %u frames", name,
+				 summary[stage].p50, summary[stage].p95, summary[stage].p99,
+				 summary[stage].count);
+	}
+
+	gst_element_post_message(GST_ELEMENT(src), gst_message_new_element(GST_OBJECT(src), s));
+}
+
+static GstPad *gst_rpi_cam_src_request_new_pad(GstElement * element, GstPadTemplate * templ,
+					       const gchar * name, const GstCaps * caps)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(element);
+	RASPI_AUX_STREAM stream;
+	GstPad *pad;
+
+	if (g_str_equal(GST_PAD_TEMPLATE_NAME_TEMPLATE(templ), "analytics")) {
+		stream = RASPI_AUX_ANALYTICS;
+		if (src->capture_config.preview_parameters.wantPreview)
+			GST_WARNING_OBJECT(src, "The analytics pad only produces data "
+					   "with preview=false");
+		name = "analytics";
+	} else {
+		stream = RASPI_AUX_SUBSTREAM;
+		if (name == NULL)
+			name = "subsrc_0";
+	}
+
+	if (src->aux_srcpad[stream]) {
+		GST_WARNING_OBJECT(src, "Pad %s already exists", GST_PAD_NAME(src->aux_srcpad[stream]));
+		return NULL;
+	}
+	if (src->started)
+		GST_WARNING_OBJECT(src, "%s requested while running, it will only "
+				   "produce data after the next restart", name);
+
+	pad = gst_pad_new_from_template(templ, name);
+	gst_pad_set_element_private(pad, GINT_TO_POINTER(stream));
+	gst_pad_set_activatemode_function(pad,
+					  GST_DEBUG_FUNCPTR(gst_rpi_cam_src_aux_activate_mode));
+	gst_pad_use_fixed_caps(pad);
+
+	src->aux_srcpad[stream] = pad;
+	if (stream == RASPI_AUX_ANALYTICS)
+		src->capture_config.analytics.enable = 1;
+	else
+		src->capture_config.substream.enable = 1;
+
+	if (GST_STATE(element) > GST_STATE_READY)
+		gst_pad_set_active(pad, TRUE);
+	gst_element_add_pad(element, pad);
+
+	return pad;
+}
+
+static void gst_rpi_cam_src_release_pad(GstElement * element, GstPad * pad)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(element);
+	RASPI_AUX_STREAM stream = GPOINTER_TO_INT(gst_pad_get_element_private(pad));
+
+	if (pad != src->aux_srcpad[stream])
+		return;
+
+	gst_pad_set_active(pad, FALSE);
+	src->aux_srcpad[stream] = NULL;
+	gst_caps_replace(&src->aux_caps[stream], NULL);
+	if (stream == RASPI_AUX_ANALYTICS)
+		src->capture_config.analytics.enable = 0;
+	else
+		src->capture_config.substream.enable = 0;
+	gst_element_remove_pad(element, pad);
+}
+
+static gboolean gst_rpi_cam_src_aux_activate_mode(GstPad * pad, GstObject * parent,
+						  GstPadMode mode, gboolean active)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(parent);
+
+	if (mode != GST_PAD_MODE_PUSH)
+		return FALSE;
+
+	/* The task itself is started from create(), once the camera is running */
+	if (!active)
+		gst_rpi_cam_src_aux_stop_task(src, GPOINTER_TO_INT(gst_pad_get_element_private(pad)));
+
+	return TRUE;
+}
+
+static void gst_rpi_cam_src_aux_stop_task(GstRpiCamSrc * src, RASPI_AUX_STREAM stream)
+{
+	if (src->aux_srcpad[stream] == NULL)
+		return;
+
+	if (src->capture_state)
+		raspi_capture_set_aux_flushing(src->capture_state, stream, TRUE);
+	gst_pad_stop_task(src->aux_srcpad[stream]);
+	if (src->capture_state)
+		raspi_capture_set_aux_flushing(src->capture_state, stream, FALSE);
+}
+
+/* Work out the caps of a secondary pad and update the capture config to match */
+static GstCaps *gst_rpi_cam_src_aux_negotiate(GstRpiCamSrc * src, RASPI_AUX_STREAM stream)
+{
+	RASPIVID_CONFIG *config = &src->capture_config;
+	GstCaps *caps;
+
+	if (stream == RASPI_AUX_SUBSTREAM) {
+		GEnumValue *profile =
+		    g_enum_get_value(g_type_class_peek(GST_RPI_CAM_TYPE_RPI_CAM_SRC_H264_PROFILE),
+				     config->substream.profile);
+
+		caps = gst_caps_new_simple("video/x-h264",
+					   "width", G_TYPE_INT, config->substream.width,
+					   "height", G_TYPE_INT, config->substream.height,
+					   "framerate", GST_TYPE_FRACTION, config->fps_n, config->fps_d,
+					   "stream-format", G_TYPE_STRING, "byte-stream",
+					   "alignment", G_TYPE_STRING, "au",
+					   "profile", G_TYPE_STRING,
+					   profile ? profile->value_nick : "high", NULL);
+	} else {
+		GstCaps *peer, *gray;
+
+		caps = gst_caps_new_simple("video/x-raw",
+					   "width", G_TYPE_INT, config->analytics.width,
+					   "height", G_TYPE_INT, config->analytics.height,
+					   "framerate", GST_TYPE_FRACTION, config->fps_n, config->fps_d,
+					   NULL);
+
+		/* Luma only is all motion detection needs, so prefer it when accepted */
+		gray = gst_caps_copy(caps);
+		gst_caps_set_simple(gray, "format", G_TYPE_STRING, "GRAY8", NULL);
+		peer = gst_pad_peer_query_caps(src->aux_srcpad[stream], NULL);
+		config->analytics.grayscale = gst_caps_can_intersect(gray, peer);
+		gst_caps_unref(peer);
+		gst_caps_unref(gray);
+
+		gst_caps_set_simple(caps, "format", G_TYPE_STRING,
+				    config->analytics.grayscale ? "GRAY8" : "I420", NULL);
+	}
+
+	GST_DEBUG_OBJECT(src, "Caps for %s: %" GST_PTR_FORMAT,
+			 GST_PAD_NAME(src->aux_srcpad[stream]), caps);
+
+	return caps;
+}
+
+static void gst_rpi_cam_src_aux_loop(GstPad * pad)
+{
+	GstRpiCamSrc *src = GST_RPICAMSRC(GST_PAD_PARENT(pad));
+	RASPI_AUX_STREAM stream = GPOINTER_TO_INT(gst_pad_get_element_private(pad));
+	GstBuffer *buf = NULL;
+	GstFlowReturn ret;
+	GstClock *clock;
+
+	if (src->aux_caps[stream]) {
+		GstSegment segment;
+		gchar *stream_id;
+
+		stream_id = gst_pad_create_stream_id(pad, GST_ELEMENT(src), GST_PAD_NAME(pad));
+		gst_pad_push_event(pad, gst_event_new_stream_start(stream_id));
+		g_free(stream_id);
+
+		gst_pad_push_event(pad, gst_event_new_caps(src->aux_caps[stream]));
+		gst_caps_replace(&src->aux_caps[stream], NULL);
+
+		gst_segment_init(&segment, GST_FORMAT_TIME);
+		gst_pad_push_event(pad, gst_event_new_segment(&segment));
+	}
+
+	ret = raspi_capture_fill_aux_buffer(src->capture_state, stream, &buf);
+	if (ret != GST_FLOW_OK)
+		goto pause;
+
+	/* Same running-time stamping basesrc's do-timestamp gives the main pad */
+	clock = gst_element_get_clock(GST_ELEMENT(src));
+	if (clock) {
+		GST_BUFFER_DTS(buf) = GST_BUFFER_PTS(buf) =
+		    gst_clock_get_time(clock) - gst_element_get_base_time(GST_ELEMENT(src));
+		gst_object_unref(clock);
+	}
+
+	ret = gst_pad_push(pad, buf);
+	/* Keep draining while unlinked, so a stalled port never holds up the camera */
+	if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED)
+		goto pause;
+
+	return;
+
+ pause:
+	GST_DEBUG_OBJECT(pad, "Pausing task, reason %s", gst_flow_get_name(ret));
+	gst_pad_pause_task(pad);
+	if (ret == GST_FLOW_EOS) {
+		gst_pad_push_event(pad, gst_event_new_eos());
+	} else if (ret < GST_FLOW_EOS) {
+		GST_ELEMENT_ERROR(src, STREAM, FAILED, ("Internal data stream error."),
+				  ("%s stopped, reason %s", GST_PAD_NAME(pad),
+				   gst_flow_get_name(ret)));
+		gst_pad_push_event(pad, gst_event_new_eos());
+	}
+}
+
 gboolean rpicamsrc_plugin_init(GstPlugin * rpicamsrc)
 {
 	GST_DEBUG_CATEGORY_INIT(gst_rpi_cam_src_debug, "rpicamsrc", 0, "rpicamsrc debug");
 
-	return gst_element_register(rpicamsrc, "rpicamsrc", GST_RANK_NONE, GST_TYPE_RPICAMSRC);
+	return gst_element_register(rpicamsrc, "rpicamsrc", GST_RANK_NONE, GST_TYPE_RPICAMSRC)
+	    && gst_element_register(rpicamsrc, "rpicamshmsrc", GST_RANK_NONE,
+				    GST_TYPE_RPICAMSHMSRC);
 }
 
 #ifndef PACKAGE
@@ -46,7 +46,12 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstpushsrc.h>
+#include <gst/video/video.h>
 #include "RaspiCapture.h"
+#include "RaspiMotion.h"
+#include "RaspiShm.h"
+#include "RaspiSched.h"
+#include "RaspiStats.h"
 
 G_BEGIN_DECLS
 
@@ -68,10 +73,48 @@ struct _GstRpiCamSrc
   GstPushSrc parent;
 
   GstPad *video_srcpad;
+  GstPad *aux_srcpad[RASPI_AUX_STREAM_COUNT];  /* subsrc_%u and analytics request pads */
+  GstCaps *aux_caps[RASPI_AUX_STREAM_COUNT];   /* Caps still to push, with stream-start and segment */
+
+  gboolean motion_detect;
+  RASPIMOTION_PARAMETERS motion_params;  /* Under the object lock, as are the strings below */
+  gboolean motion_params_changed;  /* motion_params changed since the detector was made */
+  gchar *motion_regions;
+  gchar *motion_capture_prefix;    /* Take a still named after this when motion starts, NULL for none */
+  RASPIMOTION_STATE *motion;       /* Created on the first frame with motion vectors */
+  GThreadPool *capture_pool;       /* Runs motion triggered stills off the streaming thread */
 
   RASPIVID_CONFIG capture_config;
   RASPIVID_STATE *capture_state;
+  GMutex state_lock;               /* Held by other threads using capture_state, stop() frees it under it */
   gboolean started;
+  volatile gint camera_parameters_changed;  /* Picture settings to send before the next frame */
+  volatile gint quantisation_changed;  /* quantisation-parameter to send before the next frame */
+
+  guint64 frames_pushed;           /* For the QoS messages posted when the leaky policy drops */
+  guint64 frames_dropped;
+
+  gchar *broker_socket;            /* Publish every frame to rpicamshmsrc consumers, NULL for none */
+  gint broker_slots;
+  RASPISHM_SERVER_T *broker;       /* Created once the video caps are known */
+  gsize broker_slot_size;
+  GstVideoInfo broker_info;        /* Packed layout raw frames are published in, GST_VIDEO_FORMAT_UNKNOWN for encoded video */
+
+  RASPISCHED_PARAMETERS streaming_sched;  /* Applied to the streaming thread while it runs our task */
+  RASPISCHED_PARAMETERS streaming_saved;  /* What that thread had before, put back when it leaves */
+  gboolean streaming_sched_applied;
+  RASPISCHED_PARAMETERS capture_sched;    /* Applied to the still capture worker */
+  gboolean capture_sched_applied;
+
+  gboolean latency_tracing;
+  gint latency_interval;           /* Milliseconds between rpicamsrc-latency messages */
+  RASPILATENCY_T *latency;         /* Recent frames, NULL unless latency_tracing */
+  RASPILATENCY_RECORD latency_pending;  /* Frame being pushed, completed by the next create() */
+  gint64 latency_reported;
+
+  RASPISTATS_T stats;              /* Lock-free counters behind the stats property */
+  gint stats_interval;             /* Milliseconds between rpicamsrc-stats messages, 0 for none */
+  gint64 stats_posted;
 };
 
 struct _GstRpiCamSrcClass 
@@ -0,0 +1,644 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013 Jan Schmidt <jan@centricular.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* rpicam-bench: throughput and latency benchmark of the capture code.
+ *
+ * "api" mode drives raspi_capture_setup() / raspi_capture_start() /
+ * raspi_capture_fill_buffer() directly, the way the element does but with
+ * no pipeline around it, optionally taking stills on a second thread while
+ * video runs. "pipeline" mode runs rpicamsrc ! capsfilter ! fakesink and
+ * reads timings from the element's handoffs and rpicamsrc-latency
+ * messages. Either way the results are printed as one JSON object, so runs
+ * on hardware or on the simulator (make SIM=1) can be compared per commit.
+ *
+ * CPU cost is the process' user plus system time over the measured run,
+ * so it covers the MMAL callback threads too, and on the simulator the
+ * simulated camera and encoder as well.
+ *
+ * --isp-sweep repeats the run with flicker avoidance, video denoise, still
+ * denoise and DRC each switched on alone, after a run with all of them off
+ * and before one with all on, and prints a JSON array of the results. Add
+ * --stills for still latencies; still denoise only shows there.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <gst/gst.h>
+
+#include "gstrpicamsrc.h"
+#include "gstrpicam-enum-types.h"
+#include "RaspiCapture.h"
+#include "RaspiLatency.h"
+#include "RaspiRing.h"
+
+/// Frames kept for the latency percentiles
+#define BENCH_LATENCY_FRAMES 4096
+/// Runs of --isp-sweep: all off, each stage alone, all on
+#define BENCH_ISP_STEPS 6
+
+typedef enum
+{
+	BENCH_MODE_API,
+	BENCH_MODE_PIPELINE
+} BENCH_MODE;
+
+typedef struct
+{
+	BENCH_MODE mode;
+	gint duration;		/* Seconds of video measured */
+	gint width, height, fps;
+	gint bitrate;
+	gboolean mjpeg;
+	gint stills;		/* Stills taken while video runs, api mode only */
+	gchar *label;		/* Free form, e.g. the commit being measured */
+	gchar *output;		/* JSON file, NULL for stdout */
+	/* ISP stages */
+	MMAL_PARAM_FLICKERAVOID_T flicker;
+	gboolean video_denoise, still_denoise;
+	MMAL_PARAMETER_DRC_STRENGTH_T drc;
+	gboolean isp_sweep;
+} BENCH_OPTIONS;
+
+typedef struct
+{
+	/* Times are microseconds from the start of setup */
+	gint64 setup;
+	gint64 start;
+	gint64 first_frame;
+	gint64 teardown;
+
+	guint64 frames;
+	guint64 bytes;
+	guint64 dropped;
+	gint64 measured;	/* Duration the frames were counted over */
+	gint64 cpu;		/* CPU time over the same period */
+	RASPILATENCY_PERCENTILES latency;
+
+	guint stills;		/* Stills taken, the times only cover these */
+	guint still_failures;
+	gint64 still_min, still_max, still_total;
+} BENCH_RESULT;
+
+/* Still worker of api mode */
+typedef struct
+{
+	RASPIVID_STATE *state;
+	BENCH_RESULT *result;
+	gint count;
+	volatile gint done;
+} BENCH_STILLS;
+
+/* Pipeline mode counters, updated from fakesink's streaming thread */
+typedef struct
+{
+	gint64 started;
+	volatile gint64 first_frame;
+	volatile gint64 last_frame;
+	guint64 frames;
+	guint64 bytes;
+	gint64 cpu_first;
+} BENCH_PIPELINE;
+
+static gint64 cpu_time(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return (gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+	    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* Nick of an enum property value, as gst-launch takes it */
+static const gchar *enum_nick(GType type, gint value)
+{
+	GEnumValue *nick = g_enum_get_value(g_type_class_ref(type), value);
+
+	return nick ? nick->value_nick : "?";
+}
+
+/* Enum value from its nick, -1 if there's no such nick */
+static gint enum_value(GType type, const gchar * nick)
+{
+	GEnumValue *value = g_enum_get_value_by_nick(g_type_class_ref(type), nick);
+
+	return value ? value->value : -1;
+}
+
+/* Switch the ISP stages for one run of --isp-sweep */
+static void set_isp_step(BENCH_OPTIONS * run, gint step)
+{
+	gboolean all = step == BENCH_ISP_STEPS - 1;
+
+	run->flicker = all || step == 1 ? MMAL_PARAM_FLICKERAVOID_AUTO : MMAL_PARAM_FLICKERAVOID_OFF;
+	run->video_denoise = all || step == 2;
+	run->still_denoise = all || step == 3;
+	run->drc = all || step == 4 ? MMAL_PARAMETER_DRC_STRENGTH_HIGH :
+	    MMAL_PARAMETER_DRC_STRENGTH_OFF;
+}
+
+static gpointer take_stills(gpointer data)
+{
+	BENCH_STILLS *stills = data;
+	BENCH_RESULT *result = stills->result;
+	gint i;
+
+	for (i = 0; i < stills->count; i++) {
+		gint64 started = raspiring_now(), took;
+		gchar *filename = raspi_capture_photo(stills->state, "/tmp/rpicam-bench");
+
+		took = raspiring_now() - started;
+		if (filename == NULL) {
+			result->still_failures++;
+			continue;
+		}
+		unlink(filename);
+		g_free(filename);
+
+		if (result->stills == 0 || took < result->still_min)
+			result->still_min = took;
+		if (took > result->still_max)
+			result->still_max = took;
+		result->still_total += took;
+		result->stills++;
+	}
+
+	g_atomic_int_set(&stills->done, 1);
+	return NULL;
+}
+
+static gboolean run_api(const BENCH_OPTIONS * options, BENCH_RESULT * result)
+{
+	RASPIVID_CONFIG config;
+	RASPIVID_STATE *state;
+	RASPILATENCY_T *trace;
+	RASPILATENCY_PERCENTILES summary[RASPILATENCY_STAGE_COUNT];
+	BENCH_STILLS stills = { 0 };
+	GThread *worker = NULL;
+	gint64 origin, deadline = 0, measure_start = 0, cpu_start = 0, now;
+	gboolean ok = TRUE;
+
+	memset(&config, 0, sizeof(config));
+	raspicapture_default_config(&config);
+	config.width = options->width;
+	config.height = options->height;
+	config.fps_n = options->fps;
+	config.fps_d = 1;
+	config.bitrate = options->bitrate;
+	config.encoding = options->mjpeg ? MMAL_ENCODING_MJPEG : MMAL_ENCODING_H264;
+	config.preview_parameters.wantPreview = 0;
+	config.camera_parameters.flickerAvoidMode = options->flicker;
+	config.camera_parameters.videoDenoise = options->video_denoise;
+	config.camera_parameters.stillsDenoise = options->still_denoise;
+	config.camera_parameters.drcLevel = options->drc;
+
+	trace = raspilatency_create(BENCH_LATENCY_FRAMES);
+	if (trace == NULL)
+		return FALSE;
+
+	origin = raspiring_now();
+	state = raspi_capture_setup(&config);
+	result->setup = raspiring_now() - origin;
+	if (state == NULL) {
+		g_printerr("rpicam-bench: capture setup failed\n");
+		raspilatency_destroy(trace);
+		return FALSE;
+	}
+
+	if (!raspi_capture_start(state)) {
+		g_printerr("rpicam-bench: capture start failed\n");
+		ok = FALSE;
+		goto done;
+	}
+	result->start = raspiring_now() - origin;
+
+	do {
+		GstBuffer *buf = NULL;
+		RASPILATENCY_RECORD timing;
+
+		if (raspi_capture_fill_buffer(state, &buf) != GST_FLOW_OK) {
+			g_printerr("rpicam-bench: capture stopped delivering frames\n");
+			ok = FALSE;
+			break;
+		}
+
+		now = raspiring_now();
+		if (GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER)) {
+			gst_buffer_unref(buf);
+			continue;
+		}
+
+		/* Everything is measured from the first frame on */
+		if (result->first_frame == 0) {
+			result->first_frame = now - origin;
+			measure_start = now;
+			cpu_start = cpu_time();
+			deadline = now + (gint64) options->duration * G_USEC_PER_SEC;
+
+			if (options->stills > 0) {
+				stills.state = state;
+				stills.result = result;
+				stills.count = options->stills;
+				worker = g_thread_new("rpicam-bench-stills", take_stills, &stills);
+			}
+		} else {
+			result->frames++;
+			result->bytes += gst_buffer_get_size(buf);
+		}
+
+		raspi_capture_get_frame_timing(state, &timing);
+		gst_buffer_unref(buf);
+		timing.pushed = raspiring_now();
+		raspilatency_record(trace, &timing);
+	} while (deadline == 0 || now < deadline || (worker && !g_atomic_int_get(&stills.done)));
+
+	if (measure_start) {
+		result->measured = now - measure_start;
+		result->cpu = cpu_time() - cpu_start;
+	}
+	result->dropped = raspi_capture_get_dropped_frames(state);
+
+	/* Stills still waiting on frames would never finish once video stops */
+	if (worker)
+		g_thread_join(worker);
+
+	raspilatency_summarise(trace, summary);
+	result->latency = summary[RASPILATENCY_STAGE_TOTAL];
+
+ done:
+	now = raspiring_now();
+	raspi_capture_stop(state);
+	raspi_capture_free(state);
+	result->teardown = raspiring_now() - now;
+	raspilatency_destroy(trace);
+
+	return ok;
+}
+
+static void on_handoff(GstElement * sink, GstBuffer * buf, GstPad * pad, gpointer data)
+{
+	BENCH_PIPELINE *counters = data;
+	gint64 now = raspiring_now();
+
+	if (GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER))
+		return;
+
+	if (counters->first_frame == 0) {
+		counters->cpu_first = cpu_time();
+		counters->first_frame = now;
+	} else {
+		counters->frames++;
+		counters->bytes += gst_buffer_get_size(buf);
+	}
+	counters->last_frame = now;
+}
+
+static gboolean run_pipeline(const BENCH_OPTIONS * options, BENCH_RESULT * result)
+{
+	BENCH_PIPELINE counters = { 0 };
+	GstElement *pipeline, *sink;
+	GstBus *bus;
+	GError *error = NULL;
+	gchar *description;
+	gint64 origin, deadline, cpu_last = 0, now;
+	gboolean ok = TRUE;
+
+	description =
+	    g_strdup_printf("rpicamsrc name=src preview=false bitrate=%d latency-tracing=true "
+			    "latency-interval=%d flicker-avoidance=%s video-denoise=%s "
+			    "still-denoise=%s drc=%s ! %s,width=%d,height=%d,framerate=%d/1 ! "
+			    "fakesink name=sink sync=false signal-handoffs=true", options->bitrate,
+			    MAX(options->duration * 1000 / 2, 100),
+			    enum_nick(GST_RPI_CAM_TYPE_RPI_CAM_SRC_FLICKER_AVOIDANCE, options->flicker),
+			    options->video_denoise ? "true" : "false",
+			    options->still_denoise ? "true" : "false",
+			    enum_nick(GST_RPI_CAM_TYPE_RPI_CAM_SRC_DRC_LEVEL, options->drc),
+			    options->mjpeg ? "image/jpeg" : "video/x-h264", options->width,
+			    options->height, options->fps);
+	pipeline = gst_parse_launch(description, &error);
+	g_free(description);
+	if (pipeline == NULL) {
+		g_printerr("rpicam-bench: %s\n", error ? error->message : "bad pipeline");
+		g_clear_error(&error);
+		return FALSE;
+	}
+
+	sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+	g_signal_connect(sink, "handoff", G_CALLBACK(on_handoff), &counters);
+	gst_object_unref(sink);
+
+	origin = raspiring_now();
+	if (gst_element_set_state(pipeline, GST_STATE_PAUSED) == GST_STATE_CHANGE_FAILURE) {
+		g_printerr("rpicam-bench: pipeline failed to start\n");
+		gst_object_unref(pipeline);
+		return FALSE;
+	}
+	gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+	result->setup = raspiring_now() - origin;
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+	result->start = raspiring_now() - origin;
+
+	bus = gst_element_get_bus(pipeline);
+	deadline = 0;
+	for (;;) {
+		GstMessage *msg;
+		const GstStructure *s;
+
+		now = raspiring_now();
+		if (deadline == 0 && counters.first_frame) {
+			result->first_frame = counters.first_frame - origin;
+			deadline = counters.first_frame + (gint64) options->duration * G_USEC_PER_SEC;
+		}
+		if (deadline && now >= deadline)
+			break;
+		/* Nothing within 10s of starting means the camera never came up */
+		if (deadline == 0 && now - origin > 10 * G_USEC_PER_SEC) {
+			g_printerr("rpicam-bench: no frames from the pipeline\n");
+			ok = FALSE;
+			break;
+		}
+
+		msg = gst_bus_timed_pop_filtered(bus, 100 * GST_MSECOND,
+						 GST_MESSAGE_ERROR | GST_MESSAGE_EOS |
+						 GST_MESSAGE_ELEMENT);
+		if (msg == NULL)
+			continue;
+
+		if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+			GError *err = NULL;
+
+			gst_message_parse_error(msg, &err, NULL);
+			g_printerr("rpicam-bench: %s\n", err->message);
+			g_clear_error(&err);
+			ok = FALSE;
+		} else if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+			ok = FALSE;
+		} else if ((s = gst_message_get_structure(msg))
+			   && gst_structure_has_name(s, "rpicamsrc-latency")) {
+			/* Keep the latest window, the trace covers the most recent frames */
+			gst_structure_get_int64(s, "total-p50", &result->latency.p50);
+			gst_structure_get_int64(s, "total-p95", &result->latency.p95);
+			gst_structure_get_int64(s, "total-p99", &result->latency.p99);
+			gst_structure_get_int64(s, "total-max", &result->latency.max);
+			gst_structure_get_uint(s, "total-frames", &result->latency.count);
+		}
+		gst_message_unref(msg);
+		if (!ok)
+			break;
+	}
+	gst_object_unref(bus);
+	cpu_last = cpu_time();
+
+	if (counters.first_frame) {
+		result->frames = counters.frames;
+		result->bytes = counters.bytes;
+		result->measured = counters.last_frame - counters.first_frame;
+		result->cpu = cpu_last - counters.cpu_first;
+	}
+
+	now = raspiring_now();
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(pipeline);
+	result->teardown = raspiring_now() - now;
+
+	return ok;
+}
+
+/* Write a string as a JSON string literal */
+static void write_json_string(FILE * out, const gchar * s)
+{
+	fputc('"', out);
+	for (; s && *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((guchar) * s < 0x20)
+			fprintf(out, "\\u%04x", (guchar) * s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+static void write_json(FILE * out, const BENCH_OPTIONS * options, const BENCH_RESULT * result,
+		       gboolean ok)
+{
+	gdouble seconds = result->measured / (gdouble) G_USEC_PER_SEC;
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"label\": ");
+	write_json_string(out, options->label);
+	fprintf(out, ",\n");
+	fprintf(out, "  \"mode\": \"%s\",\n", options->mode == BENCH_MODE_API ? "api" : "pipeline");
+#ifdef RPICAM_SIM
+	fprintf(out, "  \"backend\": \"sim\",\n");
+#else
+	fprintf(out, "  \"backend\": \"mmal\",\n");
+#endif
+	fprintf(out, "  \"ok\": %s,\n", ok ? "true" : "false");
+	fprintf(out, "  \"encoding\": \"%s\",\n", options->mjpeg ? "mjpeg" : "h264");
+	fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n", options->width, options->height);
+	fprintf(out, "  \"requested_fps\": %d,\n  \"bitrate\": %d,\n", options->fps,
+		options->bitrate);
+	fprintf(out, "  \"isp\": { \"flicker_avoidance\": \"%s\", \"video_denoise\": %s, "
+		"\"still_denoise\": %s, \"drc\": \"%s\" },\n",
+		enum_nick(GST_RPI_CAM_TYPE_RPI_CAM_SRC_FLICKER_AVOIDANCE, options->flicker),
+		options->video_denoise ? "true" : "false",
+		options->still_denoise ? "true" : "false",
+		enum_nick(GST_RPI_CAM_TYPE_RPI_CAM_SRC_DRC_LEVEL, options->drc));
+	fprintf(out, "  \"frames\": %" G_GUINT64_FORMAT ",\n", result->frames);
+	fprintf(out, "  \"dropped_frames\": %" G_GUINT64_FORMAT ",\n", result->dropped);
+	fprintf(out, "  \"fps\": %.3f,\n", seconds > 0 ? result->frames / seconds : 0.0);
+	fprintf(out, "  \"bits_per_second\": %.0f,\n",
+		seconds > 0 ? result->bytes * 8 / seconds : 0.0);
+	fprintf(out, "  \"cpu_us_per_frame\": %.1f,\n",
+		result->frames ? result->cpu / (gdouble) result->frames : 0.0);
+	fprintf(out, "  \"cpu_percent\": %.1f,\n",
+		result->measured ? 100.0 * result->cpu / result->measured : 0.0);
+	fprintf(out, "  \"latency_us\": { \"frames\": %u, \"p50\": %" G_GINT64_FORMAT
+		", \"p95\": %" G_GINT64_FORMAT ", \"p99\": %" G_GINT64_FORMAT
+		", \"max\": %" G_GINT64_FORMAT " },\n", result->latency.count, result->latency.p50,
+		result->latency.p95, result->latency.p99, result->latency.max);
+	fprintf(out, "  \"startup_ms\": { \"setup\": %.1f, \"start\": %.1f, \"first_frame\": %.1f },\n",
+		result->setup / 1000.0, result->start / 1000.0, result->first_frame / 1000.0);
+	fprintf(out, "  \"teardown_ms\": %.1f,\n", result->teardown / 1000.0);
+	fprintf(out, "  \"stills\": { \"count\": %u, \"failed\": %u, \"min_ms\": %.1f, "
+		"\"avg_ms\": %.1f, \"max_ms\": %.1f }\n", result->stills, result->still_failures,
+		result->still_min / 1000.0,
+		result->stills ? result->still_total / 1000.0 / result->stills : 0.0,
+		result->still_max / 1000.0);
+	fprintf(out, "}\n");
+}
+
+static gboolean run_once(const BENCH_OPTIONS * options, BENCH_RESULT * result)
+{
+	memset(result, 0, sizeof(*result));
+	if (options->mode == BENCH_MODE_API)
+		return run_api(options, result);
+
+	return run_pipeline(options, result);
+}
+
+int main(int argc, char *argv[])
+{
+	BENCH_OPTIONS options = { BENCH_MODE_API, 10, 1920, 1080, 30, 17000000, FALSE, 0, NULL,
+		NULL, MMAL_PARAM_FLICKERAVOID_OFF, TRUE, TRUE, MMAL_PARAMETER_DRC_STRENGTH_OFF, FALSE
+	};
+	BENCH_RESULT result;
+	gchar *mode = NULL, *encoding = NULL, *flicker = NULL, *drc = NULL;
+	gint step;
+	GOptionEntry entries[] = {
+		{"mode", 'm', 0, G_OPTION_ARG_STRING, &mode,
+		 "api (raspi_capture_* calls) or pipeline (rpicamsrc ! fakesink)", "MODE"},
+		{"duration", 'd', 0, G_OPTION_ARG_INT, &options.duration,
+		 "Seconds of video to measure (10)", "S"},
+		{"width", 'W', 0, G_OPTION_ARG_INT, &options.width, "Frame width (1920)", "W"},
+		{"height", 'H', 0, G_OPTION_ARG_INT, &options.height, "Frame height (1080)", "H"},
+		{"fps", 'f', 0, G_OPTION_ARG_INT, &options.fps, "Frame rate (30)", "FPS"},
+		{"bitrate", 'b', 0, G_OPTION_ARG_INT, &options.bitrate,
+		 "Encoder bitrate (17000000)", "BPS"},
+		{"encoding", 'e', 0, G_OPTION_ARG_STRING, &encoding, "h264 or mjpeg (h264)", "ENC"},
+		{"stills", 's', 0, G_OPTION_ARG_INT, &options.stills,
+		 "Stills to take while video runs, api mode only (0)", "N"},
+		{"label", 'l', 0, G_OPTION_ARG_STRING, &options.label,
+		 "Copied into the results, e.g. the commit measured", "TEXT"},
+		{"output", 'o', 0, G_OPTION_ARG_FILENAME, &options.output,
+		 "Write the JSON here instead of stdout", "FILE"},
+		{"flicker", 0, 0, G_OPTION_ARG_STRING, &flicker,
+		 "Flicker avoidance: off, auto, 50hz or 60hz (off)", "MODE"},
+		{"no-video-denoise", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE,
+		 &options.video_denoise, "Switch off denoise for video", NULL},
+		{"no-still-denoise", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE,
+		 &options.still_denoise, "Switch off denoise for stills", NULL},
+		{"drc", 0, 0, G_OPTION_ARG_STRING, &drc,
+		 "Dynamic range compression: off, low, medium or high (off)", "LEVEL"},
+		{"isp-sweep", 'i', 0, G_OPTION_ARG_NONE, &options.isp_sweep,
+		 "Measure with each ISP stage on and off, overriding the settings above", NULL},
+		{NULL}
+	};
+	GOptionContext *context = g_option_context_new("- benchmark rpicamsrc capture");
+	GError *error = NULL;
+	FILE *out = stdout;
+	gboolean ok;
+
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("rpicam-bench: %s\n", error->message);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	if (mode && strcmp(mode, "pipeline") == 0)
+		options.mode = BENCH_MODE_PIPELINE;
+	else if (mode && strcmp(mode, "api") != 0) {
+		g_printerr("rpicam-bench: unknown mode %s\n", mode);
+		return 2;
+	}
+	if (encoding && strcmp(encoding, "mjpeg") == 0)
+		options.mjpeg = TRUE;
+	else if (encoding && strcmp(encoding, "h264") != 0) {
+		g_printerr("rpicam-bench: unknown encoding %s\n", encoding);
+		return 2;
+	}
+	if (options.duration <= 0 || options.width <= 0 || options.height <= 0
+	    || options.fps <= 0 || options.stills < 0) {
+		g_printerr("rpicam-bench: duration, size and fps must be positive\n");
+		return 2;
+	}
+
+	gst_init(&argc, &argv);
+	gst_plugin_register_static(GST_VERSION_MAJOR, GST_VERSION_MINOR, "rpicamsrc",
+				   "Raspberry Pi camera source", rpicamsrc_plugin_init, "1.0",
+				   "LGPL", "rpicam-bench", "rpicam-bench", "");
+
+	if (flicker) {
+		options.flicker = enum_value(GST_RPI_CAM_TYPE_RPI_CAM_SRC_FLICKER_AVOIDANCE, flicker);
+		if ((gint) options.flicker < 0) {
+			g_printerr("rpicam-bench: unknown flicker avoidance %s\n", flicker);
+			return 2;
+		}
+	}
+	if (drc) {
+		options.drc = enum_value(GST_RPI_CAM_TYPE_RPI_CAM_SRC_DRC_LEVEL, drc);
+		if ((gint) options.drc < 0) {
+			g_printerr("rpicam-bench: unknown DRC level %s\n", drc);
+			return 2;
+		}
+	}
+
+	/* Normally done when the element class is first used */
+	if (options.mode == BENCH_MODE_API)
+		raspicapture_init();
+
+	if (options.output && (out = fopen(options.output, "w")) == NULL) {
+		g_printerr("rpicam-bench: can't write %s\n", options.output);
+		return 2;
+	}
+
+	if (options.isp_sweep) {
+		ok = TRUE;
+		fprintf(out, "[\n");
+		for (step = 0; step < BENCH_ISP_STEPS; step++) {
+			BENCH_OPTIONS run = options;
+			gboolean run_ok;
+
+			set_isp_step(&run, step);
+			run_ok = run_once(&run, &result);
+			if (step > 0)
+				fprintf(out, ",\n");
+			write_json(out, &run, &result, run_ok);
+			ok = ok && run_ok;
+		}
+		fprintf(out, "]\n");
+	} else {
+		ok = run_once(&options, &result);
+		write_json(out, &options, &result, ok);
+	}
+	if (out != stdout)
+		fclose(out);
+
+	return ok ? 0 : 1;
+}
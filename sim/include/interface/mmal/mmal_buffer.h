@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_BUFFER_H
+#define MMAL_BUFFER_H
+
+#include "mmal_types.h"
+
+#define MMAL_BUFFER_HEADER_FLAG_EOS                    (1<<0)
+#define MMAL_BUFFER_HEADER_FLAG_FRAME_START            (1<<1)
+#define MMAL_BUFFER_HEADER_FLAG_FRAME_END              (1<<2)
+#define MMAL_BUFFER_HEADER_FLAG_FRAME                  (MMAL_BUFFER_HEADER_FLAG_FRAME_START|MMAL_BUFFER_HEADER_FLAG_FRAME_END)
+#define MMAL_BUFFER_HEADER_FLAG_KEYFRAME               (1<<3)
+#define MMAL_BUFFER_HEADER_FLAG_DISCONTINUITY          (1<<4)
+#define MMAL_BUFFER_HEADER_FLAG_CONFIG                 (1<<5)
+#define MMAL_BUFFER_HEADER_FLAG_ENCRYPTED              (1<<6)
+#define MMAL_BUFFER_HEADER_FLAG_CODECSIDEINFO          (1<<7)
+#define MMAL_BUFFER_HEADER_FLAGS_SNAPSHOT              (1<<8)
+#define MMAL_BUFFER_HEADER_FLAG_CORRUPTED              (1<<9)
+#define MMAL_BUFFER_HEADER_FLAG_TRANSMISSION_FAILED    (1<<10)
+#define MMAL_BUFFER_HEADER_FLAG_DECODEONLY             (1<<11)
+#define MMAL_BUFFER_HEADER_FLAG_NAL_END                (1<<12)
+
+struct MMAL_BUFFER_HEADER_PRIVATE_T;
+
+typedef struct MMAL_BUFFER_HEADER_T
+{
+   struct MMAL_BUFFER_HEADER_T *next;            /// Used to link headers in a queue
+   struct MMAL_BUFFER_HEADER_PRIVATE_T *priv;    /// Data private to the framework
+   uint32_t cmd;                                 /// Event code, or 0 for a data buffer
+   uint8_t *data;                                /// Payload
+   uint32_t alloc_size;                          /// Allocated size of the payload
+   uint32_t length;                              /// Number of valid bytes in the payload
+   uint32_t offset;                              /// Offset of the valid bytes in the payload
+   uint32_t flags;                               /// MMAL_BUFFER_HEADER_FLAG_* flags
+   int64_t pts;                                  /// Presentation timestamp in microseconds
+   int64_t dts;                                  /// Decode timestamp in microseconds
+   void *type;                                   /// Type specific data, unused here
+   void *user_data;                              /// Field reserved for the client
+} MMAL_BUFFER_HEADER_T;
+
+void mmal_buffer_header_acquire(MMAL_BUFFER_HEADER_T *header);
+void mmal_buffer_header_reset(MMAL_BUFFER_HEADER_T *header);
+void mmal_buffer_header_release(MMAL_BUFFER_HEADER_T *header);
+MMAL_STATUS_T mmal_buffer_header_mem_lock(MMAL_BUFFER_HEADER_T *header);
+void mmal_buffer_header_mem_unlock(MMAL_BUFFER_HEADER_T *header);
+
+#endif /* MMAL_BUFFER_H */
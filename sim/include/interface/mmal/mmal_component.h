@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_COMPONENT_H
+#define MMAL_COMPONENT_H
+
+#include "mmal_port.h"
+
+struct MMAL_COMPONENT_PRIVATE_T;
+struct MMAL_COMPONENT_USERDATA_T;
+
+typedef struct MMAL_COMPONENT_T
+{
+   struct MMAL_COMPONENT_PRIVATE_T *priv;      /// Data private to the framework
+   struct MMAL_COMPONENT_USERDATA_T *userdata; /// Field reserved for the client
+   const char *name;                           /// Component name
+   uint32_t is_enabled;                        /// Whether the component is enabled
+   MMAL_PORT_T *control;                       /// Control port
+   uint32_t input_num;                         /// Number of input ports
+   MMAL_PORT_T **input;                        /// Array of input ports
+   uint32_t output_num;                        /// Number of output ports
+   MMAL_PORT_T **output;                       /// Array of output ports
+   uint32_t clock_num;                         /// Number of clock ports
+   MMAL_PORT_T **clock;                        /// Array of clock ports
+   uint32_t port_num;                          /// Total number of ports
+   MMAL_PORT_T **port;                         /// Array of all the ports
+   uint32_t id;                                /// Unique identifier, for debugging
+} MMAL_COMPONENT_T;
+
+MMAL_STATUS_T mmal_component_create(const char *name, MMAL_COMPONENT_T **component);
+void mmal_component_acquire(MMAL_COMPONENT_T *component);
+MMAL_STATUS_T mmal_component_release(MMAL_COMPONENT_T *component);
+MMAL_STATUS_T mmal_component_destroy(MMAL_COMPONENT_T *component);
+MMAL_STATUS_T mmal_component_enable(MMAL_COMPONENT_T *component);
+MMAL_STATUS_T mmal_component_disable(MMAL_COMPONENT_T *component);
+
+#endif /* MMAL_COMPONENT_H */
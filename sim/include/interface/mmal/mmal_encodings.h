@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_ENCODINGS_H
+#define MMAL_ENCODINGS_H
+
+#include "mmal_common.h"
+
+#define MMAL_ENCODING_H264     MMAL_FOURCC('H','2','6','4')
+#define MMAL_ENCODING_MJPEG    MMAL_FOURCC('M','J','P','G')
+#define MMAL_ENCODING_JPEG     MMAL_FOURCC('J','P','E','G')
+#define MMAL_ENCODING_I420     MMAL_FOURCC('I','4','2','0')
+#define MMAL_ENCODING_YV12     MMAL_FOURCC('Y','V','1','2')
+#define MMAL_ENCODING_NV12     MMAL_FOURCC('N','V','1','2')
+#define MMAL_ENCODING_NV21     MMAL_FOURCC('N','V','2','1')
+#define MMAL_ENCODING_RGB24    MMAL_FOURCC('R','G','B','3')
+#define MMAL_ENCODING_BGR24    MMAL_FOURCC('B','G','R','3')
+#define MMAL_ENCODING_RGBA     MMAL_FOURCC('R','G','B','A')
+#define MMAL_ENCODING_BGRA     MMAL_FOURCC('B','G','R','A')
+#define MMAL_ENCODING_OPAQUE   MMAL_FOURCC('O','P','Q','V')
+#define MMAL_ENCODING_UNKNOWN  0
+
+#endif /* MMAL_ENCODINGS_H */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_FORMAT_H
+#define MMAL_FORMAT_H
+
+#include "mmal_types.h"
+
+typedef enum
+{
+   MMAL_ES_TYPE_UNKNOWN,
+   MMAL_ES_TYPE_CONTROL,
+   MMAL_ES_TYPE_AUDIO,
+   MMAL_ES_TYPE_VIDEO,
+   MMAL_ES_TYPE_SUBPICTURE
+} MMAL_ES_TYPE_T;
+
+typedef struct
+{
+   uint32_t width;              /// Width of frame in pixels
+   uint32_t height;             /// Height of frame in rows of pixels
+   MMAL_RECT_T crop;            /// Visible region of the frame
+   MMAL_RATIONAL_T frame_rate;  /// Frame rate
+   MMAL_RATIONAL_T par;         /// Pixel aspect ratio
+   MMAL_FOURCC_T color_space;   /// Colour space of the frames
+} MMAL_VIDEO_FORMAT_T;
+
+typedef union
+{
+   MMAL_VIDEO_FORMAT_T video;
+} MMAL_ES_SPECIFIC_FORMAT_T;
+
+typedef struct MMAL_ES_FORMAT_T
+{
+   MMAL_ES_TYPE_T type;               /// Type of the elementary stream
+   MMAL_FOURCC_T encoding;            /// FourCC of the stream
+   MMAL_FOURCC_T encoding_variant;    /// Variant of the encoding
+   MMAL_ES_SPECIFIC_FORMAT_T *es;     /// Type specific information
+   uint32_t bitrate;                  /// Bitrate in bits per second
+   uint32_t flags;                    /// Flags describing the stream
+   uint32_t extradata_size;           /// Size of the codec specific data
+   uint8_t *extradata;                /// Codec specific data
+} MMAL_ES_FORMAT_T;
+
+MMAL_ES_FORMAT_T *mmal_format_alloc(void);
+void mmal_format_free(MMAL_ES_FORMAT_T *format);
+void mmal_format_copy(MMAL_ES_FORMAT_T *format_dest, MMAL_ES_FORMAT_T *format_src);
+MMAL_STATUS_T mmal_format_full_copy(MMAL_ES_FORMAT_T *format_dest, MMAL_ES_FORMAT_T *format_src);
+
+#endif /* MMAL_FORMAT_H */
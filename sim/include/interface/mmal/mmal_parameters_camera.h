@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_PARAMETERS_CAMERA_H
+#define MMAL_PARAMETERS_CAMERA_H
+
+#include "mmal_parameters_common.h"
+
+enum
+{
+   MMAL_PARAMETER_THUMBNAIL_CONFIGURATION = MMAL_PARAMETER_GROUP_CAMERA,
+   MMAL_PARAMETER_CAPTURE_QUALITY,
+   MMAL_PARAMETER_ROTATION,
+   MMAL_PARAMETER_EXIF_DISABLE,
+   MMAL_PARAMETER_EXIF,
+   MMAL_PARAMETER_AWB_MODE,
+   MMAL_PARAMETER_IMAGE_EFFECT,
+   MMAL_PARAMETER_COLOUR_EFFECT,
+   MMAL_PARAMETER_FLICKER_AVOID,
+   MMAL_PARAMETER_FLASH,
+   MMAL_PARAMETER_REDEYE,
+   MMAL_PARAMETER_FOCUS,
+   MMAL_PARAMETER_FOCAL_LENGTHS,
+   MMAL_PARAMETER_EXPOSURE_COMP,
+   MMAL_PARAMETER_ZOOM,
+   MMAL_PARAMETER_MIRROR,
+   MMAL_PARAMETER_CAMERA_NUM,
+   MMAL_PARAMETER_CAPTURE,
+   MMAL_PARAMETER_EXPOSURE_MODE,
+   MMAL_PARAMETER_EXP_METERING_MODE,
+   MMAL_PARAMETER_FOCUS_STATUS,
+   MMAL_PARAMETER_CAMERA_CONFIG,
+   MMAL_PARAMETER_CAPTURE_STATUS,
+   MMAL_PARAMETER_FACE_TRACK,
+   MMAL_PARAMETER_DRAW_BOX_FACES_AND_FOCUS,
+   MMAL_PARAMETER_JPEG_Q_FACTOR,
+   MMAL_PARAMETER_FRAME_RATE,
+   MMAL_PARAMETER_USE_STC,
+   MMAL_PARAMETER_CAMERA_INFO,
+   MMAL_PARAMETER_VIDEO_STABILISATION,
+   MMAL_PARAMETER_FACE_TRACK_RESULTS,
+   MMAL_PARAMETER_ENABLE_RAW_CAPTURE,
+   MMAL_PARAMETER_DPF_FILE,
+   MMAL_PARAMETER_ENABLE_DPF_FILE,
+   MMAL_PARAMETER_DPF_FAIL_IS_FATAL,
+   MMAL_PARAMETER_CAPTURE_MODE,
+   MMAL_PARAMETER_FOCUS_REGIONS,
+   MMAL_PARAMETER_INPUT_CROP,
+   MMAL_PARAMETER_SENSOR_INFORMATION,
+   MMAL_PARAMETER_FLASH_SELECT,
+   MMAL_PARAMETER_FIELD_OF_VIEW,
+   MMAL_PARAMETER_HIGH_DYNAMIC_RANGE,
+   MMAL_PARAMETER_DYNAMIC_RANGE_COMPRESSION,
+   MMAL_PARAMETER_ALGORITHM_CONTROL,
+   MMAL_PARAMETER_SHARPNESS,
+   MMAL_PARAMETER_CONTRAST,
+   MMAL_PARAMETER_BRIGHTNESS,
+   MMAL_PARAMETER_SATURATION,
+   MMAL_PARAMETER_ISO,
+   MMAL_PARAMETER_ANTISHAKE,
+   MMAL_PARAMETER_IMAGE_EFFECT_PARAMETERS,
+   MMAL_PARAMETER_CAMERA_BURST_CAPTURE,
+   MMAL_PARAMETER_CAMERA_MIN_ISO,
+   MMAL_PARAMETER_CAMERA_USE_CASE,
+   MMAL_PARAMETER_CAPTURE_STATS_PASS,
+   MMAL_PARAMETER_CAMERA_CUSTOM_SENSOR_CONFIG,
+   MMAL_PARAMETER_ENABLE_REGISTER_FILE,
+   MMAL_PARAMETER_REGISTER_FAIL_IS_FATAL,
+   MMAL_PARAMETER_CONFIGFILE_REGISTERS,
+   MMAL_PARAMETER_CONFIGFILE_CHUNK_REGISTERS,
+   MMAL_PARAMETER_JPEG_ATTACH_LOG,
+   MMAL_PARAMETER_ZERO_SHUTTER_LAG,
+   MMAL_PARAMETER_FPS_RANGE,
+   MMAL_PARAMETER_CAPTURE_EXPOSURE_COMP,
+   MMAL_PARAMETER_SW_SHARPEN_DISABLE,
+   MMAL_PARAMETER_FLASH_REQUIRED,
+   MMAL_PARAMETER_SW_SATURATION_DISABLE,
+   MMAL_PARAMETER_SHUTTER_SPEED,
+   MMAL_PARAMETER_CUSTOM_AWB_GAINS,
+   MMAL_PARAMETER_CAMERA_SETTINGS,
+   MMAL_PARAMETER_PRIVACY_INDICATOR,
+   MMAL_PARAMETER_VIDEO_DENOISE,
+   MMAL_PARAMETER_STILLS_DENOISE,
+   MMAL_PARAMETER_ANNOTATE,
+   MMAL_PARAMETER_STEREOSCOPIC_MODE,
+   MMAL_PARAMETER_ANALOG_GAIN,
+   MMAL_PARAMETER_DIGITAL_GAIN,
+};
+
+typedef struct MMAL_PARAMETER_THUMBNAIL_CONFIG_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   uint32_t enable;
+   uint32_t width, height;
+   uint32_t quality;
+} MMAL_PARAMETER_THUMBNAIL_CONFIG_T;
+
+/** One "key=value" EXIF tag, stored inline after the structure */
+typedef struct MMAL_PARAMETER_EXIF_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   uint32_t keylen;
+   uint32_t value_offset;
+   uint32_t valuelen;
+   uint8_t data[1];
+} MMAL_PARAMETER_EXIF_T;
+
+typedef enum
+{
+   MMAL_PARAM_EXPOSUREMODE_OFF,
+   MMAL_PARAM_EXPOSUREMODE_AUTO,
+   MMAL_PARAM_EXPOSUREMODE_NIGHT,
+   MMAL_PARAM_EXPOSUREMODE_NIGHTPREVIEW,
+   MMAL_PARAM_EXPOSUREMODE_BACKLIGHT,
+   MMAL_PARAM_EXPOSUREMODE_SPOTLIGHT,
+   MMAL_PARAM_EXPOSUREMODE_SPORTS,
+   MMAL_PARAM_EXPOSUREMODE_SNOW,
+   MMAL_PARAM_EXPOSUREMODE_BEACH,
+   MMAL_PARAM_EXPOSUREMODE_VERYLONG,
+   MMAL_PARAM_EXPOSUREMODE_FIXEDFPS,
+   MMAL_PARAM_EXPOSUREMODE_ANTISHAKE,
+   MMAL_PARAM_EXPOSUREMODE_FIREWORKS,
+   MMAL_PARAM_EXPOSUREMODE_MAX = 0x7fffffff
+} MMAL_PARAM_EXPOSUREMODE_T;
+
+typedef struct MMAL_PARAMETER_EXPOSUREMODE_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_PARAM_EXPOSUREMODE_T value;
+} MMAL_PARAMETER_EXPOSUREMODE_T;
+
+typedef enum
+{
+   MMAL_PARAM_EXPOSUREMETERINGMODE_AVERAGE,
+   MMAL_PARAM_EXPOSUREMETERINGMODE_SPOT,
+   MMAL_PARAM_EXPOSUREMETERINGMODE_BACKLIT,
+   MMAL_PARAM_EXPOSUREMETERINGMODE_MATRIX,
+   MMAL_PARAM_EXPOSUREMETERINGMODE_MAX = 0x7fffffff
+} MMAL_PARAM_EXPOSUREMETERINGMODE_T;
+
+typedef struct MMAL_PARAMETER_EXPOSUREMETERINGMODE_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_PARAM_EXPOSUREMETERINGMODE_T value;
+} MMAL_PARAMETER_EXPOSUREMETERINGMODE_T;
+
+typedef enum MMAL_PARAM_AWBMODE_T
+{
+   MMAL_PARAM_AWBMODE_OFF,
+   MMAL_PARAM_AWBMODE_AUTO,
+   MMAL_PARAM_AWBMODE_SUNLIGHT,
+   MMAL_PARAM_AWBMODE_CLOUDY,
+   MMAL_PARAM_AWBMODE_SHADE,
+   MMAL_PARAM_AWBMODE_TUNGSTEN,
+   MMAL_PARAM_AWBMODE_FLUORESCENT,
+   MMAL_PARAM_AWBMODE_INCANDESCENT,
+   MMAL_PARAM_AWBMODE_FLASH,
+   MMAL_PARAM_AWBMODE_HORIZON,
+   MMAL_PARAM_AWBMODE_MAX = 0x7fffffff
+} MMAL_PARAM_AWBMODE_T;
+
+typedef struct MMAL_PARAMETER_AWBMODE_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_PARAM_AWBMODE_T value;
+} MMAL_PARAMETER_AWBMODE_T;
+
+typedef struct MMAL_PARAMETER_AWB_GAINS_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_RATIONAL_T r_gain;             /// Red gain, used with MMAL_PARAM_AWBMODE_OFF
+   MMAL_RATIONAL_T b_gain;             /// Blue gain, used with MMAL_PARAM_AWBMODE_OFF
+} MMAL_PARAMETER_AWB_GAINS_T;
+
+typedef enum MMAL_PARAM_IMAGEFX_T
+{
+   MMAL_PARAM_IMAGEFX_NONE,
+   MMAL_PARAM_IMAGEFX_NEGATIVE,
+   MMAL_PARAM_IMAGEFX_SOLARIZE,
+   MMAL_PARAM_IMAGEFX_POSTERIZE,
+   MMAL_PARAM_IMAGEFX_WHITEBOARD,
+   MMAL_PARAM_IMAGEFX_BLACKBOARD,
+   MMAL_PARAM_IMAGEFX_SKETCH,
+   MMAL_PARAM_IMAGEFX_DENOISE,
+   MMAL_PARAM_IMAGEFX_EMBOSS,
+   MMAL_PARAM_IMAGEFX_OILPAINT,
+   MMAL_PARAM_IMAGEFX_HATCH,
+   MMAL_PARAM_IMAGEFX_GPEN,
+   MMAL_PARAM_IMAGEFX_PASTEL,
+   MMAL_PARAM_IMAGEFX_WATERCOLOUR,
+   MMAL_PARAM_IMAGEFX_FILM,
+   MMAL_PARAM_IMAGEFX_BLUR,
+   MMAL_PARAM_IMAGEFX_SATURATION,
+   MMAL_PARAM_IMAGEFX_COLOURSWAP,
+   MMAL_PARAM_IMAGEFX_WASHEDOUT,
+   MMAL_PARAM_IMAGEFX_POSTERISE,
+   MMAL_PARAM_IMAGEFX_COLOURPOINT,
+   MMAL_PARAM_IMAGEFX_COLOURBALANCE,
+   MMAL_PARAM_IMAGEFX_CARTOON,
+   MMAL_PARAM_IMAGEFX_DEINTERLACE_DOUBLE,
+   MMAL_PARAM_IMAGEFX_DEINTERLACE_ADV,
+   MMAL_PARAM_IMAGEFX_DEINTERLACE_FAST,
+   MMAL_PARAM_IMAGEFX_MAX = 0x7fffffff
+} MMAL_PARAM_IMAGEFX_T;
+
+typedef struct MMAL_PARAMETER_IMAGEFX_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_PARAM_IMAGEFX_T value;
+} MMAL_PARAMETER_IMAGEFX_T;
+
+#define MMAL_MAX_IMAGEFX_PARAMETERS 6
+
+typedef struct MMAL_PARAMETER_IMAGEFX_PARAMETERS_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   MMAL_PARAM_IMAGEFX_T effect;
+   uint32_t num_effect_params;
+   uint32_t effect_parameter[MMAL_MAX_IMAGEFX_PARAMETERS];
+} MMAL_PARAMETER_IMAGEFX_PARAMETERS_T;
+
+typedef struct MMAL_PARAMETER_COLOURFX_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   int32_t enable;
+   uint32_t u;
+   uint32_t v;
+} MMAL_PARAMETER_COLOURFX_T;
+
+typedef enum
+{
+   MMAL_PARAM_FLICKERAVOID_OFF,
+   MMAL_PARAM_FLICKERAVOID_AUTO,
+   MMAL_PARAM_FLICKERAVOID_50HZ,
+   MMAL_PARAM_FLICKERAVOID_60HZ,
+   MMAL_PARAM_FLICKERAVOID_MAX = 0x7FFFFFFF
+} MMAL_PARAM_FLICKERAVOID_T;
+
+typedef struct MMAL_PARAMETER_FLICKERAVOID_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_PARAM_FLICKERAVOID_T value;
+} MMAL_PARAMETER_FLICKERAVOID_T;
+
+typedef enum MMAL_PARAMETER_DRC_STRENGTH_T
+{
+   MMAL_PARAMETER_DRC_STRENGTH_OFF,
+   MMAL_PARAMETER_DRC_STRENGTH_LOW,
+   MMAL_PARAMETER_DRC_STRENGTH_MEDIUM,
+   MMAL_PARAMETER_DRC_STRENGTH_HIGH,
+   MMAL_PARAMETER_DRC_STRENGTH_MAX = 0x7fffffff
+} MMAL_PARAMETER_DRC_STRENGTH_T;
+
+typedef struct MMAL_PARAMETER_DRC_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_PARAMETER_DRC_STRENGTH_T strength;   /// DRC strength
+} MMAL_PARAMETER_DRC_T;
+
+#define MMAL_CAMERA_ANNOTATE_MAX_TEXT_LEN_V3 256
+
+typedef struct MMAL_PARAMETER_CAMERA_ANNOTATE_V3_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   MMAL_BOOL_T enable;
+   MMAL_BOOL_T show_shutter;
+   MMAL_BOOL_T show_analog_gain;
+   MMAL_BOOL_T show_lens;
+   MMAL_BOOL_T show_caf;
+   MMAL_BOOL_T show_motion;
+   MMAL_BOOL_T show_frame_num;
+   MMAL_BOOL_T enable_text_background;
+   MMAL_BOOL_T custom_background_colour;
+   uint8_t custom_background_Y;
+   uint8_t custom_background_U;
+   uint8_t custom_background_V;
+   uint8_t dummy1;
+   MMAL_BOOL_T custom_text_colour;
+   uint8_t custom_text_Y;
+   uint8_t custom_text_U;
+   uint8_t custom_text_V;
+   uint8_t text_size;                  /// 0 for the default size
+   char text[MMAL_CAMERA_ANNOTATE_MAX_TEXT_LEN_V3];
+} MMAL_PARAMETER_CAMERA_ANNOTATE_V3_T;
+
+typedef enum MMAL_PARAM_MIRROR_T
+{
+   MMAL_PARAM_MIRROR_NONE,
+   MMAL_PARAM_MIRROR_VERTICAL,
+   MMAL_PARAM_MIRROR_HORIZONTAL,
+   MMAL_PARAM_MIRROR_BOTH,
+} MMAL_PARAM_MIRROR_T;
+
+typedef struct MMAL_PARAMETER_MIRROR_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_PARAM_MIRROR_T value;
+} MMAL_PARAMETER_MIRROR_T;
+
+typedef enum MMAL_CAMERA_STC_MODE_T
+{
+   MMAL_PARAM_TIMESTAMP_MODE_ZERO,        /// Always timestamp frames as 0
+   MMAL_PARAM_TIMESTAMP_MODE_RAW_STC,     /// Use the raw STC value for the frame timestamp
+   MMAL_PARAM_TIMESTAMP_MODE_RESET_STC,   /// Use the STC timestamp but subtract the timestamp of the first frame
+   MMAL_PARAM_TIMESTAMP_MODE_MAX = 0x7FFFFFFF
+} MMAL_CAMERA_STC_MODE_T;
+
+typedef struct MMAL_PARAMETER_CAMERA_CONFIG_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   uint32_t max_stills_w;
+   uint32_t max_stills_h;
+   uint32_t stills_yuv422;
+   uint32_t one_shot_stills;
+
+   uint32_t max_preview_video_w;
+   uint32_t max_preview_video_h;
+   uint32_t num_preview_video_frames;
+
+   uint32_t stills_capture_circular_buffer_height;
+
+   uint32_t fast_preview_resume;
+
+   MMAL_CAMERA_STC_MODE_T use_stc_timestamp;
+} MMAL_PARAMETER_CAMERA_CONFIG_T;
+
+typedef struct MMAL_PARAMETER_INPUT_CROP_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_RECT_T rect;   /// Crop rectangle as 16P16 fixed point values
+} MMAL_PARAMETER_INPUT_CROP_T;
+
+/** What the camera's control loops chose, sent in MMAL_EVENT_PARAMETER_CHANGED
+ * events once requested with MMAL_PARAMETER_CHANGE_EVENT_REQUEST */
+typedef struct MMAL_PARAMETER_CAMERA_SETTINGS_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   uint32_t exposure;                  /// Exposure time in microseconds
+   MMAL_RATIONAL_T analog_gain;
+   MMAL_RATIONAL_T digital_gain;
+   MMAL_RATIONAL_T awb_red_gain;
+   MMAL_RATIONAL_T awb_blue_gain;
+   uint32_t focus_position;
+} MMAL_PARAMETER_CAMERA_SETTINGS_T;
+
+#endif /* MMAL_PARAMETERS_CAMERA_H */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_PARAMETERS_COMMON_H
+#define MMAL_PARAMETERS_COMMON_H
+
+#include "mmal_types.h"
+
+#define MMAL_PARAMETER_GROUP_COMMON   (0<<16)
+#define MMAL_PARAMETER_GROUP_CAMERA   (1<<16)
+#define MMAL_PARAMETER_GROUP_VIDEO    (2<<16)
+#define MMAL_PARAMETER_GROUP_AUDIO    (3<<16)
+#define MMAL_PARAMETER_GROUP_CLOCK    (4<<16)
+
+enum
+{
+   MMAL_PARAMETER_UNUSED = MMAL_PARAMETER_GROUP_COMMON,
+   MMAL_PARAMETER_SUPPORTED_ENCODINGS,
+   MMAL_PARAMETER_URI,
+   MMAL_PARAMETER_CHANGE_EVENT_REQUEST,
+   MMAL_PARAMETER_ZERO_COPY,
+   MMAL_PARAMETER_BUFFER_REQUIREMENTS,
+   MMAL_PARAMETER_STATISTICS,
+   MMAL_PARAMETER_CORE_STATISTICS,
+   MMAL_PARAMETER_MEM_USAGE,
+   MMAL_PARAMETER_BUFFER_FLAG_FILTER,
+   MMAL_PARAMETER_SEEK,
+   MMAL_PARAMETER_POWERMON_ENABLE,
+   MMAL_PARAMETER_LOGGING,
+   MMAL_PARAMETER_SYSTEM_TIME,
+   MMAL_PARAMETER_NO_IMAGE_PADDING,
+   MMAL_PARAMETER_LOCKSTEP_ENABLE
+};
+
+typedef struct MMAL_PARAMETER_HEADER_T
+{
+   uint32_t id;      /// Parameter ID
+   uint32_t size;    /// Size in bytes of the whole parameter, header included
+} MMAL_PARAMETER_HEADER_T;
+
+/** Ask for MMAL_EVENT_PARAMETER_CHANGED events when a parameter changes */
+typedef struct MMAL_PARAMETER_CHANGE_EVENT_REQUEST_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   uint32_t change_id;   /// ID of the parameter to report changes of
+   MMAL_BOOL_T enable;   /// Whether to report them
+} MMAL_PARAMETER_CHANGE_EVENT_REQUEST_T;
+
+typedef struct MMAL_PARAMETER_BOOLEAN_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_BOOL_T enable;
+} MMAL_PARAMETER_BOOLEAN_T;
+
+typedef struct MMAL_PARAMETER_UINT64_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   uint64_t value;
+} MMAL_PARAMETER_UINT64_T;
+
+typedef struct MMAL_PARAMETER_INT64_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   int64_t value;
+} MMAL_PARAMETER_INT64_T;
+
+typedef struct MMAL_PARAMETER_UINT32_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   uint32_t value;
+} MMAL_PARAMETER_UINT32_T;
+
+typedef struct MMAL_PARAMETER_INT32_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   int32_t value;
+} MMAL_PARAMETER_INT32_T;
+
+typedef struct MMAL_PARAMETER_RATIONAL_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_RATIONAL_T value;
+} MMAL_PARAMETER_RATIONAL_T;
+
+#endif /* MMAL_PARAMETERS_COMMON_H */
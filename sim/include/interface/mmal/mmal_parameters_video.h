@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_PARAMETERS_VIDEO_H
+#define MMAL_PARAMETERS_VIDEO_H
+
+#include "mmal_parameters_common.h"
+
+enum
+{
+   MMAL_PARAMETER_DISPLAYREGION = MMAL_PARAMETER_GROUP_VIDEO,
+   MMAL_PARAMETER_SUPPORTED_PROFILES,
+   MMAL_PARAMETER_PROFILE,
+   MMAL_PARAMETER_INTRAPERIOD,
+   MMAL_PARAMETER_RATECONTROL,
+   MMAL_PARAMETER_NALUNITFORMAT,
+   MMAL_PARAMETER_MINIMISE_FRAGMENTATION,
+   MMAL_PARAMETER_MB_ROWS_PER_SLICE,
+   MMAL_PARAMETER_VIDEO_LEVEL_EXTENSION,
+   MMAL_PARAMETER_VIDEO_EEDE_ENABLE,
+   MMAL_PARAMETER_VIDEO_EEDE_LOSSRATE,
+   MMAL_PARAMETER_VIDEO_REQUEST_I_FRAME,
+   MMAL_PARAMETER_VIDEO_INTRA_REFRESH,
+   MMAL_PARAMETER_VIDEO_IMMUTABLE_INPUT,
+   MMAL_PARAMETER_VIDEO_BIT_RATE,
+   MMAL_PARAMETER_VIDEO_FRAME_RATE,
+   MMAL_PARAMETER_VIDEO_ENCODE_MIN_QUANT,
+   MMAL_PARAMETER_VIDEO_ENCODE_MAX_QUANT,
+   MMAL_PARAMETER_VIDEO_ENCODE_RC_MODEL,
+   MMAL_PARAMETER_EXTRA_BUFFERS,
+   MMAL_PARAMETER_VIDEO_ALIGN_HORIZ,
+   MMAL_PARAMETER_VIDEO_ALIGN_VERT,
+   MMAL_PARAMETER_VIDEO_DROPPABLE_PFRAMES,
+   MMAL_PARAMETER_VIDEO_ENCODE_INITIAL_QUANT,
+   MMAL_PARAMETER_VIDEO_ENCODE_QP_P,
+   MMAL_PARAMETER_VIDEO_ENCODE_RC_SLICE_DQUANT,
+   MMAL_PARAMETER_VIDEO_ENCODE_FRAME_LIMIT_BITS,
+   MMAL_PARAMETER_VIDEO_ENCODE_PEAK_RATE,
+   MMAL_PARAMETER_VIDEO_ENCODE_H264_DISABLE_CABAC,
+   MMAL_PARAMETER_VIDEO_ENCODE_H264_LOW_LATENCY,
+   MMAL_PARAMETER_VIDEO_ENCODE_H264_AU_DELIMITERS,
+   MMAL_PARAMETER_VIDEO_ENCODE_H264_DEBLOCK_IDC,
+   MMAL_PARAMETER_VIDEO_ENCODE_H264_MB_INTRA_MODE,
+   MMAL_PARAMETER_VIDEO_ENCODE_HEADER_ON_OPEN,
+   MMAL_PARAMETER_VIDEO_ENCODE_PRECODE_FOR_QP,
+   MMAL_PARAMETER_VIDEO_DRM_INIT_INFO,
+   MMAL_PARAMETER_VIDEO_TIMESTAMP_FIFO,
+   MMAL_PARAMETER_VIDEO_DECODE_ERROR_CONCEALMENT,
+   MMAL_PARAMETER_VIDEO_DRM_PROTECT_BUFFER,
+   MMAL_PARAMETER_VIDEO_DECODE_CONFIG_VD3,
+   MMAL_PARAMETER_VIDEO_ENCODE_H264_VCL_HRD_PARAMETERS,
+   MMAL_PARAMETER_VIDEO_ENCODE_H264_LOW_DELAY_HRD_FLAG,
+   MMAL_PARAMETER_VIDEO_ENCODE_INLINE_HEADER,
+   MMAL_PARAMETER_VIDEO_ENCODE_SEI_ENABLE,
+   MMAL_PARAMETER_VIDEO_ENCODE_INLINE_VECTORS,
+};
+
+#define MMAL_DISPLAY_SET_NONE          0
+#define MMAL_DISPLAY_SET_NUM           1
+#define MMAL_DISPLAY_SET_FULLSCREEN    2
+#define MMAL_DISPLAY_SET_TRANSFORM     4
+#define MMAL_DISPLAY_SET_DEST_RECT     8
+#define MMAL_DISPLAY_SET_SRC_RECT      0x10
+#define MMAL_DISPLAY_SET_MODE          0x20
+#define MMAL_DISPLAY_SET_PIXEL         0x40
+#define MMAL_DISPLAY_SET_NOASPECT      0x80
+#define MMAL_DISPLAY_SET_LAYER         0x100
+#define MMAL_DISPLAY_SET_COPYPROTECT   0x200
+#define MMAL_DISPLAY_SET_ALPHA         0x400
+
+typedef enum MMAL_DISPLAYTRANSFORM_T
+{
+   MMAL_DISPLAY_ROT0 = 0,
+   MMAL_DISPLAY_MIRROR_ROT0 = 1,
+   MMAL_DISPLAY_MIRROR_ROT180 = 2,
+   MMAL_DISPLAY_ROT180 = 3,
+   MMAL_DISPLAY_MIRROR_ROT90 = 4,
+   MMAL_DISPLAY_ROT270 = 5,
+   MMAL_DISPLAY_ROT90 = 6,
+   MMAL_DISPLAY_MIRROR_ROT270 = 7,
+   MMAL_DISPLAY_DUMMY = 0x7FFFFFFF
+} MMAL_DISPLAYTRANSFORM_T;
+
+typedef enum MMAL_DISPLAYMODE_T
+{
+   MMAL_DISPLAY_MODE_FILL = 0,
+   MMAL_DISPLAY_MODE_LETTERBOX = 1,
+   MMAL_DISPLAY_MODE_DUMMY = 0x7FFFFFFF
+} MMAL_DISPLAYMODE_T;
+
+typedef struct MMAL_DISPLAYREGION_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   uint32_t set;                      /// MMAL_DISPLAY_SET_* flags of the fields that are valid
+   uint32_t display_num;
+   MMAL_BOOL_T fullscreen;
+   MMAL_DISPLAYTRANSFORM_T transform;
+   MMAL_RECT_T dest_rect;
+   MMAL_RECT_T src_rect;
+   MMAL_BOOL_T noaspect;
+   MMAL_DISPLAYMODE_T mode;
+   uint32_t pixel_x;
+   uint32_t pixel_y;
+   int32_t layer;
+   MMAL_BOOL_T copyprotect_required;
+   uint32_t alpha;
+} MMAL_DISPLAYREGION_T;
+
+typedef enum MMAL_VIDEO_PROFILE_T
+{
+   MMAL_VIDEO_PROFILE_H263_BASELINE,
+   MMAL_VIDEO_PROFILE_H263_H320CODING,
+   MMAL_VIDEO_PROFILE_H263_BACKWARDCOMPATIBLE,
+   MMAL_VIDEO_PROFILE_H263_ISWV2,
+   MMAL_VIDEO_PROFILE_H263_ISWV3,
+   MMAL_VIDEO_PROFILE_H263_HIGHCOMPRESSION,
+   MMAL_VIDEO_PROFILE_H263_INTERNET,
+   MMAL_VIDEO_PROFILE_H263_INTERLACE,
+   MMAL_VIDEO_PROFILE_H263_HIGHLATENCY,
+   MMAL_VIDEO_PROFILE_MP4V_SIMPLE,
+   MMAL_VIDEO_PROFILE_MP4V_SIMPLESCALABLE,
+   MMAL_VIDEO_PROFILE_MP4V_CORE,
+   MMAL_VIDEO_PROFILE_MP4V_MAIN,
+   MMAL_VIDEO_PROFILE_MP4V_NBIT,
+   MMAL_VIDEO_PROFILE_MP4V_SCALABLETEXTURE,
+   MMAL_VIDEO_PROFILE_MP4V_SIMPLEFACE,
+   MMAL_VIDEO_PROFILE_MP4V_SIMPLEFBA,
+   MMAL_VIDEO_PROFILE_MP4V_BASICANIMATED,
+   MMAL_VIDEO_PROFILE_MP4V_HYBRID,
+   MMAL_VIDEO_PROFILE_MP4V_ADVANCEDREALTIME,
+   MMAL_VIDEO_PROFILE_MP4V_CORESCALABLE,
+   MMAL_VIDEO_PROFILE_MP4V_ADVANCEDCODING,
+   MMAL_VIDEO_PROFILE_MP4V_ADVANCEDCORE,
+   MMAL_VIDEO_PROFILE_MP4V_ADVANCEDSCALABLE,
+   MMAL_VIDEO_PROFILE_MP4V_ADVANCEDSIMPLE,
+   MMAL_VIDEO_PROFILE_H264_BASELINE,
+   MMAL_VIDEO_PROFILE_H264_MAIN,
+   MMAL_VIDEO_PROFILE_H264_EXTENDED,
+   MMAL_VIDEO_PROFILE_H264_HIGH,
+   MMAL_VIDEO_PROFILE_H264_HIGH10,
+   MMAL_VIDEO_PROFILE_H264_HIGH422,
+   MMAL_VIDEO_PROFILE_H264_HIGH444,
+   MMAL_VIDEO_PROFILE_H264_CONSTRAINED_BASELINE,
+   MMAL_VIDEO_PROFILE_DUMMY = 0x7FFFFFFF
+} MMAL_VIDEO_PROFILE_T;
+
+typedef enum MMAL_VIDEO_LEVEL_T
+{
+   MMAL_VIDEO_LEVEL_H263_10,
+   MMAL_VIDEO_LEVEL_H263_20,
+   MMAL_VIDEO_LEVEL_H263_30,
+   MMAL_VIDEO_LEVEL_H263_40,
+   MMAL_VIDEO_LEVEL_H263_45,
+   MMAL_VIDEO_LEVEL_H263_50,
+   MMAL_VIDEO_LEVEL_H263_60,
+   MMAL_VIDEO_LEVEL_H263_70,
+   MMAL_VIDEO_LEVEL_MP4V_0,
+   MMAL_VIDEO_LEVEL_MP4V_0b,
+   MMAL_VIDEO_LEVEL_MP4V_1,
+   MMAL_VIDEO_LEVEL_MP4V_2,
+   MMAL_VIDEO_LEVEL_MP4V_3,
+   MMAL_VIDEO_LEVEL_MP4V_4,
+   MMAL_VIDEO_LEVEL_MP4V_4a,
+   MMAL_VIDEO_LEVEL_MP4V_5,
+   MMAL_VIDEO_LEVEL_MP4V_6,
+   MMAL_VIDEO_LEVEL_H264_1,
+   MMAL_VIDEO_LEVEL_H264_1b,
+   MMAL_VIDEO_LEVEL_H264_11,
+   MMAL_VIDEO_LEVEL_H264_12,
+   MMAL_VIDEO_LEVEL_H264_13,
+   MMAL_VIDEO_LEVEL_H264_2,
+   MMAL_VIDEO_LEVEL_H264_21,
+   MMAL_VIDEO_LEVEL_H264_22,
+   MMAL_VIDEO_LEVEL_H264_3,
+   MMAL_VIDEO_LEVEL_H264_31,
+   MMAL_VIDEO_LEVEL_H264_32,
+   MMAL_VIDEO_LEVEL_H264_4,
+   MMAL_VIDEO_LEVEL_H264_41,
+   MMAL_VIDEO_LEVEL_H264_42,
+   MMAL_VIDEO_LEVEL_H264_5,
+   MMAL_VIDEO_LEVEL_H264_51,
+   MMAL_VIDEO_LEVEL_DUMMY = 0x7FFFFFFF
+} MMAL_VIDEO_LEVEL_T;
+
+typedef struct MMAL_PARAMETER_VIDEO_PROFILE_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   struct
+   {
+      MMAL_VIDEO_PROFILE_T profile;
+      MMAL_VIDEO_LEVEL_T level;
+   } profile[1];
+} MMAL_PARAMETER_VIDEO_PROFILE_T;
+
+typedef enum MMAL_VIDEO_RATECONTROL_T
+{
+   MMAL_VIDEO_RATECONTROL_DEFAULT,
+   MMAL_VIDEO_RATECONTROL_VARIABLE,
+   MMAL_VIDEO_RATECONTROL_CONSTANT,
+   MMAL_VIDEO_RATECONTROL_VARIABLE_SKIP_FRAMES,
+   MMAL_VIDEO_RATECONTROL_CONSTANT_SKIP_FRAMES,
+   MMAL_VIDEO_RATECONTROL_DUMMY = 0x7fffffff
+} MMAL_VIDEO_RATECONTROL_T;
+
+typedef struct MMAL_PARAMETER_VIDEO_RATECONTROL_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_VIDEO_RATECONTROL_T control;
+} MMAL_PARAMETER_VIDEO_RATECONTROL_T;
+
+#endif /* MMAL_PARAMETERS_VIDEO_H */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_PORT_H
+#define MMAL_PORT_H
+
+#include "mmal_format.h"
+#include "mmal_buffer.h"
+#include "mmal_parameters_common.h"
+
+typedef enum
+{
+   MMAL_PORT_TYPE_UNKNOWN = 0,
+   MMAL_PORT_TYPE_CONTROL,
+   MMAL_PORT_TYPE_INPUT,
+   MMAL_PORT_TYPE_OUTPUT,
+   MMAL_PORT_TYPE_CLOCK,
+   MMAL_PORT_TYPE_INVALID = 0xffffffff
+} MMAL_PORT_TYPE_T;
+
+#define MMAL_PORT_CAPABILITY_PASSTHROUGH                       0x01
+#define MMAL_PORT_CAPABILITY_ALLOCATION                        0x02
+#define MMAL_PORT_CAPABILITY_SUPPORTS_EVENT_FORMAT_CHANGE      0x04
+
+struct MMAL_PORT_PRIVATE_T;
+struct MMAL_PORT_USERDATA_T;
+struct MMAL_COMPONENT_T;
+
+typedef struct MMAL_PORT_T
+{
+   struct MMAL_PORT_PRIVATE_T *priv;     /// Data private to the framework
+   const char *name;                     /// Port name, for debugging
+   MMAL_PORT_TYPE_T type;                /// Type of the port
+   uint16_t index;                       /// Index among the ports of the same type
+   uint16_t index_all;                   /// Index among all the ports of the component
+   uint32_t is_enabled;                  /// Whether the port is enabled
+   MMAL_ES_FORMAT_T *format;             /// Format of the elementary stream
+
+   uint32_t buffer_num_min;              /// Minimum number of buffers the port needs
+   uint32_t buffer_size_min;             /// Minimum size of buffers the port needs
+   uint32_t buffer_alignment_min;        /// Minimum alignment of buffer payloads
+   uint32_t buffer_num_recommended;      /// Number of buffers the port recommends
+   uint32_t buffer_size_recommended;     /// Size of buffers the port recommends
+
+   uint32_t buffer_num;                  /// Number of buffers the port will use
+   uint32_t buffer_size;                 /// Size of buffers the port will use
+
+   struct MMAL_COMPONENT_T *component;   /// Component this port belongs to
+   struct MMAL_PORT_USERDATA_T *userdata; /// Field reserved for the client
+
+   uint32_t capabilities;                /// MMAL_PORT_CAPABILITY_* flags
+} MMAL_PORT_T;
+
+typedef void (*MMAL_PORT_BH_CB_T)(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer);
+
+MMAL_STATUS_T mmal_port_format_commit(MMAL_PORT_T *port);
+MMAL_STATUS_T mmal_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T cb);
+MMAL_STATUS_T mmal_port_disable(MMAL_PORT_T *port);
+MMAL_STATUS_T mmal_port_flush(MMAL_PORT_T *port);
+MMAL_STATUS_T mmal_port_parameter_set(MMAL_PORT_T *port, const MMAL_PARAMETER_HEADER_T *param);
+MMAL_STATUS_T mmal_port_parameter_get(MMAL_PORT_T *port, MMAL_PARAMETER_HEADER_T *param);
+MMAL_STATUS_T mmal_port_send_buffer(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer);
+MMAL_STATUS_T mmal_port_connect(MMAL_PORT_T *port, MMAL_PORT_T *other_port);
+MMAL_STATUS_T mmal_port_disconnect(MMAL_PORT_T *port);
+
+#endif /* MMAL_PORT_H */
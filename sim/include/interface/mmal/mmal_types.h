@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_TYPES_H
+#define MMAL_TYPES_H
+
+#include "mmal_common.h"
+
+/** Status codes returned by the API */
+typedef enum
+{
+   MMAL_SUCCESS = 0,    /// Success
+   MMAL_ENOMEM,         /// Out of memory
+   MMAL_ENOSPC,         /// Out of resources (other than memory)
+   MMAL_EINVAL,         /// Argument is invalid
+   MMAL_ENOSYS,         /// Function not implemented
+   MMAL_ENOENT,         /// No such file or directory
+   MMAL_ENXIO,          /// No such device or address
+   MMAL_EIO,            /// I/O error
+   MMAL_ESPIPE,         /// Illegal seek
+   MMAL_ECORRUPT,       /// Data is corrupt
+   MMAL_ENOTREADY,      /// Component is not ready
+   MMAL_ECONFIG,        /// Component is not configured
+   MMAL_EISCONN,        /// Port is already connected
+   MMAL_ENOTCONN,       /// Port is disconnected
+   MMAL_EAGAIN,         /// Resource temporarily unavailable, try again later
+   MMAL_EFAULT,         /// Bad address
+   MMAL_STATUS_MAX = 0x7FFFFFFF
+} MMAL_STATUS_T;
+
+typedef struct
+{
+   int32_t x;
+   int32_t y;
+   int32_t width;
+   int32_t height;
+} MMAL_RECT_T;
+
+typedef struct
+{
+   int32_t num;
+   int32_t den;
+} MMAL_RATIONAL_T;
+
+#endif /* MMAL_TYPES_H */
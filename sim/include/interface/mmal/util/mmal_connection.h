@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_CONNECTION_H
+#define MMAL_CONNECTION_H
+
+#include "interface/mmal/mmal.h"
+
+#define MMAL_CONNECTION_FLAG_TUNNELLING               0x1
+#define MMAL_CONNECTION_FLAG_ALLOCATION_ON_INPUT      0x2
+#define MMAL_CONNECTION_FLAG_ALLOCATION_ON_OUTPUT     0x4
+#define MMAL_CONNECTION_FLAG_KEEP_BUFFER_REQUIREMENTS 0x8
+#define MMAL_CONNECTION_FLAG_DIRECT                   0x10
+
+typedef struct MMAL_CONNECTION_T MMAL_CONNECTION_T;
+typedef void (*MMAL_CONNECTION_CALLBACK_T)(MMAL_CONNECTION_T *connection);
+
+struct MMAL_CONNECTION_T
+{
+   void *user_data;                      /// Field reserved for the client
+   MMAL_CONNECTION_CALLBACK_T callback;  /// Unused, every connection is tunnelled
+   uint32_t is_enabled;                  /// Whether the connection is enabled
+   uint32_t flags;                       /// MMAL_CONNECTION_FLAG_* flags
+   MMAL_PORT_T *in;                      /// Input port of the connection
+   MMAL_PORT_T *out;                     /// Output port of the connection
+   MMAL_POOL_T *pool;                    /// Unused, every connection is tunnelled
+   MMAL_QUEUE_T *queue;                  /// Unused, every connection is tunnelled
+   const char *name;                     /// Connection name, for debugging
+};
+
+MMAL_STATUS_T mmal_connection_create(MMAL_CONNECTION_T **connection,
+                                     MMAL_PORT_T *out, MMAL_PORT_T *in, uint32_t flags);
+void mmal_connection_acquire(MMAL_CONNECTION_T *connection);
+MMAL_STATUS_T mmal_connection_release(MMAL_CONNECTION_T *connection);
+MMAL_STATUS_T mmal_connection_destroy(MMAL_CONNECTION_T *connection);
+MMAL_STATUS_T mmal_connection_enable(MMAL_CONNECTION_T *connection);
+MMAL_STATUS_T mmal_connection_disable(MMAL_CONNECTION_T *connection);
+
+#endif /* MMAL_CONNECTION_H */
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_DEFAULT_COMPONENTS_H
+#define MMAL_DEFAULT_COMPONENTS_H
+
+#define MMAL_COMPONENT_DEFAULT_VIDEO_DECODER   "vc.ril.video_decode"
+#define MMAL_COMPONENT_DEFAULT_VIDEO_ENCODER   "vc.ril.video_encode"
+#define MMAL_COMPONENT_DEFAULT_VIDEO_RENDERER  "vc.ril.video_render"
+#define MMAL_COMPONENT_DEFAULT_IMAGE_DECODER   "vc.ril.image_decode"
+#define MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER   "vc.ril.image_encode"
+#define MMAL_COMPONENT_DEFAULT_CAMERA          "vc.ril.camera"
+#define MMAL_COMPONENT_DEFAULT_VIDEO_SPLITTER  "vc.ril.video_splitter"
+#define MMAL_COMPONENT_DEFAULT_NULL_SINK       "vc.null_sink"
+#define MMAL_COMPONENT_DEFAULT_RESIZER         "vc.ril.resize"
+
+#endif /* MMAL_DEFAULT_COMPONENTS_H */
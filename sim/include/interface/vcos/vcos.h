@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* Minimal stand-in for VCOS on top of pthreads and POSIX semaphores,
+ * covering what rpicamsrc uses. See sim/mmal_sim.c. */
+
+#ifndef VCOS_H
+#define VCOS_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+typedef enum
+{
+   VCOS_SUCCESS,
+   VCOS_EAGAIN,
+   VCOS_ENOENT,
+   VCOS_ENOSPC,
+   VCOS_EINVAL,
+   VCOS_EACCESS,
+   VCOS_ENOMEM,
+   VCOS_ENOSYS,
+   VCOS_EEXIST,
+   VCOS_ENXIO,
+   VCOS_EINTR
+} VCOS_STATUS_T;
+
+typedef enum
+{
+   VCOS_LOG_UNINITIALIZED,
+   VCOS_LOG_NEVER,
+   VCOS_LOG_ERROR,
+   VCOS_LOG_WARN,
+   VCOS_LOG_INFO,
+   VCOS_LOG_TRACE
+} VCOS_LOG_LEVEL_T;
+
+typedef struct VCOS_LOG_CAT_T
+{
+   VCOS_LOG_LEVEL_T level;   /// Most verbose level printed
+   const char *name;         /// Name given to vcos_log_register()
+} VCOS_LOG_CAT_T;
+
+extern VCOS_LOG_CAT_T vcos_sim_log_category;
+
+#ifndef VCOS_LOG_CATEGORY
+#define VCOS_LOG_CATEGORY (&vcos_sim_log_category)
+#endif
+
+void vcos_log_register(const char *name, VCOS_LOG_CAT_T *category);
+void vcos_log_impl(const VCOS_LOG_CAT_T *category, VCOS_LOG_LEVEL_T level, const char *fmt, ...)
+   __attribute__ ((format (printf, 3, 4)));
+
+#define vcos_log_error(...) vcos_log_impl(VCOS_LOG_CATEGORY, VCOS_LOG_ERROR, __VA_ARGS__)
+#define vcos_log_warn(...)  vcos_log_impl(VCOS_LOG_CATEGORY, VCOS_LOG_WARN, __VA_ARGS__)
+#define vcos_log_info(...)  vcos_log_impl(VCOS_LOG_CATEGORY, VCOS_LOG_INFO, __VA_ARGS__)
+#define vcos_log_trace(...) vcos_log_impl(VCOS_LOG_CATEGORY, VCOS_LOG_TRACE, __VA_ARGS__)
+
+/* Like a release build of VCOS: a failed assertion is logged, not fatal */
+#define vcos_assert(cond) \
+   do { if (!(cond)) vcos_log_error("%s:%d: assertion failed: %s", __FILE__, __LINE__, #cond); } while (0)
+
+#define VCOS_ALIGN_UP(p,n) (((p) + (n) - 1) & ~((n) - 1))
+#define VCOS_ALIGN_DOWN(p,n) ((p) & ~((n) - 1))
+
+typedef sem_t VCOS_SEMAPHORE_T;
+
+static inline VCOS_STATUS_T vcos_semaphore_create(VCOS_SEMAPHORE_T *sem, const char *name,
+                                                  unsigned int count)
+{
+   (void)name;
+   return sem_init(sem, 0, count) == 0 ? VCOS_SUCCESS : VCOS_ENOSPC;
+}
+
+static inline void vcos_semaphore_delete(VCOS_SEMAPHORE_T *sem)
+{
+   sem_destroy(sem);
+}
+
+static inline VCOS_STATUS_T vcos_semaphore_wait(VCOS_SEMAPHORE_T *sem)
+{
+   while (sem_wait(sem) != 0)
+      ;
+   return VCOS_SUCCESS;
+}
+
+static inline VCOS_STATUS_T vcos_semaphore_wait_timeout(VCOS_SEMAPHORE_T *sem, uint32_t ms)
+{
+   struct timespec deadline;
+
+   clock_gettime(CLOCK_REALTIME, &deadline);
+   deadline.tv_sec += ms / 1000;
+   deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+   if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+   }
+
+   while (sem_timedwait(sem, &deadline) != 0) {
+      if (errno != EINTR)
+         return VCOS_EAGAIN;
+   }
+   return VCOS_SUCCESS;
+}
+
+static inline VCOS_STATUS_T vcos_semaphore_trywait(VCOS_SEMAPHORE_T *sem)
+{
+   return sem_trywait(sem) == 0 ? VCOS_SUCCESS : VCOS_EAGAIN;
+}
+
+static inline VCOS_STATUS_T vcos_semaphore_post(VCOS_SEMAPHORE_T *sem)
+{
+   sem_post(sem);
+   return VCOS_SUCCESS;
+}
+
+static inline void vcos_sleep(uint32_t ms)
+{
+   usleep(ms * 1000);
+}
+
+uint32_t vcos_getmicrosecs(void);
+
+#endif /* VCOS_H */
@@ -0,0 +1,1302 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* Software stand-in for the MMAL, VCOS and bcm_host libraries, so
+ * libgstrpicamsrc.a can be built and run on a machine without a camera
+ * (make SIM=1). It covers the subset of MMAL rpicamsrc calls: components,
+ * ports, pools, queues, tunnelled connections, parameters and callbacks.
+ *
+ * Each enabled camera component runs a thread that ticks at the frame rate
+ * of its video port and pushes frames through the tunnelled graph behind
+ * it. Encoders turn frames into synthetic H264 access units, MJPEG frames
+ * or JPEG stills sized from the bitrate or quality, with random jitter.
+ * Ports enabled with a callback rather than connected get raw frames.
+ * Buffers only move when the client has sent them to a port, so a client
+ * that is slow to hand buffers back stalls the graph and the sensor skips
+ * frames, as on the real thing. As in MMAL, a connection holds a
+ * reference on both its components, so a component destroyed while still
+ * connected lives on, with its ports connected, until the connection goes.
+ *
+ * Settings come from the environment:
+ *   RPICAM_SIM_CAMERAS  number of sensors that can be selected (1)
+ *   RPICAM_SIM_JITTER   +/- percentage applied to synthetic frame sizes (10)
+ *   RPICAM_SIM_LATENCY  microseconds from exposure to output (0)
+ *   RPICAM_SIM_SEED     seed of the frame size jitter (1)
+ *   RPICAM_SIM_BUFFERS  output buffers the encoders recommend (3)
+ *   RPICAM_SIM_H264     Annex B file whose AUs are sent, looping, instead
+ *                       of synthetic ones
+ *   RPICAM_SIM_JPEG     JPEG file sent for every still
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "interface/vcos/vcos.h"
+#include "interface/mmal/mmal.h"
+#include "interface/mmal/util/mmal_util.h"
+#include "interface/mmal/util/mmal_util_params.h"
+#include "interface/mmal/util/mmal_default_components.h"
+#include "interface/mmal/util/mmal_connection.h"
+
+#include "mmal_sim_private.h"
+
+pthread_mutex_t sim_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static SIM_CONFIG config;
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+static uint32_t next_component_id;
+
+struct MMAL_QUEUE_T {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	MMAL_BUFFER_HEADER_T *first;
+	MMAL_BUFFER_HEADER_T **last;
+	unsigned int length;
+};
+
+struct MMAL_BUFFER_HEADER_PRIVATE_T {
+	MMAL_POOL_T *pool;
+	int refcount;
+};
+
+/// A pool and everything it allocated, in one block
+typedef struct {
+	MMAL_POOL_T pool;
+	MMAL_BUFFER_HEADER_T *headers;
+	struct MMAL_BUFFER_HEADER_PRIVATE_T *privs;
+} SIM_POOL;
+
+/// Connection and the storage for its name
+typedef struct {
+	MMAL_CONNECTION_T connection;
+	int refcount;
+	char name[100];
+} SIM_CONNECTION;
+
+static const struct {
+	const char *name;
+	SIM_COMPONENT_TYPE type;
+	unsigned int inputs;
+	unsigned int outputs;
+} component_types[] = {
+	{MMAL_COMPONENT_DEFAULT_CAMERA, SIM_CAMERA, 0, 3},
+	{MMAL_COMPONENT_DEFAULT_VIDEO_ENCODER, SIM_VIDEO_ENCODER, 1, 1},
+	{MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, SIM_IMAGE_ENCODER, 1, 1},
+	{MMAL_COMPONENT_DEFAULT_VIDEO_SPLITTER, SIM_SPLITTER, 1, 4},
+	{MMAL_COMPONENT_DEFAULT_RESIZER, SIM_RESIZER, 1, 1},
+	{MMAL_COMPONENT_DEFAULT_VIDEO_RENDERER, SIM_SINK, 1, 0},
+	{MMAL_COMPONENT_DEFAULT_NULL_SINK, SIM_SINK, 1, 0},
+};
+
+static unsigned int env_uint(const char *name, unsigned int fallback)
+{
+	const char *value = getenv(name);
+
+	return value && *value ? (unsigned int)strtoul(value, NULL, 0) : fallback;
+}
+
+static void load_config(void)
+{
+	const char *path;
+
+	config.cameras = env_uint("RPICAM_SIM_CAMERAS", 1);
+	config.jitter = env_uint("RPICAM_SIM_JITTER", 10);
+	config.latency = env_uint("RPICAM_SIM_LATENCY", 0);
+	config.seed = env_uint("RPICAM_SIM_SEED", 1);
+	config.encoder_buffers = env_uint("RPICAM_SIM_BUFFERS", 3);
+	if (config.jitter > 90)
+		config.jitter = 90;
+	if (config.encoder_buffers == 0)
+		config.encoder_buffers = 1;
+
+	path = getenv("RPICAM_SIM_H264");
+	if (path && *path && !sim_h264_load(path, &config.h264))
+		vcos_log_error("Unable to load H264 access units from %s", path);
+
+	path = getenv("RPICAM_SIM_JPEG");
+	if (path && *path && !sim_load_file(path, &config.jpeg))
+		vcos_log_error("Unable to load JPEG still from %s", path);
+}
+
+/**
+ * Simulator settings, read from the environment on first use
+ */
+const SIM_CONFIG *sim_config(void)
+{
+	pthread_once(&config_once, load_config);
+	return &config;
+}
+
+/**
+ * CLOCK_MONOTONIC in microseconds
+ */
+int64_t sim_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Queues */
+
+MMAL_QUEUE_T *mmal_queue_create(void)
+{
+	MMAL_QUEUE_T *queue = calloc(1, sizeof(*queue));
+	pthread_condattr_t attr;
+
+	if (queue == NULL)
+		return NULL;
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&queue->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	queue->last = &queue->first;
+
+	return queue;
+}
+
+void mmal_queue_put(MMAL_QUEUE_T * queue, MMAL_BUFFER_HEADER_T * buffer)
+{
+	pthread_mutex_lock(&queue->lock);
+	buffer->next = NULL;
+	*queue->last = buffer;
+	queue->last = &buffer->next;
+	queue->length++;
+	pthread_cond_signal(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+void mmal_queue_put_back(MMAL_QUEUE_T * queue, MMAL_BUFFER_HEADER_T * buffer)
+{
+	pthread_mutex_lock(&queue->lock);
+	buffer->next = queue->first;
+	queue->first = buffer;
+	if (queue->last == &queue->first)
+		queue->last = &buffer->next;
+	queue->length++;
+	pthread_cond_signal(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/* Called with the queue locked */
+static MMAL_BUFFER_HEADER_T *queue_pop(MMAL_QUEUE_T * queue)
+{
+	MMAL_BUFFER_HEADER_T *buffer = queue->first;
+
+	if (buffer) {
+		queue->first = buffer->next;
+		if (queue->first == NULL)
+			queue->last = &queue->first;
+		queue->length--;
+		buffer->next = NULL;
+	}
+
+	return buffer;
+}
+
+MMAL_BUFFER_HEADER_T *mmal_queue_get(MMAL_QUEUE_T * queue)
+{
+	MMAL_BUFFER_HEADER_T *buffer;
+
+	if (queue == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&queue->lock);
+	buffer = queue_pop(queue);
+	pthread_mutex_unlock(&queue->lock);
+
+	return buffer;
+}
+
+MMAL_BUFFER_HEADER_T *mmal_queue_wait(MMAL_QUEUE_T * queue)
+{
+	MMAL_BUFFER_HEADER_T *buffer;
+
+	pthread_mutex_lock(&queue->lock);
+	while (queue->first == NULL)
+		pthread_cond_wait(&queue->cond, &queue->lock);
+	buffer = queue_pop(queue);
+	pthread_mutex_unlock(&queue->lock);
+
+	return buffer;
+}
+
+MMAL_BUFFER_HEADER_T *mmal_queue_timedwait(MMAL_QUEUE_T * queue, uint32_t timeout)
+{
+	MMAL_BUFFER_HEADER_T *buffer;
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&queue->lock);
+	while (queue->first == NULL)
+		if (pthread_cond_timedwait(&queue->cond, &queue->lock, &deadline) == ETIMEDOUT)
+			break;
+	buffer = queue_pop(queue);
+	pthread_mutex_unlock(&queue->lock);
+
+	return buffer;
+}
+
+unsigned int mmal_queue_length(MMAL_QUEUE_T * queue)
+{
+	unsigned int length;
+
+	pthread_mutex_lock(&queue->lock);
+	length = queue->length;
+	pthread_mutex_unlock(&queue->lock);
+
+	return length;
+}
+
+void mmal_queue_destroy(MMAL_QUEUE_T * queue)
+{
+	if (queue == NULL)
+		return;
+
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue);
+}
+
+/* Buffer headers and pools */
+
+void mmal_buffer_header_reset(MMAL_BUFFER_HEADER_T * header)
+{
+	header->cmd = 0;
+	header->length = 0;
+	header->offset = 0;
+	header->flags = 0;
+	header->pts = MMAL_TIME_UNKNOWN;
+	header->dts = MMAL_TIME_UNKNOWN;
+}
+
+void mmal_buffer_header_acquire(MMAL_BUFFER_HEADER_T * header)
+{
+	/* A header taken straight off its pool's queue counts as held once */
+	if (__atomic_load_n(&header->priv->refcount, __ATOMIC_ACQUIRE) == 0)
+		__atomic_store_n(&header->priv->refcount, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&header->priv->refcount, 1, __ATOMIC_ACQ_REL);
+}
+
+void mmal_buffer_header_release(MMAL_BUFFER_HEADER_T * header)
+{
+	if (__atomic_sub_fetch(&header->priv->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	__atomic_store_n(&header->priv->refcount, 0, __ATOMIC_RELEASE);
+	mmal_buffer_header_reset(header);
+	if (header->priv->pool)
+		mmal_queue_put(header->priv->pool->queue, header);
+}
+
+MMAL_STATUS_T mmal_buffer_header_mem_lock(MMAL_BUFFER_HEADER_T * header)
+{
+	(void)header;
+	return MMAL_SUCCESS;
+}
+
+void mmal_buffer_header_mem_unlock(MMAL_BUFFER_HEADER_T * header)
+{
+	(void)header;
+}
+
+MMAL_POOL_T *mmal_pool_create(unsigned int headers, uint32_t payload_size)
+{
+	SIM_POOL *sim = calloc(1, sizeof(*sim));
+	unsigned int i;
+
+	if (sim == NULL)
+		return NULL;
+
+	sim->pool.queue = mmal_queue_create();
+	sim->pool.header = calloc(headers ? headers : 1, sizeof(*sim->pool.header));
+	sim->headers = calloc(headers ? headers : 1, sizeof(*sim->headers));
+	sim->privs = calloc(headers ? headers : 1, sizeof(*sim->privs));
+	if (!sim->pool.queue || !sim->pool.header || !sim->headers || !sim->privs)
+		goto error;
+
+	for (i = 0; i < headers; i++) {
+		MMAL_BUFFER_HEADER_T *header = &sim->headers[i];
+
+		if (payload_size && posix_memalign((void **)&header->data, 64, payload_size) != 0) {
+			header->data = NULL;
+			goto error;
+		}
+		header->alloc_size = payload_size;
+		header->priv = &sim->privs[i];
+		header->priv->pool = &sim->pool;
+		mmal_buffer_header_reset(header);
+		sim->pool.header[i] = header;
+		sim->pool.headers_num++;
+		mmal_queue_put(sim->pool.queue, header);
+	}
+
+	return &sim->pool;
+
+ error:
+	mmal_pool_destroy(&sim->pool);
+	return NULL;
+}
+
+void mmal_pool_destroy(MMAL_POOL_T * pool)
+{
+	SIM_POOL *sim = (SIM_POOL *) pool;
+	unsigned int i;
+
+	if (pool == NULL)
+		return;
+
+	for (i = 0; i < pool->headers_num; i++)
+		free(sim->headers[i].data);
+	mmal_queue_destroy(pool->queue);
+	free(pool->header);
+	free(sim->headers);
+	free(sim->privs);
+	free(sim);
+}
+
+/* Formats */
+
+MMAL_ES_FORMAT_T *mmal_format_alloc(void)
+{
+	SIM_FORMAT *format = calloc(1, sizeof(*format));
+
+	if (format == NULL)
+		return NULL;
+
+	format->format.es = &format->es;
+	return &format->format;
+}
+
+void mmal_format_free(MMAL_ES_FORMAT_T * format)
+{
+	free(format);
+}
+
+void mmal_format_copy(MMAL_ES_FORMAT_T * format_dest, MMAL_ES_FORMAT_T * format_src)
+{
+	MMAL_ES_SPECIFIC_FORMAT_T *es = format_dest->es;
+
+	*es = *format_src->es;
+	*format_dest = *format_src;
+	format_dest->es = es;
+	format_dest->extradata = NULL;
+	format_dest->extradata_size = 0;
+}
+
+MMAL_STATUS_T mmal_format_full_copy(MMAL_ES_FORMAT_T * format_dest,
+				    MMAL_ES_FORMAT_T * format_src)
+{
+	mmal_format_copy(format_dest, format_src);
+	return MMAL_SUCCESS;
+}
+
+/* Utilities */
+
+const char *mmal_status_to_string(MMAL_STATUS_T status)
+{
+	static const char *names[] = {
+		"SUCCESS", "ENOMEM", "ENOSPC", "EINVAL", "ENOSYS", "ENOENT", "ENXIO", "EIO",
+		"ESPIPE", "ECORRUPT", "ENOTREADY", "ECONFIG", "EISCONN", "ENOTCONN", "EAGAIN",
+		"EFAULT"
+	};
+
+	if ((unsigned int)status < sizeof(names) / sizeof(names[0]))
+		return names[status];
+	return "UNKNOWN";
+}
+
+/* Bytes per pixel of the first plane of an encoding */
+static uint32_t bytes_per_pixel(uint32_t encoding)
+{
+	switch (encoding) {
+	case MMAL_ENCODING_RGB24:
+	case MMAL_ENCODING_BGR24:
+		return 3;
+	case MMAL_ENCODING_RGBA:
+	case MMAL_ENCODING_BGRA:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+uint32_t mmal_encoding_width_to_stride(uint32_t encoding, uint32_t width)
+{
+	return width * bytes_per_pixel(encoding);
+}
+
+uint32_t mmal_encoding_stride_to_width(uint32_t encoding, uint32_t stride)
+{
+	return stride / bytes_per_pixel(encoding);
+}
+
+char *mmal_4cc_to_string(char *buf, size_t len, uint32_t fourcc)
+{
+	if (len < 5)
+		return buf;
+
+	if (fourcc == 0) {
+		snprintf(buf, len, "<0>");
+	} else {
+		buf[0] = fourcc & 0xff;
+		buf[1] = (fourcc >> 8) & 0xff;
+		buf[2] = (fourcc >> 16) & 0xff;
+		buf[3] = fourcc >> 24;
+		buf[4] = 0;
+	}
+	return buf;
+}
+
+/**
+ * Size of one raw frame in a format, with the ISP's padding
+ *
+ * @param format Format of a port
+ * @return Bytes per frame, or 0 if the encoding isn't a raw one
+ */
+uint32_t sim_raw_frame_size(const MMAL_ES_FORMAT_T * format)
+{
+	uint32_t width = VCOS_ALIGN_UP(format->es->video.width, 32);
+	uint32_t height = VCOS_ALIGN_UP(format->es->video.height, 16);
+
+	switch (format->encoding) {
+	case MMAL_ENCODING_I420:
+	case MMAL_ENCODING_YV12:
+	case MMAL_ENCODING_NV12:
+	case MMAL_ENCODING_NV21:
+		return width * height * 3 / 2;
+	case MMAL_ENCODING_RGB24:
+	case MMAL_ENCODING_BGR24:
+	case MMAL_ENCODING_RGBA:
+	case MMAL_ENCODING_BGRA:
+		return mmal_encoding_width_to_stride(format->encoding, width) * height;
+	default:
+		return 0;
+	}
+}
+
+/* Buffer requirements the port advertises for its current format */
+static void update_buffer_requirements(MMAL_PORT_T * port)
+{
+	MMAL_COMPONENT_T *component = port->component;
+	uint32_t raw = sim_raw_frame_size(port->format);
+
+	port->buffer_alignment_min = 16;
+	port->buffer_num_min = 1;
+	if (port->type != MMAL_PORT_TYPE_OUTPUT) {
+		port->buffer_size_min = port->buffer_size_recommended = raw ? raw : 128;
+		port->buffer_num_recommended = 3;
+	} else if (component->priv->type == SIM_VIDEO_ENCODER) {
+		port->buffer_size_min = 2048;
+		port->buffer_size_recommended = 65536;
+		port->buffer_num_recommended = sim_config()->encoder_buffers;
+	} else if (component->priv->type == SIM_IMAGE_ENCODER) {
+		port->buffer_size_min = 8192;
+		port->buffer_size_recommended = 81920;
+		port->buffer_num_recommended = 3;
+	} else if (raw) {
+		port->buffer_size_min = port->buffer_size_recommended = raw;
+		port->buffer_num_recommended = 3;
+	} else {
+		/* Opaque buffers only carry a handle to GPU memory */
+		port->buffer_size_min = port->buffer_size_recommended = 128;
+		port->buffer_num_recommended = 3;
+	}
+
+	if (port->buffer_size < port->buffer_size_min)
+		port->buffer_size = port->buffer_size_recommended;
+	if (port->buffer_num < port->buffer_num_min)
+		port->buffer_num = port->buffer_num_recommended;
+}
+
+/* Whether an output port of a component can produce an encoding */
+static int encoding_supported(MMAL_PORT_T * port, uint32_t encoding)
+{
+	if (port->type != MMAL_PORT_TYPE_OUTPUT)
+		return 1;
+
+	switch (port->component->priv->type) {
+	case SIM_VIDEO_ENCODER:
+		return encoding == MMAL_ENCODING_H264 || encoding == MMAL_ENCODING_MJPEG;
+	case SIM_IMAGE_ENCODER:
+		return encoding == MMAL_ENCODING_JPEG;
+	default:
+		return encoding == MMAL_ENCODING_OPAQUE || sim_raw_frame_size(port->format) != 0;
+	}
+}
+
+/* Ports */
+
+MMAL_STATUS_T mmal_port_format_commit(MMAL_PORT_T * port)
+{
+	MMAL_VIDEO_FORMAT_T *video;
+
+	if (port == NULL || port->type == MMAL_PORT_TYPE_CONTROL)
+		return MMAL_EINVAL;
+
+	pthread_mutex_lock(&sim_lock);
+	video = &port->format->es->video;
+	if (video->width == 0 || video->height == 0 || video->width > 4096 || video->height > 4096
+	    || !encoding_supported(port, port->format->encoding)) {
+		pthread_mutex_unlock(&sim_lock);
+		return MMAL_EINVAL;
+	}
+
+	port->format->type = MMAL_ES_TYPE_VIDEO;
+	if (video->crop.width == 0 || video->crop.height == 0) {
+		video->crop.width = video->width;
+		video->crop.height = video->height;
+	}
+	update_buffer_requirements(port);
+	pthread_mutex_unlock(&sim_lock);
+
+	return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_port_enable(MMAL_PORT_T * port, MMAL_PORT_BH_CB_T cb)
+{
+	MMAL_STATUS_T status = MMAL_SUCCESS;
+
+	if (port == NULL)
+		return MMAL_EINVAL;
+
+	pthread_mutex_lock(&sim_lock);
+	if (port->is_enabled || port->priv->connection)
+		status = MMAL_EINVAL;
+	else if (cb == NULL && port->type != MMAL_PORT_TYPE_INPUT)
+		status = MMAL_EINVAL;
+
+	if (status == MMAL_SUCCESS) {
+		port->priv->callback = cb;
+		sim_encoder_reset(port);
+		port->is_enabled = 1;
+	}
+	pthread_mutex_unlock(&sim_lock);
+
+	return status;
+}
+
+/* Hand back the buffers the port still holds. Real MMAL returns them
+ * through the callback; giving them straight back to their pool saves
+ * clients from seeing empty buffers. Called with sim_lock held. */
+static void flush_port(MMAL_PORT_T * port)
+{
+	MMAL_BUFFER_HEADER_T *buffer;
+
+	while ((buffer = mmal_queue_get(port->priv->queue)))
+		mmal_buffer_header_release(buffer);
+}
+
+MMAL_STATUS_T mmal_port_disable(MMAL_PORT_T * port)
+{
+	if (port == NULL)
+		return MMAL_EINVAL;
+
+	/* A camera thread waiting for a buffer on this port gives up */
+	__atomic_store_n(&port->priv->disabling, 1, __ATOMIC_RELEASE);
+	pthread_mutex_lock(&sim_lock);
+	__atomic_store_n(&port->priv->disabling, 0, __ATOMIC_RELEASE);
+
+	if (!port->is_enabled) {
+		pthread_mutex_unlock(&sim_lock);
+		return MMAL_EINVAL;
+	}
+
+	if (port->priv->connection)
+		port->priv->connection->is_enabled = 0;
+	port->is_enabled = 0;
+	flush_port(port);
+	pthread_mutex_unlock(&sim_lock);
+
+	return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_port_flush(MMAL_PORT_T * port)
+{
+	pthread_mutex_lock(&sim_lock);
+	flush_port(port);
+	pthread_mutex_unlock(&sim_lock);
+
+	return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_port_send_buffer(MMAL_PORT_T * port, MMAL_BUFFER_HEADER_T * buffer)
+{
+	if (port == NULL || buffer == NULL || !port->is_enabled)
+		return MMAL_EINVAL;
+	if (port->type != MMAL_PORT_TYPE_OUTPUT || port->priv->connection)
+		return MMAL_ENOSYS;
+
+	mmal_queue_put(port->priv->queue, buffer);
+	return MMAL_SUCCESS;
+}
+
+/**
+ * Take a buffer the client sent to an output port, to fill it
+ *
+ * @param port Output port
+ * @param timeout_ms How long to wait for the client to send one
+ * @return The buffer, or NULL if there was none or the port is going away
+ */
+MMAL_BUFFER_HEADER_T *sim_port_take_buffer(MMAL_PORT_T * port, unsigned int timeout_ms)
+{
+	MMAL_BUFFER_HEADER_T *buffer = mmal_queue_get(port->priv->queue);
+	unsigned int waited = 0;
+
+	/* Wait in slices, so a disable from another thread isn't held up */
+	while (buffer == NULL && waited < timeout_ms && port->is_enabled
+	       && !__atomic_load_n(&port->priv->disabling, __ATOMIC_ACQUIRE)) {
+		buffer = mmal_queue_timedwait(port->priv->queue, 10);
+		waited += 10;
+	}
+
+	return buffer;
+}
+
+/**
+ * Hand a filled buffer to the client's callback
+ *
+ * @param port Port the client enabled
+ * @param buffer Filled buffer, owned by the client from now on
+ */
+void sim_port_deliver(MMAL_PORT_T * port, MMAL_BUFFER_HEADER_T * buffer)
+{
+	__atomic_store_n(&buffer->priv->refcount, 1, __ATOMIC_RELEASE);
+	if (port->priv->callback)
+		port->priv->callback(port, buffer);
+	else
+		mmal_buffer_header_release(buffer);
+}
+
+/**
+ * Send an event to the client's callback, as the firmware does on
+ * control ports
+ *
+ * @param port Port the client enabled
+ * @param cmd MMAL_EVENT_* code
+ * @param data Event payload
+ * @param size Size of data in bytes
+ * @return MMAL_SUCCESS, or MMAL_ENOSPC if the client holds every event buffer
+ */
+MMAL_STATUS_T sim_port_event(MMAL_PORT_T * port, uint32_t cmd, const void *data, uint32_t size)
+{
+	struct MMAL_PORT_PRIVATE_T *priv = port->priv;
+	MMAL_BUFFER_HEADER_T *buffer;
+
+	if (!port->is_enabled || !priv->callback || size > SIM_EVENT_SIZE)
+		return MMAL_EINVAL;
+
+	if (priv->events == NULL) {
+		priv->events = mmal_pool_create(SIM_EVENT_BUFFERS, SIM_EVENT_SIZE);
+		if (priv->events == NULL)
+			return MMAL_ENOMEM;
+	}
+
+	buffer = mmal_queue_get(priv->events->queue);
+	if (buffer == NULL)
+		return MMAL_ENOSPC;
+
+	buffer->cmd = cmd;
+	memcpy(buffer->data, data, size);
+	buffer->length = size;
+	sim_port_deliver(port, buffer);
+
+	return MMAL_SUCCESS;
+}
+
+/* Parameters */
+
+SIM_PARAM *sim_param_find(MMAL_PORT_T * port, uint32_t id)
+{
+	SIM_PARAM *param;
+
+	for (param = port->priv->params; param; param = param->next)
+		if (param->value->id == id)
+			return param;
+
+	return NULL;
+}
+
+/**
+ * Read back a uint32, int32 or boolean parameter
+ *
+ * @param port Port the parameter was set on
+ * @param id Parameter ID
+ * @param fallback Value if it was never set
+ * @return The value
+ */
+uint32_t sim_param_uint32(MMAL_PORT_T * port, uint32_t id, uint32_t fallback)
+{
+	SIM_PARAM *param = sim_param_find(port, id);
+
+	if (param == NULL || param->value->size < sizeof(MMAL_PARAMETER_UINT32_T))
+		return fallback;
+
+	return ((MMAL_PARAMETER_UINT32_T *) param->value)->value;
+}
+
+/**
+ * Keep a copy of a parameter so it can be read back. Called with sim_lock held.
+ *
+ * @param port Port the parameter is set on
+ * @param param The parameter
+ * @return MMAL_SUCCESS, or MMAL_ENOMEM
+ */
+MMAL_STATUS_T sim_param_store(MMAL_PORT_T * port, const MMAL_PARAMETER_HEADER_T * param)
+{
+	SIM_PARAM *stored = sim_param_find(port, param->id);
+	MMAL_PARAMETER_HEADER_T *value = malloc(param->size);
+
+	if (value == NULL)
+		return MMAL_ENOMEM;
+	memcpy(value, param, param->size);
+
+	if (stored == NULL) {
+		stored = calloc(1, sizeof(*stored));
+		if (stored == NULL) {
+			free(value);
+			return MMAL_ENOMEM;
+		}
+		stored->next = port->priv->params;
+		port->priv->params = stored;
+	}
+
+	free(stored->value);
+	stored->value = value;
+
+	return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set(MMAL_PORT_T * port, const MMAL_PARAMETER_HEADER_T * param)
+{
+	MMAL_STATUS_T status;
+
+	if (port == NULL || param == NULL || param->size < sizeof(*param))
+		return MMAL_EINVAL;
+
+	pthread_mutex_lock(&sim_lock);
+	status = sim_parameter_hook(port, param);
+	if (status == MMAL_SUCCESS)
+		status = sim_param_store(port, param);
+	pthread_mutex_unlock(&sim_lock);
+
+	return status;
+}
+
+MMAL_STATUS_T mmal_port_parameter_get(MMAL_PORT_T * port, MMAL_PARAMETER_HEADER_T * param)
+{
+	MMAL_STATUS_T status = MMAL_SUCCESS;
+	SIM_PARAM *stored;
+
+	if (port == NULL || param == NULL || param->size < sizeof(*param))
+		return MMAL_EINVAL;
+
+	pthread_mutex_lock(&sim_lock);
+	if (param->id == MMAL_PARAMETER_SYSTEM_TIME) {
+		if (port->component->priv->type != SIM_CAMERA)
+			status = MMAL_ENOSYS;
+		else if (param->size < sizeof(MMAL_PARAMETER_UINT64_T))
+			status = MMAL_ENOSPC;
+		else
+			((MMAL_PARAMETER_UINT64_T *) param)->value =
+			    sim_camera_stc(port->component);
+	} else if ((stored = sim_param_find(port, param->id)) == NULL) {
+		status = MMAL_ENOSYS;
+	} else if (param->size < stored->value->size) {
+		param->size = stored->value->size;
+		status = MMAL_ENOSPC;
+	} else {
+		memcpy(param, stored->value, stored->value->size);
+	}
+	pthread_mutex_unlock(&sim_lock);
+
+	return status;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_boolean(MMAL_PORT_T * port, uint32_t id, MMAL_BOOL_T value)
+{
+	MMAL_PARAMETER_BOOLEAN_T param = { {id, sizeof(param)}, value };
+	return mmal_port_parameter_set(port, &param.hdr);
+}
+
+MMAL_STATUS_T mmal_port_parameter_get_boolean(MMAL_PORT_T * port, uint32_t id,
+					      MMAL_BOOL_T * value)
+{
+	MMAL_PARAMETER_BOOLEAN_T param = { {id, sizeof(param)}, 0 };
+	MMAL_STATUS_T status = mmal_port_parameter_get(port, &param.hdr);
+
+	if (status == MMAL_SUCCESS)
+		*value = param.enable;
+	return status;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_uint64(MMAL_PORT_T * port, uint32_t id, uint64_t value)
+{
+	MMAL_PARAMETER_UINT64_T param = { {id, sizeof(param)}, value };
+	return mmal_port_parameter_set(port, &param.hdr);
+}
+
+MMAL_STATUS_T mmal_port_parameter_get_uint64(MMAL_PORT_T * port, uint32_t id, uint64_t * value)
+{
+	MMAL_PARAMETER_UINT64_T param = { {id, sizeof(param)}, 0 };
+	MMAL_STATUS_T status = mmal_port_parameter_get(port, &param.hdr);
+
+	if (status == MMAL_SUCCESS)
+		*value = param.value;
+	return status;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_int64(MMAL_PORT_T * port, uint32_t id, int64_t value)
+{
+	MMAL_PARAMETER_INT64_T param = { {id, sizeof(param)}, value };
+	return mmal_port_parameter_set(port, &param.hdr);
+}
+
+MMAL_STATUS_T mmal_port_parameter_get_int64(MMAL_PORT_T * port, uint32_t id, int64_t * value)
+{
+	MMAL_PARAMETER_INT64_T param = { {id, sizeof(param)}, 0 };
+	MMAL_STATUS_T status = mmal_port_parameter_get(port, &param.hdr);
+
+	if (status == MMAL_SUCCESS)
+		*value = param.value;
+	return status;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_uint32(MMAL_PORT_T * port, uint32_t id, uint32_t value)
+{
+	MMAL_PARAMETER_UINT32_T param = { {id, sizeof(param)}, value };
+	return mmal_port_parameter_set(port, &param.hdr);
+}
+
+MMAL_STATUS_T mmal_port_parameter_get_uint32(MMAL_PORT_T * port, uint32_t id, uint32_t * value)
+{
+	MMAL_PARAMETER_UINT32_T param = { {id, sizeof(param)}, 0 };
+	MMAL_STATUS_T status = mmal_port_parameter_get(port, &param.hdr);
+
+	if (status == MMAL_SUCCESS)
+		*value = param.value;
+	return status;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_int32(MMAL_PORT_T * port, uint32_t id, int32_t value)
+{
+	MMAL_PARAMETER_INT32_T param = { {id, sizeof(param)}, value };
+	return mmal_port_parameter_set(port, &param.hdr);
+}
+
+MMAL_STATUS_T mmal_port_parameter_get_int32(MMAL_PORT_T * port, uint32_t id, int32_t * value)
+{
+	MMAL_PARAMETER_INT32_T param = { {id, sizeof(param)}, 0 };
+	MMAL_STATUS_T status = mmal_port_parameter_get(port, &param.hdr);
+
+	if (status == MMAL_SUCCESS)
+		*value = param.value;
+	return status;
+}
+
+MMAL_STATUS_T mmal_port_parameter_set_rational(MMAL_PORT_T * port, uint32_t id,
+					       MMAL_RATIONAL_T value)
+{
+	MMAL_PARAMETER_RATIONAL_T param = { {id, sizeof(param)}, value };
+	return mmal_port_parameter_set(port, &param.hdr);
+}
+
+MMAL_STATUS_T mmal_port_parameter_get_rational(MMAL_PORT_T * port, uint32_t id,
+					       MMAL_RATIONAL_T * value)
+{
+	MMAL_PARAMETER_RATIONAL_T param = { {id, sizeof(param)}, {0, 0} };
+	MMAL_STATUS_T status = mmal_port_parameter_get(port, &param.hdr);
+
+	if (status == MMAL_SUCCESS)
+		*value = param.value;
+	return status;
+}
+
+MMAL_POOL_T *mmal_port_pool_create(MMAL_PORT_T * port, unsigned int headers,
+				   uint32_t payload_size)
+{
+	(void)port;
+	return mmal_pool_create(headers, payload_size);
+}
+
+void mmal_port_pool_destroy(MMAL_PORT_T * port, MMAL_POOL_T * pool)
+{
+	if (port && port->is_enabled)
+		mmal_port_disable(port);
+	mmal_pool_destroy(pool);
+}
+
+MMAL_STATUS_T mmal_port_connect(MMAL_PORT_T * port, MMAL_PORT_T * other_port)
+{
+	(void)port;
+	(void)other_port;
+	return MMAL_ENOSYS;
+}
+
+MMAL_STATUS_T mmal_port_disconnect(MMAL_PORT_T * port)
+{
+	(void)port;
+	return MMAL_ENOSYS;
+}
+
+/* Components */
+
+static MMAL_PORT_T *create_port(MMAL_COMPONENT_T * component, MMAL_PORT_TYPE_T type,
+				unsigned int index)
+{
+	static const char *type_names[] = { "?", "ctr", "in", "out", "clk" };
+	struct MMAL_PORT_PRIVATE_T *priv = calloc(1, sizeof(*priv));
+	MMAL_PORT_T *port;
+
+	if (priv == NULL)
+		return NULL;
+
+	priv->queue = mmal_queue_create();
+	if (priv->queue == NULL) {
+		free(priv);
+		return NULL;
+	}
+
+	port = &priv->port;
+	port->priv = priv;
+	port->component = component;
+	port->type = type;
+	port->index = index;
+	port->index_all = component->port_num;
+	snprintf(priv->name, sizeof(priv->name), "%s:%s:%u", component->name,
+		 type_names[type], index);
+	port->name = priv->name;
+
+	priv->format.format.es = &priv->format.es;
+	port->format = &priv->format.format;
+	port->format->type = MMAL_ES_TYPE_VIDEO;
+	port->format->es->video.width = 640;
+	port->format->es->video.height = 480;
+	port->format->es->video.crop.width = 640;
+	port->format->es->video.crop.height = 480;
+	port->format->es->video.frame_rate.num = 30;
+	port->format->es->video.frame_rate.den = 1;
+	if (type == MMAL_PORT_TYPE_CONTROL)
+		port->format->type = MMAL_ES_TYPE_CONTROL;
+	else if (type == MMAL_PORT_TYPE_INPUT)
+		port->format->encoding = MMAL_ENCODING_I420;
+	else if (component->priv->type == SIM_VIDEO_ENCODER)
+		port->format->encoding = MMAL_ENCODING_H264;
+	else if (component->priv->type == SIM_IMAGE_ENCODER)
+		port->format->encoding = MMAL_ENCODING_JPEG;
+	else
+		port->format->encoding = MMAL_ENCODING_OPAQUE;
+
+	component->priv->ports[component->port_num++] = port;
+	if (type != MMAL_PORT_TYPE_CONTROL)
+		update_buffer_requirements(port);
+
+	return port;
+}
+
+static void destroy_port(MMAL_PORT_T * port)
+{
+	struct MMAL_PORT_PRIVATE_T *priv = port->priv;
+	SIM_PARAM *param, *next;
+
+	/* A connection holds its components, so their ports are never connected here */
+	port->is_enabled = 0;
+	flush_port(port);
+	mmal_queue_destroy(priv->queue);
+	mmal_pool_destroy(priv->events);
+
+	for (param = priv->params; param; param = next) {
+		next = param->next;
+		free(param->value);
+		free(param);
+	}
+	sim_bytes_free(&priv->exif);
+	sim_bytes_free(&priv->encoder.scratch);
+	free(priv);
+}
+
+MMAL_STATUS_T mmal_component_create(const char *name, MMAL_COMPONENT_T ** component)
+{
+	struct MMAL_COMPONENT_PRIVATE_T *priv;
+	MMAL_COMPONENT_T *c;
+	unsigned int type, i;
+
+	if (name == NULL || component == NULL)
+		return MMAL_EINVAL;
+
+	for (type = 0; type < sizeof(component_types) / sizeof(component_types[0]); type++)
+		if (strcmp(name, component_types[type].name) == 0)
+			break;
+	if (type == sizeof(component_types) / sizeof(component_types[0]))
+		return MMAL_ENOSYS;
+
+	priv = calloc(1, sizeof(*priv));
+	if (priv == NULL)
+		return MMAL_ENOMEM;
+
+	c = &priv->component;
+	c->priv = priv;
+	c->name = component_types[type].name;
+	c->id = __atomic_add_fetch(&next_component_id, 1, __ATOMIC_RELAXED);
+	priv->type = component_types[type].type;
+	priv->refcount = 1;
+	c->port = priv->ports;
+	c->input = priv->inputs;
+	c->output = priv->outputs;
+
+	c->control = create_port(c, MMAL_PORT_TYPE_CONTROL, 0);
+	if (c->control == NULL)
+		goto error;
+	for (i = 0; i < component_types[type].inputs; i++) {
+		if ((priv->inputs[i] = create_port(c, MMAL_PORT_TYPE_INPUT, i)) == NULL)
+			goto error;
+		c->input_num++;
+	}
+	for (i = 0; i < component_types[type].outputs; i++) {
+		if ((priv->outputs[i] = create_port(c, MMAL_PORT_TYPE_OUTPUT, i)) == NULL)
+			goto error;
+		c->output_num++;
+	}
+
+	if (priv->type == SIM_CAMERA)
+		sim_camera_init(c);
+
+	*component = c;
+	return MMAL_SUCCESS;
+
+ error:
+	for (i = 0; i < c->port_num; i++)
+		destroy_port(priv->ports[i]);
+	free(priv);
+	return MMAL_ENOMEM;
+}
+
+void mmal_component_acquire(MMAL_COMPONENT_T * component)
+{
+	__atomic_add_fetch(&component->priv->refcount, 1, __ATOMIC_RELAXED);
+}
+
+MMAL_STATUS_T mmal_component_release(MMAL_COMPONENT_T * component)
+{
+	unsigned int i;
+
+	if (component == NULL)
+		return MMAL_EINVAL;
+	if (__atomic_sub_fetch(&component->priv->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return MMAL_SUCCESS;
+
+	if (component->priv->type == SIM_CAMERA)
+		sim_camera_stop(component);
+
+	pthread_mutex_lock(&sim_lock);
+	for (i = 0; i < component->port_num; i++)
+		destroy_port(component->port[i]);
+	pthread_mutex_unlock(&sim_lock);
+
+	free(component->priv);
+
+	return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_component_destroy(MMAL_COMPONENT_T * component)
+{
+	return mmal_component_release(component);
+}
+
+MMAL_STATUS_T mmal_component_enable(MMAL_COMPONENT_T * component)
+{
+	MMAL_STATUS_T status = MMAL_SUCCESS;
+
+	if (component == NULL)
+		return MMAL_EINVAL;
+
+	pthread_mutex_lock(&sim_lock);
+	if (!component->is_enabled && component->priv->type == SIM_CAMERA)
+		status = sim_camera_start(component);
+	if (status == MMAL_SUCCESS)
+		component->is_enabled = 1;
+	pthread_mutex_unlock(&sim_lock);
+
+	return status;
+}
+
+MMAL_STATUS_T mmal_component_disable(MMAL_COMPONENT_T * component)
+{
+	if (component == NULL)
+		return MMAL_EINVAL;
+
+	/* Outside the lock, the camera thread needs it to finish its tick */
+	if (component->priv->type == SIM_CAMERA)
+		sim_camera_stop(component);
+
+	pthread_mutex_lock(&sim_lock);
+	component->is_enabled = 0;
+	pthread_mutex_unlock(&sim_lock);
+
+	return MMAL_SUCCESS;
+}
+
+/* Connections. All of them are tunnelled: frames go straight from the
+ * output port to the input port's component, without client buffers. */
+
+MMAL_STATUS_T mmal_connection_create(MMAL_CONNECTION_T ** connection, MMAL_PORT_T * out,
+				     MMAL_PORT_T * in, uint32_t flags)
+{
+	SIM_CONNECTION *sim;
+	MMAL_STATUS_T status;
+
+	if (connection == NULL || out == NULL || in == NULL
+	    || out->type != MMAL_PORT_TYPE_OUTPUT || in->type != MMAL_PORT_TYPE_INPUT)
+		return MMAL_EINVAL;
+
+	pthread_mutex_lock(&sim_lock);
+	if (out->priv->connection || in->priv->connection || out->is_enabled || in->is_enabled) {
+		pthread_mutex_unlock(&sim_lock);
+		return MMAL_EISCONN;
+	}
+
+	/* The input takes on the format of the output */
+	mmal_format_copy(in->format, out->format);
+	status = mmal_port_format_commit(in);
+	if (status != MMAL_SUCCESS) {
+		pthread_mutex_unlock(&sim_lock);
+		return status;
+	}
+
+	sim = calloc(1, sizeof(*sim));
+	if (sim == NULL) {
+		pthread_mutex_unlock(&sim_lock);
+		return MMAL_ENOMEM;
+	}
+
+	snprintf(sim->name, sizeof(sim->name), "%s/%s", out->name, in->name);
+	sim->refcount = 1;
+	sim->connection.name = sim->name;
+	sim->connection.flags = flags | MMAL_CONNECTION_FLAG_TUNNELLING;
+	sim->connection.out = out;
+	sim->connection.in = in;
+	out->priv->connection = &sim->connection;
+	in->priv->connection = &sim->connection;
+	*connection = &sim->connection;
+	pthread_mutex_unlock(&sim_lock);
+
+	mmal_component_acquire(out->component);
+	mmal_component_acquire(in->component);
+
+	return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_connection_enable(MMAL_CONNECTION_T * connection)
+{
+	if (connection == NULL)
+		return MMAL_EINVAL;
+
+	pthread_mutex_lock(&sim_lock);
+	if (connection->out == NULL || connection->in == NULL) {
+		pthread_mutex_unlock(&sim_lock);
+		return MMAL_ENOTCONN;
+	}
+	connection->out->is_enabled = 1;
+	connection->in->is_enabled = 1;
+	connection->is_enabled = 1;
+	sim_encoder_reset(connection->out);
+	pthread_mutex_unlock(&sim_lock);
+
+	return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_connection_disable(MMAL_CONNECTION_T * connection)
+{
+	if (connection == NULL)
+		return MMAL_EINVAL;
+
+	if (connection->out)
+		__atomic_store_n(&connection->out->priv->disabling, 1, __ATOMIC_RELEASE);
+	pthread_mutex_lock(&sim_lock);
+	connection->is_enabled = 0;
+	if (connection->out) {
+		connection->out->is_enabled = 0;
+		__atomic_store_n(&connection->out->priv->disabling, 0, __ATOMIC_RELEASE);
+	}
+	if (connection->in)
+		connection->in->is_enabled = 0;
+	pthread_mutex_unlock(&sim_lock);
+
+	return MMAL_SUCCESS;
+}
+
+void mmal_connection_acquire(MMAL_CONNECTION_T * connection)
+{
+	__atomic_add_fetch(&((SIM_CONNECTION *) connection)->refcount, 1, __ATOMIC_RELAXED);
+}
+
+MMAL_STATUS_T mmal_connection_release(MMAL_CONNECTION_T * connection)
+{
+	MMAL_PORT_T *out, *in;
+
+	if (connection == NULL)
+		return MMAL_EINVAL;
+	if (__atomic_sub_fetch(&((SIM_CONNECTION *) connection)->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return MMAL_SUCCESS;
+
+	mmal_connection_disable(connection);
+
+	pthread_mutex_lock(&sim_lock);
+	out = connection->out;
+	in = connection->in;
+	out->priv->connection = NULL;
+	in->priv->connection = NULL;
+	pthread_mutex_unlock(&sim_lock);
+
+	free(connection);
+
+	/* Last, as this may destroy the components and their ports */
+	mmal_component_release(out->component);
+	mmal_component_release(in->component);
+
+	return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_connection_destroy(MMAL_CONNECTION_T * connection)
+{
+	return mmal_connection_release(connection);
+}
@@ -0,0 +1,908 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* The simulated camera and the components fed from it. A camera thread
+ * ticks at the frame rate of the video port; each tick makes a frame on
+ * every output that is producing, and routes it through the tunnelled
+ * connections behind that output until it reaches a port with a client
+ * callback. The whole tick runs with sim_lock held.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "interface/vcos/vcos.h"
+#include "interface/mmal/mmal.h"
+#include "interface/mmal/util/mmal_util.h"
+#include "interface/mmal/util/mmal_util_params.h"
+
+#include "mmal_sim_private.h"
+
+/* Same port numbering as the real camera */
+#define CAMERA_PREVIEW_PORT 0
+#define CAMERA_VIDEO_PORT 1
+#define CAMERA_CAPTURE_PORT 2
+
+/// Default H264 key frame interval, in frames
+#define SIM_INTRAPERIOD 60
+/// Default H264 quantiser when there is no bitrate
+#define SIM_QP 26
+/// Size of a key frame relative to a P frame
+#define SIM_KEY_FRAME_WEIGHT 4
+
+/* Where the simulated exposure and white balance loops start, and settle */
+#define SIM_AE_START_GAIN 8.0
+#define SIM_AE_TARGET_GAIN 2.0
+#define SIM_AWB_TARGET_RED 1.5
+#define SIM_AWB_TARGET_BLUE 1.4
+
+/* Rough ISP cost per output pixel in nanoseconds, for the stages that can
+ * be switched off. A frame costing more than the frame interval slows
+ * the sensor down, as on the Pi. */
+#define SIM_ISP_NS_PER_PIXEL 4
+#define SIM_ISP_DENOISE_NS_PER_PIXEL 6
+#define SIM_ISP_STILLS_DENOISE_NS_PER_PIXEL 10
+#define SIM_ISP_DRC_NS_PER_PIXEL 3	/* per DRC strength step */
+
+static const uint8_t h264_levels[] = {
+	10, 9, 11, 12, 13, 20, 21, 22, 30, 31, 32, 40, 41, 42, 50, 51
+};
+
+/* 2^(n/6) * 1000, the change in size for a QP step */
+static const uint32_t qp_scale[] = { 1000, 1122, 1260, 1414, 1587, 1782 };
+
+static void emit_frame(MMAL_PORT_T * port, const SIM_FRAME * frame);
+
+/* Store a parameter as if the firmware had set it */
+static void set_default(MMAL_PORT_T * port, const void *param)
+{
+	sim_param_store(port, (const MMAL_PARAMETER_HEADER_T *)param);
+}
+
+/**
+ * Give a new camera the settings the firmware starts with, so clients
+ * reading them back before setting them get sensible values
+ *
+ * @param camera Camera component
+ */
+void sim_camera_init(MMAL_COMPONENT_T * camera)
+{
+	MMAL_PORT_T *control = camera->control;
+	MMAL_PARAMETER_RATIONAL_T zero = { {MMAL_PARAMETER_SATURATION, sizeof(zero)}, {0, 100} };
+	MMAL_PARAMETER_RATIONAL_T brightness = { {MMAL_PARAMETER_BRIGHTNESS, sizeof(brightness)},
+	{50, 100}
+	};
+	MMAL_PARAMETER_UINT32_T iso = { {MMAL_PARAMETER_ISO, sizeof(iso)}, 0 };
+	MMAL_PARAMETER_UINT32_T shutter = { {MMAL_PARAMETER_SHUTTER_SPEED, sizeof(shutter)}, 0 };
+	MMAL_PARAMETER_RATIONAL_T gain = { {MMAL_PARAMETER_ANALOG_GAIN, sizeof(gain)}, {0, 65536} };
+	MMAL_PARAMETER_AWB_GAINS_T awb_gains = {
+		{MMAL_PARAMETER_CUSTOM_AWB_GAINS, sizeof(awb_gains)}, {0, 65536}, {0, 65536}
+	};
+	MMAL_PARAMETER_BOOLEAN_T stabilisation = {
+		{MMAL_PARAMETER_VIDEO_STABILISATION, sizeof(stabilisation)}, 0
+	};
+	MMAL_PARAMETER_INT32_T exposure_comp = {
+		{MMAL_PARAMETER_EXPOSURE_COMP, sizeof(exposure_comp)}, 0
+	};
+	MMAL_PARAMETER_EXPOSUREMODE_T exposure_mode = {
+		{MMAL_PARAMETER_EXPOSURE_MODE, sizeof(exposure_mode)}, MMAL_PARAM_EXPOSUREMODE_AUTO
+	};
+	MMAL_PARAMETER_EXPOSUREMETERINGMODE_T metering = {
+		{MMAL_PARAMETER_EXP_METERING_MODE, sizeof(metering)},
+		MMAL_PARAM_EXPOSUREMETERINGMODE_AVERAGE
+	};
+	MMAL_PARAMETER_AWBMODE_T awb = {
+		{MMAL_PARAMETER_AWB_MODE, sizeof(awb)}, MMAL_PARAM_AWBMODE_AUTO
+	};
+	MMAL_PARAMETER_IMAGEFX_T imagefx = {
+		{MMAL_PARAMETER_IMAGE_EFFECT, sizeof(imagefx)}, MMAL_PARAM_IMAGEFX_NONE
+	};
+	MMAL_PARAMETER_COLOURFX_T colourfx = {
+		{MMAL_PARAMETER_COLOUR_EFFECT, sizeof(colourfx)}, 0, 128, 128
+	};
+	MMAL_PARAMETER_FLICKERAVOID_T flicker = {
+		{MMAL_PARAMETER_FLICKER_AVOID, sizeof(flicker)}, MMAL_PARAM_FLICKERAVOID_OFF
+	};
+	MMAL_PARAMETER_BOOLEAN_T denoise = { {MMAL_PARAMETER_VIDEO_DENOISE, sizeof(denoise)}, 1 };
+	MMAL_PARAMETER_DRC_T drc = {
+		{MMAL_PARAMETER_DYNAMIC_RANGE_COMPRESSION, sizeof(drc)},
+		MMAL_PARAMETER_DRC_STRENGTH_OFF
+	};
+	MMAL_PARAMETER_INPUT_CROP_T crop = {
+		{MMAL_PARAMETER_INPUT_CROP, sizeof(crop)}, {0, 0, 65536, 65536}
+	};
+	MMAL_PARAMETER_THUMBNAIL_CONFIG_T thumbnail = {
+		{MMAL_PARAMETER_THUMBNAIL_CONFIGURATION, sizeof(thumbnail)}, 0, 0, 0, 0
+	};
+	unsigned int i;
+
+	camera->priv->stc_base = sim_now();
+	camera->priv->pts_base = -1;
+
+	set_default(control, &zero);
+	zero.hdr.id = MMAL_PARAMETER_SHARPNESS;
+	set_default(control, &zero);
+	zero.hdr.id = MMAL_PARAMETER_CONTRAST;
+	set_default(control, &zero);
+	set_default(control, &brightness);
+	set_default(control, &iso);
+	set_default(control, &shutter);
+	set_default(control, &gain);
+	gain.hdr.id = MMAL_PARAMETER_DIGITAL_GAIN;
+	set_default(control, &gain);
+	set_default(control, &stabilisation);
+	set_default(control, &exposure_comp);
+	set_default(control, &exposure_mode);
+	set_default(control, &metering);
+	set_default(control, &awb);
+	set_default(control, &awb_gains);
+	set_default(control, &imagefx);
+	set_default(control, &colourfx);
+	set_default(control, &flicker);
+	set_default(control, &denoise);
+	denoise.hdr.id = MMAL_PARAMETER_STILLS_DENOISE;
+	set_default(control, &denoise);
+	set_default(control, &drc);
+	set_default(control, &crop);
+	set_default(control, &thumbnail);
+
+	for (i = 0; i < camera->output_num; i++) {
+		MMAL_PARAMETER_INT32_T rotation = { {MMAL_PARAMETER_ROTATION, sizeof(rotation)}, 0 };
+		MMAL_PARAMETER_MIRROR_T mirror = {
+			{MMAL_PARAMETER_MIRROR, sizeof(mirror)}, MMAL_PARAM_MIRROR_NONE
+		};
+
+		set_default(camera->output[i], &rotation);
+		set_default(camera->output[i], &mirror);
+	}
+}
+
+/**
+ * The camera's STC, the clock frame timestamps are on
+ *
+ * @param camera Camera component
+ * @return Microseconds
+ */
+int64_t sim_camera_stc(MMAL_COMPONENT_T * camera)
+{
+	return sim_now() - camera->priv->stc_base;
+}
+
+/**
+ * Start an encoder output port's bitstream afresh, as when it's enabled
+ *
+ * @param port Any port; only encoder outputs are affected
+ */
+void sim_encoder_reset(MMAL_PORT_T * port)
+{
+	SIM_ENCODER *encoder = &port->priv->encoder;
+
+	encoder->frames = 0;
+	encoder->since_key = 0;
+	encoder->headers_sent = 0;
+	encoder->force_key = 1;
+	encoder->next_au = 0;
+	encoder->random = sim_config()->seed * 2654435761u + port->component->id;
+}
+
+/* Start exposure and white balance from scratch */
+static void reset_control_loops(MMAL_COMPONENT_T * camera)
+{
+	camera->priv->ae_gain = SIM_AE_START_GAIN;
+	camera->priv->awb_red = camera->priv->awb_blue = 1.0;
+}
+
+/**
+ * Act on a parameter before it's stored. Called with sim_lock held.
+ *
+ * @param port Port the parameter is set on
+ * @param param The parameter
+ * @return MMAL_SUCCESS, or why the parameter was refused
+ */
+MMAL_STATUS_T sim_parameter_hook(MMAL_PORT_T * port, const MMAL_PARAMETER_HEADER_T * param)
+{
+	MMAL_COMPONENT_T *component = port->component;
+
+	switch (param->id) {
+	case MMAL_PARAMETER_CAMERA_NUM:
+		if (component->priv->type != SIM_CAMERA
+		    || param->size < sizeof(MMAL_PARAMETER_INT32_T))
+			return MMAL_EINVAL;
+		if (((const MMAL_PARAMETER_INT32_T *)param)->value < 0
+		    || ((const MMAL_PARAMETER_INT32_T *)param)->value >= (int32_t) sim_config()->cameras)
+			return MMAL_EINVAL;
+		break;
+
+	case MMAL_PARAMETER_CAPTURE:
+		if (component->priv->type != SIM_CAMERA || port->type != MMAL_PORT_TYPE_OUTPUT
+		    || param->size < sizeof(MMAL_PARAMETER_BOOLEAN_T))
+			return MMAL_EINVAL;
+		/* The control loops run with the sensor whether or not video is
+		 * captured, see sim_camera_start() */
+		port->priv->capture = ((const MMAL_PARAMETER_BOOLEAN_T *)param)->enable;
+		break;
+
+	case MMAL_PARAMETER_CHANGE_EVENT_REQUEST:{
+			const MMAL_PARAMETER_CHANGE_EVENT_REQUEST_T *request =
+			    (const MMAL_PARAMETER_CHANGE_EVENT_REQUEST_T *)param;
+
+			if (param->size < sizeof(*request))
+				return MMAL_EINVAL;
+			if (component->priv->type == SIM_CAMERA
+			    && request->change_id == MMAL_PARAMETER_CAMERA_SETTINGS)
+				component->priv->settings_events = request->enable;
+			break;
+		}
+
+	case MMAL_PARAMETER_VIDEO_REQUEST_I_FRAME:
+		if (component->priv->type != SIM_VIDEO_ENCODER)
+			return MMAL_ENOSYS;
+		if (param->size >= sizeof(MMAL_PARAMETER_BOOLEAN_T)
+		    && ((const MMAL_PARAMETER_BOOLEAN_T *)param)->enable)
+			port->priv->encoder.force_key = 1;
+		break;
+
+	case MMAL_PARAMETER_EXIF:{
+			const MMAL_PARAMETER_EXIF_T *exif = (const MMAL_PARAMETER_EXIF_T *)param;
+			size_t length;
+
+			if (component->priv->type != SIM_IMAGE_ENCODER
+			    || param->size <= offsetof(MMAL_PARAMETER_EXIF_T, data))
+				return MMAL_EINVAL;
+			length = strnlen((const char *)exif->data,
+					 param->size - offsetof(MMAL_PARAMETER_EXIF_T, data));
+			if (!sim_bytes_append(&port->priv->exif, exif->data, length)
+			    || !sim_bytes_append(&port->priv->exif, "", 1))
+				return MMAL_ENOMEM;
+			break;
+		}
+
+	default:
+		break;
+	}
+
+	return MMAL_SUCCESS;
+}
+
+/* Frames per second of a frame, 30 when the rate is variable */
+static double frame_rate(const SIM_FRAME * frame)
+{
+	if (frame->frame_rate.num <= 0 || frame->frame_rate.den <= 0)
+		return 30.0;
+
+	return (double)frame->frame_rate.num / frame->frame_rate.den;
+}
+
+/* Apply the configured +/- jitter to a size */
+static size_t jitter(size_t size, uint32_t * random)
+{
+	unsigned int range = sim_config()->jitter;
+
+	if (range == 0)
+		return size;
+
+	return size * (100 - range + sim_random(random) % (2 * range + 1)) / 100;
+}
+
+/* Fill client buffers with a payload, fragmenting it as needed. Returns 0
+ * if the client didn't send enough buffers in time or the port went away. */
+static int emit_payload(MMAL_PORT_T * port, const uint8_t * data, size_t size, uint32_t flags,
+			int64_t pts, unsigned int timeout_ms)
+{
+	size_t done = 0;
+
+	do {
+		MMAL_BUFFER_HEADER_T *buffer;
+		size_t chunk;
+
+		if (!port->is_enabled || __atomic_load_n(&port->priv->disabling, __ATOMIC_ACQUIRE))
+			return 0;
+
+		buffer = sim_port_take_buffer(port, timeout_ms);
+		if (buffer == NULL)
+			return 0;
+		if (buffer->alloc_size == 0 || buffer->data == NULL) {
+			mmal_buffer_header_release(buffer);
+			return 0;
+		}
+
+		chunk = size - done;
+		if (chunk > buffer->alloc_size)
+			chunk = buffer->alloc_size;
+		memcpy(buffer->data, data + done, chunk);
+		done += chunk;
+
+		buffer->offset = 0;
+		buffer->length = chunk;
+		buffer->flags = done == size ? flags : flags & ~MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+		buffer->pts = buffer->dts = pts;
+		sim_port_deliver(port, buffer);
+	} while (done < size);
+
+	return 1;
+}
+
+/* Hand a raw frame to a port with a client callback. Raw consumers don't
+ * hold the sensor up, so frames are dropped rather than waited for. */
+static void emit_raw(MMAL_PORT_T * port, const SIM_FRAME * frame)
+{
+	MMAL_BUFFER_HEADER_T *buffer = sim_port_take_buffer(port, 0);
+	uint32_t size = sim_raw_frame_size(port->format);
+	uint32_t stride, rows, y;
+
+	if (buffer == NULL)
+		return;
+
+	if (size == 0) {
+		/* Opaque: the payload is a handle the client can't look into */
+		size = buffer->alloc_size < 128 ? buffer->alloc_size : 128;
+		memset(buffer->data, 0, size);
+	} else {
+		if (size > buffer->alloc_size)
+			size = buffer->alloc_size;
+
+		/* Rows of the first plane move with the sequence, the rest is grey */
+		stride = mmal_encoding_width_to_stride(port->format->encoding,
+						       VCOS_ALIGN_UP(frame->width, 32));
+		rows = VCOS_ALIGN_UP(frame->height, 16);
+		memset(buffer->data, 128, size);
+		for (y = 0; y < rows && (y + 1) * stride <= size; y++)
+			memset(buffer->data + y * stride, (y + frame->sequence) & 0xff, stride);
+	}
+
+	buffer->offset = 0;
+	buffer->length = size;
+	buffer->flags = MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+	buffer->pts = buffer->dts = frame->pts;
+	sim_port_deliver(port, buffer);
+}
+
+/* Average size of an encoded frame, from the bitrate or failing that the QP */
+static size_t average_frame_size(MMAL_PORT_T * port, const SIM_FRAME * frame)
+{
+	uint32_t bitrate = sim_param_uint32(port, MMAL_PARAMETER_VIDEO_BIT_RATE,
+					    port->format->bitrate);
+	int qp = (int)sim_param_uint32(port, MMAL_PARAMETER_VIDEO_ENCODE_INITIAL_QUANT, SIM_QP);
+	uint64_t size;
+	int steps;
+
+	if (bitrate)
+		return (size_t) (bitrate / 8 / frame_rate(frame));
+
+	/* About 0.1 bits per pixel at QP 26, doubling every 6 steps down */
+	if (qp <= 0 || qp > 51)
+		qp = SIM_QP;
+	size = (uint64_t) frame->crop_width * frame->crop_height / 80;
+	steps = SIM_QP - qp;
+	if (steps >= 0)
+		size = (size << (steps / 6)) * qp_scale[steps % 6] / 1000;
+	else
+		size = (size >> (-steps / 6)) * 1000 / qp_scale[-steps % 6];
+
+	return (size_t) size;
+}
+
+/* Size of the next H264 frame, so a GOP averages out at the bitrate */
+static size_t h264_frame_size(MMAL_PORT_T * port, const SIM_FRAME * frame, int key,
+			      uint32_t intraperiod)
+{
+	SIM_ENCODER *encoder = &port->priv->encoder;
+	uint64_t gop = intraperiod ? intraperiod : SIM_INTRAPERIOD;
+	uint64_t p_size = average_frame_size(port, frame) * gop / (gop + SIM_KEY_FRAME_WEIGHT - 1);
+	size_t size = jitter(key ? p_size * SIM_KEY_FRAME_WEIGHT : p_size, &encoder->random);
+
+	return size < 64 ? 64 : size;
+}
+
+/* Stream parameters of an H264 encoder output port */
+static void h264_params(MMAL_PORT_T * port, const SIM_FRAME * frame, SIM_H264_PARAMS * params)
+{
+	SIM_PARAM *stored = sim_param_find(port, MMAL_PARAMETER_PROFILE);
+	MMAL_VIDEO_PROFILE_T profile = MMAL_VIDEO_PROFILE_H264_HIGH;
+	MMAL_VIDEO_LEVEL_T level = MMAL_VIDEO_LEVEL_H264_4;
+
+	if (stored && stored->value->size >= sizeof(MMAL_PARAMETER_VIDEO_PROFILE_T)) {
+		profile = ((MMAL_PARAMETER_VIDEO_PROFILE_T *) stored->value)->profile[0].profile;
+		level = ((MMAL_PARAMETER_VIDEO_PROFILE_T *) stored->value)->profile[0].level;
+	}
+
+	params->width = frame->crop_width;
+	params->height = frame->crop_height;
+	params->constraints = 0;
+	switch (profile) {
+	case MMAL_VIDEO_PROFILE_H264_CONSTRAINED_BASELINE:
+		params->constraints = 0x40;
+		/* fall through */
+	case MMAL_VIDEO_PROFILE_H264_BASELINE:
+		params->profile_idc = 66;
+		break;
+	case MMAL_VIDEO_PROFILE_H264_MAIN:
+		params->profile_idc = 77;
+		break;
+	default:
+		params->profile_idc = 100;
+		break;
+	}
+
+	if (level >= MMAL_VIDEO_LEVEL_H264_1 && level <= MMAL_VIDEO_LEVEL_H264_51)
+		params->level_idc = h264_levels[level - MMAL_VIDEO_LEVEL_H264_1];
+	else
+		params->level_idc = 40;
+
+	params->qp = (int)sim_param_uint32(port, MMAL_PARAMETER_VIDEO_ENCODE_INITIAL_QUANT, SIM_QP);
+	if (params->qp <= 0 || params->qp > 51)
+		params->qp = SIM_QP;
+}
+
+/* Pick the next AU of the loaded stream, skipping to an IDR if one is due */
+static const SIM_AU *next_loaded_au(SIM_ENCODER * encoder, const SIM_STREAM * stream)
+{
+	const SIM_AU *au;
+	unsigned int i;
+
+	if (encoder->force_key)
+		for (i = 0; i < stream->n_aus; i++) {
+			if (stream->aus[(encoder->next_au + i) % stream->n_aus].key) {
+				encoder->next_au = (encoder->next_au + i) % stream->n_aus;
+				break;
+			}
+		}
+
+	au = &stream->aus[encoder->next_au];
+	encoder->next_au = (encoder->next_au + 1) % stream->n_aus;
+
+	return au;
+}
+
+/* Encode a frame on an H264 or MJPEG encoder output port */
+static void encode_video(MMAL_PORT_T * port, const SIM_FRAME * frame)
+{
+	const SIM_CONFIG *config = sim_config();
+	SIM_ENCODER *encoder = &port->priv->encoder;
+	uint32_t intraperiod = sim_param_uint32(port, MMAL_PARAMETER_INTRAPERIOD, SIM_INTRAPERIOD);
+	int inline_headers = sim_param_uint32(port, MMAL_PARAMETER_VIDEO_ENCODE_INLINE_HEADER, 0);
+	int vectors = sim_param_uint32(port, MMAL_PARAMETER_VIDEO_ENCODE_INLINE_VECTORS, 0);
+	uint32_t flags = MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+	SIM_H264_PARAMS params;
+	const uint8_t *data;
+	size_t size;
+	int key;
+
+	if (port->format->encoding == MMAL_ENCODING_MJPEG) {
+		size = jitter(average_frame_size(port, frame), &encoder->random);
+		encoder->scratch.size = 0;
+		if (!sim_jpeg(&encoder->scratch, frame->crop_width, frame->crop_height, size, NULL))
+			return;
+		emit_payload(port, encoder->scratch.data, encoder->scratch.size,
+			     flags | MMAL_BUFFER_HEADER_FLAG_KEYFRAME, frame->pts, SIM_BUFFER_TIMEOUT_MS);
+		encoder->frames++;
+		return;
+	}
+
+	if (config->h264.n_aus) {
+		const SIM_AU *au = next_loaded_au(encoder, &config->h264);
+
+		key = au->key;
+		data = config->h264.data.data + au->offset;
+		size = au->size;
+		if ((!encoder->headers_sent || (key && inline_headers)) && config->h264.headers.size) {
+			if (!emit_payload(port, config->h264.headers.data, config->h264.headers.size,
+					  MMAL_BUFFER_HEADER_FLAG_CONFIG | flags, frame->pts,
+					  SIM_BUFFER_TIMEOUT_MS))
+				return;
+			encoder->headers_sent = 1;
+		}
+	} else {
+		key = encoder->force_key || (intraperiod && encoder->since_key >= intraperiod);
+		h264_params(port, frame, &params);
+		if (!encoder->headers_sent || (key && inline_headers)) {
+			encoder->scratch.size = 0;
+			if (!sim_h264_headers(&encoder->scratch, &params)
+			    || !emit_payload(port, encoder->scratch.data, encoder->scratch.size,
+					     MMAL_BUFFER_HEADER_FLAG_CONFIG | flags, frame->pts,
+					     SIM_BUFFER_TIMEOUT_MS))
+				return;
+			encoder->headers_sent = 1;
+		}
+
+		encoder->scratch.size = 0;
+		if (!sim_h264_slice(&encoder->scratch, &params, key, key ? 0 : encoder->since_key,
+				    encoder->idr_id, h264_frame_size(port, frame, key, intraperiod),
+				    &encoder->random))
+			return;
+		data = encoder->scratch.data;
+		size = encoder->scratch.size;
+	}
+
+	if (key)
+		flags |= MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+	if (!emit_payload(port, data, size, flags, frame->pts, SIM_BUFFER_TIMEOUT_MS))
+		return;
+
+	encoder->frames++;
+	encoder->force_key = 0;
+	if (key) {
+		encoder->since_key = 1;
+		encoder->idr_id++;
+	} else {
+		encoder->since_key++;
+	}
+
+	if (vectors) {
+		encoder->scratch.size = 0;
+		if (sim_motion_vectors(&encoder->scratch, frame->crop_width, frame->crop_height,
+				       &encoder->random))
+			emit_payload(port, encoder->scratch.data, encoder->scratch.size,
+				     MMAL_BUFFER_HEADER_FLAG_CODECSIDEINFO |
+				     MMAL_BUFFER_HEADER_FLAG_FRAME_END, frame->pts,
+				     SIM_BUFFER_TIMEOUT_MS);
+	}
+}
+
+/* Encode a frame on a JPEG encoder output port */
+static void encode_still(MMAL_PORT_T * port, const SIM_FRAME * frame)
+{
+	const SIM_CONFIG *config = sim_config();
+	SIM_ENCODER *encoder = &port->priv->encoder;
+	uint32_t quality = sim_param_uint32(port, MMAL_PARAMETER_JPEG_Q_FACTOR, 85);
+	const SIM_BYTES *jpeg = &encoder->scratch;
+
+	if (config->jpeg.size) {
+		jpeg = &config->jpeg;
+	} else {
+		encoder->scratch.size = 0;
+		if (!sim_jpeg(&encoder->scratch, frame->crop_width, frame->crop_height,
+			      jitter((size_t) frame->crop_width * frame->crop_height * quality / 200,
+				     &encoder->random), &port->priv->exif))
+			return;
+	}
+
+	emit_payload(port, jpeg->data, jpeg->size, MMAL_BUFFER_HEADER_FLAG_FRAME_END, frame->pts,
+		     SIM_STILL_TIMEOUT_MS);
+
+	/* EXIF tags apply to one still */
+	port->priv->exif.size = 0;
+	encoder->frames++;
+}
+
+/* A frame arriving on a component's input port through a connection */
+static void component_input(MMAL_COMPONENT_T * component, const SIM_FRAME * frame)
+{
+	unsigned int i;
+
+	switch (component->priv->type) {
+	case SIM_SPLITTER:
+	case SIM_RESIZER:
+		for (i = 0; i < component->output_num; i++)
+			emit_frame(component->output[i], frame);
+		break;
+	case SIM_VIDEO_ENCODER:
+		if (component->output[0]->is_enabled && !component->output[0]->priv->connection)
+			encode_video(component->output[0], frame);
+		break;
+	case SIM_IMAGE_ENCODER:
+		if (component->output[0]->is_enabled && !component->output[0]->priv->connection)
+			encode_still(component->output[0], frame);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Send a frame out of an output port, at the port's size */
+static void emit_frame(MMAL_PORT_T * port, const SIM_FRAME * in)
+{
+	MMAL_CONNECTION_T *connection = port->priv->connection;
+	MMAL_VIDEO_FORMAT_T *video = &port->format->es->video;
+	SIM_FRAME frame = *in;
+
+	if (!port->is_enabled)
+		return;
+
+	frame.width = video->width;
+	frame.height = video->height;
+	frame.crop_width = video->crop.width ? (uint32_t) video->crop.width : video->width;
+	frame.crop_height = video->crop.height ? (uint32_t) video->crop.height : video->height;
+
+	if (connection) {
+		if (connection->is_enabled && connection->in && connection->in->is_enabled)
+			component_input(connection->in->component, &frame);
+	} else if (port->priv->callback) {
+		emit_raw(port, &frame);
+	}
+}
+
+/* A gain stored on the control port, 0 if unset */
+static double stored_gain(MMAL_PORT_T * port, uint32_t id)
+{
+	SIM_PARAM *param = sim_param_find(port, id);
+	MMAL_RATIONAL_T gain;
+
+	if (param == NULL || param->value->size < sizeof(MMAL_PARAMETER_RATIONAL_T))
+		return 0.0;
+
+	gain = ((MMAL_PARAMETER_RATIONAL_T *) param->value)->value;
+	return gain.den ? (double)gain.num / gain.den : 0.0;
+}
+
+/* Store a gain in a camera settings report, as a 1/256 fraction */
+static MMAL_RATIONAL_T settings_gain(double gain)
+{
+	MMAL_RATIONAL_T rational = { (int32_t) (gain * 256 + 0.5), 256 };
+
+	return rational;
+}
+
+/* Move the exposure and white balance loops on by a frame, and report
+ * where they are. Like the firmware's, they start well off and close a
+ * quarter of the remaining gap each frame, settling within 20 or so.
+ * Exposure mode off holds the gain where it is, manual values win. */
+static void camera_settings(MMAL_COMPONENT_T * camera, const SIM_FRAME * frame,
+			    MMAL_PARAMETER_CAMERA_SETTINGS_T * settings)
+{
+	struct MMAL_COMPONENT_PRIVATE_T *priv = camera->priv;
+	MMAL_PORT_T *control = camera->control;
+	uint32_t shutter = sim_param_uint32(control, MMAL_PARAMETER_SHUTTER_SPEED, 0);
+	uint32_t iso = sim_param_uint32(control, MMAL_PARAMETER_ISO, 0);
+	uint32_t period = (uint32_t) (1000000 / frame_rate(frame));
+	double analog = stored_gain(control, MMAL_PARAMETER_ANALOG_GAIN);
+	double digital = stored_gain(control, MMAL_PARAMETER_DIGITAL_GAIN);
+	SIM_PARAM *awb_gains = sim_param_find(control, MMAL_PARAMETER_CUSTOM_AWB_GAINS);
+
+	if (sim_param_uint32(control, MMAL_PARAMETER_EXPOSURE_MODE, MMAL_PARAM_EXPOSUREMODE_AUTO)
+	    != MMAL_PARAM_EXPOSUREMODE_OFF)
+		priv->ae_gain += (SIM_AE_TARGET_GAIN - priv->ae_gain) / 4;
+	if (sim_param_uint32(control, MMAL_PARAMETER_AWB_MODE, MMAL_PARAM_AWBMODE_AUTO)
+	    == MMAL_PARAM_AWBMODE_OFF && awb_gains
+	    && awb_gains->value->size >= sizeof(MMAL_PARAMETER_AWB_GAINS_T)) {
+		MMAL_PARAMETER_AWB_GAINS_T *gains = (MMAL_PARAMETER_AWB_GAINS_T *) awb_gains->value;
+
+		if (gains->r_gain.den && gains->b_gain.den) {
+			priv->awb_red = (double)gains->r_gain.num / gains->r_gain.den;
+			priv->awb_blue = (double)gains->b_gain.num / gains->b_gain.den;
+		}
+	} else {
+		priv->awb_red += (SIM_AWB_TARGET_RED - priv->awb_red) / 4;
+		priv->awb_blue += (SIM_AWB_TARGET_BLUE - priv->awb_blue) / 4;
+	}
+
+	if (analog <= 0.0)
+		analog = iso ? iso / 100.0 : priv->ae_gain;
+	if (digital <= 0.0)
+		digital = 1.0;
+
+	memset(settings, 0, sizeof(*settings));
+	settings->hdr.id = MMAL_PARAMETER_CAMERA_SETTINGS;
+	settings->hdr.size = sizeof(*settings);
+	settings->exposure = shutter ? (shutter < period ? shutter : period) : period * 3 / 4;
+	settings->analog_gain = settings_gain(analog);
+	settings->digital_gain = settings_gain(digital);
+	settings->awb_red_gain = settings_gain(priv->awb_red);
+	settings->awb_blue_gain = settings_gain(priv->awb_blue);
+	settings->focus_position = 0;
+}
+
+/* How long the ISP takes over the next frame, in microseconds. A pending
+ * still is processed at the capture port's size. Called with sim_lock held. */
+static int64_t isp_time(MMAL_COMPONENT_T * camera)
+{
+	MMAL_PORT_T *control = camera->control;
+	MMAL_PORT_T *port = camera->output[CAMERA_VIDEO_PORT];
+	uint32_t drc = sim_param_uint32(control, MMAL_PARAMETER_DYNAMIC_RANGE_COMPRESSION,
+					MMAL_PARAMETER_DRC_STRENGTH_OFF);
+	int64_t ns = SIM_ISP_NS_PER_PIXEL;
+
+	if (camera->output[CAMERA_CAPTURE_PORT]->is_enabled
+	    && camera->output[CAMERA_CAPTURE_PORT]->priv->capture) {
+		port = camera->output[CAMERA_CAPTURE_PORT];
+		if (sim_param_uint32(control, MMAL_PARAMETER_STILLS_DENOISE, 1))
+			ns += SIM_ISP_STILLS_DENOISE_NS_PER_PIXEL;
+	} else if (sim_param_uint32(control, MMAL_PARAMETER_VIDEO_DENOISE, 1)) {
+		ns += SIM_ISP_DENOISE_NS_PER_PIXEL;
+	}
+	if (drc <= MMAL_PARAMETER_DRC_STRENGTH_HIGH)
+		ns += SIM_ISP_DRC_NS_PER_PIXEL * drc;
+
+	return (int64_t) port->format->es->video.width * port->format->es->video.height * ns / 1000;
+}
+
+/* One sensor frame, coming out busy microseconds after it was exposed.
+ * Called with sim_lock held. */
+static void camera_tick(MMAL_COMPONENT_T * camera, int64_t busy)
+{
+	struct MMAL_COMPONENT_PRIVATE_T *priv = camera->priv;
+	MMAL_PORT_T *video_port = camera->output[CAMERA_VIDEO_PORT];
+	SIM_PARAM *config = sim_param_find(camera->control, MMAL_PARAMETER_CAMERA_CONFIG);
+	SIM_FRAME frame;
+	unsigned int i;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.sequence = priv->sequence++;
+	frame.pts = sim_camera_stc(camera) - sim_config()->latency - busy;
+	frame.frame_rate = video_port->format->es->video.frame_rate;
+	if (config && config->value->size >= sizeof(MMAL_PARAMETER_CAMERA_CONFIG_T)) {
+		switch (((MMAL_PARAMETER_CAMERA_CONFIG_T *) config->value)->use_stc_timestamp) {
+		case MMAL_PARAM_TIMESTAMP_MODE_ZERO:
+			frame.pts = 0;
+			break;
+		case MMAL_PARAM_TIMESTAMP_MODE_RESET_STC:
+			/* Counted from the first frame, unlike MMAL_PARAMETER_SYSTEM_TIME */
+			if (priv->pts_base < 0)
+				priv->pts_base = frame.pts;
+			frame.pts -= priv->pts_base;
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* The firmware reports a frame's settings before the frame comes out */
+	if (priv->settings_events && camera->control->is_enabled) {
+		MMAL_PARAMETER_CAMERA_SETTINGS_T settings;
+
+		camera_settings(camera, &frame, &settings);
+		if (sim_port_event(camera->control, MMAL_EVENT_PARAMETER_CHANGED, &settings,
+				   sizeof(settings)) != MMAL_SUCCESS)
+			vcos_log_warn("%s: no event buffer for the camera settings",
+				      camera->name);
+	}
+
+	for (i = 0; i < camera->output_num; i++) {
+		MMAL_PORT_T *port = camera->output[i];
+
+		if (!port->is_enabled)
+			continue;
+		if (i == CAMERA_VIDEO_PORT && !port->priv->capture)
+			continue;
+		if (i == CAMERA_CAPTURE_PORT) {
+			if (!port->priv->capture)
+				continue;
+			port->priv->capture = 0;
+		}
+
+		emit_frame(port, &frame);
+	}
+}
+
+/* Frame interval of the camera in microseconds */
+static int64_t camera_interval(MMAL_COMPONENT_T * camera)
+{
+	SIM_FRAME frame;
+
+	frame.frame_rate = camera->output[CAMERA_VIDEO_PORT]->format->es->video.frame_rate;
+	return (int64_t) (1000000 / frame_rate(&frame));
+}
+
+static void *camera_thread(void *arg)
+{
+	MMAL_COMPONENT_T *camera = arg;
+	struct MMAL_COMPONENT_PRIVATE_T *priv = camera->priv;
+	int64_t next = sim_now();
+	int64_t interval, busy, now;
+	struct timespec ts;
+
+	for (;;) {
+		pthread_mutex_lock(&sim_lock);
+		if (!priv->running) {
+			pthread_mutex_unlock(&sim_lock);
+			break;
+		}
+		interval = camera_interval(camera);
+		busy = isp_time(camera);
+		pthread_mutex_unlock(&sim_lock);
+
+		/* The frame comes out once the ISP is done with it */
+		ts.tv_sec = (next + busy) / 1000000;
+		ts.tv_nsec = ((next + busy) % 1000000) * 1000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) ;
+
+		pthread_mutex_lock(&sim_lock);
+		if (priv->running)
+			camera_tick(camera, busy);
+		pthread_mutex_unlock(&sim_lock);
+
+		/* A stalled graph makes the sensor skip frames, not queue them,
+		 * and so does an ISP that can't keep up */
+		next += busy > interval ? busy : interval;
+		now = sim_now();
+		if (now > next) {
+			int64_t missed = (now - next) / interval + 1;
+
+			priv->dropped += missed;
+			priv->sequence += missed;
+			next += missed * interval;
+		}
+
+		ts.tv_sec = next / 1000000;
+		ts.tv_nsec = (next % 1000000) * 1000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) ;
+	}
+
+	return NULL;
+}
+
+/**
+ * Start the sensor. Called with sim_lock held.
+ *
+ * @param camera Camera component
+ * @return MMAL_SUCCESS, or MMAL_ENOMEM if the thread couldn't be started
+ */
+MMAL_STATUS_T sim_camera_start(MMAL_COMPONENT_T * camera)
+{
+	struct MMAL_COMPONENT_PRIVATE_T *priv = camera->priv;
+
+	if (priv->running)
+		return MMAL_SUCCESS;
+
+	priv->pts_base = -1;
+
+	reset_control_loops(camera);
+
+	priv->running = 1;
+	if (pthread_create(&priv->thread, NULL, camera_thread, camera) != 0) {
+		priv->running = 0;
+		return MMAL_ENOMEM;
+	}
+
+	return MMAL_SUCCESS;
+}
+
+/**
+ * Stop the sensor and wait for its thread. Must not be called with
+ * sim_lock held, the thread needs it to finish its tick.
+ *
+ * @param camera Camera component
+ */
+void sim_camera_stop(MMAL_COMPONENT_T * camera)
+{
+	struct MMAL_COMPONENT_PRIVATE_T *priv = camera->priv;
+	int running;
+
+	pthread_mutex_lock(&sim_lock);
+	running = priv->running;
+	priv->running = 0;
+	pthread_mutex_unlock(&sim_lock);
+
+	if (!running)
+		return;
+
+	/* Stopped from a callback on the camera thread itself */
+	if (pthread_equal(pthread_self(), priv->thread))
+		pthread_detach(priv->thread);
+	else
+		pthread_join(priv->thread, NULL);
+
+	if (priv->dropped)
+		vcos_log_info("%s: sensor skipped %llu frames", camera->name,
+			      (unsigned long long)priv->dropped);
+	priv->dropped = 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_SIM_PRIVATE_H_
+#define MMAL_SIM_PRIVATE_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "interface/mmal/mmal.h"
+#include "interface/mmal/util/mmal_connection.h"
+
+/* Internals shared by the files of the MMAL simulator. Every entry point
+ * that touches the component graph or port parameters takes sim_lock,
+ * which is recursive so port callbacks (run by a camera thread with the
+ * lock held) can call back into MMAL. Buffer queues have their own locks,
+ * so sending and releasing buffers never waits for a camera thread.
+ */
+
+#define SIM_MAX_PORTS 8
+
+/// Time an encoder waits for the client to send it an output buffer
+#define SIM_BUFFER_TIMEOUT_MS 100
+/// Time the JPEG encoder waits, the still path recycles buffers in its callback
+#define SIM_STILL_TIMEOUT_MS 1000
+/// Event buffers of a control port, and the largest event they hold
+#define SIM_EVENT_BUFFERS 4
+#define SIM_EVENT_SIZE 256
+
+typedef enum
+{
+   SIM_CAMERA,
+   SIM_VIDEO_ENCODER,
+   SIM_IMAGE_ENCODER,
+   SIM_SPLITTER,
+   SIM_RESIZER,
+   SIM_SINK
+} SIM_COMPONENT_TYPE;
+
+/// Growable byte array
+typedef struct
+{
+   uint8_t *data;
+   size_t size;
+   size_t alloc;
+} SIM_BYTES;
+
+/// One access unit of a loaded H264 stream
+typedef struct
+{
+   size_t offset;
+   size_t size;
+   int key;
+} SIM_AU;
+
+/// Pre-encoded H264 stream loaded from RPICAM_SIM_H264
+typedef struct
+{
+   SIM_BYTES data;
+   SIM_BYTES headers;                  /// SPS and PPS of the stream
+   SIM_AU *aus;
+   unsigned int n_aus;
+} SIM_STREAM;
+
+/// Simulator settings, read once from the environment
+typedef struct
+{
+   unsigned int cameras;               /// RPICAM_SIM_CAMERAS, sensors that can be selected
+   unsigned int jitter;                /// RPICAM_SIM_JITTER, +/- percent of frame size
+   int64_t latency;                    /// RPICAM_SIM_LATENCY, microseconds from exposure to output
+   uint32_t seed;                      /// RPICAM_SIM_SEED, for repeatable frame sizes
+   unsigned int encoder_buffers;       /// RPICAM_SIM_BUFFERS, recommended encoder output buffers
+   SIM_STREAM h264;                    /// RPICAM_SIM_H264, AUs to send instead of synthetic ones
+   SIM_BYTES jpeg;                     /// RPICAM_SIM_JPEG, image to send for every still
+} SIM_CONFIG;
+
+/// A frame travelling through tunnelled connections. It has no pixels; those
+/// are only made up when a port hands frames to the client
+typedef struct
+{
+   int64_t pts;
+   uint32_t sequence;
+   uint32_t width, height;             /// Size of the buffer, padding included
+   uint32_t crop_width, crop_height;   /// Visible part
+   MMAL_RATIONAL_T frame_rate;
+} SIM_FRAME;
+
+/// Bitstream state of an encoder output port
+typedef struct
+{
+   uint32_t frames;                    /// Frames since the port was enabled
+   uint32_t since_key;                 /// Frames since the last key frame
+   uint32_t idr_id;
+   int headers_sent;
+   int force_key;
+   unsigned int next_au;               /// Next AU of the loaded stream
+   uint32_t random;
+   SIM_BYTES scratch;
+} SIM_ENCODER;
+
+/// A parameter value set on a port, kept so it can be read back
+typedef struct SIM_PARAM
+{
+   struct SIM_PARAM *next;
+   MMAL_PARAMETER_HEADER_T *value;
+} SIM_PARAM;
+
+typedef struct
+{
+   MMAL_ES_FORMAT_T format;
+   MMAL_ES_SPECIFIC_FORMAT_T es;
+} SIM_FORMAT;
+
+struct MMAL_PORT_PRIVATE_T
+{
+   MMAL_PORT_T port;
+   SIM_FORMAT format;
+   char name[48];
+   MMAL_PORT_BH_CB_T callback;
+   MMAL_QUEUE_T *queue;                /// Buffers sent by the client, waiting to be filled
+   MMAL_CONNECTION_T *connection;
+   SIM_PARAM *params;
+   int disabling;                      /// Set while mmal_port_disable() waits for sim_lock
+   int capture;                        /// MMAL_PARAMETER_CAPTURE
+   SIM_BYTES exif;                     /// "key=value" tags for the next still, NUL separated
+   MMAL_POOL_T *events;                /// Event buffers, created by the first event
+   SIM_ENCODER encoder;
+};
+
+struct MMAL_COMPONENT_PRIVATE_T
+{
+   MMAL_COMPONENT_T component;
+   SIM_COMPONENT_TYPE type;
+   int refcount;
+   MMAL_PORT_T *ports[SIM_MAX_PORTS];
+   MMAL_PORT_T *inputs[SIM_MAX_PORTS];
+   MMAL_PORT_T *outputs[SIM_MAX_PORTS];
+
+   /* Camera only */
+   pthread_t thread;
+   int running;
+   int64_t stc_base;                   /// Time the STC counts from, never reset
+   int64_t pts_base;                   /// First frame's STC for RESET_STC mode, -1 until then
+   uint32_t sequence;
+   uint64_t dropped;                   /// Frames the sensor skipped while the graph stalled
+   int settings_events;                /// Send MMAL_PARAMETER_CAMERA_SETTINGS with every frame
+   double ae_gain;                     /// Where the simulated exposure loop has got to
+   double awb_red, awb_blue;           /// Where the simulated white balance loop has got to
+};
+
+extern pthread_mutex_t sim_lock;
+
+const SIM_CONFIG *sim_config(void);
+int64_t sim_now(void);
+
+/* mmal_sim.c */
+SIM_PARAM *sim_param_find(MMAL_PORT_T *port, uint32_t id);
+uint32_t sim_param_uint32(MMAL_PORT_T *port, uint32_t id, uint32_t fallback);
+MMAL_STATUS_T sim_param_store(MMAL_PORT_T *port, const MMAL_PARAMETER_HEADER_T *param);
+MMAL_BUFFER_HEADER_T *sim_port_take_buffer(MMAL_PORT_T *port, unsigned int timeout_ms);
+void sim_port_deliver(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer);
+MMAL_STATUS_T sim_port_event(MMAL_PORT_T *port, uint32_t cmd, const void *data, uint32_t size);
+uint32_t sim_raw_frame_size(const MMAL_ES_FORMAT_T *format);
+
+/* mmal_sim_camera.c */
+void sim_camera_init(MMAL_COMPONENT_T *camera);
+MMAL_STATUS_T sim_camera_start(MMAL_COMPONENT_T *camera);
+void sim_camera_stop(MMAL_COMPONENT_T *camera);
+MMAL_STATUS_T sim_parameter_hook(MMAL_PORT_T *port, const MMAL_PARAMETER_HEADER_T *param);
+int64_t sim_camera_stc(MMAL_COMPONENT_T *camera);
+void sim_encoder_reset(MMAL_PORT_T *port);
+
+/* mmal_sim_stream.c */
+typedef struct
+{
+   uint32_t width, height;             /// Visible size
+   uint8_t profile_idc;
+   uint8_t constraints;
+   uint8_t level_idc;
+   int qp;
+} SIM_H264_PARAMS;
+
+int sim_bytes_reserve(SIM_BYTES *bytes, size_t size);
+int sim_bytes_append(SIM_BYTES *bytes, const void *data, size_t size);
+void sim_bytes_free(SIM_BYTES *bytes);
+int sim_load_file(const char *path, SIM_BYTES *bytes);
+int sim_h264_load(const char *path, SIM_STREAM *stream);
+uint32_t sim_random(uint32_t *state);
+int sim_h264_headers(SIM_BYTES *out, const SIM_H264_PARAMS *params);
+int sim_h264_slice(SIM_BYTES *out, const SIM_H264_PARAMS *params, int key, uint32_t frame_num,
+                   uint32_t idr_id, size_t size, uint32_t *random);
+int sim_jpeg(SIM_BYTES *out, uint32_t width, uint32_t height, size_t size,
+             const SIM_BYTES *comments);
+int sim_motion_vectors(SIM_BYTES *out, uint32_t width, uint32_t height, uint32_t *random);
+
+#endif /* MMAL_SIM_PRIVATE_H_ */
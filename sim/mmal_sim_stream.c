@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* Bitstreams for the simulated encoders. The H264 streams have real
+ * parameter sets and slice headers, so parsers and muxers accept them,
+ * with random bytes for the slice data; the JPEGs are valid grey images
+ * padded out to the requested size. Everything is appended to a SIM_BYTES.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmal_sim_private.h"
+
+/// RBSP being written a bit at a time
+typedef struct
+{
+   SIM_BYTES bytes;
+   uint8_t current;
+   int bits;
+   int ok;
+} BIT_WRITER;
+
+/**
+ * Make room for more bytes at the end of an array
+ *
+ * @param bytes The array
+ * @param size Bytes to make room for
+ * @return 1 on success, 0 if out of memory
+ */
+int sim_bytes_reserve(SIM_BYTES * bytes, size_t size)
+{
+	size_t alloc = bytes->alloc ? bytes->alloc : 4096;
+	uint8_t *data;
+
+	if (bytes->size + size <= bytes->alloc)
+		return 1;
+
+	while (alloc < bytes->size + size)
+		alloc *= 2;
+	data = realloc(bytes->data, alloc);
+	if (data == NULL)
+		return 0;
+
+	bytes->data = data;
+	bytes->alloc = alloc;
+	return 1;
+}
+
+int sim_bytes_append(SIM_BYTES * bytes, const void *data, size_t size)
+{
+	if (!sim_bytes_reserve(bytes, size))
+		return 0;
+
+	memcpy(bytes->data + bytes->size, data, size);
+	bytes->size += size;
+	return 1;
+}
+
+void sim_bytes_free(SIM_BYTES * bytes)
+{
+	free(bytes->data);
+	memset(bytes, 0, sizeof(*bytes));
+}
+
+static int append_byte(SIM_BYTES * bytes, uint8_t byte)
+{
+	return sim_bytes_append(bytes, &byte, 1);
+}
+
+static int append_u16(SIM_BYTES * bytes, unsigned int value)
+{
+	return append_byte(bytes, value >> 8) && append_byte(bytes, value & 0xff);
+}
+
+/**
+ * Read a whole file
+ *
+ * @param path File name
+ * @param bytes Array to append the contents to
+ * @return 1 on success, 0 on failure
+ */
+int sim_load_file(const char *path, SIM_BYTES * bytes)
+{
+	FILE *file = fopen(path, "rb");
+	size_t got;
+	int ok = 1;
+
+	if (file == NULL)
+		return 0;
+
+	do {
+		if (!sim_bytes_reserve(bytes, 65536)) {
+			ok = 0;
+			break;
+		}
+		got = fread(bytes->data + bytes->size, 1, 65536, file);
+		bytes->size += got;
+	} while (got == 65536);
+
+	if (ferror(file))
+		ok = 0;
+	fclose(file);
+
+	return ok && bytes->size > 0;
+}
+
+/* Offset of the next start code at or after pos, or size if none */
+static size_t find_start_code(const uint8_t * data, size_t size, size_t pos)
+{
+	for (; pos + 3 <= size; pos++)
+		if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1)
+			return pos > 0 && data[pos - 1] == 0 ? pos - 1 : pos;
+
+	return size;
+}
+
+/**
+ * Load an Annex B H264 stream and split it into access units
+ *
+ * @param path File name
+ * @param stream Stream to fill in
+ * @return 1 on success, 0 if the file couldn't be read or has no slices
+ */
+int sim_h264_load(const char *path, SIM_STREAM * stream)
+{
+	const uint8_t *data;
+	size_t size, pos, au_start = 0, next;
+	int au_slices = 0, au_key = 0, have_headers = 0;
+	unsigned int alloc = 0;
+
+	if (!sim_load_file(path, &stream->data))
+		return 0;
+
+	data = stream->data.data;
+	size = stream->data.size;
+	pos = find_start_code(data, size, 0);
+	au_start = pos;
+
+	while (pos < size) {
+		size_t payload = pos + (data[pos + 2] == 1 ? 3 : 4);
+		int type, boundary;
+
+		next = find_start_code(data, size, payload);
+		if (payload >= next) {
+			pos = next;
+			continue;
+		}
+		type = data[payload] & 0x1f;
+
+		/* Non-VCL units after a slice and slices with first_mb_in_slice 0
+		 * start a new AU */
+		boundary = au_slices && (type == 6 || type == 7 || type == 8 || type == 9
+					 || ((type == 1 || type == 5) && payload + 1 < next
+					     && (data[payload + 1] & 0x80)));
+		if (boundary) {
+			if (!have_headers)
+				have_headers = 1;
+			if (stream->n_aus == alloc) {
+				SIM_AU *aus = realloc(stream->aus, (alloc ? alloc * 2 : 256) * sizeof(*aus));
+
+				if (aus == NULL)
+					return 0;
+				stream->aus = aus;
+				alloc = alloc ? alloc * 2 : 256;
+			}
+			stream->aus[stream->n_aus].offset = au_start;
+			stream->aus[stream->n_aus].size = pos - au_start;
+			stream->aus[stream->n_aus].key = au_key;
+			stream->n_aus++;
+			au_start = pos;
+			au_slices = au_key = 0;
+		}
+
+		if (type == 1 || type == 5)
+			au_slices++;
+		if (type == 5)
+			au_key = 1;
+		/* The first parameter sets go out as the CONFIG buffer */
+		if ((type == 7 || type == 8) && !have_headers)
+			if (!sim_bytes_append(&stream->headers, data + pos, next - pos))
+				return 0;
+
+		pos = next;
+	}
+
+	if (au_slices) {
+		SIM_AU *aus = realloc(stream->aus, (stream->n_aus + 1) * sizeof(*aus));
+
+		if (aus == NULL)
+			return 0;
+		stream->aus = aus;
+		stream->aus[stream->n_aus].offset = au_start;
+		stream->aus[stream->n_aus].size = size - au_start;
+		stream->aus[stream->n_aus].key = au_key;
+		stream->n_aus++;
+	}
+
+	return stream->n_aus > 0;
+}
+
+/**
+ * xorshift32
+ *
+ * @param state Generator state, updated
+ * @return Next value
+ */
+uint32_t sim_random(uint32_t * state)
+{
+	uint32_t x = *state ? *state : 0x9e3779b9;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+static void put_bits(BIT_WRITER * w, uint32_t value, int count)
+{
+	while (count-- > 0) {
+		w->current = (w->current << 1) | ((value >> count) & 1);
+		if (++w->bits == 8) {
+			w->ok &= append_byte(&w->bytes, w->current);
+			w->current = 0;
+			w->bits = 0;
+		}
+	}
+}
+
+static void put_ue(BIT_WRITER * w, uint32_t value)
+{
+	uint32_t coded = value + 1;
+	int length = 0;
+
+	while (coded >> length)
+		length++;
+	put_bits(w, 0, length - 1);
+	put_bits(w, coded, length);
+}
+
+static void put_se(BIT_WRITER * w, int32_t value)
+{
+	put_ue(w, value > 0 ? 2 * (uint32_t) value - 1 : (uint32_t) (-2 * value));
+}
+
+static void put_trailing_bits(BIT_WRITER * w)
+{
+	put_bits(w, 1, 1);
+	while (w->bits)
+		put_bits(w, 0, 1);
+}
+
+/* Append a NAL unit with a start code, escaping its RBSP */
+static int write_nal(SIM_BYTES * out, uint8_t header, const BIT_WRITER * w)
+{
+	static const uint8_t start_code[] = { 0, 0, 0, 1 };
+	unsigned int zeros = 0;
+	size_t i;
+
+	if (!w->ok || !sim_bytes_reserve(out, w->bytes.size + w->bytes.size / 2 + 5))
+		return 0;
+
+	sim_bytes_append(out, start_code, sizeof(start_code));
+	append_byte(out, header);
+	for (i = 0; i < w->bytes.size; i++) {
+		uint8_t byte = w->bytes.data[i];
+
+		if (zeros >= 2 && byte <= 3) {
+			out->data[out->size++] = 3;
+			zeros = 0;
+		}
+		out->data[out->size++] = byte;
+		zeros = byte == 0 ? zeros + 1 : 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Append an SPS and a PPS for a stream
+ *
+ * @param out Array to append to
+ * @param params Stream parameters
+ * @return 1 on success, 0 if out of memory
+ */
+int sim_h264_headers(SIM_BYTES * out, const SIM_H264_PARAMS * params)
+{
+	BIT_WRITER w = { {0}, 0, 0, 1 };
+	uint32_t mb_width = (params->width + 15) / 16;
+	uint32_t mb_height = (params->height + 15) / 16;
+	uint32_t crop_right = (mb_width * 16 - params->width) / 2;
+	uint32_t crop_bottom = (mb_height * 16 - params->height) / 2;
+	int ok;
+
+	put_bits(&w, params->profile_idc, 8);
+	put_bits(&w, params->constraints, 8);
+	put_bits(&w, params->level_idc, 8);
+	put_ue(&w, 0);		/* seq_parameter_set_id */
+	if (params->profile_idc == 100) {
+		put_ue(&w, 1);	/* chroma_format_idc, 4:2:0 */
+		put_ue(&w, 0);	/* bit_depth_luma_minus8 */
+		put_ue(&w, 0);	/* bit_depth_chroma_minus8 */
+		put_bits(&w, 0, 1);	/* qpprime_y_zero_transform_bypass_flag */
+		put_bits(&w, 0, 1);	/* seq_scaling_matrix_present_flag */
+	}
+	put_ue(&w, 0);		/* log2_max_frame_num_minus4 */
+	put_ue(&w, 2);		/* pic_order_cnt_type */
+	put_ue(&w, 1);		/* max_num_ref_frames */
+	put_bits(&w, 0, 1);	/* gaps_in_frame_num_value_allowed_flag */
+	put_ue(&w, mb_width - 1);
+	put_ue(&w, mb_height - 1);
+	put_bits(&w, 1, 1);	/* frame_mbs_only_flag */
+	put_bits(&w, 1, 1);	/* direct_8x8_inference_flag */
+	put_bits(&w, crop_right || crop_bottom, 1);
+	if (crop_right || crop_bottom) {
+		put_ue(&w, 0);
+		put_ue(&w, crop_right);
+		put_ue(&w, 0);
+		put_ue(&w, crop_bottom);
+	}
+	put_bits(&w, 0, 1);	/* vui_parameters_present_flag */
+	put_trailing_bits(&w);
+	ok = write_nal(out, 0x67, &w);
+
+	w.bytes.size = 0;
+	put_ue(&w, 0);		/* pic_parameter_set_id */
+	put_ue(&w, 0);		/* seq_parameter_set_id */
+	put_bits(&w, 0, 1);	/* entropy_coding_mode_flag, CAVLC */
+	put_bits(&w, 0, 1);	/* bottom_field_pic_order_in_frame_present_flag */
+	put_ue(&w, 0);		/* num_slice_groups_minus1 */
+	put_ue(&w, 0);		/* num_ref_idx_l0_default_active_minus1 */
+	put_ue(&w, 0);		/* num_ref_idx_l1_default_active_minus1 */
+	put_bits(&w, 0, 1);	/* weighted_pred_flag */
+	put_bits(&w, 0, 2);	/* weighted_bipred_idc */
+	put_se(&w, params->qp - 26);	/* pic_init_qp_minus26 */
+	put_se(&w, 0);		/* pic_init_qs_minus26 */
+	put_se(&w, 0);		/* chroma_qp_index_offset */
+	put_bits(&w, 1, 1);	/* deblocking_filter_control_present_flag */
+	put_bits(&w, 0, 1);	/* constrained_intra_pred_flag */
+	put_bits(&w, 0, 1);	/* redundant_pic_cnt_present_flag */
+	put_trailing_bits(&w);
+	ok = ok && write_nal(out, 0x68, &w);
+
+	sim_bytes_free(&w.bytes);
+	return ok;
+}
+
+/**
+ * Append a one-slice frame of roughly a given size. The slice header is
+ * valid; the slice data is filler.
+ *
+ * @param out Array to append to
+ * @param params Stream parameters, as given to sim_h264_headers()
+ * @param key Whether this is an IDR frame
+ * @param frame_num Frames since the last IDR
+ * @param idr_id idr_pic_id of IDR frames
+ * @param size Bytes the NAL unit should take, start code included
+ * @param random Generator state for the filler
+ * @return 1 on success, 0 if out of memory
+ */
+int sim_h264_slice(SIM_BYTES * out, const SIM_H264_PARAMS * params, int key, uint32_t frame_num,
+		   uint32_t idr_id, size_t size, uint32_t * random)
+{
+	BIT_WRITER w = { {0}, 0, 0, 1 };
+	int ok;
+
+	(void)params;
+
+	put_ue(&w, 0);		/* first_mb_in_slice */
+	put_ue(&w, key ? 7 : 5);	/* slice_type, all I or all P */
+	put_ue(&w, 0);		/* pic_parameter_set_id */
+	put_bits(&w, key ? 0 : frame_num & 0xf, 4);
+	if (key)
+		put_ue(&w, idr_id & 0xffff);
+	else {
+		put_bits(&w, 0, 1);	/* num_ref_idx_active_override_flag */
+		put_bits(&w, 0, 1);	/* ref_pic_list_modification_flag_l0 */
+	}
+	if (key) {
+		put_bits(&w, 0, 1);	/* no_output_of_prior_pics_flag */
+		put_bits(&w, 0, 1);	/* long_term_reference_flag */
+	} else {
+		put_bits(&w, 0, 1);	/* adaptive_ref_pic_marking_mode_flag */
+	}
+	put_se(&w, 0);		/* slice_qp_delta */
+	put_ue(&w, 1);		/* disable_deblocking_filter_idc */
+	put_bits(&w, 1, 1);
+	while (w.bits)
+		put_bits(&w, 0, 1);
+
+	/* Nonzero filler can't form start codes, so needs no escaping */
+	while (w.ok && w.bytes.size + 6 < size)
+		w.ok &= append_byte(&w.bytes, 1 + sim_random(random) % 255);
+	w.ok &= append_byte(&w.bytes, 0x80);
+
+	ok = write_nal(out, key ? 0x65 : 0x41, &w);
+	sim_bytes_free(&w.bytes);
+
+	return ok;
+}
+
+/**
+ * Append a grey baseline JPEG of roughly a given size
+ *
+ * @param out Array to append to
+ * @param width Image width
+ * @param height Image height
+ * @param size Bytes the image should take; it is padded up to this
+ * @param comments NUL separated strings to put in COM segments, or NULL
+ * @return 1 on success, 0 if out of memory
+ */
+int sim_jpeg(SIM_BYTES * out, uint32_t width, uint32_t height, size_t size,
+	     const SIM_BYTES * comments)
+{
+	static const uint8_t soi[] = { 0xff, 0xd8 };
+	static const uint8_t eoi[] = { 0xff, 0xd9 };
+	/* One 1-bit code for symbol 0: DC difference 0, then end of block */
+	static const uint8_t dht[] = {
+		0xff, 0xc4, 0x00, 0x14, 0x00, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x00,
+		0xff, 0xc4, 0x00, 0x14, 0x10, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x00
+	};
+	static const uint8_t sos[] = { 0xff, 0xda, 0x00, 0x08, 1, 1, 0x00, 0, 63, 0 };
+	uint64_t blocks = (uint64_t) ((width + 7) / 8) * ((height + 7) / 8);
+	size_t entropy = (size_t) ((blocks * 2 + 7) / 8);
+	size_t fixed, start = out->size, i;
+	int ok;
+
+	ok = sim_bytes_append(out, soi, sizeof(soi));
+
+	if (comments) {
+		for (i = 0; i < comments->size;) {
+			size_t length = strnlen((const char *)comments->data + i, comments->size - i);
+
+			if (length > 0 && length < 65533) {
+				ok = ok && append_u16(out, 0xfffe) && append_u16(out, length + 2)
+				    && sim_bytes_append(out, comments->data + i, length);
+			}
+			i += length + 1;
+		}
+	}
+
+	/* DQT, SOF0, DHT, SOS, scan and EOI */
+	fixed = 69 + 13 + sizeof(dht) + sizeof(sos) + entropy + sizeof(eoi);
+	if (size > out->size - start + fixed) {
+		size_t padding = size - (out->size - start) - fixed;
+
+		while (ok && padding >= 4) {
+			size_t segment = padding > 65537 ? 65537 : padding;
+
+			ok = append_u16(out, 0xffef) && append_u16(out, segment - 2)
+			    && sim_bytes_reserve(out, segment - 4);
+			if (ok) {
+				memset(out->data + out->size, 0, segment - 4);
+				out->size += segment - 4;
+			}
+			padding -= segment;
+		}
+	}
+
+	ok = ok && append_u16(out, 0xffdb) && append_u16(out, 67) && append_byte(out, 0)
+	    && sim_bytes_reserve(out, 64);
+	if (ok) {
+		memset(out->data + out->size, 1, 64);
+		out->size += 64;
+	}
+
+	ok = ok && append_u16(out, 0xffc0) && append_u16(out, 11) && append_byte(out, 8)
+	    && append_u16(out, height) && append_u16(out, width) && append_byte(out, 1)
+	    && append_byte(out, 1) && append_byte(out, 0x11) && append_byte(out, 0)
+	    && sim_bytes_append(out, dht, sizeof(dht)) && sim_bytes_append(out, sos, sizeof(sos))
+	    && sim_bytes_reserve(out, entropy);
+	if (ok) {
+		memset(out->data + out->size, 0, entropy);
+		/* Pad the last byte with 1 bits */
+		if (blocks % 4)
+			out->data[out->size + entropy - 1] = 0xff >> (2 * (blocks % 4));
+		out->size += entropy;
+	}
+
+	return ok && sim_bytes_append(out, eoi, sizeof(eoi));
+}
+
+/**
+ * Append the inline motion vectors of a frame: one 4 byte entry per
+ * macroblock, with an extra column, as the encoder sends them
+ *
+ * @param out Array to append to
+ * @param width Frame width
+ * @param height Frame height
+ * @param random Generator state for the SADs
+ * @return 1 on success, 0 if out of memory
+ */
+int sim_motion_vectors(SIM_BYTES * out, uint32_t width, uint32_t height, uint32_t * random)
+{
+	size_t count = (size_t) ((width + 15) / 16 + 1) * ((height + 15) / 16);
+	size_t i;
+
+	if (!sim_bytes_reserve(out, count * 4))
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		uint16_t sad = 200 + sim_random(random) % 201;
+		uint8_t *entry = out->data + out->size + i * 4;
+
+		entry[0] = 1;	/* x */
+		entry[1] = 0;	/* y */
+		entry[2] = sad & 0xff;
+		entry[3] = sad >> 8;
+	}
+	out->size += count * 4;
+
+	return 1;
+}
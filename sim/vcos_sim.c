@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* The bits of VCOS, bcm_host and the gencmd service the simulator needs */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "bcm_host.h"
+#include "interface/vcos/vcos.h"
+#include "interface/vmcs_host/vc_vchi_gencmd.h"
+
+#include "mmal_sim_private.h"
+
+VCOS_LOG_CAT_T vcos_sim_log_category = { VCOS_LOG_ERROR, "mmal_sim" };
+
+void vcos_log_register(const char *name, VCOS_LOG_CAT_T * category)
+{
+	category->name = name;
+	if (category->level == VCOS_LOG_UNINITIALIZED)
+		category->level = VCOS_LOG_ERROR;
+}
+
+void vcos_log_impl(const VCOS_LOG_CAT_T * category, VCOS_LOG_LEVEL_T level, const char *fmt, ...)
+{
+	va_list args;
+	size_t length = strlen(fmt);
+
+	if (level > category->level)
+		return;
+
+	fprintf(stderr, "%s: ", category->name);
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	if (length == 0 || fmt[length - 1] != '\n')
+		fputc('\n', stderr);
+}
+
+uint32_t vcos_getmicrosecs(void)
+{
+	return (uint32_t) sim_now();
+}
+
+void bcm_host_init(void)
+{
+}
+
+void bcm_host_deinit(void)
+{
+}
+
+int vc_gencmd(char *response, int maxlen, const char *format, ...)
+{
+	char command[128];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(command, sizeof(command), format, args);
+	va_end(args);
+
+	if (strcmp(command, "get_mem gpu") == 0)
+		snprintf(response, maxlen, "gpu=128M");
+	else if (strcmp(command, "get_camera") == 0)
+		snprintf(response, maxlen, "supported=%u detected=%u", sim_config()->cameras,
+			 sim_config()->cameras);
+	else
+		return -1;
+
+	return 0;
+}
+
+/* Find "property=" as a whole word in a gencmd response */
+static char *find_property(char *text, const char *property)
+{
+	size_t length = strlen(property);
+	char *p;
+
+	for (p = text; (p = strstr(p, property)); p += length)
+		if ((p == text || p[-1] == ' ') && p[length] == '=')
+			return p + length + 1;
+
+	return NULL;
+}
+
+int vc_gencmd_string_property(char *text, const char *property, char **value, int *length)
+{
+	char *start = find_property(text, property);
+
+	if (start == NULL)
+		return 0;
+
+	*value = start;
+	*length = (int)strcspn(start, " \n");
+	return 1;
+}
+
+int vc_gencmd_number_property(char *text, const char *property, int *number)
+{
+	char *start = find_property(text, property);
+	char *end;
+	long value;
+
+	if (start == NULL)
+		return 0;
+
+	value = strtol(start, &end, 0);
+	if (end == start)
+		return 0;
+
+	*number = (int)value;
+	return 1;
+}
@@ -0,0 +1,191 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013 Jan Schmidt <jan@centricular.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Checks the leaky policy catches up for each kind of output.
+ *
+ * Each case starts a capture instance, stops reading for a while as a
+ * stalled downstream would, then reads again. With max-queue-time set,
+ * raspi_capture_fill_buffer() has to drop the stale frames rather than
+ * hand them over late: raw and MJPEG frames anywhere, H264 with
+ * drop-to-idr even when a key frame is at the head of the queue.
+ *
+ *   leaky-test
+ *
+ * Build and run with make SIM=1 leaky-test.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+
+#include "../gstrpicamsrc.h"
+#include "../RaspiCapture.h"
+
+/// How long the reader stalls, in microseconds
+#define STALL 500000
+/// Oldest a queued frame may get, in milliseconds
+#define MAX_QUEUE_TIME 50
+/// Stalls per case
+#define STALLS 3
+/// Seconds before a hang counts as a failure
+#define WATCHDOG 60
+
+typedef struct {
+	const char *name;
+	MMAL_FOURCC_T encoding;
+	RASPIVID_LEAKY_T leaky;
+	int intraperiod;
+} LEAKY_CASE;
+
+static int failures;
+
+/**
+ * Read a frame that isn't just stream headers
+ *
+ * @return the frame, or NULL if capture failed
+ */
+static GstBuffer *read_frame(RASPIVID_STATE * state)
+{
+	GstBuffer *buf = NULL;
+
+	do {
+		if (buf)
+			gst_buffer_unref(buf);
+		buf = NULL;
+		if (raspi_capture_fill_buffer(state, &buf) != GST_FLOW_OK || buf == NULL)
+			return NULL;
+	} while (GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER));
+
+	return buf;
+}
+
+static void run_case(const LEAKY_CASE * test)
+{
+	RASPIVID_CONFIG config;
+	RASPIVID_STATE *state;
+	RASPILATENCY_RECORD timing;
+	GstBuffer *buf;
+	guint64 dropped = 0;
+	int i;
+
+	memset(&config, 0, sizeof(config));
+	raspicapture_default_config(&config);
+	config.width = 640;
+	config.height = 480;
+	config.fps_n = 30;
+	config.fps_d = 1;
+	config.encoding = test->encoding;
+	config.intraperiod = test->intraperiod;
+	config.leaky = test->leaky;
+	config.maxQueueTime = MAX_QUEUE_TIME;
+	config.preview_parameters.wantPreview = 0;
+
+	state = raspi_capture_setup(&config);
+	if (state == NULL || !raspi_capture_start(state)) {
+		g_printerr("%s: capture didn't start\n", test->name);
+		failures++;
+		if (state)
+			raspi_capture_free(state);
+		return;
+	}
+
+	for (i = 0; i < STALLS; i++) {
+		if ((buf = read_frame(state)) == NULL)
+			break;
+		gst_buffer_unref(buf);
+
+		usleep(STALL);
+		if ((buf = read_frame(state)) == NULL)
+			break;
+		gst_buffer_unref(buf);
+
+		/* The frame handed over after the stall must be a fresh one */
+		raspi_capture_get_frame_timing(state, &timing);
+		if (timing.dequeue - timing.arrival > MAX_QUEUE_TIME * 1000) {
+			g_printerr("%s: frame waited %" G_GINT64_FORMAT " us after a stall\n",
+				   test->name, (gint64) (timing.dequeue - timing.arrival));
+			failures++;
+		}
+	}
+	if (i < STALLS) {
+		g_printerr("%s: capture stopped delivering frames\n", test->name);
+		failures++;
+	}
+
+	dropped = raspi_capture_get_dropped_frames(state);
+	if (dropped == 0) {
+		g_printerr("%s: nothing dropped over %d stalls\n", test->name, STALLS);
+		failures++;
+	}
+	printf("%s: %" G_GUINT64_FORMAT " frames dropped\n", test->name, dropped);
+
+	raspi_capture_stop(state);
+	raspi_capture_free(state);
+}
+
+int main(int argc, char *argv[])
+{
+	/* One key frame a second, so a stall often leaves one at the head */
+	static const LEAKY_CASE cases[] = {
+		{"i420 drop-oldest", MMAL_ENCODING_I420, RASPIVID_LEAKY_DROP_OLDEST, 0},
+		{"mjpeg drop-oldest", MMAL_ENCODING_MJPEG, RASPIVID_LEAKY_DROP_OLDEST, 0},
+		{"h264 drop-to-idr", MMAL_ENCODING_H264, RASPIVID_LEAKY_DROP_TO_IDR, 30},
+	};
+	unsigned int i;
+
+	alarm(WATCHDOG);
+
+	gst_init(&argc, &argv);
+	gst_plugin_register_static(GST_VERSION_MAJOR, GST_VERSION_MINOR, "rpicamsrc",
+				   "Raspberry Pi camera source", rpicamsrc_plugin_init, "1.0",
+				   "LGPL", "leaky-test", "leaky-test", "");
+	raspicapture_init();
+
+	for (i = 0; i < G_N_ELEMENTS(cases); i++)
+		run_case(&cases[i]);
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+		notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+		notice, this list of conditions and the following disclaimer in the
+		documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+		names of its contributors may be used to endorse or promote products
+		derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Runs RaspiMotion on motion vector dumps.
+ *
+ * A dump is the encoder's inline vectors for each frame back to back, as
+ * raspivid -x writes them: for every frame, one RASPIMOTION_VECTOR per
+ * macroblock including the extra column the encoder adds.
+ *
+ *   motion-test
+ *       Writes dumps of known scenes and checks the events they give
+ *   motion-test [-r regions] WIDTHxHEIGHT dump...
+ *       Prints the events recorded dumps give, for tuning the settings
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../RaspiMotion.h"
+
+/// Scene used by the checks: 640x480, frames of vectors with a patch moving in it
+#define TEST_WIDTH 640
+#define TEST_HEIGHT 480
+#define MB_WIDTH(width) (((width) + 15) / 16 + 1)
+#define MB_HEIGHT(height) (((height) + 15) / 16)
+
+/// A patch of macroblocks moving from first to last frame, inclusive
+typedef struct {
+	int first, last;
+	int col, row, size;	/// Top left macroblock and side of the patch
+	signed char x_vector;
+	unsigned short sad;
+} PATCH;
+
+/// The frame an event is expected on
+typedef struct {
+	int frame;
+	RASPIMOTION_EVENT event;
+} EXPECTED;
+
+static int failures;
+
+/**
+ * Write a dump of frames still except for the patches
+ */
+static void write_scene(FILE *dump, int frames, const PATCH *patches, int num_patches)
+{
+	int mb_width = MB_WIDTH(TEST_WIDTH), mb_height = MB_HEIGHT(TEST_HEIGHT);
+	RASPIMOTION_VECTOR *vectors = calloc(mb_width * mb_height, sizeof(RASPIMOTION_VECTOR));
+	int frame, i, x, y;
+
+	for (frame = 0; frame < frames; frame++) {
+		memset(vectors, 0, mb_width * mb_height * sizeof(RASPIMOTION_VECTOR));
+		for (i = 0; i < num_patches; i++) {
+			const PATCH *p = &patches[i];
+
+			if (frame < p->first || frame > p->last)
+				continue;
+			for (y = p->row; y < p->row + p->size; y++)
+				for (x = p->col; x < p->col + p->size; x++) {
+					vectors[y * mb_width + x].x_vector = p->x_vector;
+					vectors[y * mb_width + x].sad = p->sad;
+				}
+		}
+		fwrite(vectors, sizeof(RASPIMOTION_VECTOR), mb_width * mb_height, dump);
+	}
+
+	free(vectors);
+}
+
+/**
+ * Run a dump through a detector
+ *
+ * @param events Receives the event of each frame, NULL to print them instead
+ * @return Frames read, -1 on error
+ */
+static int run_dump(FILE *dump, const RASPIMOTION_PARAMETERS *params, int width, int height,
+						  RASPIMOTION_EVENT *events, int max_frames)
+{
+	int mb_width = MB_WIDTH(width), mb_height = MB_HEIGHT(height);
+	RASPIMOTION_STATE *state = raspimotion_create(params, mb_width, mb_height);
+	RASPIMOTION_VECTOR *vectors = malloc(mb_width * mb_height * sizeof(RASPIMOTION_VECTOR));
+	int frame = 0, moving;
+
+	if (state == NULL || vectors == NULL) {
+		raspimotion_destroy(state);
+		free(vectors);
+		return -1;
+	}
+
+	while (fread(vectors, sizeof(RASPIMOTION_VECTOR), mb_width * mb_height, dump)
+			 == (size_t)(mb_width * mb_height)) {
+		RASPIMOTION_EVENT event = raspimotion_process(state, vectors, &moving);
+
+		if (events && frame < max_frames)
+			events[frame] = event;
+		else if (!events && event != RASPIMOTION_EVENT_NONE)
+			printf("frame %d: motion %s, %d moving blocks\n", frame,
+					 event == RASPIMOTION_EVENT_START ? "started" : "stopped", moving);
+		frame++;
+	}
+
+	raspimotion_destroy(state);
+	free(vectors);
+	return frame;
+}
+
+/**
+ * Check a scene gives the expected events, and none on other frames
+ */
+static void check_scene(const char *name, const RASPIMOTION_PARAMETERS *params, int frames,
+								const PATCH *patches, int num_patches,
+								const EXPECTED *expected, int num_expected)
+{
+	RASPIMOTION_EVENT *events = calloc(frames, sizeof(RASPIMOTION_EVENT));
+	FILE *dump = tmpfile();
+	int frame, i, read;
+
+	if (dump == NULL || events == NULL) {
+		fprintf(stderr, "%s: out of resources\n", name);
+		failures++;
+		goto out;
+	}
+
+	write_scene(dump, frames, patches, num_patches);
+	rewind(dump);
+	read = run_dump(dump, params, TEST_WIDTH, TEST_HEIGHT, events, frames);
+	if (read != frames) {
+		fprintf(stderr, "%s: read %d frames of %d\n", name, read, frames);
+		failures++;
+		goto out;
+	}
+
+	for (frame = 0; frame < frames; frame++) {
+		RASPIMOTION_EVENT want = RASPIMOTION_EVENT_NONE;
+
+		for (i = 0; i < num_expected; i++)
+			if (expected[i].frame == frame)
+				want = expected[i].event;
+		if (events[frame] != want) {
+			fprintf(stderr, "%s: frame %d gave event %d, expected %d\n", name, frame,
+					  events[frame], want);
+			failures++;
+		}
+	}
+
+ out:
+	if (dump)
+		fclose(dump);
+	free(events);
+}
+
+static void run_checks(void)
+{
+	/* A patch on the right, then one on the left, 16 macroblocks each */
+	static const PATCH patches[] = {
+		{10, 19, 30, 10, 4, 8, 500},
+		{60, 69, 2, 10, 4, 8, 500},
+	};
+	static const EXPECTED whole_frame[] = {
+		{12, RASPIMOTION_EVENT_START},	/* trigger_frames into the first patch */
+		{49, RASPIMOTION_EVENT_STOP},	/* release_frames after it */
+		{62, RASPIMOTION_EVENT_START},
+	};
+	static const EXPECTED right_half[] = {
+		{12, RASPIMOTION_EVENT_START},
+		{49, RASPIMOTION_EVENT_STOP},
+	};
+	RASPIMOTION_PARAMETERS params;
+
+	raspimotion_set_defaults(&params);
+	check_scene("whole frame", &params, 80, patches, 2, whole_frame, 3);
+
+	if (raspimotion_parse_regions(&params, "0.5,0,0.5,1") != 1) {
+		fprintf(stderr, "regions: \"0.5,0,0.5,1\" not parsed\n");
+		failures++;
+	}
+	check_scene("right half", &params, 80, patches, 2, right_half, 2);
+
+	if (raspimotion_parse_regions(&params, "0.5,0,0.5") >= 0) {
+		fprintf(stderr, "regions: \"0.5,0,0.5\" accepted\n");
+		failures++;
+	}
+
+	raspimotion_set_defaults(&params);
+	params.min_blocks = 17;
+	check_scene("too few blocks", &params, 80, patches, 2, NULL, 0);
+
+	raspimotion_set_defaults(&params);
+	params.magnitude = 65;
+	check_scene("too short vectors", &params, 80, patches, 2, NULL, 0);
+
+	raspimotion_set_defaults(&params);
+	params.sad = 501;
+	check_scene("too low SAD", &params, 80, patches, 2, NULL, 0);
+}
+
+int main(int argc, char **argv)
+{
+	RASPIMOTION_PARAMETERS params;
+	int width, height, i;
+
+	if (argc == 1) {
+		run_checks();
+		printf("%s\n", failures ? "FAIL" : "PASS");
+		return failures ? 1 : 0;
+	}
+
+	raspimotion_set_defaults(&params);
+	i = 1;
+	if (argc > 3 && strcmp(argv[1], "-r") == 0) {
+		if (raspimotion_parse_regions(&params, argv[2]) < 0) {
+			fprintf(stderr, "Invalid regions \"%s\"\n", argv[2]);
+			return 2;
+		}
+		i = 3;
+	}
+	if (i + 1 >= argc || sscanf(argv[i], "%dx%d", &width, &height) != 2) {
+		fprintf(stderr, "Usage: %s [-r regions] WIDTHxHEIGHT dump...\n", argv[0]);
+		return 2;
+	}
+
+	for (i++; i < argc; i++) {
+		FILE *dump = fopen(argv[i], "rb");
+		int frames;
+
+		if (dump == NULL) {
+			perror(argv[i]);
+			return 1;
+		}
+		printf("%s:\n", argv[i]);
+		frames = run_dump(dump, &params, width, height, NULL, 0);
+		fclose(dump);
+		if (frames < 0)
+			return 1;
+		printf("%d frames\n", frames);
+	}
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013 Jan Schmidt <jan@centricular.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Stress test for running several cameras in one process.
+ *
+ * Each camera gets its own thread, which repeatedly sets up, starts and
+ * stops a capture instance while a second thread takes stills from it, the
+ * way two rpicamsrc elements with motion-triggered stills would. A lost
+ * still, a leaked connection or an instance reaching into another one
+ * shows up as a failed call or as the watchdog firing on a hang.
+ *
+ *   multi-instance-test [RUNS]
+ *
+ * Build and run with make SIM=1 stress, where the simulator provides the
+ * second sensor; on hardware it needs a board with two cameras.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+
+#include "../gstrpicamsrc.h"
+#include "../RaspiCapture.h"
+
+#define CAMERAS 2
+#define DEFAULT_RUNS 5
+/// Frames pulled in each run, at least
+#define RUN_FRAMES 30
+/// Stills taken in each run, while video runs
+#define RUN_STILLS 2
+/// Seconds before a hang counts as a failure
+#define WATCHDOG 120
+
+typedef struct {
+	int camera;
+	int runs;
+	RASPIVID_STATE *state;	/// Instance the stills thread shoots with
+	volatile gint stills_done;
+
+	int frames;
+	int stills;
+	int failures;
+} INSTANCE;
+
+static gpointer take_stills(gpointer data)
+{
+	INSTANCE *instance = data;
+	char prefix[64];
+	int i;
+
+	snprintf(prefix, sizeof(prefix), "/tmp/multi-instance-test-%d", instance->camera);
+	for (i = 0; i < RUN_STILLS; i++) {
+		gchar *filename = raspi_capture_photo(instance->state, prefix);
+
+		if (filename == NULL) {
+			g_printerr("camera %d: still failed\n", instance->camera);
+			instance->failures++;
+			continue;
+		}
+		unlink(filename);
+		g_free(filename);
+		instance->stills++;
+	}
+
+	g_atomic_int_set(&instance->stills_done, 1);
+	return NULL;
+}
+
+/**
+ * Run one camera through setup, start, video with stills, stop and free
+ *
+ * @return TRUE if every step worked
+ */
+static gboolean run_once(INSTANCE * instance)
+{
+	RASPIVID_CONFIG config;
+	GThread *stills;
+	gboolean ok = TRUE;
+	int frames = 0;
+
+	memset(&config, 0, sizeof(config));
+	raspicapture_default_config(&config);
+	config.cameraNum = instance->camera;
+	config.width = 640;
+	config.height = 480;
+	config.fps_n = 30;
+	config.fps_d = 1;
+	config.encoding = MMAL_ENCODING_H264;
+	config.preview_parameters.wantPreview = 0;
+
+	instance->state = raspi_capture_setup(&config);
+	if (instance->state == NULL) {
+		g_printerr("camera %d: setup failed\n", instance->camera);
+		return FALSE;
+	}
+	if (!raspi_capture_start(instance->state)) {
+		g_printerr("camera %d: start failed\n", instance->camera);
+		raspi_capture_free(instance->state);
+		return FALSE;
+	}
+
+	g_atomic_int_set(&instance->stills_done, 0);
+	stills = g_thread_new("multi-instance-stills", take_stills, instance);
+
+	/* Stills need frames flowing until they are done */
+	while (frames < RUN_FRAMES || !g_atomic_int_get(&instance->stills_done)) {
+		GstBuffer *buf = NULL;
+
+		if (raspi_capture_fill_buffer(instance->state, &buf) != GST_FLOW_OK || buf == NULL) {
+			g_printerr("camera %d: capture stopped delivering frames\n",
+				   instance->camera);
+			ok = FALSE;
+			break;
+		}
+		if (!GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER))
+			frames++;
+		gst_buffer_unref(buf);
+	}
+	instance->frames += frames;
+
+	g_thread_join(stills);
+	raspi_capture_stop(instance->state);
+	raspi_capture_free(instance->state);
+	instance->state = NULL;
+
+	return ok;
+}
+
+static gpointer run_camera(gpointer data)
+{
+	INSTANCE *instance = data;
+	int i;
+
+	for (i = 0; i < instance->runs; i++)
+		if (!run_once(instance))
+			instance->failures++;
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	INSTANCE instances[CAMERAS];
+	GThread *threads[CAMERAS];
+	int runs = DEFAULT_RUNS, failures = 0, i;
+
+	if (argc > 1)
+		runs = atoi(argv[1]);
+	if (argc > 2 || runs <= 0) {
+		fprintf(stderr, "usage: multi-instance-test [RUNS]\n");
+		return 2;
+	}
+
+	/* Only read by the simulator, which has one sensor unless told otherwise */
+	setenv("RPICAM_SIM_CAMERAS", "2", 0);
+	/* A hang is the failure this is most likely to find */
+	alarm(WATCHDOG);
+
+	gst_init(&argc, &argv);
+	gst_plugin_register_static(GST_VERSION_MAJOR, GST_VERSION_MINOR, "rpicamsrc",
+				   "Raspberry Pi camera source", rpicamsrc_plugin_init, "1.0",
+				   "LGPL", "multi-instance-test", "multi-instance-test", "");
+	raspicapture_init();
+
+	for (i = 0; i < CAMERAS; i++) {
+		memset(&instances[i], 0, sizeof(instances[i]));
+		instances[i].camera = i;
+		instances[i].runs = runs;
+		threads[i] = g_thread_new("multi-instance-camera", run_camera, &instances[i]);
+	}
+
+	for (i = 0; i < CAMERAS; i++) {
+		g_thread_join(threads[i]);
+		printf("camera %d: %d runs, %d frames, %d stills, %d failures\n", i, runs,
+		       instances[i].frames, instances[i].stills, instances[i].failures);
+		failures += instances[i].failures;
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2013 Jan Schmidt <jan@centricular.com>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+		notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+		notice, this list of conditions and the following disclaimer in the
+		documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+		names of its contributors may be used to endorse or promote products
+		derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Compares RaspiRing with the mmal_queue it replaced, for handing buffers
+ * from an MMAL callback thread to the streaming thread.
+ *
+ * A producer thread stands in for the port callback and a consumer thread
+ * for the streaming thread, with at most RING_CAPACITY items in flight as
+ * with a port pool. Two loads are run on each:
+ *
+ *   paced  one item every INTERVAL us, the consumer sleeping between them,
+ *          so the delay from push to pop is the consumer's wakeup latency
+ *   flood  items pushed as fast as the consumer takes them, to show the
+ *          cost of contention on the hand-off
+ *
+ *   ring-bench [ITEMS [INTERVAL]]
+ *
+ * The results are printed as one JSON object. Build with make ring-bench,
+ * against the Pi's libmmal or, with SIM=1, the simulator's mmal_queue.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interface/mmal/mmal.h"
+#include "../RaspiRing.h"
+
+/// Items in flight at once, as OUTPUT_RING_SIZE in RaspiCapture.c
+#define RING_CAPACITY 64
+/// How long the consumer sleeps in one wait
+#define WAIT_TIMEOUT 100	// ms
+
+#define DEFAULT_ITEMS 20000
+#define DEFAULT_INTERVAL 500	// us
+
+typedef enum {
+	HANDOFF_RING,
+	HANDOFF_QUEUE,
+} HANDOFF_KIND;
+
+typedef struct {
+	HANDOFF_KIND kind;
+	RASPIRING_T *ring;
+	MMAL_QUEUE_T *queue;
+	MMAL_BUFFER_HEADER_T headers[RING_CAPACITY];	/// Items handed over, each one at most once at a time
+	int items;
+	int interval;		/// Microseconds between pushes, 0 to flood
+	volatile int in_flight;	/// Pushed and not yet popped
+
+	int64_t *latency;	/// Push to pop of each item, in nanoseconds
+	int64_t push_total;	/// Time spent in the pushes, in nanoseconds
+	int64_t elapsed;	/// First push to last pop, in nanoseconds
+	int full;		/// Pushes that had to wait for the consumer
+} HANDOFF;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t when)
+{
+	struct timespec ts;
+
+	ts.tv_sec = when / 1000000000;
+	ts.tv_nsec = when % 1000000000;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/* Push one item, stamped with the time it was pushed */
+static void push(HANDOFF *handoff, MMAL_BUFFER_HEADER_T *header)
+{
+	int64_t start = now_ns();
+
+	header->pts = start;
+	if (handoff->kind == HANDOFF_RING)
+		raspiring_push(handoff->ring, header, 0, start);
+	else
+		mmal_queue_put(handoff->queue, header);
+	handoff->push_total += now_ns() - start;
+}
+
+static MMAL_BUFFER_HEADER_T *pop(HANDOFF *handoff)
+{
+	if (handoff->kind == HANDOFF_RING)
+		return raspiring_wait(handoff->ring, WAIT_TIMEOUT, NULL);
+	return mmal_queue_timedwait(handoff->queue, WAIT_TIMEOUT);
+}
+
+static void *producer(void *data)
+{
+	HANDOFF *handoff = data;
+	int64_t next = now_ns();
+	int i;
+
+	for (i = 0; i < handoff->items; i++) {
+		if (handoff->interval) {
+			next += (int64_t) handoff->interval * 1000;
+			sleep_until(next);
+		}
+
+		/* Like a port with an empty pool, wait for the consumer to give one back */
+		if (__atomic_load_n(&handoff->in_flight, __ATOMIC_ACQUIRE) >= RING_CAPACITY) {
+			handoff->full++;
+			while (__atomic_load_n(&handoff->in_flight, __ATOMIC_ACQUIRE) >= RING_CAPACITY)
+				sched_yield();
+		}
+		__atomic_add_fetch(&handoff->in_flight, 1, __ATOMIC_ACQ_REL);
+		push(handoff, &handoff->headers[i % RING_CAPACITY]);
+	}
+
+	return NULL;
+}
+
+/**
+ * Hand handoff->items items from a producer thread to this one
+ *
+ * @return 0 if every item arrived, -1 otherwise
+ */
+static int run(HANDOFF *handoff)
+{
+	pthread_t thread;
+	int64_t start;
+	int i;
+
+	handoff->in_flight = 0;
+	handoff->push_total = 0;
+	handoff->full = 0;
+
+	start = now_ns();
+	if (pthread_create(&thread, NULL, producer, handoff) != 0)
+		return -1;
+
+	for (i = 0; i < handoff->items; i++) {
+		MMAL_BUFFER_HEADER_T *header = pop(handoff);
+
+		if (header == NULL) {
+			fprintf(stderr, "ring-bench: item %d never arrived\n", i);
+			break;
+		}
+		handoff->latency[i] = now_ns() - header->pts;
+		__atomic_sub_fetch(&handoff->in_flight, 1, __ATOMIC_ACQ_REL);
+	}
+	handoff->elapsed = now_ns() - start;
+
+	pthread_join(thread, NULL);
+	return i == handoff->items ? 0 : -1;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Print one run's results as a JSON object */
+static void print_result(const HANDOFF *handoff)
+{
+	int64_t *sorted = handoff->latency;
+	int n = handoff->items;
+
+	qsort(sorted, n, sizeof(int64_t), compare_int64);
+	printf("{\"items_per_sec\": %.0f, \"push_ns\": %.0f, \"full\": %d, "
+	       "\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}}",
+	       n * 1e9 / handoff->elapsed, (double)handoff->push_total / n, handoff->full,
+	       sorted[n / 2] / 1e3, sorted[n - 1 - n / 100] / 1e3, sorted[n - 1] / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *const kinds[] = { "raspiring", "mmal_queue" };
+	static const char *const loads[] = { "paced", "flood" };
+	HANDOFF handoff;
+	int interval = DEFAULT_INTERVAL, kind, load, ret = 0;
+
+	memset(&handoff, 0, sizeof(handoff));
+	handoff.items = DEFAULT_ITEMS;
+	if (argc > 1)
+		handoff.items = atoi(argv[1]);
+	if (argc > 2)
+		interval = atoi(argv[2]);
+	if (argc > 3 || handoff.items <= 0 || interval <= 0) {
+		fprintf(stderr, "usage: ring-bench [ITEMS [INTERVAL]]\n");
+		return 2;
+	}
+
+	handoff.latency = calloc(handoff.items, sizeof(int64_t));
+	handoff.ring = raspiring_create(RING_CAPACITY);
+	handoff.queue = mmal_queue_create();
+	if (handoff.latency == NULL || handoff.ring == NULL || handoff.queue == NULL) {
+		fprintf(stderr, "ring-bench: out of resources\n");
+		return 1;
+	}
+
+	printf("{\"items\": %d, \"interval_us\": %d", handoff.items, interval);
+	for (load = 0; load < 2; load++) {
+		printf(", \"%s\": {", loads[load]);
+		for (kind = HANDOFF_RING; kind <= HANDOFF_QUEUE; kind++) {
+			handoff.kind = kind;
+			handoff.interval = load == 0 ? interval : 0;
+			if (run(&handoff) < 0) {
+				ret = 1;
+				break;
+			}
+			printf("%s\"%s\": ", kind == HANDOFF_RING ? "" : ", ", kinds[kind]);
+			print_result(&handoff);
+		}
+		printf("}");
+	}
+	printf("}\n");
+
+	mmal_queue_destroy(handoff.queue);
+	raspiring_destroy(handoff.ring);
+	free(handoff.latency);
+	return ret;
+}